@@ -1716,6 +1716,470 @@ rasqal_algebra_remove_znodes(rasqal_query* query, rasqal_algebra_node* node,
 }
 
 
+/*
+ * rasqal_algebra_node_binds_variable:
+ * @query: #rasqal_query query object
+ * @node: algebra node
+ * @v: variable
+ *
+ * INTERNAL - Check if a variable is bound in every solution of a node
+ *
+ * Only BGP, JOIN, LEFTJOIN, FILTER and UNION nodes are inspected; any
+ * other node is treated as binding nothing.
+ *
+ * Return value: non-0 if @v is always bound by @node
+ */
+static int
+rasqal_algebra_node_binds_variable(rasqal_query* query,
+                                   rasqal_algebra_node* node,
+                                   rasqal_variable* v)
+{
+  int column;
+
+  switch(node->op) {
+    case RASQAL_ALGEBRA_OPERATOR_BGP:
+      if(!node->triples)
+        return 0;
+
+      for(column = node->start_column; column <= node->end_column; column++) {
+        if(rasqal_query_variable_bound_in_triple(query, v, column))
+          return 1;
+      }
+      return 0;
+
+    case RASQAL_ALGEBRA_OPERATOR_JOIN:
+      return rasqal_algebra_node_binds_variable(query, node->node1, v) ||
+             rasqal_algebra_node_binds_variable(query, node->node2, v);
+
+    case RASQAL_ALGEBRA_OPERATOR_LEFTJOIN:
+    case RASQAL_ALGEBRA_OPERATOR_FILTER:
+      return node->node1 &&
+             rasqal_algebra_node_binds_variable(query, node->node1, v);
+
+    case RASQAL_ALGEBRA_OPERATOR_UNION:
+      return rasqal_algebra_node_binds_variable(query, node->node1, v) &&
+             rasqal_algebra_node_binds_variable(query, node->node2, v);
+
+    default:
+      return 0;
+  }
+}
+
+
+typedef struct {
+  rasqal_query* query;
+  rasqal_algebra_node* node;
+  int variables_count;
+} rasqal_algebra_filter_scope;
+
+
+static int
+rasqal_algebra_expression_bound_in_node_visit(void *user_data,
+                                              rasqal_expression *e)
+{
+  rasqal_algebra_filter_scope* scope;
+  rasqal_variable* v;
+
+  scope = (rasqal_algebra_filter_scope*)user_data;
+
+  switch(e->op) {
+    case RASQAL_EXPR_RAND:
+    case RASQAL_EXPR_BNODE:
+    case RASQAL_EXPR_UUID:
+    case RASQAL_EXPR_STRUUID:
+      /* new value every evaluation so the number of evaluations matters */
+      return 1;
+
+    case RASQAL_EXPR_LITERAL:
+      v = rasqal_literal_as_variable(e->literal);
+      if(!v)
+        return 0;
+
+      scope->variables_count++;
+      return !rasqal_algebra_node_binds_variable(scope->query, scope->node, v);
+
+    default:
+      return 0;
+  }
+}
+
+
+/*
+ * rasqal_algebra_expression_bound_in_node:
+ * @query: #rasqal_query query object
+ * @e: filter expression
+ * @node: algebra node
+ *
+ * INTERNAL - Check if a filter expression can be evaluated on the solutions of a node
+ *
+ * Return value: non-0 if @e mentions variables and all of them are always bound by @node
+ */
+static int
+rasqal_algebra_expression_bound_in_node(rasqal_query* query,
+                                        rasqal_expression* e,
+                                        rasqal_algebra_node* node)
+{
+  rasqal_algebra_filter_scope scope;
+
+  scope.query = query;
+  scope.node = node;
+  scope.variables_count = 0;
+
+  if(rasqal_expression_visit(e, rasqal_algebra_expression_bound_in_node_visit,
+                             &scope))
+    return 0;
+
+  return (scope.variables_count > 0);
+}
+
+
+/* add expression @e (ownership taken) as a conjunct of *@expr_p */
+static int
+rasqal_algebra_add_conjunct(rasqal_query* query, rasqal_expression** expr_p,
+                            rasqal_expression* e)
+{
+  if(*expr_p) {
+    *expr_p = rasqal_new_2op_expression(query->world, RASQAL_EXPR_AND,
+                                        *expr_p, e);
+    if(!*expr_p)
+      return 1;
+  } else
+    *expr_p = e;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_algebra_push_down_filter_expression:
+ * @query: #rasqal_query query object
+ * @node: algebra node below the filter
+ * @e: filter conjunct
+ *
+ * INTERNAL - Move a filter conjunct to the lowest node binding its variables
+ *
+ * A conjunct reaching a BGP is evaluated by the triple pattern
+ * matching as soon as its variables are bound.  Through a JOIN it
+ * moves to the operand binding all its variables and through a
+ * LEFTJOIN only to the required side.
+ *
+ * Return value: 1 if @e was moved (and is owned by @node), 0 if it
+ * was not, <0 on failure (and @e was freed)
+ */
+static int
+rasqal_algebra_push_down_filter_expression(rasqal_query* query,
+                                           rasqal_algebra_node* node,
+                                           rasqal_expression* e)
+{
+  rasqal_algebra_node** child_p;
+  int i;
+  int rc;
+
+  switch(node->op) {
+    case RASQAL_ALGEBRA_OPERATOR_BGP:
+      if(!rasqal_algebra_expression_bound_in_node(query, e, node))
+        return 0;
+
+      return rasqal_algebra_add_conjunct(query, &node->expr, e) ? -1 : 1;
+
+    case RASQAL_ALGEBRA_OPERATOR_FILTER:
+      if(!node->node1)
+        return 0;
+
+      return rasqal_algebra_push_down_filter_expression(query, node->node1, e);
+
+    case RASQAL_ALGEBRA_OPERATOR_JOIN:
+    case RASQAL_ALGEBRA_OPERATOR_LEFTJOIN:
+      /* only the required side of a LEFTJOIN */
+      for(i = 0; i < (node->op == RASQAL_ALGEBRA_OPERATOR_JOIN ? 2 : 1); i++) {
+        child_p = i ? &node->node2 : &node->node1;
+
+        rc = rasqal_algebra_push_down_filter_expression(query, *child_p, e);
+        if(rc)
+          return rc;
+      }
+
+      /* otherwise filter an operand that binds all the variables */
+      for(i = 0; i < (node->op == RASQAL_ALGEBRA_OPERATOR_JOIN ? 2 : 1); i++) {
+        child_p = i ? &node->node2 : &node->node1;
+
+        if(!rasqal_algebra_expression_bound_in_node(query, e, *child_p))
+          continue;
+
+        if((*child_p)->op == RASQAL_ALGEBRA_OPERATOR_FILTER)
+          return rasqal_algebra_add_conjunct(query, &(*child_p)->expr, e) ? -1 : 1;
+
+        *child_p = rasqal_new_filter_algebra_node(query, e, *child_p);
+        return *child_p ? 1 : -1;
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+
+/*
+ * rasqal_algebra_push_down_filters:
+ * @query: #rasqal_query query object
+ * @node: algebra node
+ *
+ * INTERNAL - Split FILTER conjunctions and push the conjuncts down towards the triple patterns
+ *
+ * Conjuncts that cannot be moved stay in the FILTER which is removed
+ * when all of them move.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_algebra_push_down_filters(rasqal_query* query,
+                                 rasqal_algebra_node* node)
+{
+  raptor_sequence* conjuncts;
+  rasqal_expression* e;
+  rasqal_expression* kept = NULL;
+  int rc = 0;
+
+  if(node->node1 && rasqal_algebra_push_down_filters(query, node->node1))
+    return 1;
+  if(node->node2 && rasqal_algebra_push_down_filters(query, node->node2))
+    return 1;
+
+  if(node->op != RASQAL_ALGEBRA_OPERATOR_FILTER || !node->node1 || !node->expr)
+    return 0;
+
+  conjuncts = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression,
+                                  (raptor_data_print_handler)rasqal_expression_print);
+  if(!conjuncts)
+    return 1;
+
+  /* A && B is true when both are true; false or an error fails the
+   * filter either way so the conjuncts can be filtered separately */
+  if(rasqal_expression_get_conjuncts(node->expr, conjuncts)) {
+    raptor_free_sequence(conjuncts);
+    return 1;
+  }
+  rasqal_free_expression(node->expr);
+  node->expr = NULL;
+
+  while((e = (rasqal_expression*)raptor_sequence_unshift(conjuncts))) {
+    rc = rasqal_algebra_push_down_filter_expression(query, node->node1, e);
+    if(rc < 0)
+      break;
+
+    if(!rc && rasqal_algebra_add_conjunct(query, &kept, e)) {
+      rc = -1;
+      break;
+    }
+    rc = 0;
+  }
+  raptor_free_sequence(conjuncts);
+
+  node->expr = kept;
+  if(rc < 0)
+    return 1;
+
+  if(!kept) {
+    /* Replace Filter(true, A) by A */
+    rasqal_algebra_node* anode = node->node1;
+
+    memcpy(node, anode, sizeof(rasqal_algebra_node));
+    RASQAL_FREE(rasqal_algebra_node, anode);
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_algebra_expression_has_varstar(void *user_data, rasqal_expression *e)
+{
+  return (e->op == RASQAL_EXPR_VARSTAR);
+}
+
+
+/*
+ * rasqal_algebra_bgp_variable_is_needed:
+ * @query: #rasqal_query query object
+ * @node: BGP algebra node
+ * @v: variable bound in @node
+ * @width: width of the variables use maps
+ *
+ * INTERNAL - Check if a variable bound in a BGP is used outside its triple patterns
+ *
+ * Return value: non-0 if @v is needed above @node
+ */
+static int
+rasqal_algebra_bgp_variable_is_needed(rasqal_query* query,
+                                      rasqal_algebra_node* node,
+                                      rasqal_variable* v,
+                                      int width)
+{
+  unsigned short* use_map = query->variables_use_map;
+  rasqal_graph_pattern* gp;
+  int row_index;
+  int column;
+  int size;
+
+  /* query verbs, GROUP BY, HAVING, ORDER BY and VALUES */
+  for(row_index = 0; row_index <= RASQAL_VAR_USE_MAP_OFFSET_LAST; row_index++) {
+    if(use_map[row_index * width + v->offset])
+      return 1;
+  }
+
+  /* graph patterns; a BGP row only repeats its triple patterns */
+  for(row_index = 0;
+      (gp = (rasqal_graph_pattern*)raptor_sequence_get_at(query->graph_patterns_sequence, row_index));
+      row_index++) {
+    unsigned short* row;
+
+    if(gp->op == RASQAL_GRAPH_PATTERN_OPERATOR_BASIC) {
+      if(gp->filter_expression &&
+         rasqal_expression_mentions_variable(gp->filter_expression, v))
+        return 1;
+      continue;
+    }
+
+    row = &use_map[(gp->gp_index + RASQAL_VAR_USE_MAP_OFFSET_LAST + 1) * width];
+    if(row[v->offset] & (RASQAL_VAR_USE_MENTIONED_HERE | RASQAL_VAR_USE_BOUND_HERE))
+      return 1;
+  }
+
+  /* triple patterns outside this BGP */
+  size = raptor_sequence_size(query->triples);
+  for(column = 0; column < size; column++) {
+    if(column >= node->start_column && column <= node->end_column)
+      continue;
+
+    if(query->triples_use_map[column * width + v->offset])
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_algebra_narrow_bgp_rows(rasqal_query* query, rasqal_algebra_node* node,
+                               void* data)
+{
+  int width = *(int*)data;
+  raptor_sequence* seq;
+  int dropped = 0;
+  int i;
+
+  if(node->op != RASQAL_ALGEBRA_OPERATOR_BGP || !node->triples ||
+     node->triples != query->triples)
+    return 0;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                            (raptor_data_print_handler)rasqal_variable_print);
+  if(!seq)
+    return 1;
+
+  for(i = 0; i < width; i++) {
+    rasqal_variable* v = rasqal_variables_table_get(query->vars_table, i);
+    int column;
+
+    for(column = node->start_column; column <= node->end_column; column++) {
+      if(rasqal_query_variable_bound_in_triple(query, v, column))
+        break;
+    }
+    if(column > node->end_column)
+      continue;
+
+    if(!rasqal_algebra_bgp_variable_is_needed(query, node, v, width)) {
+      RASQAL_DEBUG2("variable %s is not needed above its BGP\n", v->name);
+      dropped++;
+      continue;
+    }
+
+    if(raptor_sequence_push(seq, rasqal_new_variable_from_variable(v))) {
+      raptor_free_sequence(seq);
+      return 1;
+    }
+  }
+
+  if(dropped)
+    node->vars_seq = seq;
+  else
+    raptor_free_sequence(seq);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_algebra_narrow_rows:
+ * @query: #rasqal_query query object
+ * @node: algebra node
+ *
+ * INTERNAL - Record in each BGP the variables needed above it
+ *
+ * Variables bound in a BGP that are used nowhere else in the query -
+ * typically blank node variables and variables that are not projected
+ * - are matched by the triple patterns but left out of the rows.
+ * Queries where a variable use is not fully recorded in the variables
+ * use maps (sub-SELECTs, SERVICE, updates and aggregates over *) are
+ * left unchanged.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_algebra_narrow_rows(rasqal_query* query, rasqal_algebra_node* node)
+{
+  rasqal_graph_pattern* gp;
+  rasqal_projection* projection;
+  rasqal_variable* v;
+  raptor_sequence* seq;
+  rasqal_expression* e;
+  int width;
+  int i;
+
+  if(!query->variables_use_map || !query->triples_use_map ||
+     !query->graph_patterns_sequence)
+    return 0;
+
+  if(query->verb != RASQAL_QUERY_VERB_SELECT &&
+     query->verb != RASQAL_QUERY_VERB_CONSTRUCT &&
+     query->verb != RASQAL_QUERY_VERB_ASK)
+    return 0;
+
+  for(i = 0;
+      (gp = (rasqal_graph_pattern*)raptor_sequence_get_at(query->graph_patterns_sequence, i));
+      i++) {
+    if(gp->op == RASQAL_GRAPH_PATTERN_OPERATOR_SELECT ||
+       gp->op == RASQAL_GRAPH_PATTERN_OPERATOR_SERVICE)
+      return 0;
+  }
+
+  /* COUNT(*) and similar use every variable in the row */
+  projection = rasqal_query_get_projection(query);
+  if(projection && projection->variables) {
+    for(i = 0;
+        (v = (rasqal_variable*)raptor_sequence_get_at(projection->variables, i));
+        i++) {
+      if(v->expression &&
+         rasqal_expression_visit(v->expression,
+                                 rasqal_algebra_expression_has_varstar, NULL))
+        return 0;
+    }
+  }
+
+  seq = rasqal_query_get_having_conditions_sequence(query);
+  for(i = 0; seq && (e = (rasqal_expression*)raptor_sequence_get_at(seq, i)); i++) {
+    if(rasqal_expression_visit(e, rasqal_algebra_expression_has_varstar, NULL))
+      return 0;
+  }
+
+  width = rasqal_variables_table_get_total_variables_count(query->vars_table);
+
+  return rasqal_algebra_node_visit(query, node, rasqal_algebra_narrow_bgp_rows,
+                                   &width);
+}
+
+
 static raptor_sequence*
 rasqal_algebra_get_variables_mentioned_in(rasqal_query* query,
                                           int row_index)
@@ -2013,6 +2477,12 @@ rasqal_algebra_query_to_algebra(rasqal_query* query)
   fputs("\n", stderr);
 #endif
 
+  if(rasqal_algebra_push_down_filters(query, node) ||
+     rasqal_algebra_narrow_rows(query, node)) {
+    rasqal_free_algebra_node(node);
+    return NULL;
+  }
+
 
   return node;
 }
@@ -2547,6 +3017,276 @@ rasqal_algebra_query_add_having(rasqal_query* query,
          }"
 
 
+#define PUSHDOWN_PREFIX "PREFIX ex: <http://example.org/> "
+
+static const struct {
+  const char* query_string;
+  /* FILTER nodes left after pushing down or -1 to not check */
+  int filters_count;
+  /* BGP nodes with a filter pushed down into them */
+  int bgp_filters_count;
+} filter_pushdown_test_data[] = {
+  /* a conjunct on an OPTIONAL variable stays above the LEFTJOIN */
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a OPTIONAL { ?s ex:q ?b } FILTER(?b = 2) }", 1, 0 },
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a OPTIONAL { ?s ex:q ?b } FILTER(?a = 1) }", 0, 1 },
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a OPTIONAL { ?s ex:q ?b } FILTER(?a = 1 && !BOUND(?b)) }", 1, 1 },
+  /* a filter inside the OPTIONAL cannot use ?a bound outside it */
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a OPTIONAL { ?s ex:q ?b FILTER(?b = ?a) } }", -1, 0 },
+  /* ?c is bound by VALUES outside the BGP */
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a FILTER(?a = ?c) } VALUES ?c { 1 }", 1, 0 },
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a FILTER(?a = ?c && ?a != 2) } VALUES ?c { 1 }", 1, 1 },
+  /* IRI equalities reach the BGP where they become constants */
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ?p ?o FILTER(?p = ex:q) }", 0, 1 },
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ?p ?o FILTER(sameTerm(ex:s, ?s)) }", 0, 1 },
+  /* a new value each evaluation */
+  { PUSHDOWN_PREFIX "SELECT * WHERE { ?s ex:p ?a FILTER(?a < RAND()) }", 1, 0 },
+  { NULL, 0, 0 }
+};
+
+
+typedef struct {
+  rasqal_query* query;
+  rasqal_algebra_node* node;
+  int filters_count;
+  int bgp_filters_count;
+  /* BGP filters using a variable the BGP does not bind */
+  int unbound_count;
+} filter_pushdown_counts;
+
+
+static int
+filter_pushdown_unbound_variable(void *user_data, rasqal_expression *e)
+{
+  filter_pushdown_counts* counts = (filter_pushdown_counts*)user_data;
+  rasqal_algebra_node* node = counts->node;
+  rasqal_variable* v;
+  int column;
+
+  if(e->op != RASQAL_EXPR_LITERAL)
+    return 0;
+
+  v = rasqal_literal_as_variable(e->literal);
+  if(!v)
+    return 0;
+
+  for(column = node->start_column; column <= node->end_column; column++) {
+    if(rasqal_query_variable_bound_in_triple(counts->query, v, column))
+      return 0;
+  }
+
+  return 1;
+}
+
+
+static int
+filter_pushdown_count_node(rasqal_query* query, rasqal_algebra_node* node,
+                           void* user_data)
+{
+  filter_pushdown_counts* counts = (filter_pushdown_counts*)user_data;
+
+  if(node->op == RASQAL_ALGEBRA_OPERATOR_FILTER)
+    counts->filters_count++;
+  else if(node->op == RASQAL_ALGEBRA_OPERATOR_BGP && node->expr) {
+    counts->bgp_filters_count++;
+    counts->node = node;
+    if(rasqal_expression_visit(node->expr, filter_pushdown_unbound_variable,
+                               counts))
+      counts->unbound_count++;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Check where the filter conjuncts of each query end up
+ *
+ * Return value: number of failures
+ */
+static int
+filter_pushdown_tests(rasqal_world* world, raptor_uri* base_uri,
+                      const char* program)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; filter_pushdown_test_data[i].query_string; i++) {
+    const char* query_string = filter_pushdown_test_data[i].query_string;
+    rasqal_query* query;
+    rasqal_algebra_node* node = NULL;
+    filter_pushdown_counts counts;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query, (const unsigned char*)query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: query '%s' prepare FAILED\n", program,
+              query_string);
+      failures++;
+      goto tidy;
+    }
+
+    node = rasqal_algebra_query_to_algebra(query);
+    if(!node) {
+      fprintf(stderr, "%s: query '%s' to algebra FAILED\n", program,
+              query_string);
+      failures++;
+      goto tidy;
+    }
+
+    memset(&counts, '\0', sizeof(counts));
+    counts.query = query;
+    rasqal_algebra_node_visit(query, node, filter_pushdown_count_node,
+                              &counts);
+
+    if((filter_pushdown_test_data[i].filters_count >= 0 &&
+        counts.filters_count != filter_pushdown_test_data[i].filters_count) ||
+       counts.bgp_filters_count != filter_pushdown_test_data[i].bgp_filters_count ||
+       counts.unbound_count) {
+      fprintf(stderr, "%s: query '%s' FAILED pushing down filters: %d FILTER nodes, %d BGP filters (%d with unbound variables), expected %d and %d\n",
+              program, query_string, counts.filters_count,
+              counts.bgp_filters_count, counts.unbound_count,
+              filter_pushdown_test_data[i].filters_count,
+              filter_pushdown_test_data[i].bgp_filters_count);
+      rasqal_algebra_node_print(node, stderr);
+      fputc('\n', stderr);
+      failures++;
+    }
+
+    tidy:
+    if(node)
+      rasqal_free_algebra_node(node);
+    if(query)
+      rasqal_free_query(query);
+  }
+
+  return failures;
+}
+
+
+#define NARROW_ROWS_MAX_VARIABLES 3
+
+static const struct {
+  const char* query_string;
+  /* variables the BGP must return */
+  const char* kept[NARROW_ROWS_MAX_VARIABLES + 1];
+  /* variables the BGP must leave out of its rows */
+  const char* dropped[NARROW_ROWS_MAX_VARIABLES + 1];
+} narrow_rows_test_data[] = {
+  { PUSHDOWN_PREFIX "SELECT ?s WHERE { ?s ex:p ?a . ?s ex:q ?b } ORDER BY ?a",
+    { "s", "a", NULL }, { "b", NULL } },
+  { PUSHDOWN_PREFIX "SELECT ?s WHERE { ?s ex:p ?a . ?s ex:q ?b } ORDER BY DESC(STR(?b))",
+    { "s", "b", NULL }, { "a", NULL } },
+  { PUSHDOWN_PREFIX "SELECT (COUNT(?s) AS ?n) WHERE { ?s ex:p ?a . ?s ex:q ?b } GROUP BY ?a",
+    { "s", "a", NULL }, { "b", NULL } },
+  { PUSHDOWN_PREFIX "SELECT ?a WHERE { ?s ex:p ?a . ?s ex:q ?b . ?s ex:r ?c } GROUP BY ?a HAVING(MAX(?b) > 1)",
+    { "a", "b", NULL }, { "c", NULL } },
+  /* COUNT(*) counts every variable so none are left out */
+  { PUSHDOWN_PREFIX "SELECT (COUNT(*) AS ?n) WHERE { ?s ex:p ?a . ?s ex:q ?b } GROUP BY ?s",
+    { "s", "a", "b", NULL }, { NULL } },
+  { NULL, { NULL }, { NULL } }
+};
+
+
+static int
+narrow_rows_find_bgp(rasqal_query* query, rasqal_algebra_node* node,
+                     void* user_data)
+{
+  if(node->op != RASQAL_ALGEBRA_OPERATOR_BGP)
+    return 0;
+
+  *(rasqal_algebra_node**)user_data = node;
+  return 1;
+}
+
+
+/* check if a BGP returns the variable @name in its rows */
+static int
+narrow_rows_bgp_returns(rasqal_algebra_node* node, const char* name)
+{
+  rasqal_variable* v;
+  int i;
+
+  if(!node->vars_seq)
+    return 1;
+
+  for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(node->vars_seq, i)); i++) {
+    if(!strcmp((const char*)v->name, name))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Check the BGP of each query keeps the variables used by ORDER BY,
+ * GROUP BY and HAVING in its rows
+ *
+ * Return value: number of failures
+ */
+static int
+narrow_rows_tests(rasqal_world* world, raptor_uri* base_uri,
+                  const char* program)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; narrow_rows_test_data[i].query_string; i++) {
+    const char* query_string = narrow_rows_test_data[i].query_string;
+    rasqal_query* query;
+    rasqal_algebra_node* node = NULL;
+    rasqal_algebra_node* bgp = NULL;
+    const char* name;
+    int j;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query, (const unsigned char*)query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: query '%s' prepare FAILED\n", program,
+              query_string);
+      failures++;
+      goto tidy;
+    }
+
+    node = rasqal_algebra_query_to_algebra(query);
+    if(node)
+      rasqal_algebra_node_visit(query, node, narrow_rows_find_bgp, &bgp);
+    if(!bgp) {
+      fprintf(stderr, "%s: query '%s' to algebra BGP FAILED\n", program,
+              query_string);
+      failures++;
+      goto tidy;
+    }
+
+    for(j = 0; (name = narrow_rows_test_data[i].kept[j]); j++) {
+      if(!narrow_rows_bgp_returns(bgp, name)) {
+        fprintf(stderr, "%s: query '%s' FAILED leaving out needed variable %s\n",
+                program, query_string, name);
+        failures++;
+      }
+    }
+
+    for(j = 0; (name = narrow_rows_test_data[i].dropped[j]); j++) {
+      if(narrow_rows_bgp_returns(bgp, name)) {
+        fprintf(stderr, "%s: query '%s' FAILED returning unused variable %s\n",
+                program, query_string, name);
+        failures++;
+      }
+    }
+
+    tidy:
+    if(node)
+      rasqal_free_algebra_node(node);
+    if(query)
+      rasqal_free_query(query);
+  }
+
+  return failures;
+}
+
+
 int main(int argc, char *argv[]);
 
 int
@@ -2797,6 +3537,9 @@ main(int argc, char *argv[]) {
   rasqal_algebra_node_print(node9, stderr);
   fputc('\n', stderr);
 
+  failures += filter_pushdown_tests(world, base_uri, program);
+  failures += narrow_rows_tests(world, base_uri, program);
+
 
   tidy:
   if(lit1)
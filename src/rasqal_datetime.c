@@ -155,6 +155,48 @@ rasqal_xsd_datetime_normalize(rasqal_xsd_datetime *datetime)
 }
 
 
+/* length of yyyy-mm-ddThh:mm:ss */
+#define RASQAL_XSD_DATETIME_FIXED_LEN 19
+
+#define DIGITS2(s) (((s)[0] - '0') * 10 + ((s)[1] - '0'))
+
+#ifdef STANDALONE
+/* set by the tests to compare the fixed offset and general parsers */
+static int rasqal_xsd_datetime_no_fixed_layout = 0;
+#else
+#define rasqal_xsd_datetime_no_fixed_layout 0
+#endif
+
+/*
+ * rasqal_xsd_datetime_is_fixed_layout:
+ * @s: string
+ *
+ * INTERNAL - Check if a string starts with a 4 digit year dateTime
+ *
+ * Checks for yyyy-mm-ddThh:mm:ss followed by the end of the string,
+ * a fraction or a timezone, which is how nearly all dateTimes are
+ * written.
+ *
+ * Return value: non-0 if the fields are at fixed offsets
+ */
+static int
+rasqal_xsd_datetime_is_fixed_layout(const char *s)
+{
+  char c;
+
+  if(!(ISNUM(s[0]) && ISNUM(s[1]) && ISNUM(s[2]) && ISNUM(s[3]) &&
+       s[4] == '-' && ISNUM(s[5]) && ISNUM(s[6]) &&
+       s[7] == '-' && ISNUM(s[8]) && ISNUM(s[9]) &&
+       s[10] == 'T' && ISNUM(s[11]) && ISNUM(s[12]) &&
+       s[13] == ':' && ISNUM(s[14]) && ISNUM(s[15]) &&
+       s[16] == ':' && ISNUM(s[17]) && ISNUM(s[18])))
+    return 0;
+
+  c = s[RASQAL_XSD_DATETIME_FIXED_LEN];
+  return (!c || c == '.' || c == 'Z' || c == '+' || c == '-');
+}
+
+
 /**
  * rasqal_xsd_datetime_parse:
  * @datetime_string: xsd:dateTime as lexical form string
@@ -167,6 +209,9 @@ rasqal_xsd_datetime_normalize(rasqal_xsd_datetime *datetime)
  * Does NOT normalize the structure.  Call
  * rasqal_xsd_datetime_normalize() to do that.
  *
+ * A dateTime with a 4 digit year is read at fixed offsets, see
+ * rasqal_xsd_datetime_is_fixed_layout().
+ *
  * http://www.w3.org/TR/xmlschema-2/#dt-dateTime
  *
  * "The lexical space of dateTime consists of finite-length sequences of
@@ -217,6 +262,43 @@ rasqal_xsd_datetime_parse(const char *datetime_string,
   p = (const char *)datetime_string;
   is_neg = 0;
 
+  if(is_dateTime && !rasqal_xsd_datetime_no_fixed_layout &&
+     rasqal_xsd_datetime_is_fixed_layout(p)) {
+    /* yyyy-mm-ddThh:mm:ss - read the fields at fixed offsets */
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p) * 100 + DIGITS2(p + 2));
+    if(!t)
+      return -1;
+    result->year = RASQAL_GOOD_CAST(int, t);
+
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p + 5));
+    if(t < 1 || t > 12)
+      return -2;
+    result->month = RASQAL_GOOD_CAST(unsigned char, t);
+
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p + 8));
+    if(t < 1 || t > days_per_month(result->month, result->year))
+      return -3;
+    result->day = RASQAL_GOOD_CAST(unsigned char, t);
+
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p + 11));
+    if(t > 24)
+      return -4;
+    result->hour = RASQAL_GOOD_CAST(signed char, t);
+
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p + 14));
+    if(t > 59)
+      return -5;
+    result->minute = RASQAL_GOOD_CAST(signed char, t);
+
+    t = RASQAL_GOOD_CAST(unsigned int, DIGITS2(p + 17));
+    if(t > 59)
+      return -6;
+    result->second = RASQAL_GOOD_CAST(signed char, t);
+
+    p += RASQAL_XSD_DATETIME_FIXED_LEN;
+    goto fraction;
+  }
+
   /* Parse year */
   
   /* negative years permitted */
@@ -371,6 +453,7 @@ rasqal_xsd_datetime_parse(const char *datetime_string,
 
     result->second = RASQAL_GOOD_CAST(signed char, t);
 
+  fraction:
     /* now that we have hour, minute and second, we can check
      * if hour == 24 -> only 24:00:00 permitted (normalized later)
      */
@@ -1333,6 +1416,7 @@ rasqal_xsd_datetime_set_from_timeval(rasqal_xsd_datetime *dt,
   dt->microseconds = RASQAL_GOOD_CAST(int, tv->tv_usec);
   dt->timezone_minutes = 0; /* always Zulu time */
   dt->have_tz = 'Z';
+  dt->time_on_timeline = sec;
   
   return 0;
 }
@@ -1363,6 +1447,37 @@ rasqal_xsd_datetime_set_from_unixtime(rasqal_xsd_datetime* dt,
 }
 
 
+/*
+ * rasqal_days_from_civil:
+ * @year: proleptic Gregorian year
+ * @month: month 1..12
+ *
+ * INTERNAL - Get the days from 1970-01-01 to the first day of a month
+ *
+ * Return value: number of days, <0 before 1970
+ */
+static rasqal_int64
+rasqal_days_from_civil(rasqal_int64 year, unsigned int month)
+{
+  rasqal_int64 era;
+  unsigned int year_of_era;
+  unsigned int day_of_year;
+  unsigned int day_of_era;
+
+  /* count years from March so the leap day is the last day */
+  if(month <= 2)
+    year--;
+  era = (year >= 0 ? year : year - 399) / 400;
+  year_of_era = RASQAL_GOOD_CAST(unsigned int, year - era * 400);
+  day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5;
+  day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+               day_of_year;
+
+  /* 719468 days from 0000-03-01 to 1970-01-01 */
+  return era * 146097 + RASQAL_GOOD_CAST(rasqal_int64, day_of_era) - 719468;
+}
+
+
 /**
  * rasqal_xsd_datetime_get_as_unixtime:
  * @dt: datetime
@@ -1374,31 +1489,16 @@ rasqal_xsd_datetime_set_from_unixtime(rasqal_xsd_datetime* dt,
 time_t
 rasqal_xsd_datetime_get_as_unixtime(rasqal_xsd_datetime* dt)
 {
-  struct tm time_buf;
+  rasqal_int64 days;
 
   if(!dt)
     return 0;
-  
-  memset(&time_buf, '\0', sizeof(time_buf));
 
-  time_buf.tm_year = dt->year - TM_YEAR_ORIGIN;
-  time_buf.tm_mon  = dt->month - TM_MONTH_ORIGIN;
-  time_buf.tm_mday = dt->day;
-  time_buf.tm_hour = dt->hour;
-  time_buf.tm_min  = dt->minute;
-  time_buf.tm_sec  = dt->second;
-  time_buf.tm_wday = 0;
-  time_buf.tm_yday = 0;
-  time_buf.tm_isdst = -1;
-
-#ifdef HAVE_TM_GMTOFF
-  if(dt->timezone_minutes == RASQAL_XSD_DATETIME_NO_TZ)
-    time_buf.tm_gmtoff = 0;
-  else
-    time_buf.tm_gmtoff = dt->timezone_minutes * 60;
-#endif
+  /* fields outside their range carry over as with timegm() */
+  days = rasqal_days_from_civil(dt->year, dt->month) + dt->day - 1;
 
-  return rasqal_timegm(&time_buf);
+  return RASQAL_GOOD_CAST(time_t, days * 86400 + dt->hour * 3600 +
+                                  dt->minute * 60 + dt->second);
 }
 
 
@@ -1733,6 +1833,118 @@ test_datetime_parser_tostring(const char *in_str, const char *out_expected)
 }
 
 
+/*
+ * Parse @datetime_string with the fixed offset and the general
+ * parsers and check they agree, and check the year when it is valid
+ *
+ * Return value: non-0 on failure
+ */
+static int
+test_datetime_parsers_agree(const char *datetime_string, int expected_year)
+{
+  rasqal_xsd_datetime fixed_dt; /* on stack */
+  rasqal_xsd_datetime general_dt; /* on stack */
+  int fixed_rc;
+  int general_rc;
+  int r = 0;
+
+  memset(&fixed_dt, '\0', sizeof(fixed_dt));
+  memset(&general_dt, '\0', sizeof(general_dt));
+
+  fixed_rc = rasqal_xsd_datetime_parse(datetime_string, &fixed_dt, 1);
+  if(!fixed_rc)
+    fixed_rc = rasqal_xsd_datetime_normalize(&fixed_dt) ? 1 : 0;
+
+  rasqal_xsd_datetime_no_fixed_layout = 1;
+  general_rc = rasqal_xsd_datetime_parse(datetime_string, &general_dt, 1);
+  rasqal_xsd_datetime_no_fixed_layout = 0;
+  if(!general_rc)
+    general_rc = rasqal_xsd_datetime_normalize(&general_dt) ? 1 : 0;
+
+  if(fixed_rc != general_rc) {
+    fprintf(stderr, "dateTime \"%s\" parsers returned %d and %d\n",
+            datetime_string, fixed_rc, general_rc);
+    return 1;
+  }
+
+  if(fixed_rc) {
+    if(expected_year) {
+      fprintf(stderr, "dateTime \"%s\" parse failed, expected year %d\n",
+              datetime_string, expected_year);
+      r = 1;
+    }
+    return r;
+  }
+
+  if(fixed_dt.year != general_dt.year ||
+     fixed_dt.month != general_dt.month ||
+     fixed_dt.day != general_dt.day ||
+     fixed_dt.hour != general_dt.hour ||
+     fixed_dt.minute != general_dt.minute ||
+     fixed_dt.second != general_dt.second ||
+     fixed_dt.microseconds != general_dt.microseconds ||
+     fixed_dt.timezone_minutes != general_dt.timezone_minutes ||
+     fixed_dt.have_tz != general_dt.have_tz ||
+     fixed_dt.time_on_timeline != general_dt.time_on_timeline) {
+    fprintf(stderr, "dateTime \"%s\" parsers disagree\n", datetime_string);
+    r = 1;
+  }
+
+  if(fixed_dt.year != expected_year) {
+    fprintf(stderr, "dateTime \"%s\" parsed year %d, expected %d\n",
+            datetime_string, fixed_dt.year, expected_year);
+    r = 1;
+  }
+
+  return r;
+}
+
+
+/*
+ * Check @secs converts to dateTime @expected and back again
+ *
+ * Return value: non-0 on failure
+ */
+static int
+test_datetime_unixtime(time_t secs, const char *expected)
+{
+  rasqal_xsd_datetime dt; /* on stack */
+  rasqal_xsd_datetime parsed_dt; /* on stack */
+  char *s;
+  int r = 0;
+
+  if(rasqal_xsd_datetime_set_from_unixtime(&dt, secs)) {
+    fprintf(stderr, "unixtime %ld to dateTime failed\n", (long)secs);
+    return 1;
+  }
+
+  s = rasqal_xsd_datetime_to_string(&dt);
+  if(!s || strcmp(s, expected)) {
+    fprintf(stderr, "unixtime %ld converted to dateTime \"%s\", expected \"%s\"\n",
+            (long)secs, s ? s : "(null)", expected);
+    r = 1;
+  }
+  if(s)
+    RASQAL_FREE(char*, s);
+
+  if(rasqal_xsd_datetime_get_as_unixtime(&dt) != secs ||
+     dt.time_on_timeline != secs) {
+    fprintf(stderr, "unixtime %ld converted back to %ld\n", (long)secs,
+            (long)rasqal_xsd_datetime_get_as_unixtime(&dt));
+    r = 1;
+  }
+
+  if(test_datetime_parse_and_normalize(expected, &parsed_dt) ||
+     parsed_dt.time_on_timeline != secs) {
+    fprintf(stderr, "dateTime \"%s\" parsed to unixtime %ld, expected %ld\n",
+            expected, (long)parsed_dt.time_on_timeline, (long)secs);
+    r = 1;
+  }
+
+  return r;
+}
+
+
 static int
 test_date_parse_and_normalize(const char *date_string,
                               rasqal_xsd_date *result)
@@ -2098,6 +2310,48 @@ main(int argc, char *argv[])
   MYASSERT(test_datetime_parser_tostring("2005-02-28T23:00:00-01:00", "2005-03-01T00:00:00Z") == 0);
   MYASSERT(test_datetime_parser_tostring("2004-02-29T23:00:00-01:00", "2004-03-01T00:00:00Z") == 0);
 
+  /* fixed offset and general parsers */
+
+  MYASSERT(test_datetime_parsers_agree("0000-01-01T00:00:00Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("0000-12-12T12:12:12", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("0001-01-01T00:00:00Z", 1) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T24:00:00Z", 2004) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-12-31T24:00:00", 2005) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T24:00:01Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T24:01:00Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T24:00:00.1Z", 2004) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-02-29T12:00:00Z", 2004) == 0);
+  MYASSERT(test_datetime_parsers_agree("2000-02-29T12:00:00Z", 2000) == 0);
+  MYASSERT(test_datetime_parsers_agree("2005-02-29T12:00:00Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("1900-02-29T12:00:00Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-02-30T12:00:00Z", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-02-29T23:00:00-01:00", 2004) == 0);
+  MYASSERT(test_datetime_parsers_agree("2006-05-18T18:36:03.1239+05:30", 2006) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T12:12:12-", 0) == 0);
+  MYASSERT(test_datetime_parsers_agree("2004-01-01T12:12:12x", 0) == 0);
+  /* read by the general parser only */
+  MYASSERT(test_datetime_parsers_agree("-0001-12-31T23:59:00Z", -1) == 0);
+  MYASSERT(test_datetime_parsers_agree("-2004-02-29T12:00:00Z", -2004) == 0);
+  MYASSERT(test_datetime_parsers_agree("12345-02-28T12:00:00Z", 12345) == 0);
+  MYASSERT(test_datetime_parsers_agree("-12345-12-31T24:00:00Z", -12344) == 0);
+  MYASSERT(test_datetime_parsers_agree("01234-12-12T12:12:12Z", 0) == 0);
+
+  /* unixtime before and after 1970 */
+
+  MYASSERT(test_datetime_unixtime(0, "1970-01-01T00:00:00Z") == 0);
+  MYASSERT(test_datetime_unixtime(-1, "1969-12-31T23:59:59Z") == 0);
+  MYASSERT(test_datetime_unixtime(-86400, "1969-12-31T00:00:00Z") == 0);
+  MYASSERT(test_datetime_unixtime(-86401, "1969-12-30T23:59:59Z") == 0);
+  MYASSERT(test_datetime_unixtime(-68428800, "1967-11-01T00:00:00Z") == 0);
+  MYASSERT(test_datetime_unixtime(-2147483647 - 1, "1901-12-13T20:45:52Z") == 0);
+  MYASSERT(test_datetime_unixtime(951782400, "2000-02-29T00:00:00Z") == 0);
+  if(sizeof(time_t) > 4) {
+    /* 1900 is not a leap year, 1600 is */
+    MYASSERT(test_datetime_unixtime(RASQAL_GOOD_CAST(time_t, -25508) * 86400, "1900-03-01T00:00:00Z") == 0);
+    MYASSERT(test_datetime_unixtime(RASQAL_GOOD_CAST(time_t, -135081) * 86400, "1600-02-29T00:00:00Z") == 0);
+    MYASSERT(test_datetime_unixtime(RASQAL_GOOD_CAST(time_t, -719162) * 86400, "0001-01-01T00:00:00Z") == 0);
+  }
+
 
   /* DATE */
 
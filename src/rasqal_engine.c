@@ -62,6 +62,7 @@ static const char* const rasqal_engine_error_labels[RASQAL_ENGINE_ERROR_LAST+2]=
   "ok",
   "FAILED",
   "finished",
+  "ABORTED",
   "unknown"
 };
 
@@ -74,3 +75,180 @@ rasqal_engine_error_as_string(rasqal_engine_error error)
   return rasqal_engine_error_labels[RASQAL_GOOD_CAST(int, error)];
 }
 #endif
+
+
+#ifndef HAVE_GETTIMEOFDAY
+#define gettimeofday(x,y) rasqal_gettimeofday(x,y)
+#endif
+
+/* Number of budget checks between reads of the clock */
+#define RASQAL_BUDGET_CLOCK_TICKS 64
+
+
+/*
+ * rasqal_query_budget_start:
+ * @query: query
+ *
+ * INTERNAL - Start the execution budget for a new query execution
+ *
+ * Reads the timeout, row and memory limits from the query features
+ * and clears any earlier cancellation.  A worker query has no limits
+ * of its own but stops at the deadline of its parent query.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_query_budget_start(rasqal_query* query)
+{
+  rasqal_query_budget* budget = &query->budget;
+  int timeout;
+  int max_memory;
+
+  memset(budget, '\0', sizeof(*budget));
+  query->cancelled = 0;
+
+  if(query->parent_query) {
+    budget->have_deadline = query->parent_query->budget.have_deadline;
+    budget->deadline = query->parent_query->budget.deadline;
+    budget->ticks = RASQAL_BUDGET_CLOCK_TICKS;
+    return 0;
+  }
+
+  timeout = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_TIMEOUT)];
+  if(timeout > 0) {
+    if(gettimeofday(&budget->deadline, NULL))
+      return 1;
+
+    budget->deadline.tv_sec += timeout / 1000;
+    budget->deadline.tv_usec += (timeout % 1000) * 1000;
+    if(budget->deadline.tv_usec >= 1000000) {
+      budget->deadline.tv_sec++;
+      budget->deadline.tv_usec -= 1000000;
+    }
+    budget->have_deadline = 1;
+    budget->ticks = RASQAL_BUDGET_CLOCK_TICKS;
+  }
+
+  budget->max_rows = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_MAX_ROWS)];
+
+  max_memory = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_MAX_MEMORY)];
+  if(max_memory > 0)
+    budget->max_bytes = RASQAL_GOOD_CAST(size_t, max_memory) * 1024;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_budget_abort:
+ * @query: query
+ * @reason: reason for the error message
+ *
+ * INTERNAL - Stop the query execution and report why
+ *
+ * A worker query stops without an error: its parent query reports it.
+ *
+ * Return value: 1
+ */
+int
+rasqal_query_budget_abort(rasqal_query* query, const char* reason)
+{
+  query->budget.aborted = 1;
+
+  if(!query->parent_query)
+    rasqal_log_error_simple(query->world, RAPTOR_LOG_LEVEL_ERROR,
+                            &query->locator,
+                            "Query execution aborted: %s", reason);
+  return 1;
+}
+
+
+/*
+ * rasqal_query_check_budget:
+ * @query: query (or NULL)
+ *
+ * INTERNAL - Check if the query execution must stop
+ *
+ * Cheap enough to call once per row or inner loop iteration: the
+ * clock is only read every few calls.  Once the budget is exceeded
+ * every following call fails.
+ *
+ * Return value: non-0 if execution was cancelled or exceeded its budget
+ */
+int
+rasqal_query_check_budget(rasqal_query* query)
+{
+  rasqal_query_budget* budget;
+
+  if(!query)
+    return 0;
+
+  budget = &query->budget;
+  if(budget->aborted)
+    return 1;
+
+  if(query->cancelled ||
+     (query->parent_query && query->parent_query->cancelled))
+    return rasqal_query_budget_abort(query, "cancelled");
+
+  if(budget->have_deadline && --budget->ticks <= 0) {
+    struct timeval now;
+
+    budget->ticks = RASQAL_BUDGET_CLOCK_TICKS;
+    if(!gettimeofday(&now, NULL) &&
+       (now.tv_sec > budget->deadline.tv_sec ||
+        (now.tv_sec == budget->deadline.tv_sec &&
+         now.tv_usec >= budget->deadline.tv_usec)))
+      return rasqal_query_budget_abort(query, "timeout");
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_budget_add_row:
+ * @query: query (or NULL)
+ * @row: row being buffered
+ *
+ * INTERNAL - Charge a row buffered by an operator to the execution budget
+ *
+ * Without memory accounting the size of the row is an estimate that
+ * counts the values as if they were not shared.
+ *
+ * Return value: non-0 if execution was cancelled or exceeded its budget
+ */
+int
+rasqal_query_budget_add_row(rasqal_query* query, rasqal_row* row)
+{
+  rasqal_query_budget* budget;
+  size_t size;
+
+  if(!query)
+    return 0;
+
+  if(rasqal_query_check_budget(query))
+    return 1;
+
+  budget = &query->budget;
+
+  budget->rows++;
+  if(budget->max_rows > 0 && budget->rows > budget->max_rows)
+    return rasqal_query_budget_abort(query, "too many buffered rows");
+
+  if(!budget->max_bytes)
+    return 0;
+
+  /* use the real allocated size when memory accounting is available */
+  if(!rasqal_memory_account_get_usage(query->memory_account, &size, NULL)) {
+    if(size > budget->max_bytes)
+      return rasqal_query_budget_abort(query, "query execution exceeds memory limit");
+    return 0;
+  }
+
+  budget->bytes += rasqal_row_get_size_estimate(row);
+  if(budget->bytes > budget->max_bytes)
+    return rasqal_query_budget_abort(query, "buffered rows exceed memory limit");
+
+  return 0;
+}
@@ -35,6 +35,10 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+/* for INT_MAX */
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -47,7 +51,7 @@ typedef struct {
   rasqal_query* query;
   rasqal_query_results* query_results;
 
-  /* query algebra representation of query */
+  /* query algebra representation of query (SHARED with query) */
   rasqal_algebra_node* algebra_node;
 
   /* number of nodes in #algebra_node tree */
@@ -57,6 +61,17 @@ typedef struct {
   rasqal_rowsource* rowsource;
 
   rasqal_triples_source* triples_source;
+
+  /* incremental result state replacing a node of the plan or NULL
+   * (SHARED with query) */
+  rasqal_incremental* incremental;
+
+  /* triples source of each query triple column while evaluating the
+   * appended triples or NULL */
+  rasqal_triples_source** triples_sources;
+
+  /* UNION branches that may still be evaluated on worker threads */
+  int union_threads;
 } rasqal_engine_algebra_data;
 
 
@@ -81,11 +96,18 @@ rasqal_algebra_basic_algebra_node_to_rowsource(rasqal_engine_algebra_data* execu
                                                rasqal_engine_error *error_p)
 {
   rasqal_query *query = execution_data->query;
+  rasqal_rowsource* rs;
   
-  return rasqal_new_triples_rowsource(query->world, query,
-                                      execution_data->triples_source,
-                                      node->triples,
-                                      node->start_column, node->end_column);
+  rs = rasqal_new_triples_rowsource(query->world, query,
+                                    execution_data->triples_source,
+                                    node->triples,
+                                    node->start_column, node->end_column,
+                                    node->expr, node->vars_seq);
+  if(rs && execution_data->triples_sources && node->triples)
+    rasqal_triples_rowsource_set_triples_sources(rs,
+                                                 execution_data->triples_sources);
+
+  return rs;
 }
 
 
@@ -131,6 +153,40 @@ rasqal_algebra_orderby_algebra_node_to_rowsource(rasqal_engine_algebra_data* exe
 }
 
 
+/*
+ * rasqal_algebra_union_branch_to_rowsource:
+ * @execution_data: execution data
+ * @node: UNION branch node
+ * @error_p: execution error (OUT)
+ *
+ * INTERNAL - Create a rowsource for a UNION branch, on a worker thread if allowed
+ *
+ * Return value: rowsource or NULL on failure
+ */
+static rasqal_rowsource*
+rasqal_algebra_union_branch_to_rowsource(rasqal_engine_algebra_data* execution_data,
+                                         rasqal_algebra_node* node,
+                                         rasqal_engine_error *error_p)
+{
+  rasqal_query *query = execution_data->query;
+  rasqal_rowsource *rs;
+
+  /* not for incremental evaluation: its appended triples are matched
+   * with execution_data->triples_sources */
+  if(execution_data->union_threads > 0 &&
+     !execution_data->incremental && !execution_data->triples_sources &&
+     node->op != RASQAL_ALGEBRA_OPERATOR_UNION) {
+    rs = rasqal_new_exchange_rowsource(query->world, query, node);
+    if(rs) {
+      execution_data->union_threads--;
+      return rs;
+    }
+  }
+
+  return rasqal_algebra_node_to_rowsource(execution_data, node, error_p);
+}
+
+
 static rasqal_rowsource*
 rasqal_algebra_union_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
                                                rasqal_algebra_node* node,
@@ -140,13 +196,13 @@ rasqal_algebra_union_algebra_node_to_rowsource(rasqal_engine_algebra_data* execu
   rasqal_rowsource *left_rs;
   rasqal_rowsource *right_rs;
 
-  left_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node1,
-                                             error_p);
+  left_rs = rasqal_algebra_union_branch_to_rowsource(execution_data,
+                                                     node->node1, error_p);
   if((error_p && *error_p) || !left_rs)
     return NULL;
 
-  right_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node2,
-                                              error_p);
+  right_rs = rasqal_algebra_union_branch_to_rowsource(execution_data,
+                                                      node->node2, error_p);
   if((error_p && *error_p) || !right_rs) {
     rasqal_free_rowsource(left_rs);
     return NULL;
@@ -271,6 +327,68 @@ rasqal_algebra_node_set_origin(rasqal_query *query,
 }
 
 
+/*
+ * rasqal_algebra_graph_single_pass:
+ * @execution_data: execution data
+ * @node: GRAPH algebra node
+ * @v: graph variable
+ *
+ * INTERNAL - Check if a GRAPH variable can be bound matching the inner pattern once
+ *
+ * The inner pattern must be a BGP that does not otherwise mention
+ * the variable, the triples source must bind a variable graph and the
+ * named graphs must have different names so that each solution is
+ * found once, in the same order as evaluating the pattern per graph.
+ *
+ * Return value: non-0 if the inner pattern can be matched once
+ */
+static int
+rasqal_algebra_graph_single_pass(rasqal_engine_algebra_data* execution_data,
+                                 rasqal_algebra_node* node,
+                                 rasqal_variable* v)
+{
+  rasqal_query *query = execution_data->query;
+  rasqal_algebra_node* bgp = node->node1;
+  rasqal_data_graph* dg;
+  int i;
+
+  if(!bgp || bgp->op != RASQAL_ALGEBRA_OPERATOR_BGP || !bgp->triples ||
+     bgp->start_column > bgp->end_column)
+    return 0;
+
+  if(!execution_data->triples_source ||
+     !rasqal_triples_source_support_feature(execution_data->triples_source,
+                                            RASQAL_TRIPLES_SOURCE_FEATURE_GRAPH_VARIABLE))
+    return 0;
+
+  for(i = bgp->start_column; i <= bgp->end_column; i++) {
+    rasqal_triple *t;
+
+    t = (rasqal_triple*)raptor_sequence_get_at(bgp->triples, i);
+    if(rasqal_literal_as_variable(t->subject) == v ||
+       rasqal_literal_as_variable(t->predicate) == v ||
+       rasqal_literal_as_variable(t->object) == v)
+      return 0;
+  }
+
+  for(i = 0; (dg = rasqal_query_get_data_graph(query, i)); i++) {
+    rasqal_data_graph* dg2;
+    int j;
+
+    if(!dg->name_uri)
+      continue;
+
+    for(j = 0; j < i; j++) {
+      dg2 = rasqal_query_get_data_graph(query, j);
+      if(dg2->name_uri && raptor_uri_equals(dg2->name_uri, dg->name_uri))
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+
 static rasqal_rowsource*
 rasqal_algebra_graph_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
                                                rasqal_algebra_node* node,
@@ -280,6 +398,7 @@ rasqal_algebra_graph_algebra_node_to_rowsource(rasqal_engine_algebra_data* execu
   rasqal_rowsource *rs;
   rasqal_literal *graph = node->graph;
   rasqal_variable* v;
+  int single_pass;
 
   if(!graph) {
     RASQAL_DEBUG1("graph algebra node has NULL graph\n");
@@ -332,10 +451,9 @@ eval(D(G), Graph(IRI,P)) = the empty multiset
       rs = rasqal_algebra_node_to_rowsource(execution_data, node->node1,
                                             error_p);
     } else {
-      /* case #2 - IRI is not a graph name in D - return empty rowsource */
-      rasqal_free_algebra_node(node->node1);
-      node->node1 = NULL;
-      
+      /* case #2 - IRI is not a graph name in D - return empty rowsource.
+       * node->node1 is kept since the algebra is shared by executions.
+       */
       rs = rasqal_new_empty_rowsource(query->world, query);
     }
 
@@ -349,11 +467,17 @@ eval(D(G), Graph(IRI,P)) = the empty multiset
 
 
   /* case #3 - a variable */
+  single_pass = rasqal_algebra_graph_single_pass(execution_data, node, v);
+  if(single_pass)
+    /* Match the BGP once with the variable as the graph of all the
+     * triple patterns, rather than once per named graph */
+    rasqal_algebra_node_set_origin(query, node->node1, graph);
+
   rs = rasqal_algebra_node_to_rowsource(execution_data, node->node1, error_p);
   if((error_p && *error_p) || !rs)
     return NULL;
 
-  return rasqal_new_graph_rowsource(query->world, query, rs, v);
+  return rasqal_new_graph_rowsource(query->world, query, rs, v, single_pass);
 }
 
 
@@ -473,6 +597,14 @@ rasqal_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
 {
   rasqal_rowsource* rs = NULL;
   
+  if(execution_data->incremental &&
+     node == rasqal_incremental_get_node(execution_data->incremental)) {
+    rs = rasqal_incremental_new_rowsource(execution_data->incremental);
+    if(!rs)
+      *error_p = RASQAL_ENGINE_FAILED;
+    return rs;
+  }
+
   switch(node->op) {
     case RASQAL_ALGEBRA_OPERATOR_BGP:
       rs = rasqal_algebra_basic_algebra_node_to_rowsource(execution_data,
@@ -573,97 +705,338 @@ rasqal_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
 
 
 
-static int
-rasqal_query_engine_algebra_execute_init(void* ex_data,
-                                         rasqal_query* query,
-                                         rasqal_query_results* query_results,
-                                         int flags,
-                                         rasqal_engine_error *error_p)
+/*
+ * rasqal_engine_algebra_query_to_plan:
+ * @query: query
+ *
+ * INTERNAL - Build the optimised algebra for executing a query
+ *
+ * Return value: new algebra node or NULL on failure
+ */
+static rasqal_algebra_node*
+rasqal_engine_algebra_query_to_plan(rasqal_query* query)
 {
-  rasqal_engine_algebra_data* execution_data;
-  rasqal_engine_error error;
-  int rc = 0;
   rasqal_projection* projection;
   rasqal_solution_modifier* modifier;
   rasqal_algebra_node* node;
   rasqal_algebra_aggregate* ae;
   
-  execution_data = (rasqal_engine_algebra_data*)ex_data;
-
-  /* initialise the execution_data fields */
-  execution_data->query = query;
-  execution_data->query_results = query_results;
-
-  if(!execution_data->triples_source) {
-    execution_data->triples_source = rasqal_new_triples_source(execution_data->query);
-    if(!execution_data->triples_source) {
-      *error_p = RASQAL_ENGINE_FAILED;
-      return 1;
-    }
-  }
-
   projection = rasqal_query_get_projection(query);
   modifier = query->modifier;
 
   node = rasqal_algebra_query_to_algebra(query);
   if(!node)
-    return 1;
+    return NULL;
 
   node = rasqal_algebra_query_add_group_by(query, node, modifier);
   if(!node)
-    return 1;
+    return NULL;
 
   ae = rasqal_algebra_query_prepare_aggregates(query, node, projection,
                                                modifier);
   if(!ae)
-    return 1;
+    return NULL;
 
   if(ae) {
     node = rasqal_algebra_query_add_aggregation(query, ae, node);
     ae = NULL;
     if(!node)
-      return 1;
+      return NULL;
   }
 
   node = rasqal_algebra_query_add_having(query, node, modifier);
   if(!node)
-    return 1;
+    return NULL;
 
   if(query->verb == RASQAL_QUERY_VERB_SELECT) {
     node = rasqal_algebra_query_add_projection(query, node, projection);
     if(!node)
-      return 1;
+      return NULL;
   } else if(query->verb == RASQAL_QUERY_VERB_CONSTRUCT) {
     node = rasqal_algebra_query_add_construct_projection(query, node);
     if(!node)
-      return 1;
+      return NULL;
   }
 
   node = rasqal_algebra_query_add_orderby(query, node, projection, modifier);
   if(!node)
-    return 1;
+    return NULL;
 
   node = rasqal_algebra_query_add_distinct(query, node, projection);
   if(!node)
-    return 1;
+    return NULL;
 
+  return node;
+}
 
-  execution_data->algebra_node = node;
 
-  /* count final number of nodes */
-  execution_data->nodes_count = 0; 
-  rasqal_algebra_node_visit(query,
-                            execution_data->algebra_node,
-                            rasqal_engine_algebra_count_nodes,
-                            &execution_data->nodes_count);
-  
+/*
+ * rasqal_engine_algebra_query_row_limit:
+ * @query: query
+ *
+ * INTERNAL - Get the most result rows a query execution will read
+ *
+ * This matches rasqal_query_check_limit_offset(): rows up to OFFSET
+ * plus LIMIT are read and an ASK query needs only one row.  There is
+ * no limit if OFFSET plus LIMIT is more than INT_MAX.
+ *
+ * Return value: row limit or <0 if there is no limit
+ */
+static int
+rasqal_engine_algebra_query_row_limit(rasqal_query* query)
+{
+  int limit;
+  int offset;
+
+  limit = rasqal_query_get_limit(query);
+
+  if(query->verb == RASQAL_QUERY_VERB_ASK)
+    limit = 1;
+
+  if(limit < 0)
+    return -1;
+
+  offset = rasqal_query_get_offset(query);
+  if(offset > 0)
+    /* no limit if the sum does not fit */
+    limit = (offset > INT_MAX - limit) ? -1 : limit + offset;
+
+  return limit;
+}
+
+
+/* constant part of a triple pattern or NULL to match any term */
+static rasqal_literal*
+rasqal_engine_algebra_constant_term(rasqal_literal* l)
+{
+  return (l && l->type == RASQAL_LITERAL_VARIABLE) ? NULL : l;
+}
+
+
+/*
+ * rasqal_engine_algebra_add_delta_rows:
+ * @execution_data: execution data
+ * @inc: incremental state
+ * @after: epoch the appended triples were added after
+ * @until: last epoch of the appended triples
+ *
+ * INTERNAL - Add the delta node rows made by the appended triples
+ *
+ * The new rows of a join of triple patterns over old and appended
+ * triples are those matching appended triples at pattern i, only old
+ * triples at the patterns before it and any triple after it, for each
+ * pattern i.  A pattern whose constant terms match no appended triple
+ * adds no rows.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_engine_algebra_add_delta_rows(rasqal_engine_algebra_data* execution_data,
+                                     rasqal_incremental* inc,
+                                     unsigned long after,
+                                     unsigned long until)
+{
+  rasqal_query* query = execution_data->query;
+  rasqal_triples_source* old_source = NULL;
+  rasqal_triples_source* delta_source = NULL;
+  rasqal_triples_source** sources = NULL;
+  raptor_sequence* triples;
+  int* columns;
+  int columns_count;
+  int i;
+  int rc = 1;
+
+  triples = rasqal_query_get_triple_sequence(query);
+  columns = rasqal_incremental_get_columns(inc, &columns_count);
+
+  old_source = rasqal_new_triples_source(query);
+  delta_source = rasqal_new_triples_source(query);
+  sources = RASQAL_CALLOC(rasqal_triples_source**,
+                          RASQAL_GOOD_CAST(size_t, raptor_sequence_size(triples)),
+                          sizeof(rasqal_triples_source*));
+  if(!old_source || !delta_source || !sources ||
+     rasqal_raptor_triples_source_set_epochs(old_source, 0, after) ||
+     rasqal_raptor_triples_source_set_epochs(delta_source, after, until))
+    goto tidy;
+
+  for(i = 0; i < columns_count; i++) {
+    rasqal_triple* t;
+    rasqal_triple probe;
+    rasqal_rowsource* rs;
+    rasqal_engine_error error = RASQAL_ENGINE_OK;
+    int j;
+
+    t = (rasqal_triple*)raptor_sequence_get_at(triples, columns[i]);
+
+    /* shallow copy: the literals are not freed */
+    probe = *t;
+    probe.subject = rasqal_engine_algebra_constant_term(t->subject);
+    probe.predicate = rasqal_engine_algebra_constant_term(t->predicate);
+    probe.object = rasqal_engine_algebra_constant_term(t->object);
+    if(!rasqal_triples_source_triple_present(delta_source, &probe))
+      continue;
+
+    for(j = 0; j < columns_count; j++)
+      sources[columns[j]] = (j < i) ? old_source : ((j == i) ? delta_source : NULL);
+
+    execution_data->triples_sources = sources;
+    rs = rasqal_algebra_node_to_rowsource(execution_data,
+                                          rasqal_incremental_get_delta_node(inc),
+                                          &error);
+    execution_data->triples_sources = NULL;
+    if(!rs)
+      goto tidy;
+
+    error = (error != RASQAL_ENGINE_OK) ? 1 : rasqal_incremental_add_rows(inc, rs);
+    rasqal_free_rowsource(rs);
+    if(error)
+      goto tidy;
+  }
+
+  rc = 0;
+
+  tidy:
+  if(sources)
+    RASQAL_FREE(rasqal_triples_source**, sources);
+  if(delta_source)
+    rasqal_free_triples_source(delta_source);
+  if(old_source)
+    rasqal_free_triples_source(old_source);
+
+  return rc;
+}
+
+
+/*
+ * rasqal_engine_algebra_update_incremental:
+ * @execution_data: execution data
+ *
+ * INTERNAL - Bring the incremental result state of the query up to date
+ *
+ * Queries with #RASQAL_FEATURE_INCREMENTAL keep the rows or
+ * aggregates of part of their plan between executions and only add
+ * those made by the triples appended since.  Queries that cannot be
+ * evaluated incrementally, including those with bound parameters or
+ * another triples source, are evaluated in full.
+ *
+ * The state is reset on failure so an abort is then reported by the
+ * full evaluation of the plan.
+ */
+static void
+rasqal_engine_algebra_update_incremental(rasqal_engine_algebra_data* execution_data)
+{
+  rasqal_query* query = execution_data->query;
+  rasqal_incremental* inc = query->incremental;
+  unsigned long after = 0;
+  unsigned long until = 0;
+  int rc;
+
+  if(query->parameters || !rasqal_raptor_is_triples_source(query->world)) {
+    if(inc)
+      rasqal_incremental_reset(inc);
+    return;
+  }
+
+  if(!inc) {
+    inc = rasqal_new_incremental(query, execution_data->algebra_node);
+    if(!inc)
+      return;
+    query->incremental = inc;
+  }
+
+  rc = rasqal_incremental_start(inc, execution_data->triples_source, &after,
+                                &until);
+  if(rc > 0) {
+    if(!after) {
+      rasqal_rowsource* rs;
+      rasqal_engine_error error = RASQAL_ENGINE_OK;
+
+      rs = rasqal_algebra_node_to_rowsource(execution_data,
+                                            rasqal_incremental_get_delta_node(inc),
+                                            &error);
+      rc = (!rs || error != RASQAL_ENGINE_OK) ? -1 : 0;
+      if(rs) {
+        if(!rc)
+          rc = rasqal_incremental_add_rows(inc, rs);
+        rasqal_free_rowsource(rs);
+      }
+    } else
+      rc = rasqal_engine_algebra_add_delta_rows(execution_data, inc, after,
+                                                until);
+  }
+
+  if(rc) {
+    rasqal_incremental_reset(inc);
+    return;
+  }
+
+  execution_data->incremental = inc;
+}
+
+
+static int
+rasqal_query_engine_algebra_execute_init(void* ex_data,
+                                         rasqal_query* query,
+                                         rasqal_query_results* query_results,
+                                         int flags,
+                                         rasqal_engine_error *error_p)
+{
+  rasqal_engine_algebra_data* execution_data;
+  rasqal_engine_error error;
+  int rc = 0;
+  rasqal_algebra_node* node;
   
+  execution_data = (rasqal_engine_algebra_data*)ex_data;
+
+  /* initialise the execution_data fields */
+  execution_data->query = query;
+  execution_data->query_results = query_results;
+
+  if(!execution_data->triples_source) {
+    execution_data->triples_source = rasqal_new_triples_source(execution_data->query);
+    if(!execution_data->triples_source) {
+      *error_p = RASQAL_ENGINE_FAILED;
+      return 1;
+    }
+  }
+
+  /* the algebra only depends on the prepared query, its features and
+   * solution modifier so it is built once and reused by every
+   * execution of the query.  A query sharing the prepared form of
+   * another from the world query cache has its own features and
+   * solution modifier and so builds its own plan. */
+  if(!query->algebra_plan) {
+    node = rasqal_engine_algebra_query_to_plan(query);
+    if(!node)
+      return 1;
+
+    query->algebra_plan = node;
+
+    /* count final number of nodes */
+    query->algebra_plan_nodes_count = 0;
+    rasqal_algebra_node_visit(query, node,
+                              rasqal_engine_algebra_count_nodes,
+                              &query->algebra_plan_nodes_count);
+
 #ifdef RASQAL_DEBUG
-  RASQAL_DEBUG1("algebra result: \n");
-  rasqal_algebra_node_print(node, DEBUG_FH);
-  fputc('\n', DEBUG_FH);
+    RASQAL_DEBUG1("algebra result: \n");
+    rasqal_algebra_node_print(node, DEBUG_FH);
+    fputc('\n', DEBUG_FH);
 #endif
-  RASQAL_DEBUG2("algebra nodes: %d\n", execution_data->nodes_count);
+    RASQAL_DEBUG2("algebra nodes: %d\n", query->algebra_plan_nodes_count);
+  }
+
+  node = query->algebra_plan;
+  execution_data->algebra_node = node;
+  execution_data->nodes_count = query->algebra_plan_nodes_count;
+
+  if(query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_INCREMENTAL)])
+    rasqal_engine_algebra_update_incremental(execution_data);
+
+  /* one thread reads the branches one after another like none */
+  execution_data->union_threads = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_UNION_THREADS)];
+  if(execution_data->union_threads < 2)
+    execution_data->union_threads = 0;
 
   error = RASQAL_ENGINE_OK;
   execution_data->rowsource = rasqal_algebra_node_to_rowsource(execution_data,
@@ -679,6 +1052,14 @@ rasqal_query_engine_algebra_execute_init(void* ex_data,
 #endif
   if(error != RASQAL_ENGINE_OK)
     rc = 1;
+  else {
+    /* LIMIT and OFFSET are per query and not part of the shared
+     * algebra so hint them to the rowsources for this execution */
+    int limit = rasqal_engine_algebra_query_row_limit(query);
+
+    if(rasqal_rowsource_set_limit(execution_data->rowsource, limit))
+      rc = 1;
+  }
   
   return rc;
 }
@@ -695,7 +1076,13 @@ rasqal_query_engine_algebra_get_all_rows(void* ex_data,
 
   if(execution_data->rowsource) {
     seq = rasqal_rowsource_read_all_rows(execution_data->rowsource);
-    if(!seq)
+    if(execution_data->query->budget.aborted) {
+      if(seq) {
+        raptor_free_sequence(seq);
+        seq = NULL;
+      }
+      *error_p = RASQAL_ENGINE_ABORTED;
+    } else if(!seq)
       *error_p = RASQAL_ENGINE_FAILED;
   } else
     *error_p = RASQAL_ENGINE_FAILED;
@@ -716,7 +1103,8 @@ rasqal_query_engine_algebra_get_row(void* ex_data,
   if(execution_data->rowsource) {
     row = rasqal_rowsource_read_row(execution_data->rowsource);
     if(!row)
-      *error_p = RASQAL_ENGINE_FINISHED;
+      *error_p = execution_data->query->budget.aborted ?
+                 RASQAL_ENGINE_ABORTED : RASQAL_ENGINE_FINISHED;
   } else
     *error_p = RASQAL_ENGINE_FAILED;
 
@@ -724,6 +1112,26 @@ rasqal_query_engine_algebra_get_row(void* ex_data,
 }
 
 
+#if defined(RASQAL_DEBUG) && defined(RASQAL_MEMORY_ACCOUNTING)
+static int
+rasqal_engine_algebra_print_rowsource_memory(rasqal_rowsource* rowsource,
+                                             void *user_data)
+{
+  size_t current;
+  size_t peak;
+
+  if(!rasqal_memory_account_get_usage(rowsource->memory_account,
+                                      &current, &peak))
+    RASQAL_DEBUG5("%s rowsource %p memory: %lu bytes now, %lu bytes peak\n",
+                  rowsource->handler->name, RASQAL_GOOD_CAST(void*, rowsource),
+                  RASQAL_GOOD_CAST(unsigned long, current),
+                  RASQAL_GOOD_CAST(unsigned long, peak));
+
+  return 0;
+}
+#endif
+
+
 static int
 rasqal_query_engine_algebra_execute_finish(void* ex_data,
                                            rasqal_engine_error *error_p)
@@ -733,8 +1141,15 @@ rasqal_query_engine_algebra_execute_finish(void* ex_data,
   execution_data = (rasqal_engine_algebra_data*)ex_data;
 
   if(execution_data) {
-    if(execution_data->algebra_node)
-      rasqal_free_algebra_node(execution_data->algebra_node);
+#if defined(RASQAL_DEBUG) && defined(RASQAL_MEMORY_ACCOUNTING)
+    if(execution_data->rowsource)
+      rasqal_rowsource_visit(execution_data->rowsource,
+                             rasqal_engine_algebra_print_rowsource_memory,
+                             NULL);
+#endif
+
+    /* algebra_node is owned by the query */
+    execution_data->algebra_node = NULL;
 
     if(execution_data->triples_source) {
       rasqal_free_triples_source(execution_data->triples_source);
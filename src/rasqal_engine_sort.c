@@ -36,6 +36,9 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -61,6 +64,47 @@ rasqal_engine_rowsort_free_compare_data(const void* user_data)
 }
 
 
+/*
+ * rasqal_engine_rowsort_compare_order_keys:
+ * @row_a: first row
+ * @row_b: second row
+ * @result_p: pointer to store comparison
+ *
+ * INTERNAL - compare the ORDER BY sort keys of two rows
+ *
+ * Return value: non-0 if the keys cannot decide the order
+ */
+static int
+rasqal_engine_rowsort_compare_order_keys(rasqal_row* row_a, rasqal_row* row_b,
+                                         int* result_p)
+{
+  size_t len;
+  size_t i;
+  int result;
+
+  if(!row_a->order_key || !row_b->order_key)
+    return 1;
+
+  len = row_a->order_key_len;
+  if(row_b->order_key_len < len)
+    len = row_b->order_key_len;
+
+  result = memcmp(row_a->order_key, row_b->order_key, len);
+
+  if(row_a->order_key_exact_len < row_a->order_key_len ||
+     row_b->order_key_exact_len < row_b->order_key_len) {
+    /* decided only if the keys differ before any inexact key */
+    for(i = 0; i < len && row_a->order_key[i] == row_b->order_key[i]; i++)
+      ;
+    if(i >= row_a->order_key_exact_len || i >= row_b->order_key_exact_len)
+      return 1;
+  }
+
+  *result_p = result;
+  return 0;
+}
+
+
 /**
  * rasqal_engine_rowsort_row_compare:
  * @user_data: comparison user data pointer
@@ -102,8 +146,11 @@ rasqal_engine_rowsort_row_compare(void* user_data, const void *a, const void *b)
 	}
   }
   
-  /* now order it */
-  if(rcd->order_conditions_sequence)
+  /* now order it; DISTINCT compares RDF terms which the ORDER BY
+   * sort keys do not distinguish so it never uses them */
+  if(rcd->order_conditions_sequence &&
+     (rcd->is_distinct ||
+      rasqal_engine_rowsort_compare_order_keys(row_a, row_b, &result)))
     result = rasqal_literal_array_compare(row_a->order_values,
                                           row_b->order_values,
                                           rcd->order_conditions_sequence,
@@ -218,6 +265,40 @@ rasqal_engine_rowsort_map_to_sequence(rasqal_map* map, raptor_sequence* seq)
 }
 
 
+/**
+ * rasqal_engine_rowsort_compare_rows:
+ * @order_conditions_sequence: order conditions sequence
+ * @compare_flags: literal compare flags
+ * @row_a: first row
+ * @row_b: second row
+ *
+ * INTERNAL - compare two rows in ORDER BY order
+ *
+ * Uses the same ordering as a non-distinct rowsort map: the row
+ * order values followed by the row offsets so the sort is stable.
+ *
+ * Return value: <0, 0 or >0 comparison
+ */
+int
+rasqal_engine_rowsort_compare_rows(raptor_sequence* order_conditions_sequence,
+                                   int compare_flags,
+                                   rasqal_row* row_a, rasqal_row* row_b)
+{
+  int result;
+
+  if(rasqal_engine_rowsort_compare_order_keys(row_a, row_b, &result))
+    result = rasqal_literal_array_compare(row_a->order_values,
+                                          row_b->order_values,
+                                          order_conditions_sequence,
+                                          row_a->order_size,
+                                          compare_flags);
+  if(!result)
+    result = row_a->offset - row_b->offset;
+
+  return result;
+}
+
+
 /**
  * rasqal_engine_rowsort_calculate_order_values:
  * @query: query object
@@ -257,5 +338,526 @@ rasqal_engine_rowsort_calculate_order_values(rasqal_query* query,
     }
   }
   
+  return rasqal_engine_rowsort_calculate_order_key(query, order_seq, row);
+}
+
+
+/**
+ * rasqal_engine_rowsort_calculate_order_key:
+ * @query: query object
+ * @order_seq: order conditions sequence
+ * @row: row with order values
+ *
+ * INTERNAL - Calculate the sort key of the order values of a row
+ *
+ * The key is the rasqal_literal_sort_key() of each order value with
+ * the bytes inverted for DESC conditions except for NULLs, which
+ * order first like rasqal_literal_array_compare().  The row gets no
+ * key if the query does not use XQuery comparisons or a value has no
+ * sort key.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_engine_rowsort_calculate_order_key(rasqal_query* query,
+                                          raptor_sequence* order_seq,
+                                          rasqal_row* row)
+{
+  size_t len = 0;
+  size_t offset;
+  int exact = 1;
+  int i;
+
+  if(row->order_key) {
+    RASQAL_FREE(char*, row->order_key);
+    row->order_key = NULL;
+    row->order_key_len = 0;
+  }
+
+  if(row->order_size <= 0 || !(query->compare_flags & RASQAL_COMPARE_XQUERY))
+    return 0;
+
+  for(i = 0; i < row->order_size; i++) {
+    size_t value_len;
+
+    value_len = rasqal_literal_sort_key(row->order_values[i], NULL, NULL);
+    if(!value_len)
+      return 0;
+    len += value_len;
+  }
+
+  row->order_key = RASQAL_MALLOC(unsigned char*, len);
+  if(!row->order_key)
+    return 1;
+
+  row->order_key_len = len;
+  row->order_key_exact_len = len;
+
+  offset = 0;
+  for(i = 0; i < row->order_size; i++) {
+    unsigned char* key = row->order_key + offset;
+    rasqal_expression* e;
+    size_t value_len;
+
+    value_len = rasqal_literal_sort_key(row->order_values[i], key, &exact);
+    if(!exact && row->order_key_exact_len == len)
+      row->order_key_exact_len = offset;
+
+    e = (rasqal_expression*)raptor_sequence_get_at(order_seq, i);
+    if(e && e->op == RASQAL_EXPR_ORDER_COND_DESC && row->order_values[i]) {
+      size_t j;
+
+      for(j = 0; j < value_len; j++)
+        key[j] = RASQAL_GOOD_CAST(unsigned char, ~key[j]);
+    }
+
+    offset += value_len;
+  }
+
   return 0;
 }
+
+
+/* rows in each block sorted by one task before the blocks are merged */
+#define RASQAL_ROWSORT_BLOCK_SIZE 1024
+
+/* maximum number of threads used by rasqal_engine_rowsort_sort_rows() */
+#define RASQAL_ROWSORT_MAX_THREADS 64
+
+typedef int (*rasqal_rowsort_compare_func)(rowsort_compare_data* rcd,
+                                           rasqal_row* row_a,
+                                           rasqal_row* row_b);
+
+/*
+ * One pass of a merge sort split into tasks that are the same for any
+ * number of threads so the result never depends on the thread count.
+ */
+typedef struct
+{
+  rowsort_compare_data* rcd;
+  rasqal_rowsort_compare_func compare;
+
+  /* input and output rows of this pass */
+  rasqal_row** src;
+  rasqal_row** dst;
+  int size;
+
+  /* length of the sorted runs merged in pairs or 0 to sort blocks */
+  int width;
+
+  int tasks_count;
+  int next_task;
+
+  /* number of threads; @lock is only used with more than one */
+  int threads;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+} rowsort_pass;
+
+
+/* order by values for finding duplicates then by offset */
+static int
+rasqal_engine_rowsort_compare_values(rowsort_compare_data* rcd,
+                                     rasqal_row* row_a, rasqal_row* row_b)
+{
+  int result;
+
+  result = rasqal_literal_array_compare(row_a->values, row_b->values, NULL,
+                                        row_a->size, rcd->compare_flags);
+  if(!result)
+    result = row_a->offset - row_b->offset;
+
+  return result;
+}
+
+
+static int
+rasqal_engine_rowsort_compare_order(rowsort_compare_data* rcd,
+                                    rasqal_row* row_a, rasqal_row* row_b)
+{
+  if(rcd->is_distinct) {
+    /* as rasqal_engine_rowsort_row_compare(): no sort keys */
+    int result;
+
+    result = rasqal_literal_array_compare(row_a->order_values,
+                                          row_b->order_values,
+                                          rcd->order_conditions_sequence,
+                                          row_a->order_size,
+                                          rcd->compare_flags);
+    if(!result)
+      result = row_a->offset - row_b->offset;
+
+    return result;
+  }
+
+  return rasqal_engine_rowsort_compare_rows(rcd->order_conditions_sequence,
+                                            rcd->compare_flags,
+                                            row_a, row_b);
+}
+
+
+/* merge sorted in[lo..mid) and in[mid..hi) into out[lo..hi) */
+static void
+rasqal_engine_rowsort_merge(rowsort_pass* pass,
+                            rasqal_row** in, rasqal_row** out,
+                            int lo, int mid, int hi)
+{
+  int i = lo;
+  int j = mid;
+  int k = lo;
+
+  /* take from the left run unless the right row is first: stable */
+  while(i < mid && j < hi) {
+    if(pass->compare(pass->rcd, in[j], in[i]) < 0)
+      out[k++] = in[j++];
+    else
+      out[k++] = in[i++];
+  }
+
+  while(i < mid)
+    out[k++] = in[i++];
+  while(j < hi)
+    out[k++] = in[j++];
+}
+
+
+static void
+rasqal_engine_rowsort_run_task(rowsort_pass* pass, int task)
+{
+  if(!pass->width) {
+    /* bottom up merge sort of one block of src using dst for runs */
+    int lo = task * RASQAL_ROWSORT_BLOCK_SIZE;
+    int hi = lo + RASQAL_ROWSORT_BLOCK_SIZE;
+    rasqal_row** in = pass->src;
+    rasqal_row** out = pass->dst;
+    int width;
+
+    if(hi > pass->size)
+      hi = pass->size;
+
+    for(width = 1; width < hi - lo; width *= 2) {
+      rasqal_row** tmp;
+      int start;
+
+      for(start = lo; start < hi; start += 2 * width) {
+        int mid = start + width;
+        int end = start + 2 * width;
+
+        if(mid > hi)
+          mid = hi;
+        if(end > hi)
+          end = hi;
+        rasqal_engine_rowsort_merge(pass, in, out, start, mid, end);
+      }
+
+      tmp = in; in = out; out = tmp;
+    }
+
+    if(in != pass->src)
+      memcpy(&pass->src[lo], &in[lo],
+             RASQAL_GOOD_CAST(size_t, hi - lo) * sizeof(rasqal_row*));
+  } else {
+    int lo = task * 2 * pass->width;
+    int mid = lo + pass->width;
+    int hi = lo + 2 * pass->width;
+
+    if(mid > pass->size)
+      mid = pass->size;
+    if(hi > pass->size)
+      hi = pass->size;
+    rasqal_engine_rowsort_merge(pass, pass->src, pass->dst, lo, mid, hi);
+  }
+}
+
+
+static void*
+rasqal_engine_rowsort_pass_worker(void* user_data)
+{
+  rowsort_pass* pass = (rowsort_pass*)user_data;
+
+  while(1) {
+    int task;
+
+#ifdef HAVE_PTHREAD
+    if(pass->threads > 1)
+      pthread_mutex_lock(&pass->lock);
+#endif
+    task = pass->next_task++;
+#ifdef HAVE_PTHREAD
+    if(pass->threads > 1)
+      pthread_mutex_unlock(&pass->lock);
+#endif
+
+    if(task >= pass->tasks_count)
+      break;
+
+    rasqal_engine_rowsort_run_task(pass, task);
+  }
+
+  return NULL;
+}
+
+
+/* run all tasks of a pass on the pass threads including this one */
+static void
+rasqal_engine_rowsort_run_pass(rowsort_pass* pass)
+{
+#ifdef HAVE_PTHREAD
+  pthread_t thread_ids[RASQAL_ROWSORT_MAX_THREADS];
+  int threads = pass->threads;
+  int started = 0;
+  int i;
+#endif
+
+  pass->next_task = 0;
+
+#ifdef HAVE_PTHREAD
+  if(threads > pass->tasks_count)
+    threads = pass->tasks_count;
+
+  /* if a thread cannot be started the others do its tasks */
+  for(i = 1; i < threads; i++) {
+    if(pthread_create(&thread_ids[started], NULL,
+                      rasqal_engine_rowsort_pass_worker, pass))
+      break;
+    started++;
+  }
+#endif
+
+  rasqal_engine_rowsort_pass_worker(pass);
+
+#ifdef HAVE_PTHREAD
+  for(i = 0; i < started; i++)
+    pthread_join(thread_ids[i], NULL);
+#endif
+}
+
+
+/*
+ * rasqal_engine_rowsort_sort_array:
+ * @pass: pass with comparison and threads set
+ * @rows: rows to sort
+ * @buffer: buffer of the same size as @rows
+ * @size: number of rows
+ *
+ * INTERNAL - Merge sort an array of rows
+ *
+ * Return value: @rows or @buffer, whichever holds the sorted rows
+ */
+static rasqal_row**
+rasqal_engine_rowsort_sort_array(rowsort_pass* pass,
+                                 rasqal_row** rows, rasqal_row** buffer,
+                                 int size)
+{
+  int width;
+
+  pass->src = rows;
+  pass->dst = buffer;
+  pass->size = size;
+
+  pass->width = 0;
+  pass->tasks_count = (size + RASQAL_ROWSORT_BLOCK_SIZE - 1) /
+                      RASQAL_ROWSORT_BLOCK_SIZE;
+  rasqal_engine_rowsort_run_pass(pass);
+
+  for(width = RASQAL_ROWSORT_BLOCK_SIZE; width < size; width *= 2) {
+    rasqal_row** tmp;
+
+    pass->width = width;
+    pass->tasks_count = (size + 2 * width - 1) / (2 * width);
+    rasqal_engine_rowsort_run_pass(pass);
+
+    tmp = pass->src; pass->src = pass->dst; pass->dst = tmp;
+  }
+
+  return pass->src;
+}
+
+
+/*
+ * rasqal_engine_rowsort_remove_duplicates:
+ * @rcd: compare data
+ * @in: rows sorted by rasqal_engine_rowsort_compare_values()
+ * @size: number of rows
+ * @out: array to store the first row of each set of equal rows
+ *
+ * INTERNAL - Remove duplicate rows like a distinct rowsort map
+ *
+ * The duplicates are freed.
+ *
+ * Return value: number of rows in @out
+ */
+static int
+rasqal_engine_rowsort_remove_duplicates(rowsort_compare_data* rcd,
+                                        rasqal_row** in, int size,
+                                        rasqal_row** out)
+{
+  int count = 0;
+  /* offset in @out of the first row comparing equal to the current row */
+  int group = 0;
+  int i;
+
+  for(i = 0; i < size; i++) {
+    rasqal_row* row = in[i];
+    int duplicate = 0;
+    int j;
+
+    if(count && rasqal_literal_array_compare(out[group]->values, row->values,
+                                             NULL, row->size,
+                                             rcd->compare_flags))
+      group = count;
+
+    /* rows in a group are in offset order so the first seen is kept */
+    for(j = group; j < count; j++) {
+      if(rasqal_literal_array_equals(out[j]->values, row->values, row->size)) {
+        duplicate = 1;
+        break;
+      }
+    }
+
+    if(duplicate)
+      rasqal_free_row(row);
+    else
+      out[count++] = row;
+  }
+
+  return count;
+}
+
+
+/*
+ * rasqal_engine_rowsort_get_threads:
+ * @rows: array of rows with order values
+ * @size: number of rows
+ * @is_distinct: non-0 to remove duplicate rows
+ * @threads: maximum number of threads to use
+ *
+ * INTERNAL - Get the number of threads rasqal_engine_rowsort_sort_rows() sorts with
+ *
+ * Without DISTINCT, a row with no sort key or an inexact one needs
+ * literal comparisons that may create literals so the rows are
+ * sorted with one thread.
+ *
+ * Return value: number of threads
+ */
+int
+rasqal_engine_rowsort_get_threads(rasqal_row** rows, int size,
+                                  int is_distinct, int threads)
+{
+  int i;
+
+  if(threads > RASQAL_ROWSORT_MAX_THREADS)
+    threads = RASQAL_ROWSORT_MAX_THREADS;
+
+  if(threads > 1 && !is_distinct) {
+    for(i = 0; i < size; i++) {
+      if(!rows[i]->order_key ||
+         rows[i]->order_key_exact_len < rows[i]->order_key_len)
+        return 1;
+    }
+  }
+
+  return threads;
+}
+
+
+/**
+ * rasqal_engine_rowsort_sort_rows:
+ * @rows: array of rows with order values and unique offsets
+ * @size: number of rows
+ * @is_distinct: non-0 to remove duplicate rows
+ * @compare_flags: literal compare flags
+ * @order_conditions_sequence: order conditions sequence
+ * @threads: maximum number of threads to use
+ * @seq: sequence to add the sorted rows to
+ *
+ * INTERNAL - Sort rows into the same order as a rowsort map
+ *
+ * Rows are merge sorted in blocks which are then merged in pairs.
+ * The blocks and merges are the same for any number of threads so
+ * the order never depends on @threads.  Rows are compared by order
+ * values then offset so the sort is stable.  With @is_distinct rows
+ * are first sorted by values to remove duplicates, keeping the first.
+ *
+ * Comparisons only use more than one thread when they never create
+ * literals: when all rows have exact sort keys or for DISTINCT which
+ * compares RDF terms.
+ *
+ * The rows become owned by @seq or are freed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_engine_rowsort_sort_rows(rasqal_row** rows, int size,
+                                int is_distinct, int compare_flags,
+                                raptor_sequence* order_conditions_sequence,
+                                int threads, raptor_sequence* seq)
+{
+  rowsort_compare_data rcd;
+  rowsort_pass pass;
+  rasqal_row** buffer;
+  rasqal_row** sorted = rows;
+  int i;
+  int rc = 0;
+
+  if(!size)
+    return 0;
+
+  buffer = RASQAL_MALLOC(rasqal_row**,
+                         RASQAL_GOOD_CAST(size_t, size) * sizeof(rasqal_row*));
+  if(!buffer) {
+    for(i = 0; i < size; i++)
+      rasqal_free_row(rows[i]);
+    return 1;
+  }
+
+  /* same comparisons as rasqal_engine_new_rowsort_map() */
+  rcd.is_distinct = is_distinct;
+  if(is_distinct) {
+    compare_flags &= ~RASQAL_COMPARE_XQUERY;
+    compare_flags |= RASQAL_COMPARE_RDF;
+  }
+  rcd.compare_flags = compare_flags;
+  rcd.order_conditions_sequence = order_conditions_sequence;
+
+  pass.rcd = &rcd;
+  pass.threads = rasqal_engine_rowsort_get_threads(rows, size, is_distinct,
+                                                   threads);
+#ifdef HAVE_PTHREAD
+  if(pass.threads > 1 && pthread_mutex_init(&pass.lock, NULL))
+    pass.threads = 1;
+#endif
+
+  if(is_distinct) {
+    rasqal_row** other;
+
+    pass.compare = rasqal_engine_rowsort_compare_values;
+    sorted = rasqal_engine_rowsort_sort_array(&pass, rows, buffer, size);
+    other = (sorted == rows) ? buffer : rows;
+    size = rasqal_engine_rowsort_remove_duplicates(&rcd, sorted, size, other);
+    sorted = other;
+  }
+
+  if(order_conditions_sequence) {
+    pass.compare = rasqal_engine_rowsort_compare_order;
+    sorted = rasqal_engine_rowsort_sort_array(&pass, sorted,
+                                              (sorted == rows) ? buffer : rows,
+                                              size);
+  }
+
+#ifdef HAVE_PTHREAD
+  if(pass.threads > 1)
+    pthread_mutex_destroy(&pass.lock);
+#endif
+
+  for(i = 0; i < size; i++) {
+    /* on failure the sequence frees the row */
+    if(raptor_sequence_push(seq, sorted[i]))
+      rc = 1;
+  }
+
+  RASQAL_FREE(rasqal_row**, buffer);
+
+  return rc;
+}
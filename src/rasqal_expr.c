@@ -69,7 +69,7 @@ rasqal_new_0op_expression(rasqal_world* world, rasqal_op op)
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -115,7 +115,7 @@ rasqal_new_1op_expression(rasqal_world* world, rasqal_op op,
       goto tidy;
   }
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -164,7 +164,7 @@ rasqal_new_2op_expression(rasqal_world* world,
   if(!world || !arg1 || !arg2)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -211,7 +211,7 @@ rasqal_new_3op_expression(rasqal_world* world,
   if(!world || !arg1 || !arg2) /* arg3 may be NULL */
     goto tidy;
 
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -263,7 +263,7 @@ rasqal_new_4op_expression(rasqal_world* world,
   if(!world || !arg1 || !arg2 || !arg3) /* arg4 may be NULL */
     goto tidy;
 
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -315,7 +315,7 @@ rasqal_new_string_op_expression(rasqal_world* world,
   if(!world || !arg1 || !literal)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -352,7 +352,7 @@ rasqal_new_literal_expression(rasqal_world* world, rasqal_literal *literal)
   if(!world || !literal)
     return NULL;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {  
     e->usage = 1;
     e->world = world;
@@ -379,7 +379,7 @@ rasqal_new_function_expression_common(rasqal_world* world,
   if(!world || (arg1 && args) || (name && !args)|| (!name && args))
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -481,7 +481,7 @@ rasqal_new_cast_expression(rasqal_world* world, raptor_uri* name,
   if(!world || !name || !value)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -522,7 +522,7 @@ rasqal_new_expr_seq_expression(rasqal_world* world,
   if(!world || !args)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -561,7 +561,7 @@ rasqal_new_set_expression(rasqal_world* world, rasqal_op op,
   if(!world || !arg1 || !args)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -606,7 +606,7 @@ rasqal_new_group_concat_expression(rasqal_world* world,
   if(!world || !args)
     goto tidy;
   
-  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(*e));
+  e = RASQAL_CALLOC(rasqal_expression*, 1, sizeof(rasqal_expression_internal));
   if(e) {
     e->usage = 1;
     e->world = world;
@@ -789,6 +789,32 @@ rasqal_expression_clear(rasqal_expression* e)
 }
 
 
+/*
+ * rasqal_expression_clear_internal:
+ * @e: expression made by an expression constructor
+ *
+ * INTERNAL - Free the execution fields of an expression
+ *
+ * Not done by rasqal_expression_clear() since a statically declared
+ * #rasqal_expression has no #rasqal_expression_internal fields.
+ */
+static void
+rasqal_expression_clear_internal(rasqal_expression* e)
+{
+  rasqal_expression_internal* ei = RASQAL_EXPRESSION_INTERNAL(e);
+
+  if(ei->in_set) {
+    rasqal_free_in_set(ei->in_set);
+    ei->in_set = NULL;
+  }
+
+  if(ei->memo) {
+    rasqal_free_expression_memo(ei->memo);
+    ei->memo = NULL;
+  }
+}
+
+
 /**
  * rasqal_new_expression_from_expression:
  * @e: #rasqal_expression object to copy or NULL
@@ -824,6 +850,7 @@ rasqal_free_expression(rasqal_expression* e)
   if(--e->usage)
     return;
 
+  rasqal_expression_clear_internal(e);
   rasqal_expression_clear(e);
   RASQAL_FREE(rasqal_expression, e);
 }
@@ -1819,6 +1846,7 @@ rasqal_expression_convert_to_literal(rasqal_expression* e, rasqal_literal* l)
   int usage=e->usage;
 
   /* update expression 'e' in place */
+  rasqal_expression_clear_internal(e);
   rasqal_expression_clear(e);
 
   memset(e, 0, sizeof(rasqal_expression));
@@ -1858,6 +1886,28 @@ rasqal_expression_mentions_variable(rasqal_expression* e, rasqal_variable* v)
 }
 
 
+/*
+ * rasqal_expression_get_conjuncts:
+ * @e: expression
+ * @seq: sequence of #rasqal_expression to add to
+ *
+ * INTERNAL - Add new references to the operands of a tree of AND expressions to a sequence
+ *
+ * An expression that is not an AND is added as the only conjunct.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_expression_get_conjuncts(rasqal_expression* e, raptor_sequence* seq)
+{
+  if(e->op == RASQAL_EXPR_AND)
+    return rasqal_expression_get_conjuncts(e->arg1, seq) ||
+           rasqal_expression_get_conjuncts(e->arg2, seq);
+
+  return raptor_sequence_push(seq, rasqal_new_expression_from_expression(e));
+}
+
+
 /*
  * Deep copy a sequence of rasqal_expression to a new one.
  */
@@ -2312,7 +2362,8 @@ rasqal_expression_convert_aggregate_to_variable(rasqal_expression* e_in,
   world = e_in->world;
   
   if(e_out) {
-    *e_out = RASQAL_MALLOC(rasqal_expression*, sizeof(**e_out));
+    *e_out = RASQAL_MALLOC(rasqal_expression*,
+                           sizeof(rasqal_expression_internal));
     if(!*e_out)
       goto tidy;
   }
@@ -2323,12 +2374,13 @@ rasqal_expression_convert_aggregate_to_variable(rasqal_expression* e_in,
   
   if(e_out) {
     /* if e_out is not NULL, copy entire contents to new expression */
-    memcpy(*e_out, e_in, sizeof(**e_out));
+    memcpy(*e_out, e_in, sizeof(rasqal_expression_internal));
 
     /* ... and zero out old expression */
-    memset(e_in, 0, sizeof(*e_in));
+    memset(e_in, 0, sizeof(rasqal_expression_internal));
   } else {
     /* Otherwise just destroy the old aggregate fields */
+    rasqal_expression_clear_internal(e_in);
     rasqal_expression_clear(e_in);
   }
   
@@ -2471,6 +2523,138 @@ int main(int argc, char *argv[]);
 #define assert_match(function, result, string) do { if(strcmp(result, string)) { fprintf(stderr, #function " failed - returned %s, expected %s\n", result, string); exit(1); } } while(0)
 
 
+#define SUBSTR_NO_LENGTH -999
+
+static const struct {
+  const char* string;
+  int start;
+  int length; /* or SUBSTR_NO_LENGTH when no third argument */
+  const char* expected;
+} substr_test_data[] = {
+  /* ASCII */
+  { "hello", 1, SUBSTR_NO_LENGTH, "hello" },
+  { "hello", 2, 3, "ell" },
+  { "hello", 0, SUBSTR_NO_LENGTH, "hello" },
+  { "hello", 0, 3, "he" },
+  { "hello", -1, 3, "h" },
+  { "hello", -5, 3, "" },
+  { "hello", 3, 0, "" },
+  { "hello", 2, -1, "" },
+  { "hello", 5, SUBSTR_NO_LENGTH, "o" },
+  { "hello", 6, SUBSTR_NO_LENGTH, "" },
+  { "hello", 10, 2, "" },
+  /* UTF-8 */
+  { "h\xC3\xA9llo w\xC3\xB6rld", 2, 4, "\xC3\xA9llo" },
+  { "h\xC3\xA9llo w\xC3\xB6rld", 0, 3, "h\xC3\xA9" },
+  { "h\xC3\xA9llo w\xC3\xB6rld", -1, 3, "h" },
+  { "h\xC3\xA9llo w\xC3\xB6rld", 8, SUBSTR_NO_LENGTH, "\xC3\xB6rld" },
+  { "h\xC3\xA9llo w\xC3\xB6rld", 5, 0, "" },
+  { "h\xC3\xA9llo w\xC3\xB6rld", 12, 1, "" },
+  { "\xE2\x82\xAC", 1, 1, "\xE2\x82\xAC" },
+  { "\xE2\x82\xAC", 2, SUBSTR_NO_LENGTH, "" },
+  { "", 1, SUBSTR_NO_LENGTH, "" },
+  { NULL, 0, 0, NULL }
+};
+
+static const struct {
+  const char* string;
+  int chars;
+} strlen_test_data[] = {
+  { "hello", 5 },
+  { "h\xC3\xA9llo w\xC3\xB6rld", 11 },
+  { "\xE2\x82\xAC", 1 },
+  { "", 0 },
+  { NULL, 0 }
+};
+
+
+static rasqal_expression*
+make_string_expression(rasqal_world* world, const char* str)
+{
+  size_t len = strlen(str);
+  unsigned char* s;
+
+  s = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!s)
+    return NULL;
+  memcpy(s, str, len + 1);
+
+  return rasqal_new_literal_expression(world,
+                                       rasqal_new_string_literal(world, s,
+                                                                 NULL, NULL,
+                                                                 NULL));
+}
+
+
+static int
+string_function_tests(rasqal_world* world,
+                      rasqal_evaluation_context* eval_context,
+                      const char* program)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; strlen_test_data[i].string; i++) {
+    rasqal_expression* expr;
+    rasqal_literal* result;
+    int error = 0;
+    int chars = -1;
+
+    expr = rasqal_new_1op_expression(world, RASQAL_EXPR_STRLEN,
+                                     make_string_expression(world, strlen_test_data[i].string));
+    result = rasqal_expression_evaluate2(expr, eval_context, &error);
+    if(result && !error)
+      chars = rasqal_literal_as_integer(result, &error);
+
+    if(error || chars != strlen_test_data[i].chars) {
+      fprintf(stderr, "%s: STRLEN test %d FAILED returning %d, expected %d\n",
+              program, i, chars, strlen_test_data[i].chars);
+      failures++;
+    }
+
+    if(result)
+      rasqal_free_literal(result);
+    rasqal_free_expression(expr);
+  }
+
+  for(i = 0; substr_test_data[i].string; i++) {
+    rasqal_expression* expr;
+    rasqal_expression* length_expr = NULL;
+    rasqal_literal* result;
+    const char* str = NULL;
+    int error = 0;
+
+    if(substr_test_data[i].length != SUBSTR_NO_LENGTH)
+      length_expr = rasqal_new_literal_expression(world,
+        rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER,
+                                   substr_test_data[i].length));
+
+    expr = rasqal_new_3op_expression(world, RASQAL_EXPR_SUBSTR,
+      make_string_expression(world, substr_test_data[i].string),
+      rasqal_new_literal_expression(world,
+        rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER,
+                                   substr_test_data[i].start)),
+      length_expr);
+    result = rasqal_expression_evaluate2(expr, eval_context, &error);
+    if(result && !error)
+      str = (const char*)rasqal_literal_as_string(result);
+
+    if(error || !str || strcmp(str, substr_test_data[i].expected)) {
+      fprintf(stderr,
+              "%s: SUBSTR test %d FAILED returning '%s', expected '%s'\n",
+              program, i, str ? str : "NULL", substr_test_data[i].expected);
+      failures++;
+    }
+
+    if(result)
+      rasqal_free_literal(result);
+    rasqal_free_expression(expr);
+  }
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -2532,6 +2716,9 @@ main(int argc, char *argv[])
   if(result)
     rasqal_free_literal(result);
 
+  if(string_function_tests(world, eval_context, program))
+    error = 1;
+
   rasqal_xsd_finish(world);
 
   rasqal_uri_finish(world);
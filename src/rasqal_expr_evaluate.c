@@ -478,6 +478,245 @@ rasqal_expression_evaluate_sameterm(rasqal_expression *e,
 }
 
 
+/*
+ * Prepared set of the constant members of an IN or NOT IN list
+ *
+ * rasqal_literal_equals_flags() never matches or fails comparing a URI
+ * with a non-URI so a URI is looked up in @uris and any other value is
+ * only compared to @others, in list order so errors are the same.
+ * With XQuery comparisons, integers compare by value so when all the
+ * other members are xsd:integer an integer value is looked up in
+ * @integers.
+ */
+struct rasqal_in_set_s {
+  /* open addressing hash tables of shared literals; sizes are powers
+   * of 2 or 0 if there are no members */
+  rasqal_literal** uris;
+  unsigned long uris_size;
+  rasqal_literal** integers;
+  unsigned long integers_size;
+
+  /* non-URI members in list order (shared) */
+  rasqal_literal** others;
+  int others_count;
+};
+
+
+void
+rasqal_free_in_set(rasqal_in_set* set)
+{
+  if(set->uris)
+    RASQAL_FREE(rasqal_literal**, set->uris);
+  if(set->integers)
+    RASQAL_FREE(rasqal_literal**, set->integers);
+  if(set->others)
+    RASQAL_FREE(rasqal_literal**, set->others);
+
+  RASQAL_FREE(rasqal_in_set, set);
+}
+
+
+static unsigned long
+rasqal_in_set_hash_literal(rasqal_literal* l)
+{
+  unsigned long hash;
+
+  if(l->type == RASQAL_LITERAL_URI) {
+    size_t len;
+    const unsigned char* s = raptor_uri_as_counted_string(l->value.uri, &len);
+
+    /* FNV-1a */
+    hash = 2166136261UL;
+    while(len--) {
+      hash ^= *s++;
+      hash *= 16777619UL;
+    }
+  } else {
+    rasqal_int64 i = l->value.integer;
+
+    hash = RASQAL_GOOD_CAST(unsigned long, i ^ (i >> 32)) * 2654435761UL;
+  }
+
+  return hash;
+}
+
+
+static int
+rasqal_in_set_literal_equals(rasqal_literal* l1, rasqal_literal* l2)
+{
+  if(l1->type == RASQAL_LITERAL_URI)
+    return raptor_uri_equals(l1->value.uri, l2->value.uri);
+
+  return l1->value.integer == l2->value.integer;
+}
+
+
+/* find @l in a hash table or the empty slot to add it at */
+static rasqal_literal**
+rasqal_in_set_find(rasqal_literal** table, unsigned long size,
+                   rasqal_literal* l)
+{
+  unsigned long i = rasqal_in_set_hash_literal(l) & (size - 1);
+
+  while(table[i] && !rasqal_in_set_literal_equals(l, table[i]))
+    i = (i + 1) & (size - 1);
+
+  return &table[i];
+}
+
+
+static rasqal_literal**
+rasqal_new_in_set_table(raptor_sequence* args, rasqal_literal_type type,
+                        unsigned long* size_p)
+{
+  rasqal_literal** table;
+  unsigned long size = 0;
+  unsigned long count = 0;
+  rasqal_expression* arg_e;
+  int i;
+
+  for(i = 0; (arg_e = (rasqal_expression*)raptor_sequence_get_at(args, i)); i++) {
+    if(arg_e->literal->type == type)
+      count++;
+  }
+
+  *size_p = 0;
+  if(!count)
+    return NULL;
+
+  /* at most half full */
+  for(size = 8; size < count * 2; size *= 2)
+    ;
+
+  table = RASQAL_CALLOC(rasqal_literal**, size, sizeof(rasqal_literal*));
+  if(!table)
+    return NULL;
+
+  for(i = 0; (arg_e = (rasqal_expression*)raptor_sequence_get_at(args, i)); i++) {
+    if(arg_e->literal->type == type)
+      *rasqal_in_set_find(table, size, arg_e->literal) = arg_e->literal;
+  }
+
+  *size_p = size;
+  return table;
+}
+
+
+/*
+ * rasqal_expression_prepare_in_set:
+ * @e: expression
+ *
+ * INTERNAL - Prepare a set of the members of an IN or NOT IN expression
+ *
+ * Does nothing unless @e is #RASQAL_EXPR_IN or #RASQAL_EXPR_NOT_IN
+ * with only constant literals in the list.  The set is used by
+ * rasqal_expression_evaluate2() instead of evaluating the list.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_expression_prepare_in_set(rasqal_expression* e)
+{
+  rasqal_in_set* set;
+  rasqal_expression* arg_e;
+  int integers_only = 1;
+  int size;
+  int i;
+
+  if((e->op != RASQAL_EXPR_IN && e->op != RASQAL_EXPR_NOT_IN) ||
+     RASQAL_EXPRESSION_INTERNAL(e)->in_set)
+    return 0;
+
+  size = raptor_sequence_size(e->args);
+  for(i = 0; i < size; i++) {
+    arg_e = (rasqal_expression*)raptor_sequence_get_at(e->args, i);
+    if(!arg_e || arg_e->op != RASQAL_EXPR_LITERAL || !arg_e->literal ||
+       arg_e->literal->type == RASQAL_LITERAL_VARIABLE)
+      return 0;
+
+    if(arg_e->literal->type != RASQAL_LITERAL_URI &&
+       arg_e->literal->type != RASQAL_LITERAL_INTEGER)
+      integers_only = 0;
+  }
+
+  set = RASQAL_CALLOC(rasqal_in_set*, 1, sizeof(*set));
+  if(!set)
+    return 1;
+
+  set->others = RASQAL_CALLOC(rasqal_literal**, RASQAL_GOOD_CAST(size_t, size) + 1,
+                              sizeof(rasqal_literal*));
+  if(!set->others)
+    goto failed;
+
+  for(i = 0; i < size; i++) {
+    arg_e = (rasqal_expression*)raptor_sequence_get_at(e->args, i);
+    if(arg_e->literal->type != RASQAL_LITERAL_URI)
+      set->others[set->others_count++] = arg_e->literal;
+  }
+
+  set->uris = rasqal_new_in_set_table(e->args, RASQAL_LITERAL_URI,
+                                      &set->uris_size);
+  if(!set->uris && set->others_count < size)
+    goto failed;
+
+  if(integers_only && set->others_count) {
+    set->integers = rasqal_new_in_set_table(e->args, RASQAL_LITERAL_INTEGER,
+                                            &set->integers_size);
+    if(!set->integers)
+      goto failed;
+  }
+
+  RASQAL_EXPRESSION_INTERNAL(e)->in_set = set;
+  return 0;
+
+  failed:
+  rasqal_free_in_set(set);
+  return 1;
+}
+
+
+/*
+ * rasqal_in_set_contains:
+ * @set: prepared set
+ * @l: value
+ * @flags: comparison flags
+ * @error_p: pointer to error flag
+ *
+ * INTERNAL - Check if a value is equal to a member of a prepared set
+ *
+ * Return value: non-0 if found
+ */
+static int
+rasqal_in_set_contains(rasqal_in_set* set, rasqal_literal* l, int flags,
+                       int* error_p)
+{
+  int i;
+
+  if(l->type == RASQAL_LITERAL_URI)
+    return (set->uris && *rasqal_in_set_find(set->uris, set->uris_size, l));
+
+  if(set->integers &&
+     (flags & RASQAL_COMPARE_XQUERY) && !(flags & RASQAL_COMPARE_RDF) &&
+     (l->type == RASQAL_LITERAL_INTEGER ||
+      l->type == RASQAL_LITERAL_INTEGER_SUBTYPE))
+    return (*rasqal_in_set_find(set->integers, set->integers_size, l) != NULL);
+
+  for(i = 0; i < set->others_count; i++) {
+    int found;
+
+    found = (rasqal_literal_equals_flags(l, set->others[i], flags,
+                                         error_p) != 0);
+    if(error_p && *error_p)
+      return 0;
+
+    if(found)
+      return 1;
+  }
+
+  return 0;
+}
+
+
 /* 
  * rasqal_expression_evaluate_in_set:
  * @e: The expression to evaluate.
@@ -494,6 +733,7 @@ rasqal_expression_evaluate_in_set(rasqal_expression *e,
                                   int *error_p)
 {
   rasqal_world* world = eval_context->world;
+  rasqal_in_set* set = RASQAL_EXPRESSION_INTERNAL(e)->in_set;
   int size = raptor_sequence_size(e->args);
   int i;
   rasqal_literal* l1;
@@ -502,6 +742,13 @@ rasqal_expression_evaluate_in_set(rasqal_expression *e,
   l1 = rasqal_expression_evaluate2(e->arg1, eval_context, error_p);
   if((error_p && *error_p) || !l1)
     goto failed;
+
+  if(set) {
+    found = rasqal_in_set_contains(set, l1, eval_context->flags, error_p);
+    if(error_p && *error_p)
+      goto failed;
+    size = 0;
+  }
   
   for(i = 0; i < size; i++) {
     rasqal_expression* arg_e;
@@ -887,21 +1134,184 @@ rasqal_expression_evaluate_bnode_constructor(rasqal_expression *e,
 }
 
 
-/**
- * rasqal_expression_evaluate2:
- * @e: The expression to evaluate.
- * @eval_context: expression context
- * @error_p: pointer to error return flag
- * 
- * Evaluate a #rasqal_expression tree in the context of a
- * #rasqal_evaluation_context to give a #rasqal_literal result or error.
- * 
- * Return value: a #rasqal_literal value or NULL (a valid value).  @error_p is set to non-0 on failure.  
- **/
-rasqal_literal*
-rasqal_expression_evaluate2(rasqal_expression* e,
-                            rasqal_evaluation_context* eval_context,
-                            int *error_p)
+/*
+ * Per-row result of a deterministic expression shared by equal
+ * subexpressions of a query
+ *
+ * The result is reused while every variable the expression mentions
+ * has the same value literal object as when it was made.  References
+ * to those literals are held so that other values cannot be made at
+ * the same addresses.
+ *
+ * A memo is not locked.  It belongs to the expressions of one
+ * prepared query, which only one query uses at a time: the world
+ * query cache does not share a prepared form while it is in use.
+ * Queries sharing it in turn reset the memos when they execute.
+ */
+struct rasqal_expression_memo_s {
+  int usage;
+
+  /* variables mentioned by the expression (shared) */
+  rasqal_variable** variables;
+  int variables_count;
+
+  /* values of @variables when @result was made */
+  rasqal_literal** values;
+
+  /* evaluation context (shared) and its flags when @result was made */
+  rasqal_evaluation_context* eval_context;
+  int flags;
+
+  /* result or NULL when there is none */
+  rasqal_literal* result;
+};
+
+
+/*
+ * rasqal_new_expression_memo:
+ * @variables: array of variables mentioned by the expression
+ * @variables_count: size of @variables
+ *
+ * INTERNAL - Constructor - make a per-row memo for an expression
+ *
+ * Takes ownership of the @variables array but not the variables.
+ *
+ * Return value: new memo or NULL on failure
+ */
+rasqal_expression_memo*
+rasqal_new_expression_memo(rasqal_variable** variables, int variables_count)
+{
+  rasqal_expression_memo* memo;
+
+  memo = RASQAL_CALLOC(rasqal_expression_memo*, 1, sizeof(*memo));
+  if(!memo) {
+    RASQAL_FREE(rasqal_variable**, variables);
+    return NULL;
+  }
+
+  memo->values = RASQAL_CALLOC(rasqal_literal**,
+                               RASQAL_GOOD_CAST(size_t, variables_count) + 1,
+                               sizeof(rasqal_literal*));
+  if(!memo->values) {
+    RASQAL_FREE(rasqal_variable**, variables);
+    RASQAL_FREE(rasqal_expression_memo, memo);
+    return NULL;
+  }
+
+  memo->usage = 1;
+  memo->variables = variables;
+  memo->variables_count = variables_count;
+
+  return memo;
+}
+
+
+/*
+ * rasqal_new_expression_memo_from_expression_memo:
+ * @memo: memo
+ *
+ * INTERNAL - Copy Constructor - add a reference to a shared memo
+ *
+ * Return value: @memo
+ */
+rasqal_expression_memo*
+rasqal_new_expression_memo_from_expression_memo(rasqal_expression_memo* memo)
+{
+  memo->usage++;
+  return memo;
+}
+
+
+static void
+rasqal_expression_memo_clear(rasqal_expression_memo* memo)
+{
+  int i;
+
+  for(i = 0; i < memo->variables_count; i++) {
+    if(memo->values[i]) {
+      rasqal_free_literal(memo->values[i]);
+      memo->values[i] = NULL;
+    }
+  }
+
+  if(memo->result) {
+    rasqal_free_literal(memo->result);
+    memo->result = NULL;
+  }
+}
+
+
+/*
+ * rasqal_expression_memo_reset:
+ * @memo: memo
+ *
+ * INTERNAL - Forget the result and the value references of a memo
+ */
+void
+rasqal_expression_memo_reset(rasqal_expression_memo* memo)
+{
+  rasqal_expression_memo_clear(memo);
+  memo->eval_context = NULL;
+}
+
+
+void
+rasqal_free_expression_memo(rasqal_expression_memo* memo)
+{
+  if(--memo->usage)
+    return;
+
+  rasqal_expression_memo_clear(memo);
+
+  RASQAL_FREE(rasqal_literal**, memo->values);
+  RASQAL_FREE(rasqal_variable**, memo->variables);
+  RASQAL_FREE(rasqal_expression_memo, memo);
+}
+
+
+/* return the memo result (shared) if it was made with the current values */
+static rasqal_literal*
+rasqal_expression_memo_get(rasqal_expression_memo* memo,
+                           rasqal_evaluation_context* eval_context)
+{
+  int i;
+
+  if(!memo->result || memo->eval_context != eval_context ||
+     memo->flags != eval_context->flags)
+    return NULL;
+
+  for(i = 0; i < memo->variables_count; i++) {
+    if(memo->variables[i]->value != memo->values[i])
+      return NULL;
+  }
+
+  return memo->result;
+}
+
+
+/* store @result (shared) made with the current values */
+static void
+rasqal_expression_memo_set(rasqal_expression_memo* memo,
+                           rasqal_evaluation_context* eval_context,
+                           rasqal_literal* result)
+{
+  int i;
+
+  rasqal_expression_memo_clear(memo);
+
+  for(i = 0; i < memo->variables_count; i++)
+    memo->values[i] = rasqal_new_literal_from_literal(memo->variables[i]->value);
+
+  memo->eval_context = eval_context;
+  memo->flags = eval_context->flags;
+  memo->result = rasqal_new_literal_from_literal(result);
+}
+
+
+static rasqal_literal*
+rasqal_expression_evaluate_op(rasqal_expression* e,
+                              rasqal_evaluation_context* eval_context,
+                              int *error_p)
 {
   rasqal_world *world;
   int flags;
@@ -919,6 +1329,7 @@ rasqal_expression_evaluate2(rasqal_expression* e,
     struct { int b1; int b2; } bools;
     int b;
     int i;
+    rasqal_int64 i64;
     raptor_uri *dt_uri;
     const unsigned char *s;
     unsigned char *new_s;
@@ -930,10 +1341,6 @@ rasqal_expression_evaluate2(rasqal_expression* e,
     raptor_stringbuffer* sb;
   } vars;
 
-  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(e, rasqal_expression, NULL);
-  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(eval_context, rasqal_evaluation_context, NULL);
-  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(error_p, intp, NULL);
-
   world = eval_context->world;
   flags = eval_context->flags;
 
@@ -1284,19 +1691,24 @@ rasqal_expression_evaluate2(rasqal_expression* e,
         goto failed;
       }
 
-      vars.i = rasqal_literal_as_integer(l2, &errs.errs.e2);
+      vars.i64 = rasqal_literal_as_integer64(l2, &errs.errs.e2);
       /* error if divisor is zero */
-      if(!vars.i)
+      if(!vars.i64)
         errs.errs.e2 = 1;
-      else
-        vars.i = rasqal_literal_as_integer(l1, &errs.errs.e1) % vars.i;
+      else if(vars.i64 == -1) {
+        /* INT64_MIN % -1 overflows */
+        rasqal_literal_as_integer64(l1, &errs.errs.e1);
+        vars.i64 = 0;
+      } else
+        vars.i64 = rasqal_literal_as_integer64(l1, &errs.errs.e1) % vars.i64;
 
       rasqal_free_literal(l1);
       rasqal_free_literal(l2);
       if(errs.errs.e1 || errs.errs.e2)
         goto failed;
 
-      result = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, vars.i);
+      result = rasqal_new_integer64_literal(world, RASQAL_LITERAL_INTEGER,
+                                            vars.i64);
       break;
       
     case RASQAL_EXPR_STR_EQ:
@@ -1346,12 +1758,13 @@ rasqal_expression_evaluate2(rasqal_expression* e,
       if((error_p && *error_p) || !l1)
         goto failed;
 
-      vars.i= ~ rasqal_literal_as_integer(l1, &errs.e);
+      vars.i64 = ~ rasqal_literal_as_integer64(l1, &errs.e);
       rasqal_free_literal(l1);
       if(errs.e)
         goto failed;
 
-      result = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, vars.i);
+      result = rasqal_new_integer64_literal(world, RASQAL_LITERAL_INTEGER,
+                                            vars.i64);
       break;
 
     case RASQAL_EXPR_BANG:
@@ -1600,6 +2013,45 @@ rasqal_expression_evaluate2(rasqal_expression* e,
 }
 
 
+/**
+ * rasqal_expression_evaluate2:
+ * @e: The expression to evaluate.
+ * @eval_context: expression context
+ * @error_p: pointer to error return flag
+ * 
+ * Evaluate a #rasqal_expression tree in the context of a
+ * #rasqal_evaluation_context to give a #rasqal_literal result or error.
+ * 
+ * Return value: a #rasqal_literal value or NULL (a valid value).  @error_p is set to non-0 on failure.  
+ **/
+rasqal_literal*
+rasqal_expression_evaluate2(rasqal_expression* e,
+                            rasqal_evaluation_context* eval_context,
+                            int *error_p)
+{
+  rasqal_expression_memo* memo;
+  rasqal_literal* result;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(e, rasqal_expression, NULL);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(eval_context, rasqal_evaluation_context, NULL);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(error_p, intp, NULL);
+
+  memo = RASQAL_EXPRESSION_INTERNAL(e)->memo;
+  if(memo) {
+    result = rasqal_expression_memo_get(memo, eval_context);
+    if(result)
+      return rasqal_new_literal_from_literal(result);
+  }
+
+  result = rasqal_expression_evaluate_op(e, eval_context, error_p);
+
+  if(memo && result && !*error_p)
+    rasqal_expression_memo_set(memo, eval_context, result);
+
+  return result;
+}
+
+
 #ifndef RASQAL_DISABLE_DEPRECATED
 /**
  * rasqal_expression_evaluate:
@@ -61,21 +61,16 @@ rasqal_expression_evaluate_strlen(rasqal_expression *e,
   rasqal_world* world = eval_context->world;
   rasqal_literal* l1;
   rasqal_literal* result = NULL;
-  const unsigned char *s;
   int len = 0;
   
   l1 = rasqal_expression_evaluate2(e->arg1, eval_context, error_p);
   if((error_p && *error_p) || !l1)
     goto failed;
   
-  s = rasqal_literal_as_string_flags(l1, eval_context->flags, error_p);
+  (void)rasqal_literal_as_counted_string_chars(l1, NULL, &len,
+                                               eval_context->flags, error_p);
   if(error_p && *error_p)
     goto failed;
-
-  if(!s)
-    len = 0;
-  else
-    len = raptor_unicode_utf8_strlen(s, strlen(RASQAL_GOOD_CAST(const char*, s)));
   
 
   result = rasqal_new_numeric_literal_from_long(world, RASQAL_LITERAL_INTEGER,
@@ -117,6 +112,7 @@ rasqal_expression_evaluate_substr(rasqal_expression *e,
   char* new_lang = NULL;
   raptor_uri* dt_uri = NULL;
   size_t len = 0;
+  int chars = 0;
   int startingLoc = 0;
   int length = -1;
   
@@ -125,7 +121,8 @@ rasqal_expression_evaluate_substr(rasqal_expression *e,
   if((error_p && *error_p) || !l1)
     goto failed;
   
-  s = rasqal_literal_as_counted_string(l1, &len, eval_context->flags, error_p);
+  s = rasqal_literal_as_counted_string_chars(l1, &len, &chars,
+                                             eval_context->flags, error_p);
   if(error_p && *error_p)
     goto failed;
 
@@ -148,16 +145,53 @@ rasqal_expression_evaluate_substr(rasqal_expression *e,
     if(error_p && *error_p)
       goto failed;
 
+    if(length < 0)
+      length = 0;
   }
   
   new_s = RASQAL_MALLOC(unsigned char*, len + 1);
   if(!new_s)
     goto failed;
 
-  /* adjust starting index to xsd fn:substring initial offset 1 */
-  if(!raptor_unicode_utf8_substr(new_s, /* dest_length_p */ NULL,
-                                 s, len, startingLoc - 1, length))
-    goto failed;
+  if(s && chars >= 0) {
+    /* xsd fn:substring: the characters at positions p counting from
+     * 1 where startingLoc <= p < startingLoc + length */
+    size_t start;
+    size_t count;
+
+    if(startingLoc < 1) {
+      if(length > 0) {
+        rasqal_int64 end = RASQAL_GOOD_CAST(rasqal_int64, startingLoc) + length;
+        length = (end > 1) ? RASQAL_GOOD_CAST(int, end - 1) : 0;
+      }
+      startingLoc = 1;
+    }
+
+    start = RASQAL_GOOD_CAST(size_t, startingLoc - 1);
+    count = 0;
+    if(start < RASQAL_GOOD_CAST(size_t, chars)) {
+      count = RASQAL_GOOD_CAST(size_t, chars) - start;
+      if(length >= 0 && RASQAL_GOOD_CAST(size_t, length) < count)
+        count = RASQAL_GOOD_CAST(size_t, length);
+    }
+
+    if(!count)
+      new_s[0] = '\0';
+    else if(RASQAL_GOOD_CAST(size_t, chars) == len) {
+      /* all ASCII: codepoint offsets are byte offsets */
+      memcpy(new_s, s + start, count);
+      new_s[count] = '\0';
+    } else if(!raptor_unicode_utf8_substr(new_s, /* dest_length_p */ NULL,
+                                          s, len, RASQAL_GOOD_CAST(int, start),
+                                          RASQAL_GOOD_CAST(int, count)))
+      goto failed;
+  } else {
+    /* not valid UTF-8: as much as can be decoded */
+    /* adjust starting index to xsd fn:substring initial offset 1 */
+    if(!raptor_unicode_utf8_substr(new_s, /* dest_length_p */ NULL,
+                                   s, len, startingLoc - 1, length))
+      goto failed;
+  }
 
   if(l1->language) {
     len = strlen(RASQAL_GOOD_CAST(const char*, l1->language));
@@ -233,25 +267,7 @@ rasqal_expression_evaluate_set_case(rasqal_expression *e,
   if(!new_s)
     goto failed;
 
-  if(e->op == RASQAL_EXPR_UCASE) {
-    unsigned int i;
-    
-    for(i = 0; i < len; i++) {
-      unsigned char c = s[i];
-      if(islower(RASQAL_GOOD_CAST(int, c)))
-        c = RASQAL_GOOD_CAST(unsigned char, toupper(RASQAL_GOOD_CAST(int, c)));
-      new_s[i] = c;
-    }
-  } else { /* RASQAL_EXPR_LCASE */
-    unsigned int i;
-
-    for(i = 0; i < len; i++) {
-      unsigned char c = s[i];
-      if(isupper(RASQAL_GOOD_CAST(int, c)))
-        c = RASQAL_GOOD_CAST(unsigned char, tolower(RASQAL_GOOD_CAST(int, c)));
-      new_s[i] = c;
-    }
-  }
+  rasqal_string_set_case(new_s, s, len, (e->op == RASQAL_EXPR_UCASE));
   new_s[len] = '\0';
 
   if(l1->language) {
@@ -405,9 +421,7 @@ rasqal_expression_evaluate_str_prefix_suffix(rasqal_expression *e,
     } else if(e->op == RASQAL_EXPR_STRENDS) {
       b = !memcmp(s1 + len1 - len2, s2, len2);
     } else { /* RASQAL_EXPR_CONTAINS */
-      /* b = (strnstr(RASQAL_GOOD_CAST(const char*, s1), RASQAL_GOOD_CAST(const char*, s2), len2) != NULL); */
-      b = (strstr(RASQAL_GOOD_CAST(const char*, s1),
-                  RASQAL_GOOD_CAST(const char*, s2)) != NULL);
+      b = (rasqal_string_search(s1, len1, s2, len2) != NULL);
     }
   }
   
@@ -881,7 +895,7 @@ rasqal_expression_evaluate_strbefore(rasqal_expression *e,
   const unsigned char *needle;
   size_t haystack_len;
   size_t needle_len;
-  const char *ptr;
+  const unsigned char *ptr;
   unsigned char* result;
   size_t result_len;
   char* new_lang = NULL;
@@ -929,10 +943,9 @@ rasqal_expression_evaluate_strbefore(rasqal_expression *e,
   if((error_p && *error_p) || !needle)
     goto failed;
 
-  ptr = strstr(RASQAL_GOOD_CAST(const char*, haystack), 
-               RASQAL_GOOD_CAST(const char*, needle));
+  ptr = rasqal_string_search(haystack, haystack_len, needle, needle_len);
   if(ptr) {
-    result_len = RASQAL_GOOD_CAST(size_t, ptr - RASQAL_GOOD_CAST(const char*, haystack));
+    result_len = RASQAL_GOOD_CAST(size_t, ptr - haystack);
 
     if(l1->language) {
       size_t len = strlen(RASQAL_GOOD_CAST(const char*, l1->language));
@@ -1001,7 +1014,7 @@ rasqal_expression_evaluate_strafter(rasqal_expression *e,
   const unsigned char *needle;
   size_t haystack_len;
   size_t needle_len;
-  const char *ptr;
+  const unsigned char *ptr;
   unsigned char* result;
   size_t result_len;
   char* new_lang = NULL;
@@ -1050,11 +1063,10 @@ rasqal_expression_evaluate_strafter(rasqal_expression *e,
   if((error_p && *error_p) || !needle)
     goto failed;
 
-  ptr = strstr(RASQAL_GOOD_CAST(const char*, haystack),
-               RASQAL_GOOD_CAST(const char*, needle));
+  ptr = rasqal_string_search(haystack, haystack_len, needle, needle_len);
   if(ptr) {
     ptr += needle_len;
-    result_len = haystack_len - RASQAL_GOOD_CAST(size_t, (ptr - RASQAL_GOOD_CAST(const char*, haystack)));
+    result_len = haystack_len - RASQAL_GOOD_CAST(size_t, (ptr - haystack));
 
     if(l1->language) {
       size_t len = strlen(RASQAL_GOOD_CAST(const char*, l1->language));
@@ -1065,7 +1077,7 @@ rasqal_expression_evaluate_strafter(rasqal_expression *e,
       memcpy(new_lang, l1->language, len + 1);
     }
   } else {
-    ptr = (const char *)"";
+    ptr = RASQAL_GOOD_CAST(const unsigned char*, "");
     result_len = 0;
   }
 
@@ -57,7 +57,15 @@ static const struct
   const char *label;
 } rasqal_features_list [RASQAL_FEATURE_LAST + 1]= {
   { RASQAL_FEATURE_NO_NET,    1,  "noNet",    "Deny network requests." } ,
-  { RASQAL_FEATURE_RAND_SEED, 1,  "randSeed", "Set rand() seed." }
+  { RASQAL_FEATURE_RAND_SEED, 1,  "randSeed", "Set rand() seed." },
+  { RASQAL_FEATURE_TIMEOUT,   1,  "timeout",  "Maximum execution time in milliseconds." },
+  { RASQAL_FEATURE_MAX_ROWS,  1,  "maxRows",  "Maximum number of buffered rows." },
+  { RASQAL_FEATURE_MAX_MEMORY, 1, "maxMemory", "Maximum size of buffered rows in kilobytes." },
+  { RASQAL_FEATURE_SORT_MEMORY, 1, "sortMemory", "Size of rows sorted in memory in kilobytes." },
+  { RASQAL_FEATURE_SORT_THREADS, 1, "sortThreads", "Number of threads sorting rows in memory." },
+  { RASQAL_FEATURE_SCAN_THREADS, 1, "scanThreads", "Number of threads scanning triples." },
+  { RASQAL_FEATURE_INCREMENTAL, 1, "incremental", "Evaluate repeated queries over appended triples only." },
+  { RASQAL_FEATURE_UNION_THREADS, 1, "unionThreads", "Number of threads evaluating UNION branches." }
 };
 
 
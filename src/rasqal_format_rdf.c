@@ -759,6 +759,7 @@ static const rasqal_rowsource_handler rasqal_rowsource_rdf_handler={
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -1061,6 +1061,7 @@ static const rasqal_rowsource_handler rasqal_rowsource_sparql_xml_handler={
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -56,32 +56,35 @@
 #include "sv.h"
 
 static int
-rasqal_iostream_write_csv_string(const unsigned char *string, size_t len,
-                                 raptor_iostream *iostr)
+rasqal_write_buffer_write_csv_string(rasqal_write_buffer* wb,
+                                     const unsigned char *string, size_t len)
 {
   const char delim = '\x22';
-  int quoting_needed = 0;
-  size_t i;
-
-  for(i = 0; i < len; i++) {
-    char c = RASQAL_GOOD_CAST(char, string[i]);
-    /* Quoting needed for delim (double quote), comma, linefeed or return */
-    if(c == delim   || c == ',' || c == '\r' || c == '\n') {
-      quoting_needed++;
+  size_t plain_len;
+
+  /* Quoting needed for delim (double quote), comma, linefeed or return */
+  plain_len = rasqal_string_csv_plain_length(string, len);
+  if(plain_len == len)
+    return rasqal_write_buffer_write_counted_string(wb, string, len);
+
+  rasqal_write_buffer_write_byte(wb, delim);
+  while(len > 0) {
+    const unsigned char* p;
+
+    /* copy up to and including the next delim which is then doubled */
+    p = RASQAL_GOOD_CAST(const unsigned char*, memchr(string, delim, len));
+    if(!p) {
+      rasqal_write_buffer_write_counted_string(wb, string, len);
       break;
     }
+
+    plain_len = RASQAL_GOOD_CAST(size_t, p - string) + 1;
+    rasqal_write_buffer_write_counted_string(wb, string, plain_len);
+    rasqal_write_buffer_write_byte(wb, delim);
+    string += plain_len;
+    len -= plain_len;
   }
-  if(!quoting_needed)
-    return raptor_iostream_counted_string_write(string, len, iostr);
-
-  raptor_iostream_write_byte(delim, iostr);
-  for(i = 0; i < len; i++) {
-    char c = RASQAL_GOOD_CAST(char, string[i]);
-    if(c == delim)
-      raptor_iostream_write_byte(delim, iostr);
-    raptor_iostream_write_byte(c, iostr);
-  }
-  raptor_iostream_write_byte(delim, iostr);
+  rasqal_write_buffer_write_byte(wb, delim);
 
   return 0;
 }
@@ -100,6 +103,9 @@ rasqal_iostream_write_csv_string(const unsigned char *string, size_t len,
  *
  * INTERNAL - Write a @sep-separated values version of the query results format to an iostream.
  * 
+ * Each row is built in a #rasqal_write_buffer and written to @iostr
+ * in large blocks.
+ *
  * If the writing succeeds, the query results will be exhausted.
  * 
  * Return value: non-0 on failure
@@ -119,6 +125,8 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
   int i;
   int vars_count;
   int emit_mkr;
+  rasqal_write_buffer* wb;
+  int rc = 0;
 
   if(!strcmp(label, (const char*)"mkr"))
     emit_mkr = 1;
@@ -133,9 +141,13 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
     return 1;
   }
 
+  wb = rasqal_new_write_buffer(iostr, 0);
+  if(!wb)
+    return 1;
+
   if(emit_mkr) {
-    raptor_iostream_counted_string_write("result is relation with format = csv;\n", 38, iostr);
-    raptor_iostream_counted_string_write("begin relation result;\n", 23, iostr);
+    rasqal_write_buffer_write_counted_string(wb, "result is relation with format = csv;\n", 38);
+    rasqal_write_buffer_write_counted_string(wb, "begin relation result;\n", 23);
   }
   
   /* Header */
@@ -147,15 +159,16 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
       break;
 
     if(i > 0)
-      raptor_iostream_write_byte(sep, iostr);
+      rasqal_write_buffer_write_byte(wb, sep);
 
     if(variable_prefix)
-      raptor_iostream_write_byte(variable_prefix, iostr);
-    raptor_iostream_string_write(name, iostr);
+      rasqal_write_buffer_write_byte(wb, variable_prefix);
+    rasqal_write_buffer_write_counted_string(wb, name,
+                                             strlen(RASQAL_GOOD_CAST(const char*, name)));
   }
   if(emit_mkr)
-    raptor_iostream_counted_string_write(";", 1, iostr);
-  raptor_iostream_counted_string_write(eol_str, eol_str_len, iostr);
+    rasqal_write_buffer_write_counted_string(wb, ";", 1);
+  rasqal_write_buffer_write_counted_string(wb, eol_str, eol_str_len);
 
 
   /* Variable Binding Results */
@@ -166,7 +179,7 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
       rasqal_literal *l = rasqal_query_results_get_binding_value(results, i);
 
       if(i > 0)
-        raptor_iostream_write_byte(sep, iostr);
+        rasqal_write_buffer_write_byte(wb, sep);
 
       if(l) {
         const unsigned char* str;
@@ -176,22 +189,23 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
           case RASQAL_LITERAL_URI:
             str = RASQAL_GOOD_CAST(const unsigned char*, raptor_uri_as_counted_string(l->value.uri, &len));
             if(csv_escape)
-              rasqal_iostream_write_csv_string(str, len, iostr);
+              rasqal_write_buffer_write_csv_string(wb, str, len);
             else {
-              raptor_iostream_write_byte('<', iostr);
+              rasqal_write_buffer_write_byte(wb, '<');
               if(str && len > 0)
-                raptor_string_ntriples_write(str, len, '"', iostr);
-              raptor_iostream_write_byte('>', iostr);
+                rasqal_write_buffer_write_ntriples_string(wb, str, len, '"');
+              rasqal_write_buffer_write_byte(wb, '>');
             }
             break;
 
           case RASQAL_LITERAL_BLANK:
+            rasqal_write_buffer_flush(wb);
             raptor_bnodeid_ntriples_write(l->string, l->string_len, iostr);
             break;
 
           case RASQAL_LITERAL_STRING:
             if(csv_escape) {
-              rasqal_iostream_write_csv_string(l->string, l->string_len, iostr);
+              rasqal_write_buffer_write_csv_string(wb, l->string, l->string_len);
             } else {
               if(l->datatype && l->valid) {
                 rasqal_literal_type ltype;
@@ -202,25 +216,26 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
                   /* write integer, float, double and decimal XSD typed
                    * data without quotes, datatype or language 
                    */
-                  raptor_string_ntriples_write(l->string, l->string_len, '\0', iostr);
+                  rasqal_write_buffer_write_ntriples_string(wb, l->string, l->string_len, '\0');
                   break;
                 }
               }
 
-              raptor_iostream_write_byte('"', iostr);
-              raptor_string_ntriples_write(l->string, l->string_len, '"', iostr);
-              raptor_iostream_write_byte('"', iostr);
+              rasqal_write_buffer_write_byte(wb, '"');
+              rasqal_write_buffer_write_ntriples_string(wb, l->string, l->string_len, '"');
+              rasqal_write_buffer_write_byte(wb, '"');
 
               if(l->language) {
-                raptor_iostream_write_byte('@', iostr);
-                raptor_iostream_string_write(RASQAL_GOOD_CAST(const unsigned char*, l->language), iostr);
+                rasqal_write_buffer_write_byte(wb, '@');
+                rasqal_write_buffer_write_counted_string(wb, l->language,
+                                                         strlen(l->language));
               }
 
               if(l->datatype) {
-                raptor_iostream_string_write("^^<", iostr);
+                rasqal_write_buffer_write_counted_string(wb, "^^<", 3);
                 str = RASQAL_GOOD_CAST(const unsigned char*, raptor_uri_as_counted_string(l->datatype, &len));
-                raptor_string_ntriples_write(str, len, '"', iostr);
-                raptor_iostream_write_byte('>', iostr);
+                rasqal_write_buffer_write_ntriples_string(wb, str, len, '"');
+                rasqal_write_buffer_write_byte(wb, '>');
               }
             }
 
@@ -254,16 +269,20 @@ rasqal_query_results_write_sv(raptor_iostream *iostr,
 
     /* End Result Row */
     if(emit_mkr)
-      raptor_iostream_counted_string_write(";", 1, iostr);
-    raptor_iostream_counted_string_write(eol_str, eol_str_len, iostr);
+      rasqal_write_buffer_write_counted_string(wb, ";", 1);
+    rasqal_write_buffer_write_counted_string(wb, eol_str, eol_str_len);
     
     rasqal_query_results_next(results);
   }
   if(emit_mkr)
-    raptor_iostream_counted_string_write("end relation result;\n", 21, iostr);
+    rasqal_write_buffer_write_counted_string(wb, "end relation result;\n", 21);
 
   /* end sparql */
-  return 0;
+  if(rasqal_write_buffer_flush(wb))
+    rc = 1;
+  rasqal_free_write_buffer(wb);
+
+  return rc;
 }
 
 
@@ -584,6 +603,7 @@ static const rasqal_rowsource_handler rasqal_rowsource_csv_handler={
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 static const rasqal_rowsource_handler rasqal_rowsource_mkr_handler={
@@ -598,6 +618,7 @@ static const rasqal_rowsource_handler rasqal_rowsource_mkr_handler={
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 static const rasqal_rowsource_handler rasqal_rowsource_tsv_handler={
@@ -612,6 +633,7 @@ static const rasqal_rowsource_handler rasqal_rowsource_tsv_handler={
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -233,8 +233,14 @@ rasqal_free_world(rasqal_world* world)
   rasqal_finish_result_formats(world);
   rasqal_finish_query_results();
 
+  /* cached queries refer to the query language factories */
+  rasqal_world_set_query_cache_size(world, 0);
+  rasqal_world_set_results_cache_size(world, 0);
+
   rasqal_delete_query_language_factories(world);
 
+  rasqal_raptor_finish(world);
+
 #ifdef RAPTOR_TRIPLES_SOURCE_REDLAND
   rasqal_redland_finish();
 #endif
@@ -1239,3 +1245,266 @@ rasqal_sign_free(void *ptr)
   free(p);
 }
 #endif
+
+
+/*
+ * Memory accounting
+ *
+ * When built with RASQAL_MEMORY_ACCOUNTING every RASQAL_MALLOC /
+ * RASQAL_CALLOC block has a header recording its size and the memory
+ * account that was current when it was allocated.  The block is
+ * charged to that account and all its parents and is uncharged from
+ * the same accounts when freed, wherever that happens.
+ *
+ * The current account is per-thread where the compiler supports it.
+ */
+
+#if defined(__GNUC__)
+#define RASQAL_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define RASQAL_THREAD_LOCAL __declspec(thread)
+#else
+#define RASQAL_THREAD_LOCAL
+#endif
+
+#ifdef RASQAL_MEMORY_ACCOUNTING
+#ifndef SIZE_MAX
+#define SIZE_MAX ((size_t)-1)
+#endif
+
+static RASQAL_THREAD_LOCAL rasqal_memory_account* rasqal_memory_current_account = NULL;
+
+/* Allocation header; a union to keep the returned memory aligned */
+typedef union {
+  struct {
+    size_t size;
+    rasqal_memory_account* account;
+  } h;
+  double align_double;
+  void* align_pointer;
+} rasqal_memory_header;
+
+
+/* Free released accounts that have nothing charged to them anymore */
+static void
+rasqal_memory_account_collect(rasqal_memory_account* account)
+{
+  while(account && account->released && !account->allocations) {
+    rasqal_memory_account* parent = account->parent;
+    rasqal_memory_account* p;
+
+    free(account);
+
+    /* drop the child's hold on its parents */
+    for(p = parent; p; p = p->parent)
+      p->allocations--;
+
+    account = parent;
+  }
+}
+
+
+static void*
+rasqal_memory_charge(rasqal_memory_header* header, size_t size)
+{
+  rasqal_memory_account* account = rasqal_memory_current_account;
+
+  header->h.size = size;
+  header->h.account = account;
+
+  for(; account; account = account->parent) {
+    account->allocations++;
+    account->current += size;
+    if(account->current > account->peak)
+      account->peak = account->current;
+  }
+
+  return header + 1;
+}
+
+
+void*
+rasqal_account_malloc(size_t size)
+{
+  rasqal_memory_header* header;
+
+  if(size > SIZE_MAX - sizeof(*header))
+    return NULL;
+
+  header = (rasqal_memory_header*)malloc(sizeof(*header) + size);
+  if(!header)
+    return NULL;
+
+  return rasqal_memory_charge(header, size);
+}
+
+
+void*
+rasqal_account_calloc(size_t nmemb, size_t size)
+{
+  rasqal_memory_header* header;
+
+  /* turn into bytes */
+  if(nmemb && size > SIZE_MAX / nmemb)
+    return NULL;
+  size = nmemb * size;
+
+  if(size > SIZE_MAX - sizeof(*header))
+    return NULL;
+
+  header = (rasqal_memory_header*)calloc(1, sizeof(*header) + size);
+  if(!header)
+    return NULL;
+
+  return rasqal_memory_charge(header, size);
+}
+
+
+void
+rasqal_account_free(void *ptr)
+{
+  rasqal_memory_header* header;
+  rasqal_memory_account* account;
+
+  if(!ptr)
+    return;
+
+  header = (rasqal_memory_header*)ptr - 1;
+
+  for(account = header->h.account; account; account = account->parent) {
+    account->allocations--;
+    account->current -= header->h.size;
+  }
+
+  rasqal_memory_account_collect(header->h.account);
+
+  free(header);
+}
+#endif
+
+
+/*
+ * rasqal_new_memory_account:
+ * @parent: parent account (or NULL)
+ *
+ * INTERNAL - Constructor - create a memory account
+ *
+ * Everything charged to the new account is also charged to @parent.
+ *
+ * Return value: new account or NULL on failure or if memory accounting is not available
+ */
+rasqal_memory_account*
+rasqal_new_memory_account(rasqal_memory_account* parent)
+{
+#ifdef RASQAL_MEMORY_ACCOUNTING
+  rasqal_memory_account* account;
+  rasqal_memory_account* p;
+
+  /* not charged to any account */
+  account = (rasqal_memory_account*)calloc(1, sizeof(*account));
+  if(!account)
+    return NULL;
+
+  account->parent = parent;
+
+  /* the child holds its parents until it is freed */
+  for(p = parent; p; p = p->parent)
+    p->allocations++;
+
+  return account;
+#else
+  return NULL;
+#endif
+}
+
+
+/*
+ * rasqal_free_memory_account:
+ * @account: account (or NULL)
+ *
+ * INTERNAL - Destructor - release a memory account
+ *
+ * The account is freed when the last allocation charged to it is freed.
+ */
+void
+rasqal_free_memory_account(rasqal_memory_account* account)
+{
+#ifdef RASQAL_MEMORY_ACCOUNTING
+  if(!account)
+    return;
+
+  if(rasqal_memory_current_account == account)
+    rasqal_memory_current_account = account->parent;
+
+  account->released = 1;
+  rasqal_memory_account_collect(account);
+#endif
+}
+
+
+/*
+ * rasqal_memory_account_enter:
+ * @account: account to make current (or NULL to suspend accounting)
+ *
+ * INTERNAL - Charge following allocations to @account
+ *
+ * With a NULL @account following allocations are not charged to any
+ * account until rasqal_memory_account_leave() is called, such as for
+ * data shared between queries.
+ *
+ * Return value: the previous account to pass to rasqal_memory_account_leave()
+ */
+rasqal_memory_account*
+rasqal_memory_account_enter(rasqal_memory_account* account)
+{
+#ifdef RASQAL_MEMORY_ACCOUNTING
+  rasqal_memory_account* previous = rasqal_memory_current_account;
+
+  rasqal_memory_current_account = account;
+
+  return previous;
+#else
+  return NULL;
+#endif
+}
+
+
+/*
+ * rasqal_memory_account_leave:
+ * @previous: account returned by rasqal_memory_account_enter()
+ *
+ * INTERNAL - Restore the account current before rasqal_memory_account_enter()
+ */
+void
+rasqal_memory_account_leave(rasqal_memory_account* previous)
+{
+#ifdef RASQAL_MEMORY_ACCOUNTING
+  rasqal_memory_current_account = previous;
+#endif
+}
+
+
+/*
+ * rasqal_memory_account_get_usage:
+ * @account: account
+ * @current_p: pointer to store bytes currently allocated (or NULL)
+ * @peak_p: pointer to store peak bytes allocated (or NULL)
+ *
+ * INTERNAL - Get the memory charged to an account
+ *
+ * Return value: non-0 if @account is NULL
+ */
+int
+rasqal_memory_account_get_usage(rasqal_memory_account* account,
+                                size_t* current_p, size_t* peak_p)
+{
+  if(!account)
+    return 1;
+
+  if(current_p)
+    *current_p = account->current;
+  if(peak_p)
+    *peak_p = account->peak;
+
+  return 0;
+}
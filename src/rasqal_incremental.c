@@ -0,0 +1,1097 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_incremental.c - Rasqal incremental evaluation of repeated queries
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <raptor.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+/*
+ * Result state of a query executed with #RASQAL_FEATURE_INCREMENTAL
+ *
+ * The query plan is split at a monotonic node of triple patterns,
+ * joins and filters (the delta node) whose rows only grow when
+ * triples are appended to the graphs.  The state keeps either all the
+ * rows of that node or, when it is below an aggregation of COUNT,
+ * SUM, MIN and MAX, the running aggregates of each group.  Each
+ * execution adds the rows made by the triples appended since the
+ * last one and the plan above the state is evaluated as usual.
+ */
+struct rasqal_incremental_s {
+  rasqal_query* query;
+
+  /* node replaced by the state: the AGGREGATION node or the delta
+   * node (SHARED with the query plan) */
+  rasqal_algebra_node* node;
+
+  /* monotonic node evaluated over the appended triples (SHARED) */
+  rasqal_algebra_node* delta_node;
+
+  /* GROUP BY expressions or NULL if not grouped (SHARED) */
+  raptor_sequence* group_exprs;
+
+  /* aggregate expressions and the variables they bind, or NULL to
+   * keep rows (SHARED) */
+  raptor_sequence* agg_exprs;
+  raptor_sequence* agg_vars;
+  int agg_count;
+
+  /* argument expressions of each aggregate */
+  raptor_sequence** agg_args;
+
+  /* columns of the triple patterns matched by the delta node */
+  int* columns;
+  int columns_count;
+
+  /* non-0 if the rows or groups hold the result for the graphs below */
+  int valid;
+
+  /* last graph epoch when the result was brought up to date */
+  unsigned long epoch;
+
+  /* load epoch of each graph the result was evaluated over */
+  unsigned long* load_epochs;
+  int graphs_count;
+
+  /* variables of the delta node rows or NULL before the first rows */
+  raptor_sequence* vars_seq;
+  int size;
+
+  /* sequence of the delta node rows when not aggregating */
+  raptor_sequence* rows;
+
+  /* tree of #rasqal_incremental_group when aggregating */
+  raptor_avltree* groups;
+};
+
+
+/* one group of an aggregating query */
+typedef struct {
+  rasqal_incremental* inc;
+
+  /* values of the GROUP BY expressions; empty if not grouped */
+  raptor_sequence* key;
+
+  /* delta node values of the first row of the group */
+  rasqal_literal** values;
+
+  /* running aggregate of each expression */
+  void** aggs;
+} rasqal_incremental_group;
+
+
+static void
+rasqal_free_incremental_group(rasqal_incremental_group* group)
+{
+  int i;
+
+  if(group->key)
+    raptor_free_sequence(group->key);
+
+  if(group->values) {
+    for(i = 0; i < group->inc->size; i++) {
+      if(group->values[i])
+        rasqal_free_literal(group->values[i]);
+    }
+    RASQAL_FREE(rasqal_literal**, group->values);
+  }
+
+  if(group->aggs) {
+    for(i = 0; i < group->inc->agg_count; i++) {
+      if(group->aggs[i])
+        rasqal_builtin_agg_expression_execute_finish(group->aggs[i]);
+    }
+    RASQAL_FREE(void**, group->aggs);
+  }
+
+  RASQAL_FREE(rasqal_incremental_group, group);
+}
+
+
+static int
+rasqal_incremental_group_compare(const void* a, const void* b)
+{
+  rasqal_incremental_group* group_a = (rasqal_incremental_group*)a;
+  rasqal_incremental_group* group_b = (rasqal_incremental_group*)b;
+
+  /* as rasqal_rowsource_groupby_literal_sequence_compare() */
+  return rasqal_literal_sequence_compare(RASQAL_COMPARE_URI,
+                                         group_a->key, group_b->key);
+}
+
+
+/*
+ * rasqal_new_incremental_group:
+ * @inc: incremental state
+ * @key: group key literals; becomes owned by the group
+ * @values: row values to keep or NULL for none
+ *
+ * INTERNAL - Create a group with new running aggregates
+ *
+ * Return value: new group or NULL on failure
+ */
+static rasqal_incremental_group*
+rasqal_new_incremental_group(rasqal_incremental* inc, raptor_sequence* key,
+                             rasqal_literal** values)
+{
+  rasqal_incremental_group* group;
+  int i;
+
+  group = RASQAL_CALLOC(rasqal_incremental_group*, 1, sizeof(*group));
+  if(!group) {
+    raptor_free_sequence(key);
+    return NULL;
+  }
+
+  group->inc = inc;
+  group->key = key;
+
+  if(inc->size) {
+    group->values = RASQAL_CALLOC(rasqal_literal**,
+                                  RASQAL_GOOD_CAST(size_t, inc->size),
+                                  sizeof(rasqal_literal*));
+    if(!group->values)
+      goto failed;
+
+    for(i = 0; values && i < inc->size; i++)
+      group->values[i] = rasqal_new_literal_from_literal(values[i]);
+  }
+
+  group->aggs = RASQAL_CALLOC(void**, RASQAL_GOOD_CAST(size_t, inc->agg_count),
+                              sizeof(void*));
+  if(!group->aggs)
+    goto failed;
+
+  for(i = 0; i < inc->agg_count; i++) {
+    rasqal_expression* expr;
+
+    expr = (rasqal_expression*)raptor_sequence_get_at(inc->agg_exprs, i);
+    group->aggs[i] = rasqal_builtin_agg_expression_execute_init(inc->query->world,
+                                                                expr);
+    if(!group->aggs[i])
+      goto failed;
+  }
+
+  return group;
+
+  failed:
+  rasqal_free_incremental_group(group);
+  return NULL;
+}
+
+
+/* step the aggregates of @group over the variables bound now as the
+ * aggregation rowsource does */
+static void
+rasqal_incremental_group_step(rasqal_incremental* inc,
+                              rasqal_incremental_group* group)
+{
+  int i;
+
+  for(i = 0; i < inc->agg_count; i++) {
+    raptor_sequence* seq;
+    int error = 0;
+
+    seq = rasqal_expression_sequence_evaluate(inc->query, inc->agg_args[i],
+                                              /* ignore_errors */ 1,
+                                              &error);
+    if(error)
+      continue;
+
+    (void)rasqal_builtin_agg_expression_execute_step(group->aggs[i], seq);
+    raptor_free_sequence(seq);
+  }
+}
+
+
+/* non-0 if @e gives a new value each time it is evaluated */
+static int
+rasqal_incremental_expression_is_volatile(void *user_data,
+                                          rasqal_expression *e)
+{
+  switch(e->op) {
+    case RASQAL_EXPR_RAND:
+    case RASQAL_EXPR_NOW:
+    case RASQAL_EXPR_BNODE:
+    case RASQAL_EXPR_UUID:
+    case RASQAL_EXPR_STRUUID:
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+
+/* non-0 if any expression of @seq (or NULL) is volatile */
+static int
+rasqal_incremental_sequence_is_volatile(raptor_sequence* seq)
+{
+  rasqal_expression* e;
+  int i;
+
+  for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(seq, i)); i++) {
+    if(rasqal_expression_visit(e, rasqal_incremental_expression_is_volatile,
+                               NULL))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_incremental_add_columns:
+ * @inc: incremental state
+ * @node: algebra node
+ *
+ * INTERNAL - Check a delta node is monotonic and find its triple patterns
+ *
+ * Return value: non-0 if @node is not made of triple patterns, joins
+ * and filters of expressions giving the same value each time
+ */
+static int
+rasqal_incremental_add_columns(rasqal_incremental* inc,
+                               rasqal_algebra_node* node)
+{
+  int column;
+
+  if(!node)
+    return 0;
+
+  if(node->expr &&
+     rasqal_expression_visit(node->expr,
+                             rasqal_incremental_expression_is_volatile, NULL))
+    return 1;
+
+  switch(node->op) {
+    case RASQAL_ALGEBRA_OPERATOR_BGP:
+      if(!node->triples || node->start_column < 0)
+        return 0;
+
+      /* the columns index the query triples */
+      if(node->triples != rasqal_query_get_triple_sequence(inc->query))
+        return 1;
+
+      for(column = node->start_column; column <= node->end_column; column++)
+        inc->columns[inc->columns_count++] = column;
+      return 0;
+
+    case RASQAL_ALGEBRA_OPERATOR_FILTER:
+      return rasqal_incremental_add_columns(inc, node->node1);
+
+    case RASQAL_ALGEBRA_OPERATOR_JOIN:
+      return (rasqal_incremental_add_columns(inc, node->node1) ||
+              rasqal_incremental_add_columns(inc, node->node2));
+
+    default:
+      return 1;
+  }
+}
+
+
+static int rasqal_incremental_variable_is_kept(rasqal_incremental* inc, rasqal_variable* v);
+
+
+/* non-0 if @e uses a variable that is not a group key or aggregate */
+static int
+rasqal_incremental_expression_uses_row(void *user_data, rasqal_expression *e)
+{
+  rasqal_incremental* inc = (rasqal_incremental*)user_data;
+  rasqal_variable* v;
+
+  if(e->op != RASQAL_EXPR_LITERAL)
+    return 0;
+
+  v = rasqal_literal_as_variable(e->literal);
+  return (v && !rasqal_incremental_variable_is_kept(inc, v));
+}
+
+
+/*
+ * rasqal_incremental_variable_is_kept:
+ * @inc: incremental state
+ * @v: variable used above the aggregation
+ *
+ * INTERNAL - Check a variable has the same value in every row of a group
+ *
+ * The state keeps the values of only the first row found of a group
+ * so the plan above the aggregation may only use the aggregates, the
+ * variables grouped by and expressions of them.
+ *
+ * Return value: non-0 if @v is an aggregate, a GROUP BY variable or
+ * an expression of them
+ */
+static int
+rasqal_incremental_variable_is_kept(rasqal_incremental* inc, rasqal_variable* v)
+{
+  rasqal_variable* v2;
+  rasqal_expression* e;
+  int i;
+
+  if(v->expression)
+    return !rasqal_expression_visit(v->expression,
+                                    rasqal_incremental_expression_uses_row,
+                                    inc);
+
+  for(i = 0; (v2 = (rasqal_variable*)raptor_sequence_get_at(inc->agg_vars, i)); i++) {
+    if(!strcmp(RASQAL_GOOD_CAST(const char*, v->name),
+               RASQAL_GOOD_CAST(const char*, v2->name)))
+      return 1;
+  }
+
+  for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(inc->group_exprs, i)); i++) {
+    if(e->op == RASQAL_EXPR_LITERAL &&
+       (v2 = rasqal_literal_as_variable(e->literal)) &&
+       !strcmp(RASQAL_GOOD_CAST(const char*, v->name),
+               RASQAL_GOOD_CAST(const char*, v2->name)))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* non-0 if the plan from @node down to the aggregation uses a
+ * variable that differs between the rows of a group */
+static int
+rasqal_incremental_plan_uses_rows(rasqal_incremental* inc,
+                                  rasqal_algebra_node* node)
+{
+  rasqal_variable* v;
+  rasqal_expression* e;
+  int i;
+
+  for(; node != inc->node; node = node->node1) {
+    for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(node->vars_seq, i)); i++) {
+      if(!rasqal_incremental_variable_is_kept(inc, v))
+        return 1;
+    }
+
+    for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(node->seq, i)); i++) {
+      if(rasqal_expression_visit(e, rasqal_incremental_expression_uses_row,
+                                 inc))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * rasqal_new_incremental:
+ * @query: query
+ * @plan: query algebra plan
+ *
+ * INTERNAL - Constructor - create the incremental evaluation state of a query
+ *
+ * The plan must be a SELECT of solution modifiers over either an
+ * aggregation of COUNT, SUM, MIN and MAX without DISTINCT, optionally
+ * grouped, or directly over the delta node.  The delta node may only
+ * be triple patterns, joins and filters with expressions that give
+ * the same value each time they are evaluated.
+ *
+ * Return value: new state or NULL if the query cannot be evaluated
+ * incrementally or on failure
+ */
+rasqal_incremental*
+rasqal_new_incremental(rasqal_query* query, rasqal_algebra_node* plan)
+{
+  rasqal_incremental* inc;
+  rasqal_algebra_node* node;
+  raptor_sequence* triples;
+  int i;
+
+  if(query->verb != RASQAL_QUERY_VERB_SELECT || !plan)
+    return NULL;
+
+  triples = rasqal_query_get_triple_sequence(query);
+  if(!triples || !raptor_sequence_size(triples))
+    return NULL;
+
+  for(node = plan; node; node = node->node1) {
+    if(node->op != RASQAL_ALGEBRA_OPERATOR_DISTINCT &&
+       node->op != RASQAL_ALGEBRA_OPERATOR_ORDERBY &&
+       node->op != RASQAL_ALGEBRA_OPERATOR_PROJECT &&
+       node->op != RASQAL_ALGEBRA_OPERATOR_HAVING &&
+       node->op != RASQAL_ALGEBRA_OPERATOR_SLICE)
+      break;
+  }
+  if(!node)
+    return NULL;
+
+  inc = RASQAL_CALLOC(rasqal_incremental*, 1, sizeof(*inc));
+  if(!inc)
+    return NULL;
+
+  inc->query = query;
+  inc->node = node;
+
+  if(node->op == RASQAL_ALGEBRA_OPERATOR_AGGREGATION) {
+    rasqal_expression* expr;
+
+    inc->agg_exprs = node->seq;
+    inc->agg_vars = node->vars_seq;
+    inc->agg_count = raptor_sequence_size(node->seq);
+
+    for(i = 0; (expr = (rasqal_expression*)raptor_sequence_get_at(inc->agg_exprs, i)); i++) {
+      if((expr->op != RASQAL_EXPR_COUNT && expr->op != RASQAL_EXPR_SUM &&
+          expr->op != RASQAL_EXPR_MIN && expr->op != RASQAL_EXPR_MAX) ||
+         (expr->flags & RASQAL_EXPR_FLAG_DISTINCT) ||
+         rasqal_expression_visit(expr, rasqal_incremental_expression_is_volatile,
+                                 NULL))
+        goto failed;
+    }
+
+    node = node->node1;
+    if(node && node->op == RASQAL_ALGEBRA_OPERATOR_GROUP) {
+      inc->group_exprs = node->seq;
+      if(rasqal_incremental_sequence_is_volatile(inc->group_exprs))
+        goto failed;
+      node = node->node1;
+    }
+
+    if(rasqal_incremental_plan_uses_rows(inc, plan))
+      goto failed;
+  }
+
+  inc->delta_node = node;
+
+  inc->columns = RASQAL_CALLOC(int*,
+                               RASQAL_GOOD_CAST(size_t, raptor_sequence_size(triples)),
+                               sizeof(int));
+  if(!inc->columns)
+    goto failed;
+
+  if(!node || rasqal_incremental_add_columns(inc, node) || !inc->columns_count)
+    goto failed;
+
+  if(inc->agg_count) {
+    inc->agg_args = RASQAL_CALLOC(raptor_sequence**,
+                                  RASQAL_GOOD_CAST(size_t, inc->agg_count),
+                                  sizeof(raptor_sequence*));
+    if(!inc->agg_args)
+      goto failed;
+
+    /* as rasqal_new_aggregation_rowsource() */
+    for(i = 0; i < inc->agg_count; i++) {
+      rasqal_expression* expr;
+
+      expr = (rasqal_expression*)raptor_sequence_get_at(inc->agg_exprs, i);
+      if(expr->args)
+        inc->agg_args[i] = rasqal_expression_copy_expression_sequence(expr->args);
+      else {
+        inc->agg_args[i] = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression,
+                                               (raptor_data_print_handler)rasqal_expression_print);
+        if(inc->agg_args[i])
+          raptor_sequence_push(inc->agg_args[i],
+                               rasqal_new_expression_from_expression(expr->arg1));
+      }
+      if(!inc->agg_args[i])
+        goto failed;
+    }
+  }
+
+  return inc;
+
+  failed:
+  rasqal_free_incremental(inc);
+  return NULL;
+}
+
+
+/*
+ * rasqal_incremental_reset:
+ * @inc: incremental state
+ *
+ * INTERNAL - Drop the result so the next execution evaluates the query in full
+ */
+void
+rasqal_incremental_reset(rasqal_incremental* inc)
+{
+  if(inc->rows) {
+    raptor_free_sequence(inc->rows);
+    inc->rows = NULL;
+  }
+
+  if(inc->groups) {
+    raptor_free_avltree(inc->groups);
+    inc->groups = NULL;
+  }
+
+  inc->valid = 0;
+}
+
+
+/**
+ * rasqal_free_incremental:
+ * @inc: incremental state
+ *
+ * INTERNAL - Destructor - destroy the incremental evaluation state of a query
+ */
+void
+rasqal_free_incremental(rasqal_incremental* inc)
+{
+  int i;
+
+  if(!inc)
+    return;
+
+  rasqal_incremental_reset(inc);
+
+  if(inc->agg_args) {
+    for(i = 0; i < inc->agg_count; i++) {
+      if(inc->agg_args[i])
+        raptor_free_sequence(inc->agg_args[i]);
+    }
+    RASQAL_FREE(raptor_sequence**, inc->agg_args);
+  }
+
+  if(inc->columns)
+    RASQAL_FREE(int*, inc->columns);
+
+  if(inc->load_epochs)
+    RASQAL_FREE(unsigned long*, inc->load_epochs);
+
+  if(inc->vars_seq)
+    raptor_free_sequence(inc->vars_seq);
+
+  RASQAL_FREE(rasqal_incremental, inc);
+}
+
+
+/* node of the query plan replaced by the state */
+rasqal_algebra_node*
+rasqal_incremental_get_node(rasqal_incremental* inc)
+{
+  return inc->node;
+}
+
+
+/* node evaluated over the appended triples */
+rasqal_algebra_node*
+rasqal_incremental_get_delta_node(rasqal_incremental* inc)
+{
+  return inc->delta_node;
+}
+
+
+/* columns of the triple patterns of the delta node; the number of
+ * them is stored in *@count_p */
+int*
+rasqal_incremental_get_columns(rasqal_incremental* inc, int* count_p)
+{
+  *count_p = inc->columns_count;
+  return inc->columns;
+}
+
+
+/*
+ * rasqal_incremental_start:
+ * @inc: incremental state
+ * @rts: triples source of the execution
+ * @after_p: pointer to store the epoch the appended triples were added after
+ * @until_p: pointer to store the last epoch of the appended triples
+ *
+ * INTERNAL - Start bringing the result up to date with the graphs of an execution
+ *
+ * The result is dropped if any graph was loaded again, rather than
+ * only had triples appended, since it was evaluated.  *@after_p is
+ * then 0 and the delta node must be evaluated over all the triples.
+ *
+ * Return value: 1 if the rows of the delta node must be added, 0 if
+ * the result is up to date or <0 on failure
+ */
+int
+rasqal_incremental_start(rasqal_incremental* inc, rasqal_triples_source* rts,
+                         unsigned long* after_p, unsigned long* until_p)
+{
+  unsigned long load_epoch;
+  unsigned long epoch;
+  unsigned long last_epoch = 0;
+  int same = inc->valid;
+  int count;
+  int i;
+
+  for(count = 0;
+      !rasqal_raptor_triples_source_get_graph_epochs(rts, count, &load_epoch,
+                                                     &epoch);
+      count++) {
+    if(count >= inc->graphs_count || inc->load_epochs[count] != load_epoch)
+      same = 0;
+    if(epoch > last_epoch)
+      last_epoch = epoch;
+  }
+  if(count != inc->graphs_count)
+    same = 0;
+
+  if(same) {
+    if(last_epoch <= inc->epoch)
+      return 0;
+
+    *after_p = inc->epoch;
+    *until_p = last_epoch;
+    inc->epoch = last_epoch;
+    return 1;
+  }
+
+  rasqal_incremental_reset(inc);
+
+  if(inc->load_epochs) {
+    RASQAL_FREE(unsigned long*, inc->load_epochs);
+    inc->load_epochs = NULL;
+  }
+  inc->graphs_count = 0;
+
+  if(count) {
+    inc->load_epochs = RASQAL_CALLOC(unsigned long*,
+                                     RASQAL_GOOD_CAST(size_t, count),
+                                     sizeof(unsigned long));
+    if(!inc->load_epochs)
+      return -1;
+
+    for(i = 0; i < count; i++)
+      (void)rasqal_raptor_triples_source_get_graph_epochs(rts, i,
+                                                          &inc->load_epochs[i],
+                                                          &epoch);
+  }
+  inc->graphs_count = count;
+
+  if(inc->agg_count)
+    inc->groups = raptor_new_avltree(rasqal_incremental_group_compare,
+                                     (raptor_data_free_handler)rasqal_free_incremental_group,
+                                     /* flags */ 0);
+  else
+    inc->rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                    (raptor_data_print_handler)rasqal_row_print);
+  if(!inc->groups && !inc->rows)
+    return -1;
+
+  inc->epoch = last_epoch;
+  inc->valid = 1;
+  *after_p = 0;
+  *until_p = last_epoch;
+
+  return 1;
+}
+
+
+/* add one delta node row to the state */
+static int
+rasqal_incremental_add_row(rasqal_incremental* inc, rasqal_row* row)
+{
+  rasqal_query* query = inc->query;
+  rasqal_incremental_group key_group;
+  rasqal_incremental_group* group;
+  raptor_sequence* key;
+  int i;
+
+  if(!inc->agg_count) {
+    rasqal_row* copy;
+
+    copy = rasqal_new_row_for_size(query->world, inc->size);
+    if(!copy)
+      return 1;
+
+    for(i = 0; i < inc->size; i++)
+      rasqal_row_set_value_at(copy, i, row->values[i]);
+
+    return raptor_sequence_push(inc->rows, copy);
+  }
+
+  rasqal_row_bind_variables(row, query->vars_table);
+
+  /* as rasqal_groupby_rowsource_process() */
+  if(inc->group_exprs) {
+    key = rasqal_expression_sequence_evaluate(query, inc->group_exprs,
+                                              /* ignore_errors */ 0,
+                                              /* error_p */ NULL);
+    if(!key)
+      return 0;
+  } else {
+    key = raptor_new_sequence((raptor_data_free_handler)rasqal_free_literal,
+                              (raptor_data_print_handler)rasqal_literal_print);
+    if(!key)
+      return 1;
+  }
+
+  memset(&key_group, '\0', sizeof(key_group));
+  key_group.key = key;
+
+  group = (rasqal_incremental_group*)raptor_avltree_search(inc->groups,
+                                                           &key_group);
+  if(group)
+    raptor_free_sequence(key);
+  else {
+    group = rasqal_new_incremental_group(inc, key, row->values);
+    if(!group)
+      return 1;
+
+    /* after this, group is owned by the tree */
+    if(raptor_avltree_add(inc->groups, group))
+      return 1;
+  }
+
+  rasqal_incremental_group_step(inc, group);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_incremental_add_rows:
+ * @inc: incremental state
+ * @rowsource: rowsource of the delta node
+ *
+ * INTERNAL - Add the rows of the delta node to the state
+ *
+ * On failure, including the execution being aborted, the state must
+ * be reset with rasqal_incremental_reset().
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_incremental_add_rows(rasqal_incremental* inc, rasqal_rowsource* rowsource)
+{
+  rasqal_query* query = inc->query;
+  raptor_sequence* bindings = NULL;
+  rasqal_row* row;
+  int rc = 0;
+
+  if(rasqal_rowsource_ensure_variables(rowsource))
+    return 1;
+
+  if(!inc->vars_seq) {
+    inc->vars_seq = rasqal_variable_copy_variable_sequence(rowsource->variables_sequence);
+    if(!inc->vars_seq)
+      return 1;
+    inc->size = rowsource->size;
+  } else if(rowsource->size != inc->size)
+    return 1;
+
+  if(inc->agg_count)
+    bindings = rasqal_variables_table_take_bindings(query->vars_table);
+
+  while((row = rasqal_rowsource_read_row(rowsource))) {
+    rc = rasqal_incremental_add_row(inc, row);
+    rasqal_free_row(row);
+    if(rc)
+      break;
+  }
+
+  if(bindings)
+    rasqal_variables_table_install_bindings(query->vars_table, bindings);
+
+  if(query->budget.aborted)
+    rc = 1;
+
+  return rc;
+}
+
+
+/*
+ * Rowsource returning the rows or aggregated groups of the state as
+ * they were when it was created, so a later execution can change the
+ * state while the results of this one are read.
+ */
+typedef struct {
+  rasqal_incremental* inc;
+
+  /* variables of the rows */
+  raptor_sequence* vars_seq;
+
+  /* sequence of detached rows */
+  raptor_sequence* rows;
+
+  /* index into rows */
+  int offset;
+} rasqal_incremental_rowsource_context;
+
+
+static int
+rasqal_incremental_rowsource_finish(rasqal_rowsource* rowsource,
+                                    void *user_data)
+{
+  rasqal_incremental_rowsource_context* con;
+
+  con = (rasqal_incremental_rowsource_context*)user_data;
+
+  if(con->vars_seq)
+    raptor_free_sequence(con->vars_seq);
+
+  if(con->rows)
+    raptor_free_sequence(con->rows);
+
+  RASQAL_FREE(rasqal_incremental_rowsource_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_incremental_rowsource_ensure_variables(rasqal_rowsource* rowsource,
+                                              void *user_data)
+{
+  rasqal_incremental_rowsource_context* con;
+  rasqal_variable* v;
+  int i;
+
+  con = (rasqal_incremental_rowsource_context*)user_data;
+
+  rowsource->size = 0;
+  for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(con->vars_seq, i)); i++) {
+    if(rasqal_rowsource_add_variable(rowsource, v) < 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static rasqal_row*
+rasqal_incremental_rowsource_read_row(rasqal_rowsource* rowsource,
+                                      void *user_data)
+{
+  rasqal_incremental_rowsource_context* con;
+  rasqal_row* saved_row;
+  rasqal_row* row;
+  int i;
+
+  con = (rasqal_incremental_rowsource_context*)user_data;
+
+  saved_row = (rasqal_row*)raptor_sequence_get_at(con->rows, con->offset);
+  if(!saved_row)
+    return NULL;
+
+  row = rasqal_new_row(rowsource);
+  if(!row)
+    return NULL;
+
+  for(i = 0; i < row->size && i < saved_row->size; i++)
+    rasqal_row_set_value_at(row, i, saved_row->values[i]);
+
+  /* bind the aggregates as the aggregation rowsource does */
+  rasqal_row_bind_variables(row, rowsource->query->vars_table);
+
+  row->offset = con->offset++;
+
+  return row;
+}
+
+
+static int
+rasqal_incremental_rowsource_reset(rasqal_rowsource* rowsource,
+                                   void *user_data)
+{
+  rasqal_incremental_rowsource_context* con;
+
+  con = (rasqal_incremental_rowsource_context*)user_data;
+  con->offset = 0;
+
+  return 0;
+}
+
+
+static const rasqal_rowsource_handler rasqal_incremental_rowsource_handler = {
+  /* .version = */ 1,
+  "incremental",
+  /* .init = */ NULL,
+  /* .finish = */ rasqal_incremental_rowsource_finish,
+  /* .ensure_variables = */ rasqal_incremental_rowsource_ensure_variables,
+  /* .read_row = */ rasqal_incremental_rowsource_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ rasqal_incremental_rowsource_reset,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ NULL,
+  /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
+};
+
+
+/* add the aggregated row of @group to @rows */
+static int
+rasqal_incremental_add_group_row(rasqal_incremental* inc,
+                                 rasqal_incremental_group* group,
+                                 raptor_sequence* rows)
+{
+  rasqal_row* row;
+  int i;
+
+  row = rasqal_new_row_for_size(inc->query->world, inc->size + inc->agg_count);
+  if(!row)
+    return 1;
+
+  for(i = 0; i < inc->size; i++)
+    rasqal_row_set_value_at(row, i, group->values[i]);
+
+  for(i = 0; i < inc->agg_count; i++) {
+    rasqal_literal* result;
+
+    result = rasqal_builtin_agg_expression_execute_result(group->aggs[i]);
+    rasqal_row_set_value_at(row, inc->size + i, result);
+    if(result)
+      rasqal_free_literal(result);
+  }
+
+  return raptor_sequence_push(rows, row);
+}
+
+
+/*
+ * rasqal_incremental_get_group_rows:
+ * @inc: incremental state
+ * @rows: sequence to add the rows to
+ *
+ * INTERNAL - Add a row for each group in key order
+ *
+ * A grouped query without rows has one group made of a row with no
+ * values bound as with rasqal_new_groupby_rowsource().
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_incremental_get_group_rows(rasqal_incremental* inc,
+                                  raptor_sequence* rows)
+{
+  raptor_avltree_iterator* iterator;
+  rasqal_incremental_group* group;
+  int rc = 0;
+
+  if(!raptor_avltree_size(inc->groups)) {
+    raptor_sequence* bindings;
+    raptor_sequence* key;
+
+    if(!inc->group_exprs)
+      return 0;
+
+    key = raptor_new_sequence((raptor_data_free_handler)rasqal_free_literal,
+                              (raptor_data_print_handler)rasqal_literal_print);
+    if(!key)
+      return 1;
+
+    group = rasqal_new_incremental_group(inc, key, NULL);
+    if(!group)
+      return 1;
+
+    /* taking the bindings leaves every variable unbound */
+    bindings = rasqal_variables_table_take_bindings(inc->query->vars_table);
+    rasqal_incremental_group_step(inc, group);
+    if(bindings)
+      rasqal_variables_table_install_bindings(inc->query->vars_table, bindings);
+
+    rc = rasqal_incremental_add_group_row(inc, group, rows);
+    rasqal_free_incremental_group(group);
+    return rc;
+  }
+
+  iterator = raptor_new_avltree_iterator(inc->groups, NULL, NULL, 1);
+  if(!iterator)
+    return 1;
+
+  while((group = (rasqal_incremental_group*)raptor_avltree_iterator_get(iterator))) {
+    rc = rasqal_incremental_add_group_row(inc, group, rows);
+    if(rc || raptor_avltree_iterator_next(iterator))
+      break;
+  }
+  raptor_free_avltree_iterator(iterator);
+
+  return rc;
+}
+
+
+/**
+ * rasqal_incremental_new_rowsource:
+ * @inc: incremental state
+ *
+ * INTERNAL - Create a rowsource returning the result of the state
+ *
+ * The rows are those of the replaced node: the delta node rows or
+ * the delta node values of the first row of each group followed by
+ * the aggregates.
+ *
+ * Return value: new rowsource or NULL on failure
+ */
+rasqal_rowsource*
+rasqal_incremental_new_rowsource(rasqal_incremental* inc)
+{
+  rasqal_query* query = inc->query;
+  rasqal_incremental_rowsource_context* con;
+  rasqal_row* row;
+  int i;
+
+  if(!inc->valid || !inc->vars_seq)
+    return NULL;
+
+  con = RASQAL_CALLOC(rasqal_incremental_rowsource_context*, 1, sizeof(*con));
+  if(!con)
+    return NULL;
+
+  con->inc = inc;
+  con->vars_seq = rasqal_variable_copy_variable_sequence(inc->vars_seq);
+  con->rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                  (raptor_data_print_handler)rasqal_row_print);
+  if(!con->vars_seq || !con->rows)
+    goto failed;
+
+  if(inc->agg_count) {
+    rasqal_variable* v;
+
+    for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(inc->agg_vars, i)); i++) {
+      if(raptor_sequence_push(con->vars_seq, rasqal_new_variable_from_variable(v)))
+        goto failed;
+    }
+
+    if(rasqal_incremental_get_group_rows(inc, con->rows))
+      goto failed;
+  } else {
+    /* the rows are never changed once added so they are shared */
+    for(i = 0; (row = (rasqal_row*)raptor_sequence_get_at(inc->rows, i)); i++) {
+      if(raptor_sequence_push(con->rows, rasqal_new_row_from_row(row)))
+        goto failed;
+    }
+  }
+
+  return rasqal_new_rowsource_from_handler(query->world, query,
+                                           con,
+                                           &rasqal_incremental_rowsource_handler,
+                                           query->vars_table,
+                                           /* flags */ 0);
+
+  failed:
+  rasqal_incremental_rowsource_finish(NULL, con);
+  return NULL;
+}
@@ -76,6 +76,15 @@ void rasqal_sign_free(void *ptr);
 #define RASQAL_REALLOC(type, ptr, size) (type0rasqal_sign_realloc(ptr, size)
 #define RASQAL_FREE(type, ptr)   rasqal_sign_free((void*)ptr)
 
+#elif defined(RASQAL_MEMORY_ACCOUNTING)
+void* rasqal_account_malloc(size_t size);
+void* rasqal_account_calloc(size_t nmemb, size_t size);
+void rasqal_account_free(void *ptr);
+
+#define RASQAL_MALLOC(type, size)   (type)rasqal_account_malloc(size)
+#define RASQAL_CALLOC(type, nmemb, size) (type)rasqal_account_calloc(nmemb, size)
+#define RASQAL_FREE(type, ptr)   rasqal_account_free((void*)ptr)
+
 #else
 #define RASQAL_MALLOC(type, size) (type)malloc(size)
 #define RASQAL_CALLOC(type, size, count) (type)calloc(size, count)
@@ -404,6 +413,59 @@ typedef enum {
 } rasqal_triples_use_map_flags;
 
 
+/*
+ * rasqal_memory_account:
+ * @parent: account also charged with every allocation (or NULL)
+ * @current: bytes currently allocated
+ * @peak: highest value of @current
+ * @allocations: live allocations and child accounts holding this account
+ * @released: non-0 when the owner has released the account
+ *
+ * INTERNAL - Memory allocated while the account was current
+ *
+ * Only counts anything when built with RASQAL_MEMORY_ACCOUNTING.
+ * An account is freed once it is released and nothing charged to it
+ * remains allocated.
+ */
+typedef struct rasqal_memory_account_s rasqal_memory_account;
+
+struct rasqal_memory_account_s {
+  rasqal_memory_account* parent;
+  size_t current;
+  size_t peak;
+  int allocations;
+  int released;
+};
+
+
+/*
+ * rasqal_query_budget:
+ * @deadline: absolute time when execution must stop (if @have_deadline)
+ * @have_deadline: non-0 if @deadline is set
+ * @ticks: budget checks left until the clock is read again
+ * @max_rows: maximum rows buffered by operators or 0 for no limit
+ * @max_bytes: maximum estimated bytes of buffered rows or 0 for no limit
+ * @rows: rows buffered so far
+ * @bytes: estimated bytes of rows buffered so far
+ * @aborted: non-0 once any limit was exceeded or the query cancelled
+ *
+ * INTERNAL - Execution budget for one query execution
+ *
+ * Set up from the query features by rasqal_query_budget_start() and
+ * checked with rasqal_query_check_budget().
+ */
+typedef struct {
+  struct timeval deadline;
+  int have_deadline;
+  int ticks;
+  int max_rows;
+  size_t max_bytes;
+  int rows;
+  size_t bytes;
+  int aborted;
+} rasqal_query_budget;
+
+
 /*
  * A query in some query language
  */
@@ -565,9 +627,76 @@ struct rasqal_query_s {
 
   /* Variable projection (or NULL when invalid such as for ASK) */
   rasqal_projection* projection;
+
+  /* INTERNAL execution budget of the current execution */
+  rasqal_query_budget budget;
+
+  /* INTERNAL flag: non-0 when rasqal_query_cancel() was called.
+   * May be set from another thread.
+   */
+  volatile int cancelled;
+
+  /* INTERNAL query this query evaluates part of on a worker thread
+   * (or NULL); see rasqal_new_worker_query()
+   */
+  struct rasqal_query_s* parent_query;
+
+  /* INTERNAL memory account of the current execution (or NULL);
+   * owned by the query results
+   */
+  rasqal_memory_account* memory_account;
+
+  /* INTERNAL optimised algebra plan built by the first execution and
+   * shared by later ones; read-only once built (or NULL)
+   */
+  struct rasqal_algebra_node_s* algebra_plan;
+
+  /* INTERNAL number of nodes in #algebra_plan */
+  int algebra_plan_nodes_count;
+
+  /* INTERNAL result state kept between executions with
+   * #RASQAL_FEATURE_INCREMENTAL (or NULL)
+   */
+  struct rasqal_incremental_s* incremental;
+
+  /* INTERNAL sequence of #rasqal_query_parameter bound with
+   * rasqal_query_bind_parameter() (or NULL)
+   */
+  raptor_sequence* parameters;
+
+  /* INTERNAL query owning the parsed query structures shared by this
+   * query when prepared from the world query cache (or NULL).  The
+   * shared structures are owned and freed by that query.
+   */
+  rasqal_query* template_query;
+
+  /* INTERNAL normalised query key made when preparing the query with
+   * the world results cache enabled (or NULL)
+   */
+  unsigned char* results_cache_key;
+  size_t results_cache_key_len;
+
+  /* INTERNAL sequence of #rasqal_expression_memo given to equal
+   * subexpressions when preparing, reset when the query is executed
+   * or freed (or NULL).  Shared like the parsed query structures.
+   */
+  raptor_sequence* expression_memos;
 };
 
 
+/*
+ * A query parameter: a variable of a prepared query bound to a value
+ * before execution
+ */
+typedef struct {
+  /* variable (reference) */
+  rasqal_variable* variable;
+
+  /* value (owned) or NULL when not bound */
+  rasqal_literal* value;
+} rasqal_query_parameter;
+
+
 /*
  * A query language factory for a query language.
  *
@@ -630,6 +759,12 @@ struct rasqal_row_s {
   int order_size;
   rasqal_literal** order_values;
 
+  /* sort key of @order_values from rasqal_literal_sort_key() (or NULL)
+   * and the length of its prefix before any inexact key */
+  unsigned char* order_key;
+  size_t order_key_len;
+  size_t order_key_exact_len;
+
   /* Group ID */
   int group_id;
 
@@ -658,10 +793,17 @@ typedef enum {
 
 /* rasqal_rowsource_aggregation.c */
 rasqal_rowsource* rasqal_new_aggregation_rowsource(rasqal_world *world, rasqal_query* query, rasqal_rowsource* rowsource, raptor_sequence* exprs_seq, raptor_sequence* vars_seq);
+void* rasqal_builtin_agg_expression_execute_init(rasqal_world *world, rasqal_expression* expr);
+void rasqal_builtin_agg_expression_execute_finish(void* user_data);
+int rasqal_builtin_agg_expression_execute_step(void* user_data, raptor_sequence* literals);
+rasqal_literal* rasqal_builtin_agg_expression_execute_result(void* user_data);
 
 /* rasqal_rowsource_empty.c */
 rasqal_rowsource* rasqal_new_empty_rowsource(rasqal_world *world, rasqal_query* query);
 
+/* rasqal_rowsource_exchange.c */
+rasqal_rowsource* rasqal_new_exchange_rowsource(rasqal_world *world, rasqal_query* query, struct rasqal_algebra_node_s* node);
+
 /* rasqal_rowsource_engine.c */
 rasqal_rowsource* rasqal_new_execution_rowsource(rasqal_query_results* query_results);
 
@@ -678,7 +820,7 @@ rasqal_rowsource* rasqal_new_distinct_rowsource(rasqal_world *world, rasqal_quer
 rasqal_rowsource* rasqal_new_filter_rowsource(rasqal_world *world, rasqal_query *query, rasqal_rowsource* rs, rasqal_expression* expr);
 
 /* rasqal_rowsource_graph.c */
-rasqal_rowsource* rasqal_new_graph_rowsource(rasqal_world *world, rasqal_query *query, rasqal_rowsource* rowsource, rasqal_variable *var);
+rasqal_rowsource* rasqal_new_graph_rowsource(rasqal_world *world, rasqal_query *query, rasqal_rowsource* rowsource, rasqal_variable *var, int single_pass);
 
 /* rasqal_rowsource_groupby.c */
 rasqal_rowsource* rasqal_new_groupby_rowsource(rasqal_world *world, rasqal_query* query, rasqal_rowsource* rowsource, raptor_sequence* exprs_seq);
@@ -705,7 +847,8 @@ rasqal_rowsource* rasqal_new_service_rowsource(rasqal_world *world, rasqal_query
 rasqal_rowsource* rasqal_new_sort_rowsource(rasqal_world *world, rasqal_query *query, rasqal_rowsource *rowsource, raptor_sequence* order_seq, int distinct);
 
 /* rasqal_rowsource_triples.c */
-rasqal_rowsource* rasqal_new_triples_rowsource(rasqal_world *world, rasqal_query* query, rasqal_triples_source* triples_source, raptor_sequence* triples, int start_column, int end_column);
+rasqal_rowsource* rasqal_new_triples_rowsource(rasqal_world *world, rasqal_query* query, rasqal_triples_source* triples_source, raptor_sequence* triples, int start_column, int end_column, rasqal_expression* filter_expr, raptor_sequence* vars_seq);
+int rasqal_triples_rowsource_set_triples_sources(rasqal_rowsource* rowsource, rasqal_triples_source** triples_sources);
 
 /* rasqal_rowsource_union.c */
 rasqal_rowsource* rasqal_new_union_rowsource(rasqal_world *world, rasqal_query* query, rasqal_rowsource* left, rasqal_rowsource* right);
@@ -814,6 +957,18 @@ typedef rasqal_rowsource* (*rasqal_rowsource_get_inner_rowsource_func) (rasqal_r
 typedef int (*rasqal_rowsource_set_origin_func) (rasqal_rowsource* rowsource, void *user_data, rasqal_literal *origin);
 
 
+/**
+ * rasqal_rowsource_set_limit_func
+ * @user_data: user data
+ * @limit: maximum number of rows that will be read
+ *
+ * Handler function for passing a row limit hint to inner rowsources
+ *
+ * Return value: non-0 on failure
+ */
+typedef int (*rasqal_rowsource_set_limit_func) (rasqal_rowsource* rowsource, void *user_data, int limit);
+
+
 /**
  * rasqal_rowsource_handler:
  * @version: API version - 1
@@ -827,6 +982,7 @@ typedef int (*rasqal_rowsource_set_origin_func) (rasqal_rowsource* rowsource, vo
  * @set_requirements: set requirements flag handler - optional (V1)
  * @get_inner_rowsource: get inner rowsource handler - optional if has no inner rowsources (V1)
  * @set_origin: set origin (GRAPH) handler - optional (V1)
+ * @set_limit: set row limit hint handler - optional; if absent the hint is not passed to inner rowsources (V1)
  *
  * Row Source implementation factory handler structure.
  * 
@@ -844,6 +1000,7 @@ typedef struct {
   rasqal_rowsource_set_requirements_func     set_requirements;
   rasqal_rowsource_get_inner_rowsource_func  get_inner_rowsource;
   rasqal_rowsource_set_origin_func           set_origin;
+  rasqal_rowsource_set_limit_func            set_limit;
 } rasqal_rowsource_handler;
 
 
@@ -902,6 +1059,7 @@ typedef struct rasqal_results_compare_s rasqal_results_compare;
  * @offset: size of @rows_sequence
  * @generate_group: non-0 to generate a group (ID 0) around all the returned rows, if there is no grouping returned.
  * @usage: reference count
+ * @limit: maximum number of rows any reader needs between resets or <0 if unknown
  *
  * Rasqal Row Source class providing a sequence of rows of values similar to a SQL table.
  *
@@ -965,6 +1123,12 @@ struct rasqal_rowsource_s
   unsigned int generate_group : 1;
 
   int usage;
+
+  /* memory allocated while reading rows (or NULL) */
+  rasqal_memory_account* memory_account;
+
+  /* row limit hint set by rasqal_rowsource_set_limit() */
+  int limit;
 };
 
 
@@ -989,6 +1153,7 @@ int rasqal_rowsource_write(rasqal_rowsource *rowsource,  raptor_iostream *iostr)
 void rasqal_rowsource_print(rasqal_rowsource* rs, FILE* fh);
 int rasqal_rowsource_ensure_variables(rasqal_rowsource *rowsource);
 int rasqal_rowsource_set_origin(rasqal_rowsource* rowsource, rasqal_literal *literal);
+int rasqal_rowsource_set_limit(rasqal_rowsource* rowsource, int limit);
 int rasqal_rowsource_request_grouping(rasqal_rowsource* rowsource);
 void rasqal_rowsource_remove_all_variables(rasqal_rowsource *rowsource);
 
@@ -1097,6 +1262,11 @@ char* rasqal_vsnprintf(const char* message, va_list arguments);
 unsigned char* rasqal_world_generate_bnodeid(rasqal_world* world, unsigned char *user_bnodeid);
 int rasqal_world_reset_now(rasqal_world* world);
 struct timeval* rasqal_world_get_now_timeval(rasqal_world* world);
+rasqal_memory_account* rasqal_new_memory_account(rasqal_memory_account* parent);
+void rasqal_free_memory_account(rasqal_memory_account* account);
+rasqal_memory_account* rasqal_memory_account_enter(rasqal_memory_account* account);
+void rasqal_memory_account_leave(rasqal_memory_account* previous);
+int rasqal_memory_account_get_usage(rasqal_memory_account* account, size_t* current_p, size_t* peak_p);
 
 
 typedef enum {
@@ -1192,6 +1362,7 @@ int rasqal_double_approximately_equal(double a, double b);
 rasqal_literal* rasqal_new_string_literal_node(rasqal_world*, const unsigned char *string, const char *language, raptor_uri *datatype);
 int rasqal_literal_as_boolean(rasqal_literal* literal, int* error_p);
 int rasqal_literal_as_integer(rasqal_literal* l, int* error_p);
+rasqal_int64 rasqal_literal_as_integer64(rasqal_literal* l, int* error_p);
 double rasqal_literal_as_double(rasqal_literal* l, int* error_p);
 raptor_uri* rasqal_literal_as_uri(rasqal_literal* l);
 int rasqal_literal_string_to_native(rasqal_literal *l, int flags);
@@ -1205,6 +1376,7 @@ int rasqal_expression_is_constant(rasqal_expression* e);
 void rasqal_expression_clear(rasqal_expression* e);
 void rasqal_expression_convert_to_literal(rasqal_expression* e, rasqal_literal* l);
 int rasqal_expression_mentions_variable(rasqal_expression* e, rasqal_variable* v);
+int rasqal_expression_get_conjuncts(rasqal_expression* e, raptor_sequence* seq);
 void rasqal_triple_write(rasqal_triple* t, raptor_iostream* iostr);
 void rasqal_variable_write(rasqal_variable* v, raptor_iostream* iostr);
 int rasqal_expression_is_aggregate(rasqal_expression* e);
@@ -1219,6 +1391,34 @@ int rasqal_literal_sequence_equals(raptor_sequence* values_a, raptor_sequence* v
 
 /* rasqal_expr_evaluate.c */
 int rasqal_language_matches(const unsigned char* lang_tag, const unsigned char* lang_range);
+typedef struct rasqal_in_set_s rasqal_in_set;
+int rasqal_expression_prepare_in_set(rasqal_expression* e);
+void rasqal_free_in_set(rasqal_in_set* set);
+typedef struct rasqal_expression_memo_s rasqal_expression_memo;
+rasqal_expression_memo* rasqal_new_expression_memo(rasqal_variable** variables, int variables_count);
+rasqal_expression_memo* rasqal_new_expression_memo_from_expression_memo(rasqal_expression_memo* memo);
+void rasqal_free_expression_memo(rasqal_expression_memo* memo);
+void rasqal_expression_memo_reset(rasqal_expression_memo* memo);
+void rasqal_query_reset_expression_memos(rasqal_query* query);
+
+/*
+ * rasqal_expression_internal:
+ * @expression: the public expression fields
+ * @in_set: prepared set of constant #RASQAL_EXPR_IN and #RASQAL_EXPR_NOT_IN members (or NULL)
+ * @memo: per-row result shared by equal subexpressions of a query (or NULL)
+ *
+ * INTERNAL - Expression as allocated by the expression constructors
+ *
+ * Keeps the fields used only by query execution out of the public
+ * #rasqal_expression structure.
+ */
+typedef struct {
+  rasqal_expression expression;
+  rasqal_in_set* in_set;
+  rasqal_expression_memo* memo;
+} rasqal_expression_internal;
+
+#define RASQAL_EXPRESSION_INTERNAL(e) (RASQAL_GOOD_CAST(rasqal_expression_internal*, e))
 
 /* rasqal_expr_datetimes.c */
 rasqal_literal* rasqal_expression_evaluate_now(rasqal_expression *e, rasqal_evaluation_context *eval_context, int *error_p);
@@ -1266,15 +1466,35 @@ int rasqal_strncasecmp(const char* s1, const char* s2, size_t n);
 #  endif
 #endif
 
-/* timegm.c */
-#ifdef HAVE_TIMEGM
-#define rasqal_timegm timegm
-#else
-time_t rasqal_timegm(struct tm *tm);
-#endif
-
 /* rasqal_raptor.c */
+typedef struct rasqal_raptor_loaded_graph_s rasqal_raptor_loaded_graph;
+
 int rasqal_raptor_init(rasqal_world*);
+void rasqal_raptor_finish(rasqal_world* world);
+unsigned long rasqal_raptor_data_graph_epoch(rasqal_world* world, rasqal_data_graph* dg);
+int rasqal_raptor_is_triples_source(rasqal_world* world);
+int rasqal_raptor_triples_source_set_epochs(rasqal_triples_source* rts, unsigned long after, unsigned long until);
+int rasqal_raptor_triples_source_get_graph_epochs(rasqal_triples_source* rts, int i, unsigned long* load_epoch_p, unsigned long* epoch_p);
+
+/* rasqal_query_cache.c */
+typedef struct rasqal_query_cache_entry_s rasqal_query_cache_entry;
+
+unsigned char* rasqal_query_cache_make_key(rasqal_query* query, const unsigned char* query_string, raptor_uri* base_uri, size_t* key_len_p);
+rasqal_query* rasqal_query_cache_get(rasqal_world* world, const unsigned char* key, size_t key_len);
+int rasqal_query_cache_add(rasqal_world* world, unsigned char* key, size_t key_len, rasqal_query* template_query);
+
+/* rasqal_results_cache.c */
+typedef struct rasqal_results_cache_entry_s rasqal_results_cache_entry;
+
+unsigned char* rasqal_results_cache_make_key(rasqal_query* query, size_t* key_len_p);
+raptor_sequence* rasqal_results_cache_get(rasqal_world* world, const unsigned char* key, size_t key_len, rasqal_variables_table* vars_table);
+int rasqal_results_cache_add(rasqal_world* world, unsigned char* key, size_t key_len, raptor_sequence* rows);
+
+/* rasqal_strings.c */
+size_t rasqal_string_ascii_prefix_length(const unsigned char* s, size_t len);
+int rasqal_utf8_strlen(const unsigned char* s, size_t len);
+const unsigned char* rasqal_string_search(const unsigned char* haystack, size_t haystack_len, const unsigned char* needle, size_t needle_len);
+void rasqal_string_set_case(unsigned char* dest, const unsigned char* src, size_t len, int upper);
 
 #ifdef RAPTOR_TRIPLES_SOURCE_REDLAND
 /* rasqal_redland.c */
@@ -1309,7 +1529,9 @@ extern const unsigned char* rasqal_xsd_boolean_false;
 
 rasqal_literal* rasqal_literal_cast(rasqal_literal* l, raptor_uri* datatype, int flags,  int* error_p);
 rasqal_literal* rasqal_new_numeric_literal(rasqal_world*, rasqal_literal_type type, double d);
+rasqal_literal* rasqal_new_integer64_literal(rasqal_world* world, rasqal_literal_type type, rasqal_int64 integer);
 int rasqal_literal_is_numeric(rasqal_literal* literal);
+const unsigned char* rasqal_literal_as_counted_string_chars(rasqal_literal* l, size_t *len_p, int *chars_p, int flags, int *error_p);
 rasqal_literal* rasqal_literal_add(rasqal_literal* l1, rasqal_literal* l2, int *error);
 rasqal_literal* rasqal_literal_subtract(rasqal_literal* l1, rasqal_literal* l2, int *error);
 rasqal_literal* rasqal_literal_multiply(rasqal_literal* l1, rasqal_literal* l2, int *error);
@@ -1329,6 +1551,7 @@ int rasqal_literal_write_turtle(rasqal_literal* l, raptor_iostream* iostr);
 int rasqal_literal_array_equals(rasqal_literal** values_a, rasqal_literal** values_b, int size);
 int rasqal_literal_array_compare(rasqal_literal** values_a, rasqal_literal** values_b, raptor_sequence* exprs_seq, int size, int compare_flags);
 int rasqal_literal_array_compare_by_order(rasqal_literal** values_a, rasqal_literal** values_b, int* order, int size, int compare_flags);
+size_t rasqal_literal_sort_key(rasqal_literal* l, unsigned char* buffer, int* exact_p);
 rasqal_map* rasqal_new_literal_sequence_sort_map(int is_distinct, int compare_flags);
 int rasqal_literal_sequence_sort_map_add_literal_sequence(rasqal_map* map, raptor_sequence* literals_sequence);
 raptor_sequence* rasqal_new_literal_sequence_of_sequence_from_data(rasqal_world* world, const char* const row_data[], int width);
@@ -1362,8 +1585,11 @@ rasqal_triple_parts rasqal_query_variable_bound_in_triple(rasqal_query* query, r
 int rasqal_query_store_select_query(rasqal_query* query, rasqal_projection* projection, raptor_sequence* data_graphs, rasqal_graph_pattern* where_gp, rasqal_solution_modifier* modifier);
 int rasqal_query_reset_select_query(rasqal_query* query);
 rasqal_projection* rasqal_query_get_projection(rasqal_query* query);
+rasqal_literal* rasqal_query_get_parameter_value(rasqal_query* query, rasqal_variable* v);
+int rasqal_query_set_parameter_variables(rasqal_query* query);
 int rasqal_query_set_projection(rasqal_query* query, rasqal_projection* projection);
 int rasqal_query_set_modifier(rasqal_query* query, rasqal_solution_modifier* modifier);
+rasqal_query* rasqal_new_worker_query(rasqal_query* query);
 
 /* rasqal_query_results.c */
 int rasqal_init_query_results(void);
@@ -1427,6 +1653,7 @@ raptor_sequence* rasqal_row_sequence_copy(raptor_sequence *seq);
 void rasqal_row_set_rowsource(rasqal_row* row, rasqal_rowsource* rowsource);
 void rasqal_row_set_weak_rowsource(rasqal_row* row, rasqal_rowsource* rowsource);
 rasqal_variable* rasqal_row_get_variable_by_offset(rasqal_row* row, int offset);
+size_t rasqal_row_get_size_estimate(rasqal_row* row);
 
 raptor_sequence* rasqal_variables_table_take_bindings(rasqal_variables_table* vt);
 void rasqal_variables_table_install_bindings(rasqal_variables_table* vt, raptor_sequence* bindings_sequence);
@@ -1461,7 +1688,7 @@ const char* rasqal_xsd_datatype_label(rasqal_literal_type native_type);
 int rasqal_xsd_is_datatype_uri(rasqal_world*, raptor_uri* uri);
 
 int rasqal_xsd_datatype_is_numeric(rasqal_literal_type type);
-unsigned char* rasqal_xsd_format_integer(int i, size_t *len_p);
+unsigned char* rasqal_xsd_format_integer(rasqal_int64 i, size_t *len_p);
 unsigned char* rasqal_xsd_format_float(float f, size_t *len_p);
 unsigned char* rasqal_xsd_format_double(double d, size_t *len_p);
 rasqal_literal_type rasqal_xsd_datatype_parent_type(rasqal_literal_type type);
@@ -1525,6 +1752,37 @@ struct rasqal_world_s {
 
   /* generated counter - increments at every generation */
   int genid_counter;
+
+  /* graphs parsed by the raptor triples source that may be shared */
+  rasqal_raptor_loaded_graph* loaded_graphs;
+
+  /* counter for blank node ID bases of loaded graphs */
+  int loaded_graphs_counter;
+
+  /* cache of prepared queries in most recently used first order */
+  rasqal_query_cache_entry* query_cache;
+
+  /* maximum number of entries in #query_cache; 0 to disable */
+  int query_cache_size;
+
+  /* number of entries in #query_cache */
+  int query_cache_count;
+
+  /* counter for epochs of loaded graphs - increments at every load */
+  unsigned long loaded_graphs_epoch;
+
+  /* cache of stored query results in most recently used first order */
+  rasqal_results_cache_entry* results_cache;
+
+  /* maximum bytes used by #results_cache; 0 to disable */
+  size_t results_cache_size;
+
+  /* bytes used by #results_cache */
+  size_t results_cache_used;
+
+  /* lookups in #results_cache that were found and not found */
+  unsigned long results_cache_hits;
+  unsigned long results_cache_misses;
 };
 
 
@@ -1592,6 +1850,7 @@ struct rasqal_algebra_node_s {
   struct rasqal_algebra_node_s *node2;
 
   /* types FILTER, LEFTJOIN
+   * type BGP: filter pushed down into the triple patterns (or NULL)
    * (otherwise NULL) 
    */
   rasqal_expression* expr;
@@ -1605,7 +1864,9 @@ struct rasqal_algebra_node_s {
   /* types PROJECT, DISTINCT, REDUCED
    * FIXME: sequence of solution mappings */
 
-  /* types PROJECT, AGGREGATION: sequence of #rasqal_variable */
+  /* types PROJECT, AGGREGATION: sequence of #rasqal_variable
+   * type BGP: the variables needed above the node or NULL for all
+   */
   raptor_sequence* vars_seq;
 
   /* type SLICE: limit and offset rows */
@@ -1743,6 +2004,7 @@ int rasqal_variables_write(raptor_sequence* seq, raptor_iostream* iostr);
  * @RASQAL_ENGINE_OK:
  * @RASQAL_ENGINE_FAILED:
  * @RASQAL_ENGINE_FINISHED:
+ * @RASQAL_ENGINE_ABORTED: execution stopped by timeout, cancellation or exceeding a row or memory budget
  *
  * Execution engine errors.
  *
@@ -1751,7 +2013,8 @@ typedef enum {
   RASQAL_ENGINE_OK,
   RASQAL_ENGINE_FAILED,
   RASQAL_ENGINE_FINISHED,
-  RASQAL_ENGINE_ERROR_LAST = RASQAL_ENGINE_FINISHED
+  RASQAL_ENGINE_ABORTED,
+  RASQAL_ENGINE_ERROR_LAST = RASQAL_ENGINE_ABORTED
 } rasqal_engine_error;
 
 
@@ -1815,6 +2078,10 @@ struct rasqal_query_execution_factory_s {
 const char* rasqal_engine_get_parts_string(rasqal_triple_parts parts);
 const char* rasqal_engine_error_as_string(rasqal_engine_error error);
 #endif
+int rasqal_query_budget_start(rasqal_query* query);
+int rasqal_query_check_budget(rasqal_query* query);
+int rasqal_query_budget_abort(rasqal_query* query, const char* reason);
+int rasqal_query_budget_add_row(rasqal_query* query, rasqal_row* row);
 
 
 /* rasqal_engine_sort.c */
@@ -1822,6 +2089,10 @@ rasqal_map* rasqal_engine_new_rowsort_map(int is_distinct, int compare_flags, ra
 int rasqal_engine_rowsort_map_add_row(rasqal_map* map, rasqal_row* row);
 raptor_sequence* rasqal_engine_rowsort_map_to_sequence(rasqal_map* map, raptor_sequence* seq);
 int rasqal_engine_rowsort_calculate_order_values(rasqal_query* query, raptor_sequence* order_seq, rasqal_row* row);
+int rasqal_engine_rowsort_calculate_order_key(rasqal_query* query, raptor_sequence* order_seq, rasqal_row* row);
+int rasqal_engine_rowsort_compare_rows(raptor_sequence* order_conditions_sequence, int compare_flags, rasqal_row* row_a, rasqal_row* row_b);
+int rasqal_engine_rowsort_get_threads(rasqal_row** rows, int size, int is_distinct, int threads);
+int rasqal_engine_rowsort_sort_rows(rasqal_row** rows, int size, int is_distinct, int compare_flags, raptor_sequence* order_conditions_sequence, int threads, raptor_sequence* seq);
 
 
 /* rasqal_engine_algebra.c */
@@ -1829,9 +2100,50 @@ int rasqal_engine_rowsort_calculate_order_values(rasqal_query* query, raptor_seq
 /* New query engine based on executing over query algebra */
 extern const rasqal_query_execution_factory rasqal_query_engine_algebra;
 
+/* rasqal_incremental.c */
+typedef struct rasqal_incremental_s rasqal_incremental;
+
+rasqal_incremental* rasqal_new_incremental(rasqal_query* query, rasqal_algebra_node* plan);
+void rasqal_free_incremental(rasqal_incremental* inc);
+void rasqal_incremental_reset(rasqal_incremental* inc);
+rasqal_algebra_node* rasqal_incremental_get_node(rasqal_incremental* inc);
+rasqal_algebra_node* rasqal_incremental_get_delta_node(rasqal_incremental* inc);
+int* rasqal_incremental_get_columns(rasqal_incremental* inc, int* count_p);
+int rasqal_incremental_start(rasqal_incremental* inc, rasqal_triples_source* rts, unsigned long* after_p, unsigned long* until_p);
+int rasqal_incremental_add_rows(rasqal_incremental* inc, rasqal_rowsource* rowsource);
+rasqal_rowsource* rasqal_incremental_new_rowsource(rasqal_incremental* inc);
+
 /* rasqal_iostream.c */
 raptor_iostream* rasqal_new_iostream_from_stringbuffer(raptor_world *raptor_world_ptr, raptor_stringbuffer* sb);
 
+#define RASQAL_WRITE_BUFFER_DEFAULT_SIZE 65536
+
+/*
+ * rasqal_write_buffer:
+ * @iostr: iostream written to when the buffer is flushed (shared)
+ * @buffer: output buffer
+ * @size: size of @buffer
+ * @offset: number of bytes used in @buffer
+ *
+ * INTERNAL - Output buffer for building rows and writing them to an
+ * iostream in large blocks.
+ */
+typedef struct {
+  raptor_iostream* iostr;
+  unsigned char* buffer;
+  size_t size;
+  size_t offset;
+} rasqal_write_buffer;
+
+rasqal_write_buffer* rasqal_new_write_buffer(raptor_iostream* iostr, size_t size);
+void rasqal_free_write_buffer(rasqal_write_buffer* wb);
+int rasqal_write_buffer_flush(rasqal_write_buffer* wb);
+int rasqal_write_buffer_write_counted_string(rasqal_write_buffer* wb, const void *string, size_t len);
+int rasqal_write_buffer_write_byte(rasqal_write_buffer* wb, const int c);
+int rasqal_write_buffer_write_ntriples_string(rasqal_write_buffer* wb, const unsigned char *string, size_t len, const char delim);
+size_t rasqal_string_ntriples_plain_length(const unsigned char *string, size_t len, const char delim);
+size_t rasqal_string_csv_plain_length(const unsigned char *string, size_t len);
+
 /* rasqal_service.c */
 rasqal_rowsource* rasqal_service_execute_as_rowsource(rasqal_service* svc, rasqal_variables_table* vars_table);
 
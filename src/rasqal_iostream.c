@@ -160,3 +160,357 @@ rasqal_new_iostream_from_stringbuffer(raptor_world *raptor_world_ptr,
 
   return raptor_new_iostream_from_handler(raptor_world_ptr, con, handler);
 }
+
+
+/*
+ * Word-at-a-time (SWAR) byte tests over 8 bytes at once.
+ *
+ * RASQAL_SWAR_HAS_LESS(x, n) is non-0 if any byte in x is < n (n <= 128)
+ * RASQAL_SWAR_HAS_BYTE(x, b) is non-0 if any byte in x equals b
+ * RASQAL_SWAR_HAS_HIGH(x) is non-0 if any byte in x is >= 0x80
+ */
+#define RASQAL_SWAR_ONES  RASQAL_GOOD_CAST(uint64_t, 0x0101010101010101ULL)
+#define RASQAL_SWAR_HIGHS RASQAL_GOOD_CAST(uint64_t, 0x8080808080808080ULL)
+#define RASQAL_SWAR_HAS_LESS(x, n) \
+  (((x) - RASQAL_SWAR_ONES * (n)) & ~(x) & RASQAL_SWAR_HIGHS)
+#define RASQAL_SWAR_HAS_BYTE(x, b) \
+  RASQAL_SWAR_HAS_LESS((x) ^ (RASQAL_SWAR_ONES * (b)), 1)
+#define RASQAL_SWAR_HAS_HIGH(x) ((x) & RASQAL_SWAR_HIGHS)
+
+
+/* non-0 if byte @c can be written as-is in an N-Triples string with @delim */
+#define RASQAL_NTRIPLES_PLAIN_BYTE(c, delim) \
+  ((c) >= 0x20 && (c) < 0x7f && (c) != '\\' && (c) != (delim))
+
+
+/*
+ * rasqal_string_ntriples_plain_length:
+ * @string: string
+ * @len: length of @string
+ * @delim: string delimiter or '\0' for none
+ *
+ * INTERNAL - Get the length of the prefix of @string that needs no escaping
+ *
+ * Scans 8 bytes at a time for any byte that raptor_string_ntriples_write()
+ * would escape: control characters, DEL, non-ASCII, backslash or @delim.
+ *
+ * Return value: length of unescaped prefix (@len if none need escaping)
+ */
+size_t
+rasqal_string_ntriples_plain_length(const unsigned char *string, size_t len,
+                                    const char delim)
+{
+  const unsigned char d = RASQAL_GOOD_CAST(unsigned char, delim);
+  size_t i = 0;
+
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+
+    memcpy(&w, string + i, 8);
+    if(RASQAL_SWAR_HAS_HIGH(w) ||
+       RASQAL_SWAR_HAS_LESS(w, 0x20) ||
+       RASQAL_SWAR_HAS_BYTE(w, 0x7f) ||
+       RASQAL_SWAR_HAS_BYTE(w, '\\') ||
+       (d && RASQAL_SWAR_HAS_BYTE(w, d)))
+      break;
+  }
+
+  for(; i < len; i++) {
+    unsigned char c = string[i];
+    if(!RASQAL_NTRIPLES_PLAIN_BYTE(c, d))
+      break;
+  }
+
+  return i;
+}
+
+
+/*
+ * rasqal_string_csv_plain_length:
+ * @string: string
+ * @len: length of @string
+ *
+ * INTERNAL - Get the length of the prefix of @string that needs no CSV quoting
+ *
+ * Scans 8 bytes at a time for a double quote, comma, linefeed or return.
+ *
+ * Return value: length of unquoted prefix (@len if no quoting needed)
+ */
+size_t
+rasqal_string_csv_plain_length(const unsigned char *string, size_t len)
+{
+  size_t i = 0;
+
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+
+    memcpy(&w, string + i, 8);
+    if(RASQAL_SWAR_HAS_BYTE(w, '"') ||
+       RASQAL_SWAR_HAS_BYTE(w, ',') ||
+       RASQAL_SWAR_HAS_BYTE(w, '\r') ||
+       RASQAL_SWAR_HAS_BYTE(w, '\n'))
+      break;
+  }
+
+  for(; i < len; i++) {
+    unsigned char c = string[i];
+    if(c == '"' || c == ',' || c == '\r' || c == '\n')
+      break;
+  }
+
+  return i;
+}
+
+
+/*
+ * rasqal_new_write_buffer:
+ * @iostr: iostream to write to (shared)
+ * @size: buffer size in bytes or 0 for the default
+ *
+ * INTERNAL - create a new output buffer that writes to @iostr in large blocks
+ *
+ * Return value: new write buffer or NULL on failure
+ */
+rasqal_write_buffer*
+rasqal_new_write_buffer(raptor_iostream* iostr, size_t size)
+{
+  rasqal_write_buffer* wb;
+
+  if(!iostr)
+    return NULL;
+
+  if(!size)
+    size = RASQAL_WRITE_BUFFER_DEFAULT_SIZE;
+
+  wb = RASQAL_CALLOC(rasqal_write_buffer*, 1, sizeof(*wb));
+  if(!wb)
+    return NULL;
+
+  wb->buffer = RASQAL_MALLOC(unsigned char*, size);
+  if(!wb->buffer) {
+    RASQAL_FREE(rasqal_write_buffer, wb);
+    return NULL;
+  }
+
+  wb->iostr = iostr;
+  wb->size = size;
+  wb->offset = 0;
+
+  return wb;
+}
+
+
+/*
+ * rasqal_free_write_buffer:
+ * @wb: write buffer
+ *
+ * INTERNAL - flush and destroy a write buffer
+ */
+void
+rasqal_free_write_buffer(rasqal_write_buffer* wb)
+{
+  if(!wb)
+    return;
+
+  rasqal_write_buffer_flush(wb);
+
+  if(wb->buffer)
+    RASQAL_FREE(unsigned char*, wb->buffer);
+
+  RASQAL_FREE(rasqal_write_buffer, wb);
+}
+
+
+/*
+ * rasqal_write_buffer_flush:
+ * @wb: write buffer
+ *
+ * INTERNAL - write all buffered bytes to the iostream
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_write_buffer_flush(rasqal_write_buffer* wb)
+{
+  size_t len = wb->offset;
+
+  if(!len)
+    return 0;
+
+  wb->offset = 0;
+  if(raptor_iostream_write_bytes(wb->buffer, 1, len, wb->iostr) !=
+     RASQAL_BAD_CAST(int, len))
+    return 1;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_write_buffer_write_counted_string:
+ * @wb: write buffer
+ * @string: bytes to write
+ * @len: length of @string
+ *
+ * INTERNAL - append bytes to the write buffer, flushing as needed
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_write_buffer_write_counted_string(rasqal_write_buffer* wb,
+                                         const void *string, size_t len)
+{
+  if(len > wb->size - wb->offset) {
+    if(rasqal_write_buffer_flush(wb))
+      return 1;
+
+    /* too large to buffer: write it directly */
+    if(len > wb->size)
+      return (raptor_iostream_write_bytes(string, 1, len, wb->iostr) !=
+              RASQAL_BAD_CAST(int, len));
+  }
+
+  memcpy(wb->buffer + wb->offset, string, len);
+  wb->offset += len;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_write_buffer_write_byte:
+ * @wb: write buffer
+ * @c: byte
+ *
+ * INTERNAL - append a byte to the write buffer, flushing as needed
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_write_buffer_write_byte(rasqal_write_buffer* wb, const int c)
+{
+  if(wb->offset == wb->size && rasqal_write_buffer_flush(wb))
+    return 1;
+
+  wb->buffer[wb->offset++] = RASQAL_BAD_CAST(unsigned char, c);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_write_buffer_write_escape:
+ * @wb: write buffer
+ * @escape: escape character 'u' or 'U'
+ * @value: code point
+ * @digits: number of hexadecimal digits
+ *
+ * INTERNAL - append a backslash u or U escape of a code point
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_write_buffer_write_escape(rasqal_write_buffer* wb, const char escape,
+                                 unsigned long value, int digits)
+{
+  static const char hex_digits[] = "0123456789ABCDEF";
+  unsigned char buf[10];
+  int i;
+
+  buf[0] = '\\';
+  buf[1] = RASQAL_GOOD_CAST(unsigned char, escape);
+  for(i = digits + 1; i > 1; i--) {
+    buf[i] = RASQAL_GOOD_CAST(unsigned char, hex_digits[value & 0xf]);
+    value >>= 4;
+  }
+
+  return rasqal_write_buffer_write_counted_string(wb, buf,
+                                                  RASQAL_GOOD_CAST(size_t, digits + 2));
+}
+
+
+/*
+ * rasqal_write_buffer_write_ntriples_string:
+ * @wb: write buffer
+ * @string: UTF-8 string to write
+ * @len: length of @string
+ * @delim: string delimiter or '\0' for none
+ *
+ * INTERNAL - write a string escaped as raptor_string_ntriples_write() does
+ *
+ * Runs of bytes that need no escaping are copied into the buffer
+ * whole; the other bytes are escaped into the buffer one at a time
+ * with the same escapes as raptor_string_ntriples_write() so the
+ * output is identical.  As there, a NUL ends the string.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_write_buffer_write_ntriples_string(rasqal_write_buffer* wb,
+                                          const unsigned char *string,
+                                          size_t len, const char delim)
+{
+  const unsigned char d = RASQAL_GOOD_CAST(unsigned char, delim);
+
+  while(len > 0) {
+    size_t plain_len;
+    unsigned char c;
+    int rc;
+
+    plain_len = rasqal_string_ntriples_plain_length(string, len, delim);
+    if(plain_len) {
+      if(rasqal_write_buffer_write_counted_string(wb, string, plain_len))
+        return 1;
+      string += plain_len;
+      len -= plain_len;
+      if(!len)
+        break;
+    }
+
+    c = *string;
+    if(!c)
+      break;
+
+    if((d && c == d && (c == '\'' || c == '"')) || c == '\\') {
+      rc = rasqal_write_buffer_write_byte(wb, '\\') ||
+           rasqal_write_buffer_write_byte(wb, c);
+    } else if(d && c == d)
+      rc = rasqal_write_buffer_write_escape(wb, 'u', c, 4);
+    else if(c == '\t')
+      rc = rasqal_write_buffer_write_counted_string(wb, "\\t", 2);
+    else if(c == '\n')
+      rc = rasqal_write_buffer_write_counted_string(wb, "\\n", 2);
+    else if(c == '\r')
+      rc = rasqal_write_buffer_write_counted_string(wb, "\\r", 2);
+    else if(c == '\b')
+      rc = rasqal_write_buffer_write_counted_string(wb, "\\b", 2);
+    else if(c == '\f')
+      rc = rasqal_write_buffer_write_counted_string(wb, "\\f", 2);
+    else if(c < 0x80)
+      rc = rasqal_write_buffer_write_escape(wb, 'u', c, 4);
+    else {
+      raptor_unichar unichar;
+      int unichar_len;
+
+      unichar_len = raptor_unicode_utf8_string_get_char(string, len, &unichar);
+      /* UTF-8 encoding error or truncated at the end of the string */
+      if(unichar_len < 0 || RASQAL_GOOD_CAST(size_t, unichar_len) > len)
+        return 1;
+
+      if(unichar < 0x10000)
+        rc = rasqal_write_buffer_write_escape(wb, 'u', unichar, 4);
+      else
+        rc = rasqal_write_buffer_write_escape(wb, 'U', unichar, 8);
+
+      string += unichar_len - 1;
+      len -= RASQAL_GOOD_CAST(size_t, unichar_len - 1);
+    }
+    if(rc)
+      return 1;
+
+    string++;
+    len--;
+  }
+
+  return 0;
+}
@@ -67,6 +67,16 @@
 
 #define DEBUG_FH stderr
 
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+/* literals of the loaded graphs are referenced by the worker threads
+ * of exchange rowsources too */
+#define RASQAL_LITERAL_USAGE_INCREMENT(l) __sync_add_and_fetch(&(l)->usage, 1)
+#define RASQAL_LITERAL_USAGE_DECREMENT(l) __sync_sub_and_fetch(&(l)->usage, 1)
+#else
+#define RASQAL_LITERAL_USAGE_INCREMENT(l) (++(l)->usage)
+#define RASQAL_LITERAL_USAGE_DECREMENT(l) (--(l)->usage)
+#endif
+
 
 #ifndef STANDALONE
 
@@ -95,6 +105,24 @@ const unsigned char* rasqal_xsd_boolean_false = (const unsigned char*)"false";
 rasqal_literal*
 rasqal_new_integer_literal(rasqal_world* world, rasqal_literal_type type,
                            int integer)
+{
+  return rasqal_new_integer64_literal(world, type, integer);
+}
+
+
+/*
+ * rasqal_new_integer64_literal:
+ * @world: rasqal world object
+ * @type: Type of literal such as RASQAL_LITERAL_INTEGER or RASQAL_LITERAL_BOOLEAN
+ * @integer: 64 bit integer value
+ *
+ * INTERNAL - Create a new Rasqal integer literal from a 64 bit integer
+ *
+ * Return value: New #rasqal_literal or NULL on failure
+ */
+rasqal_literal*
+rasqal_new_integer64_literal(rasqal_world* world, rasqal_literal_type type,
+                             rasqal_int64 integer)
 {
   raptor_uri* dt_uri;
   rasqal_literal* l;
@@ -141,8 +169,8 @@ rasqal_new_integer_literal(rasqal_world* world, rasqal_literal_type type,
  *
  * Constructor - Create a new Rasqal numeric literal from a long.
  * 
- * The value is turned into a rasqal integer or decimal literal and
- * given a datatype of xsd:integer
+ * The value is turned into a rasqal integer literal and given a
+ * datatype of xsd:integer
  * 
  * Return value: New #rasqal_literal or NULL on failure
  **/
@@ -151,9 +179,6 @@ rasqal_new_numeric_literal_from_long(rasqal_world* world,
                                      rasqal_literal_type type,
                                      long value)
 {
-  rasqal_xsd_decimal* d;
-  unsigned char *string;
-
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
   /* boolean values should always be in range */
@@ -162,17 +187,8 @@ rasqal_new_numeric_literal_from_long(rasqal_world* world,
     return rasqal_new_integer_literal(world, type, ivalue);
   }
   
-  /* For other types, if in int range, make an integer literal */
-  if(value >= INT_MIN && value <= INT_MAX) {
-    return rasqal_new_integer_literal(world, type, RASQAL_GOOD_CAST(int, value));
-  }
-
-  /* Otherwise turn it into a decimal */
-  d = rasqal_new_xsd_decimal(world);
-  rasqal_xsd_decimal_set_long(d, value);
-  string = RASQAL_GOOD_CAST(unsigned char*, rasqal_xsd_decimal_as_counted_string(d, NULL));
-
-  return rasqal_new_decimal_literal_from_decimal(world, string, d);
+  /* For other types, a long always fits in a 64 bit integer literal */
+  return rasqal_new_integer64_literal(world, type, value);
 }
 
 
@@ -489,8 +505,10 @@ rasqal_new_numeric_literal(rasqal_world* world, rasqal_literal_type type,
 
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE: 
-      if(d >= (double)INT_MIN && d <= (double)INT_MAX)
-        return rasqal_new_integer_literal(world, type, RASQAL_GOOD_CAST(int, d));
+      /* -(double)INT64_MIN is 2^63 which is exact unlike INT64_MAX */
+      if(d >= (double)INT64_MIN && d < -(double)INT64_MIN)
+        return rasqal_new_integer64_literal(world, type,
+                                            RASQAL_GOOD_CAST(rasqal_int64, d));
 
       /* otherwise FALLTHROUGH and make it a decimal. */
 
@@ -577,6 +595,78 @@ rasqal_new_datetime_literal_from_datetime(rasqal_world* world,
 }
 
 
+/*
+ * rasqal_literal_string_to_int64:
+ * @string: integer lexical form
+ * @value_p: pointer to store value
+ *
+ * INTERNAL - Parse an xsd:integer lexical form as a 64 bit integer
+ *
+ * Return value: 0 on success, >0 if out of range or <0 if not an integer
+ */
+static int
+rasqal_literal_string_to_int64(const unsigned char* string,
+                               rasqal_int64* value_p)
+{
+  const unsigned char* p = string;
+  uint64_t max = INT64_MAX;
+  uint64_t u = 0;
+  int negative = 0;
+
+  if(*p == '+' || *p == '-')
+    negative = (*p++ == '-');
+
+  if(!*p)
+    return -1;
+
+  /* magnitude of INT64_MIN is one more than INT64_MAX */
+  if(negative)
+    max++;
+
+  for(; *p; p++) {
+    unsigned int digit;
+
+    if(*p < '0' || *p > '9')
+      return -1;
+
+    digit = RASQAL_GOOD_CAST(unsigned int, *p - '0');
+    if(u > (max - digit) / 10)
+      return 1;
+
+    u = u * 10 + digit;
+  }
+
+  if(!negative)
+    *value_p = RASQAL_GOOD_CAST(rasqal_int64, u);
+  else if(u == max)
+    *value_p = INT64_MIN;
+  else
+    *value_p = -RASQAL_GOOD_CAST(rasqal_int64, u);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_literal_count_chars:
+ * @l: string literal
+ *
+ * INTERNAL - Count the codepoints of a string literal into its char_len
+ *
+ * Done when the literal is made so literals shared between queries
+ * and threads, such as cached data graph triples, are only read.
+ */
+static void
+rasqal_literal_count_chars(rasqal_literal* l)
+{
+  int chars = 0;
+
+  if(l->string && l->string_len)
+    chars = rasqal_utf8_strlen(l->string, l->string_len);
+
+  l->char_len = (chars > 0) ? chars : 0;
+}
+
 
 /*
  * rasqal_literal_set_typed_value:
@@ -594,7 +684,6 @@ rasqal_literal_set_typed_value(rasqal_literal* l, rasqal_literal_type type,
                                const unsigned char* string,
                                int canonicalize)
 {  
-  char *eptr;
   raptor_uri* dt_uri;
   int i;
   double d;
@@ -602,6 +691,9 @@ rasqal_literal_set_typed_value(rasqal_literal* l, rasqal_literal_type type,
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(l, rasqal_literal, 1);
 
+  /* l->string may be replaced below */
+  l->char_len = 0;
+
 retype:
   l->valid = rasqal_xsd_datatype_check(type, string ? string : l->string,
                                        0 /* no flags set */);
@@ -644,24 +736,20 @@ retype:
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
       if(1) {
-        long long_i;
+        rasqal_int64 integer = 0;
+        int rc;
 
-        eptr = NULL;
-        errno = 0;
-        long_i = strtol(RASQAL_GOOD_CAST(const char*, l->string), &eptr, 10);
-        if(*eptr)
+        rc = rasqal_literal_string_to_int64(l->string, &integer);
+        if(rc < 0)
           return 1;
 
-        if(errno == ERANGE) {
-          /* under or overflow of strtol() so fallthrough to DECIMAL */
-
-        } else if(long_i >= INT_MIN && long_i <= INT_MAX) {
-          l->value.integer = RASQAL_GOOD_CAST(int, long_i);
+        if(!rc) {
+          l->value.integer = integer;
           break;
         }
       }
       
-      /* Will not fit in an int so turn it into a decimal */
+      /* Will not fit in a 64 bit integer so turn it into a decimal */
       type = RASQAL_LITERAL_DECIMAL;
       goto retype;
 
@@ -718,8 +806,12 @@ retype:
       break;
 
     case RASQAL_LITERAL_XSD_STRING:
+      /* No change - kept as same type */
+      rasqal_literal_count_chars(l);
+      break;
+
     case RASQAL_LITERAL_UDT:
-      /* No change - kept as same type - xsd:string or user defined */
+      /* No change - kept as same type - user defined */
       break;
 
     case RASQAL_LITERAL_BOOLEAN:
@@ -737,6 +829,7 @@ retype:
 
   case RASQAL_LITERAL_STRING:
     /* No change - kept as a string */
+    rasqal_literal_count_chars(l);
     break;
 
   case RASQAL_LITERAL_DATE:
@@ -938,7 +1031,9 @@ rasqal_new_string_literal_common(rasqal_world* world,
        rasqal_literal_string_to_native(l, canonicalize)) {
       rasqal_free_literal(l);
       l = NULL;
-    }
+    } else if(l->type == RASQAL_LITERAL_STRING ||
+              l->type == RASQAL_LITERAL_XSD_STRING)
+      rasqal_literal_count_chars(l);
   } else {
     if(language)
       RASQAL_FREE(char*, language);
@@ -1138,7 +1233,7 @@ rasqal_new_literal_from_literal(rasqal_literal* l)
   if(!l)
     return NULL;
   
-  l->usage++;
+  RASQAL_LITERAL_USAGE_INCREMENT(l);
   return l;
 }
 
@@ -1156,7 +1251,7 @@ rasqal_free_literal(rasqal_literal* l)
   if(!l)
     return;
   
-  if(--l->usage)
+  if(RASQAL_LITERAL_USAGE_DECREMENT(l))
     return;
   
   switch(l->type) {
@@ -1530,21 +1625,24 @@ rasqal_literal_as_boolean(rasqal_literal* l, int *error_p)
 
 
 /*
- * rasqal_literal_as_integer
+ * rasqal_literal_as_integer64
  * @l: #rasqal_literal object
  * @error_p: pointer to error flag
  * 
- * INTERNAL - Return a literal as an integer value
+ * INTERNAL - Return a literal as a 64 bit integer value
  *
  * Integers, booleans, double and float literals natural are turned into
  * integers. If string values are the lexical form of an integer, that is
- * returned.  Otherwise the error flag is set.
+ * returned.  Otherwise or if the value is out of range, the error flag
+ * is set.
  * 
  * Return value: integer value
  **/
-int
-rasqal_literal_as_integer(rasqal_literal* l, int *error_p)
+rasqal_int64
+rasqal_literal_as_integer64(rasqal_literal* l, int *error_p)
 {
+  double d;
+
   if(!l) {
     /* type error */
     if(error_p)
@@ -1562,52 +1660,43 @@ rasqal_literal_as_integer(rasqal_literal* l, int *error_p)
 
     case RASQAL_LITERAL_DOUBLE:
     case RASQAL_LITERAL_FLOAT:
-      return RASQAL_FLOATING_AS_INT(l->value.floating);
+      d = l->value.floating;
+      goto from_double;
 
     case RASQAL_LITERAL_DECIMAL:
       {
         int error = 0;
         
         long lvalue = rasqal_xsd_decimal_get_long(l->value.decimal, &error);
-        if(lvalue < INT_MIN || lvalue > INT_MAX)
-          error = 1;
-
         if(error) {
           if(error_p)
             *error_p = 1;
           return 0;
         }
         
-        return RASQAL_GOOD_CAST(int, lvalue);
+        return lvalue;
       }
 
     case RASQAL_LITERAL_STRING:
     case RASQAL_LITERAL_XSD_STRING:
       {
         char *eptr;
-        double  d;
-        long long_i;
+        rasqal_int64 integer = 0;
 
-        eptr = NULL;
-        errno = 0;
-        long_i = strtol(RASQAL_GOOD_CAST(const char*, l->string), &eptr, 10);
-        /* If formatted correctly and no under or overflow */
-        if(RASQAL_GOOD_CAST(unsigned char*, eptr) != l->string && *eptr=='\0' &&
-           errno != ERANGE)
-          /* FIXME may lose precision or be out of range from long to int */
-          return RASQAL_BAD_CAST(int, long_i);
+        if(!rasqal_literal_string_to_int64(l->string, &integer))
+          return integer;
 
         eptr = NULL;
         d = strtod(RASQAL_GOOD_CAST(const char*, l->string), &eptr);
         if(RASQAL_GOOD_CAST(unsigned char*, eptr) != l->string && *eptr=='\0')
-          return RASQAL_FLOATING_AS_INT(d);
+          goto from_double;
       }
       if(error_p)
         *error_p = 1;
       return 0;
 
     case RASQAL_LITERAL_VARIABLE:
-      return rasqal_literal_as_integer(l->value.variable->value, error_p);
+      return rasqal_literal_as_integer64(l->value.variable->value, error_p);
 
     case RASQAL_LITERAL_BLANK:
     case RASQAL_LITERAL_URI:
@@ -1625,6 +1714,56 @@ rasqal_literal_as_integer(rasqal_literal* l, int *error_p)
       RASQAL_FATAL2("Unknown literal type %u", l->type);
       return 0; /* keep some compilers happy */
   }
+
+  from_double:
+  /* also false for NaN */
+  if(d >= (double)INT64_MIN && d < -(double)INT64_MIN)
+    return RASQAL_GOOD_CAST(rasqal_int64, d);
+
+  if(error_p)
+    *error_p = 1;
+  return 0;
+}
+
+
+/*
+ * rasqal_literal_as_integer
+ * @l: #rasqal_literal object
+ * @error_p: pointer to error flag
+ * 
+ * INTERNAL - Return a literal as an integer value
+ *
+ * As rasqal_literal_as_integer64() but values that do not fit in an
+ * int are clamped to INT_MIN or INT_MAX, so positions and lengths
+ * given as large integers still work.  A decimal out of int range
+ * sets the error flag as before.
+ * 
+ * Return value: integer value
+ **/
+int
+rasqal_literal_as_integer(rasqal_literal* l, int *error_p)
+{
+  int error = 0;
+  rasqal_int64 integer;
+
+  integer = rasqal_literal_as_integer64(l, &error);
+  if(!error && (integer < INT_MIN || integer > INT_MAX)) {
+    while(l->type == RASQAL_LITERAL_VARIABLE)
+      l = l->value.variable->value;
+
+    if(l->type == RASQAL_LITERAL_DECIMAL)
+      error = 1;
+    else
+      integer = (integer < INT_MIN) ? INT_MIN : INT_MAX;
+  }
+
+  if(error) {
+    if(error_p)
+      *error_p = 1;
+    return 0;
+  }
+
+  return RASQAL_GOOD_CAST(int, integer);
 }
 
 
@@ -1788,6 +1927,54 @@ rasqal_literal_as_counted_string(rasqal_literal* l, size_t *len_p,
 }
 
 
+/*
+ * rasqal_literal_as_counted_string_chars:
+ * @l: #rasqal_literal object
+ * @len_p: pointer to store length of string in bytes
+ * @chars_p: pointer to store number of Unicode codepoints in string
+ * @flags: comparison flags
+ * @error_p: pointer to error
+ *
+ * INTERNAL - Get the string form of a literal with its codepoint count
+ *
+ * As rasqal_literal_as_counted_string() and also counts the
+ * codepoints.  String literals have the count made when they are
+ * created; other strings are counted on each call.  The literal is
+ * never changed so this is safe on literals shared between threads.
+ * A count equal to *@len_p means the string is all ASCII.  *@chars_p
+ * is set <0 if the string is not valid UTF-8.
+ *
+ * Return value: the string or NULL on failure
+ */
+const unsigned char*
+rasqal_literal_as_counted_string_chars(rasqal_literal* l, size_t *len_p,
+                                       int *chars_p, int flags, int *error_p)
+{
+  const unsigned char* s;
+  size_t len = 0;
+  int chars = 0;
+
+  while(l && l->type == RASQAL_LITERAL_VARIABLE)
+    l = l->value.variable->value;
+
+  s = rasqal_literal_as_counted_string(l, &len, flags, error_p);
+
+  if(s && len) {
+    if(s == l->string && l->char_len)
+      chars = l->char_len;
+    else
+      chars = rasqal_utf8_strlen(s, len);
+  }
+
+  if(len_p)
+    *len_p = len;
+  if(chars_p)
+    *chars_p = chars;
+
+  return s;
+}
+
+
 /**
  * rasqal_literal_as_string_flags:
  * @l: #rasqal_literal object
@@ -2010,6 +2197,47 @@ rasqal_literal_get_language(rasqal_literal* l)
 
 
 
+/*
+ * rasqal_new_xsd_decimal_from_int64:
+ * @world: world
+ * @integer: 64 bit integer
+ *
+ * INTERNAL - Make a new XSD decimal with the exact value of an integer
+ *
+ * Return value: new decimal or NULL on failure
+ */
+static rasqal_xsd_decimal*
+rasqal_new_xsd_decimal_from_int64(rasqal_world* world, rasqal_int64 integer)
+{
+  rasqal_xsd_decimal* dec;
+  int rc;
+
+  dec = rasqal_new_xsd_decimal(world);
+  if(!dec)
+    return NULL;
+
+  if(integer >= LONG_MIN && integer <= LONG_MAX)
+    rc = rasqal_xsd_decimal_set_long(dec, RASQAL_GOOD_CAST(long, integer));
+  else {
+    unsigned char* string = rasqal_xsd_format_integer(integer, NULL);
+
+    rc = !string;
+    if(string) {
+      rc = rasqal_xsd_decimal_set_string(dec,
+                                         RASQAL_GOOD_CAST(const char*, string));
+      RASQAL_FREE(char*, string);
+    }
+  }
+
+  if(rc) {
+    rasqal_free_xsd_decimal(dec);
+    dec = NULL;
+  }
+
+  return dec;
+}
+
+
 /*
  * rasqal_new_literal_from_promotion:
  * @lit: existing literal
@@ -2029,6 +2257,7 @@ rasqal_new_literal_from_promotion(rasqal_literal* lit,
   int errori = 0;
   double d;
   int i;
+  rasqal_int64 integer;
   unsigned char *new_s = NULL;
   unsigned char* s;
   size_t len = 0;
@@ -2089,6 +2318,17 @@ rasqal_new_literal_from_promotion(rasqal_literal* lit,
     
   switch(type) {
     case RASQAL_LITERAL_DECIMAL:
+      if(lit->type == RASQAL_LITERAL_INTEGER ||
+         lit->type == RASQAL_LITERAL_INTEGER_SUBTYPE) {
+        /* exactly, as a double cannot hold all 64 bit integers */
+        dec = rasqal_new_xsd_decimal_from_int64(lit->world,
+                                                lit->value.integer);
+        if(dec)
+          new_lit = rasqal_new_decimal_literal_from_decimal(lit->world,
+                                                            NULL, dec);
+        break;
+      }
+
       dec = rasqal_new_xsd_decimal(lit->world);
       if(dec) {
         d = rasqal_literal_as_double(lit, &errori);
@@ -2128,12 +2368,12 @@ rasqal_new_literal_from_promotion(rasqal_literal* lit,
 
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(lit, &errori);
+      integer = rasqal_literal_as_integer64(lit, &errori);
       /* failure always means no match */
       if(errori)
         new_lit = NULL;
       else
-        new_lit = rasqal_new_integer_literal(lit->world, type, i);
+        new_lit = rasqal_new_integer64_literal(lit->world, type, integer);
       break;
     
     case RASQAL_LITERAL_BOOLEAN:
@@ -2573,7 +2813,9 @@ rasqal_literal_compare(rasqal_literal* l1, rasqal_literal* l2, int flags,
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_BOOLEAN:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      result = new_lits[0]->value.integer - new_lits[1]->value.integer;
+      /* not a subtraction which may overflow */
+      result = (new_lits[0]->value.integer > new_lits[1]->value.integer) -
+               (new_lits[0]->value.integer < new_lits[1]->value.integer);
       break;
 
     case RASQAL_LITERAL_DOUBLE:
@@ -2606,6 +2848,246 @@ rasqal_literal_compare(rasqal_literal* l1, rasqal_literal* l2, int flags,
 }
 
 
+/* sort key classes in ORDER BY order */
+#define RASQAL_SORT_KEY_NULL       0x00
+#define RASQAL_SORT_KEY_BLANK      0x01
+#define RASQAL_SORT_KEY_URI        0x02
+#define RASQAL_SORT_KEY_NUMERIC    0x03
+#define RASQAL_SORT_KEY_DATETIME   0x04
+#define RASQAL_SORT_KEY_DATE       0x05
+#define RASQAL_SORT_KEY_STRING     0x06
+#define RASQAL_SORT_KEY_XSD_STRING 0x07
+
+/* integers with a larger magnitude may not be exact as a double */
+#define RASQAL_SORT_KEY_MAX_EXACT_INTEGER ((rasqal_int64)1 << 53)
+
+
+/* write a 64 bit unsigned integer big endian so it orders with memcmp */
+static size_t
+rasqal_literal_sort_key_uint64(unsigned char* buffer, uint64_t u)
+{
+  int i;
+
+  if(buffer) {
+    for(i = 7; i >= 0; i--) {
+      buffer[i] = RASQAL_GOOD_CAST(unsigned char, u & 0xff);
+      u >>= 8;
+    }
+  }
+
+  return 8;
+}
+
+
+static size_t
+rasqal_literal_sort_key_int64(unsigned char* buffer, rasqal_int64 i)
+{
+  /* flip the sign bit so negative numbers order first */
+  return rasqal_literal_sort_key_uint64(buffer,
+                                        RASQAL_GOOD_CAST(uint64_t, i) ^
+                                        (RASQAL_GOOD_CAST(uint64_t, 1) << 63));
+}
+
+
+static size_t
+rasqal_literal_sort_key_double(unsigned char* buffer, double d)
+{
+  uint64_t u;
+
+  /* all NaNs order last */
+  if(d != d)
+    return rasqal_literal_sort_key_uint64(buffer, ~RASQAL_GOOD_CAST(uint64_t, 0));
+
+  /* -0 equals 0 */
+  if(d == 0.0)
+    d = 0.0;
+
+  memcpy(&u, &d, sizeof(u));
+
+  /* IEEE 754 bits order as unsigned integers after inverting negative
+   * numbers and setting the sign bit of positive numbers */
+  if(u >> 63)
+    u = ~u;
+  else
+    u |= (RASQAL_GOOD_CAST(uint64_t, 1) << 63);
+
+  return rasqal_literal_sort_key_uint64(buffer, u);
+}
+
+
+/* write a string up to NUL and a NUL terminator, which orders as strcmp() */
+static size_t
+rasqal_literal_sort_key_string(unsigned char* buffer,
+                               const unsigned char* string, int lower)
+{
+  size_t len = strlen(RASQAL_GOOD_CAST(const char*, string));
+
+  if(buffer) {
+    size_t i;
+
+    for(i = 0; i < len; i++)
+      buffer[i] = lower ? RASQAL_GOOD_CAST(unsigned char, tolower(string[i]))
+                        : string[i];
+    buffer[len] = '\0';
+  }
+
+  return len + 1;
+}
+
+
+/*
+ * rasqal_literal_sort_key:
+ * @l: literal or NULL
+ * @buffer: buffer to write the key into or NULL to only get the length
+ * @exact_p: pointer to flag cleared if the key is not exact (or NULL)
+ *
+ * INTERNAL - Encode a literal as a sort key for SPARQL ORDER BY
+ *
+ * Two sort keys compare with memcmp() as rasqal_literal_compare()
+ * with flags #RASQAL_COMPARE_XQUERY and #RASQAL_COMPARE_URI compares
+ * the literals, so comparing them needs no promoted literals.  Keys
+ * are prefix free so they can be concatenated for several ORDER BY
+ * conditions.
+ *
+ * The key is a class byte: NULL first, then blank nodes, URIs,
+ * numerics (including booleans), dateTimes, dates, plain literals and
+ * xsd:strings, followed by the value in that class.  Numerics are
+ * encoded as doubles, strings as their bytes then the language and
+ * datatype of plain literals.  Literals of different classes that
+ * rasqal_literal_compare() cannot compare order by class.
+ *
+ * Decimals and integers that a double cannot hold set *@exact_p to 0:
+ * different keys still order correctly but equal keys do not mean
+ * equal values, so rasqal_literal_compare() must decide.
+ *
+ * Return value: key length or 0 if the literal has no sort key
+ */
+size_t
+rasqal_literal_sort_key(rasqal_literal* l, unsigned char* buffer,
+                        int* exact_p)
+{
+  size_t len = 1;
+  unsigned char key_class;
+  double d;
+
+#define SORT_KEY_AT(offset) (buffer ? buffer + (offset) : NULL)
+
+  if(l)
+    l = rasqal_literal_value(l);
+
+  if(!l) {
+    if(buffer)
+      buffer[0] = RASQAL_SORT_KEY_NULL;
+    return 1;
+  }
+
+  switch(l->type) {
+    case RASQAL_LITERAL_BLANK:
+      key_class = RASQAL_SORT_KEY_BLANK;
+      len += rasqal_literal_sort_key_string(SORT_KEY_AT(len), l->string, 0);
+      break;
+
+    case RASQAL_LITERAL_URI:
+      key_class = RASQAL_SORT_KEY_URI;
+      len += rasqal_literal_sort_key_string(SORT_KEY_AT(len),
+                                            raptor_uri_as_string(l->value.uri),
+                                            0);
+      break;
+
+    case RASQAL_LITERAL_STRING:
+      key_class = RASQAL_SORT_KEY_STRING;
+      len += rasqal_literal_sort_key_string(SORT_KEY_AT(len), l->string, 0);
+
+      /* no language first; languages compare case independently */
+      if(buffer)
+        buffer[len] = (l->language != NULL);
+      len++;
+      if(l->language)
+        len += rasqal_literal_sort_key_string(SORT_KEY_AT(len),
+                                              RASQAL_GOOD_CAST(const unsigned char*, l->language),
+                                              1);
+
+      /* no datatype first */
+      if(buffer)
+        buffer[len] = (l->datatype != NULL);
+      len++;
+      if(l->datatype)
+        len += rasqal_literal_sort_key_string(SORT_KEY_AT(len),
+                                              raptor_uri_as_string(l->datatype),
+                                              0);
+      break;
+
+    case RASQAL_LITERAL_XSD_STRING:
+      key_class = RASQAL_SORT_KEY_XSD_STRING;
+      len += rasqal_literal_sort_key_string(SORT_KEY_AT(len), l->string, 0);
+      break;
+
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+      key_class = RASQAL_SORT_KEY_NUMERIC;
+      if(exact_p &&
+         (l->value.integer > RASQAL_SORT_KEY_MAX_EXACT_INTEGER ||
+          l->value.integer < -RASQAL_SORT_KEY_MAX_EXACT_INTEGER))
+        *exact_p = 0;
+      d = RASQAL_GOOD_CAST(double, l->value.integer);
+      len += rasqal_literal_sort_key_double(SORT_KEY_AT(len), d);
+      break;
+
+    case RASQAL_LITERAL_FLOAT:
+    case RASQAL_LITERAL_DOUBLE:
+      key_class = RASQAL_SORT_KEY_NUMERIC;
+      /* NaN compares equal to every number */
+      if(exact_p && l->value.floating != l->value.floating)
+        *exact_p = 0;
+      len += rasqal_literal_sort_key_double(SORT_KEY_AT(len),
+                                            l->value.floating);
+      break;
+
+    case RASQAL_LITERAL_DECIMAL:
+      key_class = RASQAL_SORT_KEY_NUMERIC;
+      if(exact_p)
+        *exact_p = 0;
+      d = rasqal_xsd_decimal_get_double(l->value.decimal);
+      len += rasqal_literal_sort_key_double(SORT_KEY_AT(len), d);
+      break;
+
+    case RASQAL_LITERAL_DATETIME:
+      if(!l->value.datetime)
+        return 0;
+      key_class = RASQAL_SORT_KEY_DATETIME;
+      len += rasqal_literal_sort_key_int64(SORT_KEY_AT(len),
+                                           RASQAL_GOOD_CAST(rasqal_int64, l->value.datetime->time_on_timeline));
+      len += rasqal_literal_sort_key_int64(SORT_KEY_AT(len),
+                                           l->value.datetime->microseconds);
+      break;
+
+    case RASQAL_LITERAL_DATE:
+      if(!l->value.date)
+        return 0;
+      key_class = RASQAL_SORT_KEY_DATE;
+      len += rasqal_literal_sort_key_int64(SORT_KEY_AT(len),
+                                           RASQAL_GOOD_CAST(rasqal_int64, l->value.date->time_on_timeline));
+      break;
+
+    case RASQAL_LITERAL_UDT:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_VARIABLE:
+    case RASQAL_LITERAL_UNKNOWN:
+    default:
+      return 0;
+  }
+
+#undef SORT_KEY_AT
+
+  if(buffer)
+    buffer[0] = key_class;
+
+  return len;
+}
+
+
 /*
  * rasqal_literal_is_string:
  * @l1: #rasqal_literal first literal
@@ -3449,10 +3931,98 @@ rasqal_literal_is_numeric(rasqal_literal* literal)
 }
 
 
+/*
+ * Overflow checked 64 bit integer arithmetic for the xsd:integer fast
+ * paths.  Each returns non-0 without setting *result_p if the result
+ * does not fit so that the operation can be done as xsd:decimal.
+ */
+static int
+rasqal_int64_add(rasqal_int64 a, rasqal_int64 b, rasqal_int64* result_p)
+{
+  if((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+    return 1;
+
+  *result_p = a + b;
+  return 0;
+}
+
+
+static int
+rasqal_int64_subtract(rasqal_int64 a, rasqal_int64 b, rasqal_int64* result_p)
+{
+  if((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+    return 1;
+
+  *result_p = a - b;
+  return 0;
+}
+
+
+static int
+rasqal_int64_multiply(rasqal_int64 a, rasqal_int64 b, rasqal_int64* result_p)
+{
+  if(a > 0) {
+    if(b > 0 ? (a > INT64_MAX / b) : (b < INT64_MIN / a))
+      return 1;
+  } else if(a < 0) {
+    if(b > 0 ? (a < INT64_MIN / b) : (b < INT64_MAX / a))
+      return 1;
+  }
+
+  *result_p = a * b;
+  return 0;
+}
+
+
+typedef int (*rasqal_xsd_decimal_op)(rasqal_xsd_decimal* result, rasqal_xsd_decimal* a, rasqal_xsd_decimal* b);
+
+/*
+ * rasqal_literal_integer_overflow:
+ * @world: world
+ * @a: first integer
+ * @b: second integer
+ * @op: XSD decimal operation
+ *
+ * INTERNAL - Do an integer operation that overflowed as xsd:decimal
+ *
+ * Return value: new decimal literal or NULL on failure
+ */
+static rasqal_literal*
+rasqal_literal_integer_overflow(rasqal_world* world,
+                                rasqal_int64 a, rasqal_int64 b,
+                                rasqal_xsd_decimal_op op)
+{
+  rasqal_xsd_decimal* d1;
+  rasqal_xsd_decimal* d2 = NULL;
+  rasqal_xsd_decimal* dec = NULL;
+  rasqal_literal* result = NULL;
+
+  d1 = rasqal_new_xsd_decimal_from_int64(world, a);
+  if(d1)
+    d2 = rasqal_new_xsd_decimal_from_int64(world, b);
+  if(d2)
+    dec = rasqal_new_xsd_decimal(world);
+
+  if(dec) {
+    if(op(dec, d1, d2))
+      rasqal_free_xsd_decimal(dec);
+    else
+      result = rasqal_new_decimal_literal_from_decimal(world, NULL, dec);
+  }
+
+  if(d1)
+    rasqal_free_xsd_decimal(d1);
+  if(d2)
+    rasqal_free_xsd_decimal(d2);
+
+  return result;
+}
+
+
 rasqal_literal*
 rasqal_literal_add(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 {
-  int i;
+  rasqal_int64 i1, i2, integer;
   double d;
   rasqal_xsd_decimal* dec;
   int error = 0;
@@ -3469,14 +4039,23 @@ rasqal_literal_add(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
   switch(type) {
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(l1, &error);
+      i1 = rasqal_literal_as_integer64(l1, &error);
       if(error)
         break;
-      i = i + rasqal_literal_as_integer(l2, &error);
+      i2 = rasqal_literal_as_integer64(l2, &error);
       if(error)
         break;
 
-      result = rasqal_new_integer_literal(l1->world, RASQAL_LITERAL_INTEGER, i);
+      if(!rasqal_int64_add(i1, i2, &integer))
+        result = rasqal_new_integer64_literal(l1->world,
+                                              RASQAL_LITERAL_INTEGER, integer);
+      else {
+        /* overflow so promote to xsd:decimal */
+        result = rasqal_literal_integer_overflow(l1->world, i1, i2,
+                                                 rasqal_xsd_decimal_add);
+        if(!result)
+          error = 1;
+      }
       break;
       
     case RASQAL_LITERAL_FLOAT:
@@ -3540,7 +4119,7 @@ rasqal_literal_add(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 rasqal_literal*
 rasqal_literal_subtract(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 {
-  int i;
+  rasqal_int64 i1, i2, integer;
   double d;
   rasqal_xsd_decimal* dec;
   int error = 0;
@@ -3557,14 +4136,23 @@ rasqal_literal_subtract(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
   switch(type) {
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(l1, &error);
+      i1 = rasqal_literal_as_integer64(l1, &error);
       if(error)
         break;
-      i = i - rasqal_literal_as_integer(l2, &error);
+      i2 = rasqal_literal_as_integer64(l2, &error);
       if(error)
         break;
 
-      result = rasqal_new_integer_literal(l1->world, RASQAL_LITERAL_INTEGER, i);
+      if(!rasqal_int64_subtract(i1, i2, &integer))
+        result = rasqal_new_integer64_literal(l1->world,
+                                              RASQAL_LITERAL_INTEGER, integer);
+      else {
+        /* overflow so promote to xsd:decimal */
+        result = rasqal_literal_integer_overflow(l1->world, i1, i2,
+                                                 rasqal_xsd_decimal_subtract);
+        if(!result)
+          error = 1;
+      }
       break;
       
     case RASQAL_LITERAL_FLOAT:
@@ -3628,7 +4216,7 @@ rasqal_literal_subtract(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 rasqal_literal*
 rasqal_literal_multiply(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 {
-  int i;
+  rasqal_int64 i1, i2, integer;
   double d;
   rasqal_xsd_decimal* dec;
   int error = 0;
@@ -3645,14 +4233,23 @@ rasqal_literal_multiply(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
   switch(type) {
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(l1, &error);
+      i1 = rasqal_literal_as_integer64(l1, &error);
       if(error)
         break;
-      i = i * rasqal_literal_as_integer(l2, &error);
+      i2 = rasqal_literal_as_integer64(l2, &error);
       if(error)
         break;
 
-      result = rasqal_new_integer_literal(l1->world, RASQAL_LITERAL_INTEGER, i);
+      if(!rasqal_int64_multiply(i1, i2, &integer))
+        result = rasqal_new_integer64_literal(l1->world,
+                                              RASQAL_LITERAL_INTEGER, integer);
+      else {
+        /* overflow so promote to xsd:decimal */
+        result = rasqal_literal_integer_overflow(l1->world, i1, i2,
+                                                 rasqal_xsd_decimal_multiply);
+        if(!result)
+          error = 1;
+      }
       break;
       
     case RASQAL_LITERAL_FLOAT:
@@ -3803,7 +4400,8 @@ rasqal_literal_divide(rasqal_literal* l1, rasqal_literal* l2, int *error_p)
 rasqal_literal*
 rasqal_literal_negate(rasqal_literal* l, int *error_p)
 {
-  int i;
+  rasqal_int64 i;
+  rasqal_int64 integer;
   double d;
   rasqal_xsd_decimal* dec;
   int error = 0;
@@ -3814,11 +4412,20 @@ rasqal_literal_negate(rasqal_literal* l, int *error_p)
   switch(l->type) {
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(l, &error);
+      i = rasqal_literal_as_integer64(l, &error);
       if(error)
         break;
-      i = -i;
-      result = rasqal_new_integer_literal(l->world, RASQAL_LITERAL_INTEGER, i);
+
+      if(!rasqal_int64_subtract(0, i, &integer))
+        result = rasqal_new_integer64_literal(l->world,
+                                              RASQAL_LITERAL_INTEGER, integer);
+      else {
+        /* -INT64_MIN overflows so promote to xsd:decimal */
+        result = rasqal_literal_integer_overflow(l->world, 0, i,
+                                                 rasqal_xsd_decimal_subtract);
+        if(!result)
+          error = 1;
+      }
       break;
       
     case RASQAL_LITERAL_FLOAT:
@@ -3868,7 +4475,8 @@ rasqal_literal_negate(rasqal_literal* l, int *error_p)
 rasqal_literal*
 rasqal_literal_abs(rasqal_literal* l, int *error_p)
 {
-  int i;
+  rasqal_int64 i;
+  rasqal_int64 integer;
   double d;
   rasqal_xsd_decimal* dec;
   int error = 0;
@@ -3882,12 +4490,23 @@ rasqal_literal_abs(rasqal_literal* l, int *error_p)
   switch(l->type) {
     case RASQAL_LITERAL_INTEGER:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      i = rasqal_literal_as_integer(l, &error);
+      i = rasqal_literal_as_integer64(l, &error);
       if(error)
         break;
 
-      i = abs(i);
-      result = rasqal_new_integer_literal(l->world, RASQAL_LITERAL_INTEGER, i);
+      if(i >= 0)
+        result = rasqal_new_integer64_literal(l->world,
+                                              RASQAL_LITERAL_INTEGER, i);
+      else if(!rasqal_int64_subtract(0, i, &integer))
+        result = rasqal_new_integer64_literal(l->world,
+                                              RASQAL_LITERAL_INTEGER, integer);
+      else {
+        /* -INT64_MIN overflows so promote to xsd:decimal */
+        result = rasqal_literal_integer_overflow(l->world, 0, i,
+                                                 rasqal_xsd_decimal_subtract);
+        if(!result)
+          error = 1;
+      }
       break;
       
     case RASQAL_LITERAL_FLOAT:
@@ -4989,6 +5608,438 @@ static const struct {
 };
 
 
+/* Sort key tests: literals in ascending ORDER BY order */
+#define SORT_KEY_NULL ((rasqal_literal_type)-1)
+
+static const struct {
+  rasqal_literal_type type;
+  const char* string;
+  const char* language;
+  /* literals with the same rank have equal keys */
+  int rank;
+  int exact;
+} sort_key_test_data[] = {
+  { SORT_KEY_NULL, NULL, NULL, 0, 1 },
+  { RASQAL_LITERAL_BLANK, "a", NULL, 1, 1 },
+  { RASQAL_LITERAL_BLANK, "ab", NULL, 2, 1 },
+  { RASQAL_LITERAL_BLANK, "b", NULL, 3, 1 },
+  { RASQAL_LITERAL_URI, "http://example.org/a", NULL, 4, 1 },
+  { RASQAL_LITERAL_URI, "http://example.org/b", NULL, 5, 1 },
+  { RASQAL_LITERAL_DOUBLE, "-INF", NULL, 6, 1 },
+  { RASQAL_LITERAL_INTEGER, "-5", NULL, 7, 1 },
+  { RASQAL_LITERAL_DECIMAL, "-0.5", NULL, 8, 0 },
+  { RASQAL_LITERAL_DOUBLE, "-0.0E0", NULL, 9, 1 },
+  { RASQAL_LITERAL_INTEGER, "0", NULL, 9, 1 },
+  { RASQAL_LITERAL_DOUBLE, "0.0E0", NULL, 9, 1 },
+  { RASQAL_LITERAL_INTEGER, "1", NULL, 10, 1 },
+  { RASQAL_LITERAL_DOUBLE, "1.5E0", NULL, 11, 1 },
+  { RASQAL_LITERAL_DECIMAL, "10.25", NULL, 12, 0 },
+  { RASQAL_LITERAL_INTEGER, "9007199254740993", NULL, 13, 0 },
+  { RASQAL_LITERAL_DOUBLE, "INF", NULL, 14, 1 },
+  { RASQAL_LITERAL_DOUBLE, "NaN", NULL, 15, 0 },
+  { RASQAL_LITERAL_DATETIME, "1969-12-31T23:59:59Z", NULL, 16, 1 },
+  { RASQAL_LITERAL_DATETIME, "1970-01-01T00:00:00.5Z", NULL, 17, 1 },
+  { RASQAL_LITERAL_DATETIME, "2000-01-01T00:00:00Z", NULL, 18, 1 },
+  { RASQAL_LITERAL_DATE, "1969-12-31Z", NULL, 19, 1 },
+  { RASQAL_LITERAL_DATE, "2000-01-01Z", NULL, 20, 1 },
+  { RASQAL_LITERAL_STRING, "", NULL, 21, 1 },
+  { RASQAL_LITERAL_STRING, "a", NULL, 22, 1 },
+  { RASQAL_LITERAL_STRING, "a", "en", 23, 1 },
+  { RASQAL_LITERAL_STRING, "a", "EN-gb", 24, 1 },
+  { RASQAL_LITERAL_STRING, "a", "fr", 25, 1 },
+  { RASQAL_LITERAL_STRING, "ab", NULL, 26, 1 },
+  { RASQAL_LITERAL_STRING, "b", NULL, 27, 1 },
+  { RASQAL_LITERAL_XSD_STRING, "", NULL, 28, 1 },
+  { RASQAL_LITERAL_XSD_STRING, "a", NULL, 29, 1 },
+  { RASQAL_LITERAL_XSD_STRING, "ab", NULL, 30, 1 }
+};
+
+#define SORT_KEY_TESTS_COUNT (int)(sizeof(sort_key_test_data) / sizeof(sort_key_test_data[0]))
+
+
+static unsigned char*
+sort_key_test_strdup(const char* string)
+{
+  size_t len = strlen(string);
+  unsigned char* s = RASQAL_MALLOC(unsigned char*, len + 1);
+
+  if(s)
+    memcpy(s, string, len + 1);
+
+  return s;
+}
+
+
+static rasqal_literal*
+sort_key_test_new_literal(rasqal_world* world, int i)
+{
+  rasqal_literal_type type = sort_key_test_data[i].type;
+  const char* string = sort_key_test_data[i].string;
+  const char* language = sort_key_test_data[i].language;
+  char* lang = NULL;
+
+  switch(type) {
+    case RASQAL_LITERAL_BLANK:
+      return rasqal_new_simple_literal(world, type,
+                                       sort_key_test_strdup(string));
+
+    case RASQAL_LITERAL_URI:
+      return rasqal_new_uri_literal(world,
+                                    raptor_new_uri(world->raptor_world_ptr,
+                                                   RASQAL_GOOD_CAST(const unsigned char*, string)));
+
+    case RASQAL_LITERAL_STRING:
+      if(language)
+        lang = RASQAL_GOOD_CAST(char*, sort_key_test_strdup(language));
+      return rasqal_new_string_literal(world, sort_key_test_strdup(string),
+                                       lang, NULL, NULL);
+
+    default:
+      return rasqal_new_typed_literal(world, type,
+                                      RASQAL_GOOD_CAST(const unsigned char*, string));
+  }
+}
+
+
+/* memcmp() keys of prefix free encodings */
+static int
+sort_key_test_compare(const unsigned char* a, size_t a_len,
+                      const unsigned char* b, size_t b_len)
+{
+  int result = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+
+  if(!result && a_len != b_len)
+    result = (a_len < b_len) ? -1 : 1;
+
+  return result;
+}
+
+
+#define SIGN(x) (((x) > 0) - ((x) < 0))
+
+static int
+sort_key_tests(rasqal_world* world, const char* program)
+{
+  rasqal_literal* literals[SORT_KEY_TESTS_COUNT];
+  unsigned char* keys[SORT_KEY_TESTS_COUNT];
+  unsigned char* desc_keys[SORT_KEY_TESTS_COUNT];
+  size_t lens[SORT_KEY_TESTS_COUNT];
+  int failures = 0;
+  int i;
+  int j;
+
+  memset(literals, 0, sizeof(literals));
+  memset(keys, 0, sizeof(keys));
+  memset(desc_keys, 0, sizeof(desc_keys));
+
+  for(i = 0; i < SORT_KEY_TESTS_COUNT; i++) {
+    int exact = 1;
+    size_t k;
+
+    if(sort_key_test_data[i].type != SORT_KEY_NULL) {
+      literals[i] = sort_key_test_new_literal(world, i);
+      if(!literals[i]) {
+        fprintf(stderr, "%s: sort key test %d failed to create literal\n",
+                program, i);
+        failures++;
+        goto tidy;
+      }
+    }
+
+    lens[i] = rasqal_literal_sort_key(literals[i], NULL, NULL);
+    keys[i] = RASQAL_MALLOC(unsigned char*, lens[i] + 1);
+    desc_keys[i] = RASQAL_MALLOC(unsigned char*, lens[i] + 1);
+    if(!lens[i] || !keys[i] || !desc_keys[i]) {
+      fprintf(stderr, "%s: sort key test %d has no key\n", program, i);
+      failures++;
+      goto tidy;
+    }
+
+    /* the length is the same with and without a buffer */
+    if(rasqal_literal_sort_key(literals[i], keys[i], &exact) != lens[i]) {
+      fprintf(stderr, "%s: sort key test %d key length changed\n",
+              program, i);
+      failures++;
+    }
+
+    if(exact != sort_key_test_data[i].exact) {
+      fprintf(stderr, "%s: sort key test %d exact %d expected %d\n",
+              program, i, exact, sort_key_test_data[i].exact);
+      failures++;
+    }
+
+    /* a DESC condition inverts the key bytes */
+    for(k = 0; k < lens[i]; k++)
+      desc_keys[i][k] = RASQAL_GOOD_CAST(unsigned char, ~keys[i][k]);
+  }
+
+  for(i = 0; i < SORT_KEY_TESTS_COUNT; i++) {
+    for(j = 0; j < SORT_KEY_TESTS_COUNT; j++) {
+      int expected = SIGN(sort_key_test_data[i].rank - sort_key_test_data[j].rank);
+      size_t len = (lens[i] < lens[j]) ? lens[i] : lens[j];
+      int result;
+
+      result = SIGN(sort_key_test_compare(keys[i], lens[i], keys[j], lens[j]));
+      if(result != expected) {
+        fprintf(stderr, "%s: sort key test %d vs %d returned %d expected %d\n",
+                program, i, j, result, expected);
+        failures++;
+      }
+
+      /* prefix free: keys that differ do so before either ends */
+      if(expected && !memcmp(keys[i], keys[j], len)) {
+        fprintf(stderr, "%s: sort key test %d vs %d keys are not prefix free\n",
+                program, i, j);
+        failures++;
+      }
+
+      result = SIGN(sort_key_test_compare(desc_keys[i], lens[i],
+                                          desc_keys[j], lens[j]));
+      if(result != -expected) {
+        fprintf(stderr, "%s: sort key test %d vs %d DESC returned %d expected %d\n",
+                program, i, j, result, -expected);
+        failures++;
+      }
+
+      /* keys of the same class order the same as
+       * rasqal_literal_compare() where it can compare the values;
+       * inexact keys such as NaN, which compares equal to every
+       * number, are left to it */
+      if(literals[i] && literals[j] && keys[i][0] == keys[j][0] &&
+         sort_key_test_data[i].exact && sort_key_test_data[j].exact) {
+        int error = 0;
+
+        result = rasqal_literal_compare(literals[i], literals[j],
+                                        RASQAL_COMPARE_XQUERY |
+                                        RASQAL_COMPARE_URI, &error);
+        if(!error && SIGN(result) != expected) {
+          fprintf(stderr, "%s: sort key test %d vs %d literal compare returned %d expected %d\n",
+                  program, i, j, SIGN(result), expected);
+          failures++;
+        }
+      }
+    }
+  }
+
+  tidy:
+  for(i = 0; i < SORT_KEY_TESTS_COUNT; i++) {
+    if(literals[i])
+      rasqal_free_literal(literals[i]);
+    if(keys[i])
+      RASQAL_FREE(char*, keys[i]);
+    if(desc_keys[i])
+      RASQAL_FREE(char*, desc_keys[i]);
+  }
+
+  return failures;
+}
+
+
+static const struct {
+  const char* string;
+  /* type after parsing as xsd:integer */
+  rasqal_literal_type type;
+} integer64_parse_test_data[] = {
+  { "2147483648", RASQAL_LITERAL_INTEGER },
+  { "-2147483649", RASQAL_LITERAL_INTEGER },
+  { "9223372036854775807", RASQAL_LITERAL_INTEGER },
+  { "-9223372036854775808", RASQAL_LITERAL_INTEGER },
+  /* will not fit in 64 bits */
+  { "9223372036854775808", RASQAL_LITERAL_DECIMAL },
+  { "-9223372036854775809", RASQAL_LITERAL_DECIMAL },
+  { NULL, RASQAL_LITERAL_UNKNOWN }
+};
+
+static const struct {
+  char op;
+  const char* a;
+  const char* b;
+  /* type and value of the result */
+  rasqal_literal_type type;
+  const char* result;
+} integer64_op_test_data[] = {
+  { '+', "2147483647", "1", RASQAL_LITERAL_INTEGER, "2147483648" },
+  { '-', "-2147483648", "1", RASQAL_LITERAL_INTEGER, "-2147483649" },
+  { '*', "3037000499", "3037000499", RASQAL_LITERAL_INTEGER,
+    "9223372030926249001" },
+  /* overflows so promoted to xsd:decimal */
+  { '+', "9223372036854775807", "1", RASQAL_LITERAL_DECIMAL,
+    "9223372036854775808" },
+  { '-', "-9223372036854775808", "1", RASQAL_LITERAL_DECIMAL,
+    "-9223372036854775809" },
+  { '*', "4294967296", "4294967296", RASQAL_LITERAL_DECIMAL,
+    "18446744073709551616" },
+  { '*', "-9223372036854775808", "-1", RASQAL_LITERAL_DECIMAL,
+    "9223372036854775808" },
+  { '\0', NULL, NULL, RASQAL_LITERAL_UNKNOWN, NULL }
+};
+
+static const struct {
+  rasqal_literal_type type;
+  const char* string;
+  /* rasqal_literal_as_integer() result and error */
+  int integer;
+  int error;
+} integer_clamp_test_data[] = {
+  { RASQAL_LITERAL_INTEGER, "2147483647", INT_MAX, 0 },
+  { RASQAL_LITERAL_INTEGER, "3000000000", INT_MAX, 0 },
+  { RASQAL_LITERAL_INTEGER, "-3000000000", INT_MIN, 0 },
+  { RASQAL_LITERAL_INTEGER, "9223372036854775807", INT_MAX, 0 },
+  { RASQAL_LITERAL_DECIMAL, "3000000000.5", 0, 1 },
+  { RASQAL_LITERAL_UNKNOWN, NULL, 0, 0 }
+};
+
+
+static int
+integer64_tests(rasqal_world* world, const char* program)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; integer64_parse_test_data[i].string; i++) {
+    const unsigned char* string;
+    rasqal_literal* l;
+    rasqal_literal* expected = NULL;
+    int error = 0;
+
+    string = RASQAL_GOOD_CAST(const unsigned char*,
+                              integer64_parse_test_data[i].string);
+    l = rasqal_new_typed_literal(world, RASQAL_LITERAL_INTEGER, string);
+    if(!l) {
+      fprintf(stderr, "%s: integer %s failed to create literal\n",
+              program, string);
+      failures++;
+      continue;
+    }
+
+    if(l->type != integer64_parse_test_data[i].type) {
+      fprintf(stderr, "%s: integer %s has type %s expected %s\n",
+              program, string, rasqal_literal_type_label(l->type),
+              rasqal_literal_type_label(integer64_parse_test_data[i].type));
+      failures++;
+    } else if(l->type == RASQAL_LITERAL_INTEGER) {
+      rasqal_int64 integer = rasqal_literal_as_integer64(l, &error);
+      unsigned char* buffer;
+
+      buffer = rasqal_xsd_format_integer(integer, NULL);
+      if(error || !buffer ||
+         strcmp(RASQAL_GOOD_CAST(const char*, buffer),
+                integer64_parse_test_data[i].string)) {
+        fprintf(stderr, "%s: integer %s has value %s\n",
+                program, string, buffer ? (const char*)buffer : "?");
+        failures++;
+      }
+      if(buffer)
+        RASQAL_FREE(char*, buffer);
+    } else {
+      expected = rasqal_new_typed_literal(world, RASQAL_LITERAL_DECIMAL,
+                                          string);
+      if(!expected ||
+         rasqal_literal_compare(l, expected, RASQAL_COMPARE_XQUERY, &error) ||
+         error) {
+        fprintf(stderr, "%s: integer %s did not keep its decimal value\n",
+                program, string);
+        failures++;
+      }
+    }
+
+    if(expected)
+      rasqal_free_literal(expected);
+    rasqal_free_literal(l);
+  }
+
+  for(i = 0; integer64_op_test_data[i].op; i++) {
+    rasqal_literal* a;
+    rasqal_literal* b;
+    rasqal_literal* result = NULL;
+    rasqal_literal* expected;
+    int error = 0;
+
+    a = rasqal_new_typed_literal(world, RASQAL_LITERAL_INTEGER,
+                                 RASQAL_GOOD_CAST(const unsigned char*,
+                                                  integer64_op_test_data[i].a));
+    b = rasqal_new_typed_literal(world, RASQAL_LITERAL_INTEGER,
+                                 RASQAL_GOOD_CAST(const unsigned char*,
+                                                  integer64_op_test_data[i].b));
+    expected = rasqal_new_typed_literal(world, integer64_op_test_data[i].type,
+                                        RASQAL_GOOD_CAST(const unsigned char*,
+                                                         integer64_op_test_data[i].result));
+
+    if(a && b) {
+      switch(integer64_op_test_data[i].op) {
+        case '+':
+          result = rasqal_literal_add(a, b, &error);
+          break;
+        case '-':
+          result = rasqal_literal_subtract(a, b, &error);
+          break;
+        default:
+          result = rasqal_literal_multiply(a, b, &error);
+          break;
+      }
+    }
+
+    if(!result || error || !expected) {
+      fprintf(stderr, "%s: %s %c %s FAILED\n", program,
+              integer64_op_test_data[i].a, integer64_op_test_data[i].op,
+              integer64_op_test_data[i].b);
+      failures++;
+    } else if(result->type != integer64_op_test_data[i].type ||
+              rasqal_literal_compare(result, expected, RASQAL_COMPARE_XQUERY,
+                                     &error) || error) {
+      fprintf(stderr, "%s: %s %c %s returned %s %s expected %s %s\n",
+              program,
+              integer64_op_test_data[i].a, integer64_op_test_data[i].op,
+              integer64_op_test_data[i].b,
+              rasqal_literal_type_label(result->type),
+              rasqal_literal_as_string(result),
+              rasqal_literal_type_label(integer64_op_test_data[i].type),
+              integer64_op_test_data[i].result);
+      failures++;
+    }
+
+    if(result)
+      rasqal_free_literal(result);
+    if(expected)
+      rasqal_free_literal(expected);
+    if(b)
+      rasqal_free_literal(b);
+    if(a)
+      rasqal_free_literal(a);
+  }
+
+  for(i = 0; integer_clamp_test_data[i].string; i++) {
+    rasqal_literal* l;
+    int integer;
+    int error = 0;
+
+    l = rasqal_new_typed_literal(world, integer_clamp_test_data[i].type,
+                                 RASQAL_GOOD_CAST(const unsigned char*,
+                                                  integer_clamp_test_data[i].string));
+    if(!l) {
+      fprintf(stderr, "%s: %s failed to create literal\n",
+              program, integer_clamp_test_data[i].string);
+      failures++;
+      continue;
+    }
+
+    integer = rasqal_literal_as_integer(l, &error);
+    if(error != integer_clamp_test_data[i].error ||
+       (!error && integer != integer_clamp_test_data[i].integer)) {
+      fprintf(stderr, "%s: %s as integer returned %d error %d expected %d error %d\n",
+              program, integer_clamp_test_data[i].string, integer, error,
+              integer_clamp_test_data[i].integer,
+              integer_clamp_test_data[i].error);
+      failures++;
+    }
+
+    rasqal_free_literal(l);
+  }
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -5070,7 +6121,13 @@ main(int argc, char *argv[])
       failures++;
     }
   }
-  
+
+  fprintf(stderr, "%s: Testing literal sort keys\n", program);
+  failures += sort_key_tests(world, program);
+
+  fprintf(stderr, "%s: Testing 64 bit integers\n", program);
+  failures += integer64_tests(world, program);
+
 
   tidy:
   rasqal_free_world(world);
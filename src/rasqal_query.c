@@ -74,6 +74,8 @@
 #define DEBUG_FH stderr
 
 static int rasqal_query_add_query_result(rasqal_query* query, rasqal_query_results* query_results);
+static int rasqal_query_share_prepared(rasqal_query* query, rasqal_query* source, int data_graphs_offset);
+static int rasqal_query_prepare_internal(rasqal_query* query, const unsigned char *query_string, raptor_uri *base_uri, int use_caches);
 
 
 /**
@@ -179,6 +181,54 @@ rasqal_free_query(rasqal_query* query)
   if(--query->usage)
     return;
   
+  /* the incremental state shares nodes of the algebra plan */
+  if(query->incremental)
+    rasqal_free_incremental(query->incremental);
+
+  if(query->algebra_plan)
+    rasqal_free_algebra_node(query->algebra_plan);
+
+  if(query->template_query) {
+    /* prepared from the world query cache: the parsed query
+     * structures are owned by the template query */
+    rasqal_query_reset_expression_memos(query);
+
+    if(query->factory)
+      query->factory->terminate(query);
+
+    if(query->eval_context)
+      rasqal_free_evaluation_context(query->eval_context);
+
+    if(query->context)
+      RASQAL_FREE(rasqal_query_context, query->context);
+
+    if(query->base_uri)
+      raptor_free_uri(query->base_uri);
+
+    if(query->query_string)
+      RASQAL_FREE(char*, query->query_string);
+
+    if(query->data_graphs)
+      raptor_free_sequence(query->data_graphs);
+
+    if(query->results)
+      raptor_free_sequence(query->results);
+
+    if(query->modifier)
+      rasqal_free_solution_modifier(query->modifier);
+
+    if(query->parameters)
+      raptor_free_sequence(query->parameters);
+
+    if(query->results_cache_key)
+      RASQAL_FREE(char*, query->results_cache_key);
+
+    rasqal_free_query(query->template_query);
+
+    RASQAL_FREE(rasqal_query, query);
+    return;
+  }
+
   if(query->factory)
     query->factory->terminate(query);
 
@@ -242,9 +292,18 @@ rasqal_free_query(rasqal_query* query)
   if(query->bindings)
     rasqal_free_bindings(query->bindings);
   
+  if(query->parameters)
+    raptor_free_sequence(query->parameters);
+  
   if(query->projection)
     rasqal_free_projection(query->projection);
   
+  if(query->results_cache_key)
+    RASQAL_FREE(char*, query->results_cache_key);
+
+  if(query->expression_memos)
+    raptor_free_sequence(query->expression_memos);
+
   RASQAL_FREE(rasqal_query, query);
 }
 
@@ -305,12 +364,26 @@ rasqal_query_set_feature(rasqal_query* query, rasqal_feature feature, int value)
   switch(feature) {
     case RASQAL_FEATURE_NO_NET:
     case RASQAL_FEATURE_RAND_SEED:
+    case RASQAL_FEATURE_INCREMENTAL:
 
       if(feature == RASQAL_FEATURE_RAND_SEED)
         query->user_set_rand = 1;
       
       query->features[RASQAL_GOOD_CAST(int, feature)] = value;
       break;
+
+    case RASQAL_FEATURE_TIMEOUT:
+    case RASQAL_FEATURE_MAX_ROWS:
+    case RASQAL_FEATURE_MAX_MEMORY:
+    case RASQAL_FEATURE_SORT_MEMORY:
+    case RASQAL_FEATURE_SORT_THREADS:
+    case RASQAL_FEATURE_SCAN_THREADS:
+    case RASQAL_FEATURE_UNION_THREADS:
+      if(value < 0)
+        return 1;
+
+      query->features[RASQAL_GOOD_CAST(int, feature)] = value;
+      break;
   }
 
   return 0;
@@ -370,8 +443,19 @@ rasqal_query_get_feature(rasqal_query *query, rasqal_feature feature)
   switch(feature) {
     case RASQAL_FEATURE_NO_NET:
     case RASQAL_FEATURE_RAND_SEED:
+    case RASQAL_FEATURE_INCREMENTAL:
       result = (query->features[RASQAL_GOOD_CAST(int, feature)] != 0);
       break;
+
+    case RASQAL_FEATURE_TIMEOUT:
+    case RASQAL_FEATURE_MAX_ROWS:
+    case RASQAL_FEATURE_MAX_MEMORY:
+    case RASQAL_FEATURE_SORT_MEMORY:
+    case RASQAL_FEATURE_SORT_THREADS:
+    case RASQAL_FEATURE_SCAN_THREADS:
+    case RASQAL_FEATURE_UNION_THREADS:
+      result = query->features[RASQAL_GOOD_CAST(int, feature)];
+      break;
   }
   
   return result;
@@ -1221,10 +1305,35 @@ rasqal_query_prepare(rasqal_query* query,
                      const unsigned char *query_string,
                      raptor_uri *base_uri)
 {
-  int rc = 0;
-  
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
 
+  return rasqal_query_prepare_internal(query, query_string, base_uri,
+                                       /* use_caches */ 1);
+}
+
+
+/*
+ * rasqal_query_prepare_internal:
+ * @query: the #rasqal_query object
+ * @query_string: the query string (or NULL)
+ * @base_uri: base URI of query string (optional)
+ * @use_caches: non-0 to share the prepared query with the world query cache
+ *
+ * INTERNAL - Prepare a query as rasqal_query_prepare()
+ *
+ * Return value: non-0 on failure.
+ */
+static int
+rasqal_query_prepare_internal(rasqal_query* query,
+                              const unsigned char *query_string,
+                              raptor_uri *base_uri,
+                              int use_caches)
+{
+  int rc = 0;
+  unsigned char* cache_key = NULL;
+  size_t cache_key_len = 0;
+  int data_graphs_offset;
+  
   if(query->failed)
     return 1;
 
@@ -1290,6 +1399,36 @@ rasqal_query_prepare(rasqal_query* query,
     rasqal_evaluation_context_set_rand_seed(query->eval_context, seed);
   }
   
+  if(use_caches && query_string && query->world->results_cache_size > 0)
+    /* the results cache key starts with the same normalised query */
+    query->results_cache_key = rasqal_query_cache_make_key(query, query_string,
+                                                           query->base_uri,
+                                                           &query->results_cache_key_len);
+
+  if(use_caches && query_string && query->world->query_cache_size > 0) {
+    /* the key is made before parsing changes the language context */
+    cache_key = rasqal_query_cache_make_key(query, query_string,
+                                            query->base_uri, &cache_key_len);
+    if(cache_key) {
+      rasqal_query* template_query;
+
+      template_query = rasqal_query_cache_get(query->world, cache_key,
+                                              cache_key_len);
+      if(template_query) {
+        RASQAL_FREE(char*, cache_key);
+
+        rc = rasqal_query_share_prepared(query, template_query, 0);
+        if(rc) {
+          query->failed = 1;
+          rc = 1;
+        }
+        return rc;
+      }
+    }
+  }
+
+  /* data graphs added before preparing are not part of the parsed query */
+  data_graphs_offset = raptor_sequence_size(query->data_graphs);
 
   rc = query->factory->prepare(query);
   if(rc) {
@@ -1300,10 +1439,185 @@ rasqal_query_prepare(rasqal_query* query,
     rc = 1;
   }
 
+  if(cache_key) {
+    rasqal_query* template_query = NULL;
+
+    if(!rc)
+      template_query = rasqal_new_query(query->world,
+                                        query->factory->desc.names[0], NULL);
+    if(template_query) {
+      template_query->prepared = 1;
+      if(rasqal_query_share_prepared(template_query, query,
+                                     data_graphs_offset)) {
+        rasqal_free_query(template_query);
+        template_query = NULL;
+      }
+    }
+
+    /* failing to cache the query does not fail preparing it */
+    if(template_query)
+      rasqal_query_cache_add(query->world, cache_key, cache_key_len,
+                             template_query);
+    else
+      RASQAL_FREE(char*, cache_key);
+  }
+
   return rc;
 }
 
 
+/*
+ * rasqal_new_worker_query:
+ * @query: prepared query
+ *
+ * INTERNAL - Prepare a query again to evaluate part of it on a worker thread
+ *
+ * The worker query parses the query string of @query again so that it
+ * has its own variables, triples and expressions; it is never shared
+ * with the world query cache.  It uses the data graphs of @query and
+ * stops when @query is cancelled or reaches its deadline.
+ *
+ * Return value: new query or NULL on failure
+ */
+rasqal_query*
+rasqal_new_worker_query(rasqal_query* query)
+{
+  rasqal_query* worker;
+  rasqal_data_graph* dg;
+  int i;
+
+  if(!query->query_string)
+    return NULL;
+
+  worker = rasqal_new_query(query->world, query->factory->desc.names[0], NULL);
+  if(!worker)
+    return NULL;
+
+  worker->parent_query = query;
+  memcpy(worker->features, query->features, sizeof(query->features));
+
+  if(rasqal_query_prepare_internal(worker, query->query_string,
+                                   query->base_uri, /* use_caches */ 0))
+    goto failed;
+
+  /* replace the data graphs named in the query string with all those
+   * of @query */
+  while((dg = (rasqal_data_graph*)raptor_sequence_pop(worker->data_graphs)))
+    rasqal_free_data_graph(dg);
+
+  for(i = 0; (dg = (rasqal_data_graph*)raptor_sequence_get_at(query->data_graphs, i)); i++) {
+    if(raptor_sequence_push(worker->data_graphs,
+                            rasqal_new_data_graph_from_data_graph(dg)))
+      goto failed;
+  }
+
+  return worker;
+
+  failed:
+  rasqal_free_query(worker);
+  return NULL;
+}
+
+
+/*
+ * rasqal_query_share_prepared:
+ * @query: query to set up
+ * @source: prepared query
+ * @data_graphs_offset: index of the first data graph of @source to copy
+ *
+ * INTERNAL - Make a query use the parsed and prepared form of another
+ *
+ * The parsed query structures and the variables table are shared
+ * with the query owning them, which @query keeps a reference to.
+ * The data graphs from @data_graphs_offset and the solution modifier
+ * of @source are copied so they can be changed per query.  Since the
+ * variables are shared the world query cache only shares a prepared
+ * form that no other query is using.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_query_share_prepared(rasqal_query* query, rasqal_query* source,
+                            int data_graphs_offset)
+{
+  rasqal_query* owner;
+  rasqal_data_graph* dg;
+  int i;
+
+  owner = source->template_query ? source->template_query : source;
+
+  /* the empty structures made by rasqal_new_query() are replaced */
+  raptor_free_namespaces(query->namespaces);
+  rasqal_free_variables_table(query->vars_table);
+  raptor_free_sequence(query->triples);
+  raptor_free_sequence(query->prefixes);
+
+  owner->usage++;
+  query->template_query = owner;
+
+  query->namespaces = source->namespaces;
+  query->vars_table = source->vars_table;
+  query->triples = source->triples;
+  query->prefixes = source->prefixes;
+  query->query_graph_pattern = source->query_graph_pattern;
+  query->verb = source->verb;
+  query->constructs = source->constructs;
+  query->optional_triples = source->optional_triples;
+  query->describes = source->describes;
+  query->triples_use_map = source->triples_use_map;
+  query->variables_use_map = source->variables_use_map;
+  query->prefix_depth = source->prefix_depth;
+  query->graph_pattern_count = source->graph_pattern_count;
+  query->graph_patterns_sequence = source->graph_patterns_sequence;
+  query->explain = source->explain;
+  query->updates = source->updates;
+  query->bindings = source->bindings;
+  query->projection = source->projection;
+  query->expression_memos = source->expression_memos;
+
+  if(!query->base_uri && source->base_uri)
+    query->base_uri = raptor_uri_copy(source->base_uri);
+
+  for(i = data_graphs_offset;
+      (dg = (rasqal_data_graph*)raptor_sequence_get_at(source->data_graphs, i));
+      i++) {
+    dg = rasqal_new_data_graph_from_data_graph(dg);
+    if(!dg || raptor_sequence_push(query->data_graphs, dg))
+      return 1;
+  }
+
+  if(source->modifier) {
+    rasqal_solution_modifier* sm = source->modifier;
+    raptor_sequence* order_seq;
+    raptor_sequence* group_seq;
+    raptor_sequence* having_seq;
+
+    order_seq = rasqal_expression_copy_expression_sequence(sm->order_conditions);
+    group_seq = rasqal_expression_copy_expression_sequence(sm->group_conditions);
+    having_seq = rasqal_expression_copy_expression_sequence(sm->having_conditions);
+    query->modifier = rasqal_new_solution_modifier(query, order_seq, group_seq,
+                                                   having_seq, sm->limit,
+                                                   sm->offset);
+    if(!query->modifier) {
+      if(order_seq)
+        raptor_free_sequence(order_seq);
+      if(group_seq)
+        raptor_free_sequence(group_seq);
+      if(having_seq)
+        raptor_free_sequence(having_seq);
+      return 1;
+    }
+
+    if((sm->order_conditions && !order_seq) ||
+       (sm->group_conditions && !group_seq) ||
+       (sm->having_conditions && !having_seq))
+      return 1;
+  }
+
+  return 0;
+}
+
+
 /**
  * rasqal_query_get_engine_by_name:
  * @name: query engine name
@@ -1362,6 +1676,9 @@ rasqal_query_execute_with_engine(rasqal_query* query,
   if(!query_results)
     return NULL;
 
+  /* results of a previous execution or query are not reused */
+  rasqal_query_reset_expression_memos(query);
+
   if(!engine)
     engine = rasqal_query_get_engine_by_name(NULL);
 
@@ -1396,6 +1713,228 @@ rasqal_query_execute(rasqal_query* query)
 }
 
 
+/**
+ * rasqal_query_cancel:
+ * @query: the #rasqal_query object
+ *
+ * Cancel the current execution of a query.
+ *
+ * This only sets a flag so it may be called from another thread or
+ * a signal handler while the query results are being read.  The
+ * execution stops at the next row and the query results fail.
+ *
+ * The flag is cleared when the query is next executed.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_query_cancel(rasqal_query* query)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
+
+  query->cancelled = 1;
+
+  return 0;
+}
+
+
+static void
+rasqal_free_query_parameter(rasqal_query_parameter* parameter)
+{
+  if(parameter->variable)
+    rasqal_free_variable(parameter->variable);
+
+  if(parameter->value)
+    rasqal_free_literal(parameter->value);
+
+  RASQAL_FREE(rasqal_query_parameter, parameter);
+}
+
+
+/**
+ * rasqal_query_bind_parameter:
+ * @query: the prepared #rasqal_query object
+ * @name: variable name with or without a leading '$' or '?'
+ * @value: value to bind or NULL to remove the binding
+ *
+ * Bind a query parameter to a value for the following executions.
+ *
+ * Any named variable of a prepared query may be used as a parameter;
+ * by convention they are written as $name in the query.  A bound
+ * parameter is replaced by @value in triple patterns, so the triples
+ * source can match it directly, and its variable has @value when
+ * expressions are evaluated.  The query is not parsed or planned
+ * again so the same prepared query can be executed many times with
+ * different values.
+ *
+ * The parameter must not be bound by other means in the query such
+ * as BIND(), VALUES or GRAPH ?var.
+ *
+ * Ownership of @value is taken.
+ *
+ * Return value: non-0 on failure such as no variable @name in the query
+ **/
+int
+rasqal_query_bind_parameter(rasqal_query* query,
+                            const unsigned char *name,
+                            rasqal_literal* value)
+{
+  rasqal_variable* v;
+  rasqal_query_parameter* parameter;
+  int i;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, char*, 1);
+
+  if(*name == '$' || *name == '?')
+    name++;
+
+  v = rasqal_variables_table_get_by_name(query->vars_table,
+                                         RASQAL_VARIABLE_TYPE_NORMAL, name);
+  if(!v)
+    goto failed;
+
+  if(!query->parameters) {
+    query->parameters = raptor_new_sequence((raptor_data_free_handler)rasqal_free_query_parameter,
+                                            NULL);
+    if(!query->parameters)
+      goto failed;
+  }
+
+  for(i = 0;
+      (parameter = (rasqal_query_parameter*)raptor_sequence_get_at(query->parameters, i));
+      i++) {
+    if(parameter->variable == v)
+      break;
+  }
+
+  if(!parameter) {
+    if(!value)
+      return 0;
+
+    parameter = RASQAL_CALLOC(rasqal_query_parameter*, 1, sizeof(*parameter));
+    if(!parameter)
+      goto failed;
+
+    parameter->variable = rasqal_new_variable_from_variable(v);
+    if(raptor_sequence_push(query->parameters, parameter))
+      goto failed;
+  }
+
+  if(parameter->value)
+    rasqal_free_literal(parameter->value);
+  parameter->value = value;
+
+  /* an unbound parameter must not keep the value of the last execution */
+  if(!value)
+    rasqal_variable_set_value(parameter->variable, NULL);
+
+  return 0;
+
+  failed:
+  if(value)
+    rasqal_free_literal(value);
+  return 1;
+}
+
+
+/**
+ * rasqal_query_clear_parameters:
+ * @query: the #rasqal_query object
+ *
+ * Remove all query parameter bindings.
+ *
+ * See rasqal_query_bind_parameter().
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_query_clear_parameters(rasqal_query* query)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
+
+  if(query->parameters) {
+    rasqal_query_parameter* parameter;
+    int i;
+
+    /* unbound variables must not keep the values of the last execution */
+    for(i = 0;
+        (parameter = (rasqal_query_parameter*)raptor_sequence_get_at(query->parameters, i));
+        i++)
+      rasqal_variable_set_value(parameter->variable, NULL);
+
+    raptor_free_sequence(query->parameters);
+    query->parameters = NULL;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_get_parameter_value:
+ * @query: query
+ * @v: variable
+ *
+ * INTERNAL - Get the value bound to a query parameter
+ *
+ * Return value: shared value or NULL if @v is not a bound parameter
+ */
+rasqal_literal*
+rasqal_query_get_parameter_value(rasqal_query* query, rasqal_variable* v)
+{
+  rasqal_query_parameter* parameter;
+  int i;
+
+  if(!query->parameters || !v)
+    return NULL;
+
+  for(i = 0;
+      (parameter = (rasqal_query_parameter*)raptor_sequence_get_at(query->parameters, i));
+      i++) {
+    if(parameter->variable == v)
+      return parameter->value;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * rasqal_query_set_parameter_variables:
+ * @query: query
+ *
+ * INTERNAL - Set the variables of bound query parameters to their values
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_query_set_parameter_variables(rasqal_query* query)
+{
+  rasqal_query_parameter* parameter;
+  int i;
+
+  if(!query->parameters)
+    return 0;
+
+  for(i = 0;
+      (parameter = (rasqal_query_parameter*)raptor_sequence_get_at(query->parameters, i));
+      i++) {
+    rasqal_literal* value = NULL;
+
+    if(parameter->value) {
+      value = rasqal_new_literal_from_literal(parameter->value);
+      if(!value)
+        return 1;
+    }
+
+    rasqal_variable_set_value(parameter->variable, value);
+  }
+
+  return 0;
+}
+
+
 static const char* const rasqal_query_verb_labels[RASQAL_QUERY_VERB_LAST+1] = {
   "Unknown",
   "SELECT",
@@ -1549,6 +2088,28 @@ rasqal_query_print(rasqal_query* query, FILE *fh)
 }
 
 
+/*
+ * rasqal_query_reset_expression_memos:
+ * @query: query
+ *
+ * INTERNAL - Forget the per-row results of shared subexpressions
+ */
+void
+rasqal_query_reset_expression_memos(rasqal_query* query)
+{
+  int i;
+  rasqal_expression_memo* memo;
+
+  if(!query->expression_memos)
+    return;
+
+  for(i = 0;
+      (memo = (rasqal_expression_memo*)raptor_sequence_get_at(query->expression_memos, i));
+      i++)
+    rasqal_expression_memo_reset(memo);
+}
+
+
 static int
 rasqal_query_add_query_result(rasqal_query* query,
                               rasqal_query_results* query_results) 
@@ -0,0 +1,420 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_query_cache.c - Rasqal world cache of prepared queries
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+/*
+ * A prepared query template in the world query cache
+ */
+struct rasqal_query_cache_entry_s {
+  /* next entry in most recently used first order */
+  struct rasqal_query_cache_entry_s* next;
+
+  /* key made by rasqal_query_cache_make_key() (owned) */
+  unsigned char* key;
+  size_t key_len;
+  unsigned long hash;
+
+  /* prepared query template (reference) */
+  rasqal_query* query;
+};
+
+
+static void
+rasqal_free_query_cache_entry(rasqal_query_cache_entry* entry)
+{
+  if(entry->query)
+    rasqal_free_query(entry->query);
+
+  if(entry->key)
+    RASQAL_FREE(char*, entry->key);
+
+  RASQAL_FREE(rasqal_query_cache_entry, entry);
+}
+
+
+/*
+ * rasqal_query_normalise_string:
+ * @string: query string
+ * @buffer: output buffer at least as long as @string
+ *
+ * INTERNAL - Normalise a query string for use in a cache key
+ *
+ * Comments are removed and runs of whitespace between tokens become
+ * one space.  String literals and IRIs are copied unchanged so two
+ * strings normalise the same only if they lex the same.
+ *
+ * Return value: length of normalised string in @buffer
+ */
+static size_t
+rasqal_query_normalise_string(const unsigned char* string,
+                              unsigned char* buffer)
+{
+  const unsigned char* s = string;
+  unsigned char* p = buffer;
+  int space = 0;
+
+  while(*s) {
+    unsigned char c = *s;
+
+    if(c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      space = 1;
+      s++;
+      continue;
+    }
+
+    if(c == '#') {
+      /* comment to end of line */
+      while(*s && *s != '\r' && *s != '\n')
+        s++;
+      space = 1;
+      continue;
+    }
+
+    if(space && p != buffer)
+      *p++ = ' ';
+    space = 0;
+
+    if(c == '\\') {
+      /* escaped character in a prefixed name */
+      *p++ = *s++;
+      if(*s)
+        *p++ = *s++;
+      continue;
+    }
+
+    if(c == '"' || c == '\'') {
+      /* '...', "...", '''...''' or """...""" */
+      int long_string = (s[1] == c && s[2] == c);
+
+      if(long_string) {
+        *p++ = *s++;
+        *p++ = *s++;
+      }
+      *p++ = *s++;
+
+      while(*s) {
+        if(*s == '\\' && s[1]) {
+          *p++ = *s++;
+          *p++ = *s++;
+          continue;
+        }
+
+        if(*s == c && (!long_string || (s[1] == c && s[2] == c))) {
+          if(long_string) {
+            *p++ = *s++;
+            *p++ = *s++;
+          }
+          *p++ = *s++;
+          break;
+        }
+
+        *p++ = *s++;
+      }
+      continue;
+    }
+
+    if(c == '<') {
+      /* an IRI if it ends at '>' without characters not allowed in IRIs */
+      const unsigned char* e = s + 1;
+
+      while(*e && *e != '>' && *e != '<' && *e != '"' && *e != '{' &&
+            *e != '}' && *e != ' ' && *e != '\t' && *e != '\r' && *e != '\n')
+        e++;
+
+      if(*e == '>') {
+        while(s <= e)
+          *p++ = *s++;
+        continue;
+      }
+    }
+
+    *p++ = *s++;
+  }
+
+  return RASQAL_GOOD_CAST(size_t, p - buffer);
+}
+
+
+/*
+ * rasqal_query_cache_make_key:
+ * @query: unprepared query
+ * @query_string: query string
+ * @base_uri: base URI (or NULL)
+ * @key_len_p: pointer to store key length
+ *
+ * INTERNAL - Make the world query cache key for preparing a query
+ *
+ * The key is the query language name and language context (holding
+ * the language options of the query) before parsing, the base URI
+ * and the normalised query string.
+ *
+ * Return value: new key or NULL on failure
+ */
+unsigned char*
+rasqal_query_cache_make_key(rasqal_query* query,
+                            const unsigned char* query_string,
+                            raptor_uri* base_uri,
+                            size_t* key_len_p)
+{
+  const char* name = query->factory->desc.names[0];
+  size_t name_len = strlen(name);
+  size_t context_len = query->factory->context_length;
+  const unsigned char* base_string = RASQAL_GOOD_CAST(const unsigned char*, "");
+  size_t base_len = 0;
+  size_t len;
+  unsigned char* key;
+  unsigned char* p;
+
+  if(base_uri)
+    base_string = raptor_uri_as_counted_string(base_uri, &base_len);
+
+  len = name_len + 1 + context_len + base_len + 1 +
+        strlen(RASQAL_GOOD_CAST(const char*, query_string));
+  key = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!key)
+    return NULL;
+
+  p = key;
+  memcpy(p, name, name_len + 1);
+  p += name_len + 1;
+  if(context_len) {
+    memcpy(p, query->context, context_len);
+    p += context_len;
+  }
+  memcpy(p, base_string, base_len);
+  p += base_len;
+  *p++ = '\0';
+  p += rasqal_query_normalise_string(query_string, p);
+  *p = '\0';
+
+  *key_len_p = RASQAL_GOOD_CAST(size_t, p - key);
+
+  return key;
+}
+
+
+static unsigned long
+rasqal_query_cache_hash(const unsigned char* key, size_t key_len)
+{
+  /* FNV-1a */
+  unsigned long hash = 2166136261UL;
+  size_t i;
+
+  for(i = 0; i < key_len; i++) {
+    hash ^= key[i];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+/*
+ * rasqal_query_cache_entry_in_use:
+ * @entry: cache entry
+ *
+ * INTERNAL - Check if another query is using the prepared form of an entry
+ *
+ * The template holds one reference to the query owning the parsed
+ * structures; any other reference is the query that was prepared
+ * or a query sharing it.
+ *
+ * Return value: non-0 if in use
+ */
+static int
+rasqal_query_cache_entry_in_use(rasqal_query_cache_entry* entry)
+{
+  rasqal_query* owner = entry->query->template_query;
+
+  return (owner && owner->usage > 1);
+}
+
+
+/*
+ * rasqal_query_cache_get:
+ * @world: world
+ * @key: key from rasqal_query_cache_make_key()
+ * @key_len: length of @key
+ *
+ * INTERNAL - Find a prepared query template in the world query cache
+ *
+ * Queries sharing a prepared form share its variables, so an entry
+ * is not returned while another query is using it.
+ *
+ * Return value: shared prepared query or NULL if not cached or in use
+ */
+rasqal_query*
+rasqal_query_cache_get(rasqal_world* world, const unsigned char* key,
+                       size_t key_len)
+{
+  rasqal_query_cache_entry** prev_p;
+  rasqal_query_cache_entry* entry;
+  unsigned long hash = rasqal_query_cache_hash(key, key_len);
+
+  for(prev_p = &world->query_cache; (entry = *prev_p); prev_p = &entry->next) {
+    if(entry->hash == hash && entry->key_len == key_len &&
+       !memcmp(entry->key, key, key_len)) {
+      if(rasqal_query_cache_entry_in_use(entry))
+        return NULL;
+
+      /* move to the front as the most recently used */
+      *prev_p = entry->next;
+      entry->next = world->query_cache;
+      world->query_cache = entry;
+
+      return entry->query;
+    }
+  }
+
+  return NULL;
+}
+
+
+/* remove least recently used entries beyond @size entries */
+static void
+rasqal_query_cache_trim(rasqal_world* world, int size)
+{
+  rasqal_query_cache_entry** prev_p = &world->query_cache;
+  int count = 0;
+
+  while(*prev_p && count < size) {
+    prev_p = &(*prev_p)->next;
+    count++;
+  }
+
+  while(*prev_p) {
+    rasqal_query_cache_entry* entry = *prev_p;
+
+    *prev_p = entry->next;
+    rasqal_free_query_cache_entry(entry);
+    world->query_cache_count--;
+  }
+}
+
+
+/*
+ * rasqal_query_cache_add:
+ * @world: world
+ * @key: key from rasqal_query_cache_make_key() (ownership taken)
+ * @key_len: length of @key
+ * @template_query: prepared query template (reference taken)
+ *
+ * INTERNAL - Add a prepared query template to the world query cache
+ *
+ * An entry with the same key, which was in use when @template_query
+ * was prepared, is replaced.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_query_cache_add(rasqal_world* world, unsigned char* key,
+                       size_t key_len, rasqal_query* template_query)
+{
+  rasqal_query_cache_entry** prev_p;
+  rasqal_query_cache_entry* entry;
+  unsigned long hash = rasqal_query_cache_hash(key, key_len);
+
+  for(prev_p = &world->query_cache; (entry = *prev_p); prev_p = &entry->next) {
+    if(entry->hash == hash && entry->key_len == key_len &&
+       !memcmp(entry->key, key, key_len)) {
+      /* queries using the old entry keep their references */
+      *prev_p = entry->next;
+      rasqal_free_query_cache_entry(entry);
+      world->query_cache_count--;
+      break;
+    }
+  }
+
+  entry = RASQAL_CALLOC(rasqal_query_cache_entry*, 1, sizeof(*entry));
+  if(!entry) {
+    RASQAL_FREE(char*, key);
+    rasqal_free_query(template_query);
+    return 1;
+  }
+
+  entry->key = key;
+  entry->key_len = key_len;
+  entry->hash = hash;
+  entry->query = template_query;
+
+  entry->next = world->query_cache;
+  world->query_cache = entry;
+  world->query_cache_count++;
+
+  rasqal_query_cache_trim(world, world->query_cache_size);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_set_query_cache_size:
+ * @world: world
+ * @size: maximum number of prepared queries to keep or 0 to disable
+ *
+ * Set the size of the world cache of prepared queries.
+ *
+ * When the cache is enabled, rasqal_query_prepare() looks up the
+ * query language, base URI and query string with comments and extra
+ * whitespace removed.  On a hit the query shares the parsed and
+ * prepared form of the cached query instead of parsing the string.
+ * Each query keeps its own features, data graphs, LIMIT and OFFSET,
+ * parameters, query plan and results.  The variables are shared so
+ * a cached query is only used while no other query prepared from it,
+ * including the query that was first prepared, still exists; if one
+ * does the query string is parsed again and replaces the cached one.
+ *
+ * The least recently used queries are removed when the cache is full.
+ * The cache is disabled by default.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_world_set_query_cache_size(rasqal_world* world, int size)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  if(size < 0)
+    return 1;
+
+  world->query_cache_size = size;
+  rasqal_query_cache_trim(world, size);
+
+  return 0;
+}
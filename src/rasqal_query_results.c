@@ -159,6 +159,9 @@ struct rasqal_query_results_s {
 
   /* non-0 if @vars_table has been initialized from first row */
   int vars_table_init;
+
+  /* memory allocated during execution (or NULL) */
+  rasqal_memory_account* memory_account;
 };
     
 
@@ -362,6 +365,7 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
   int rc = 0;
   size_t ex_data_size;
   rasqal_query* query;
+  int use_results_cache;
   
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
@@ -376,9 +380,11 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
   /* set executed flag early to enable cleanup on error */
   query_results->executed = 1;
 
-  /* ensure stored results are present if ordering is being done */
+  /* ensure stored results are present if ordering is being done,
+   * unless the sort may spill to disk when results are streamed */
   query_results->store_results = (store_results ||
-                                  rasqal_query_get_order_conditions_sequence(query));
+                                  (rasqal_query_get_order_conditions_sequence(query) &&
+                                   !query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SORT_MEMORY)]));
   
   ex_data_size = query_results->execution_factory->execution_data_size;
   if(ex_data_size > 0) {
@@ -391,15 +397,52 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
 
   /* Update the current datetime once per query execution */
   rasqal_world_reset_now(query->world);
+
+  if(rasqal_query_budget_start(query))
+    return 1;
+
+  if(rasqal_query_set_parameter_variables(query))
+    return 1;
+
+  use_results_cache = (query_results->store_results &&
+                       query->results_cache_key &&
+                       query->world->results_cache_size > 0);
+  if(use_results_cache) {
+    unsigned char* key;
+    size_t key_len;
+
+    key = rasqal_results_cache_make_key(query, &key_len);
+    if(key) {
+      raptor_sequence* seq;
+
+      seq = rasqal_results_cache_get(query->world, key, key_len,
+                                     query_results->vars_table);
+      RASQAL_FREE(char*, key);
+
+      if(seq) {
+        /* stored results from an earlier execution; nothing to evaluate */
+        query_results->results_sequence = seq;
+        query_results->vars_table_init = 1;
+        rasqal_query_results_rewind(query_results);
+        return 0;
+      }
+    }
+  }
+
+  query_results->memory_account = rasqal_new_memory_account(NULL);
+  query->memory_account = query_results->memory_account;
   
   if(query_results->execution_factory->execute_init) {
     rasqal_engine_error execution_error = RASQAL_ENGINE_OK;
     int execution_flags = 0;
+    rasqal_memory_account* previous_account;
 
     if(query_results->store_results)
       execution_flags |= 1;
 
+    previous_account = rasqal_memory_account_enter(query_results->memory_account);
     rc = query_results->execution_factory->execute_init(query_results->execution_data, query, query_results, execution_flags, &execution_error);
+    rasqal_memory_account_leave(previous_account);
 
     if(rc || execution_error != RASQAL_ENGINE_OK) {
       query_results->failed = 1;
@@ -413,8 +456,26 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
 #endif
 
   /* Choose either to execute all now and store OR do it on demand (lazy) */
-  if(query_results->store_results)
+  if(query_results->store_results) {
+    rasqal_memory_account* previous_account;
+
+    previous_account = rasqal_memory_account_enter(query_results->memory_account);
     rc = rasqal_query_results_execute_and_store_results(query_results);
+    rasqal_memory_account_leave(previous_account);
+
+    if(!rc && use_results_cache && query_results->results_sequence) {
+      unsigned char* key;
+      size_t key_len;
+
+      /* made again as the data graphs are now loaded */
+      key = rasqal_results_cache_make_key(query, &key_len);
+
+      /* failing to cache the results does not fail the execution */
+      if(key)
+        rasqal_results_cache_add(query->world, key, key_len,
+                                 query_results->results_sequence);
+    }
+  }
 
   return rc;
 }
@@ -464,6 +525,12 @@ rasqal_free_query_results(rasqal_query_results* query_results)
   if(query)
     rasqal_query_remove_query_result(query, query_results);
 
+  if(query_results->memory_account) {
+    if(query && query->memory_account == query_results->memory_account)
+      query->memory_account = NULL;
+    rasqal_free_memory_account(query_results->memory_account);
+  }
+
   RASQAL_FREE(rasqal_query_results, query_results);
 }
 
@@ -767,9 +834,13 @@ rasqal_query_results_ensure_have_row_internal(rasqal_query_results* query_result
     /* handle limit/offset for incremental get_row() */
     while(1) {
       int check;
+      rasqal_memory_account* previous_account;
       
+      previous_account = rasqal_memory_account_enter(query_results->memory_account);
       query_results->row = query_results->execution_factory->get_row(query_results->execution_data, &execution_error);
-      if(execution_error == RASQAL_ENGINE_FAILED) {
+      rasqal_memory_account_leave(previous_account);
+      if(execution_error == RASQAL_ENGINE_FAILED ||
+         execution_error == RASQAL_ENGINE_ABORTED) {
         query_results->failed = 1;
         break;
       }
@@ -897,6 +968,32 @@ rasqal_query_results_get_count(rasqal_query_results* query_results)
 }
 
 
+/**
+ * rasqal_query_results_get_memory_usage:
+ * @query_results: #rasqal_query_results query_results
+ * @current_p: pointer to store bytes currently allocated (or NULL)
+ * @peak_p: pointer to store peak bytes allocated (or NULL)
+ *
+ * Get the memory allocated by the query execution.
+ *
+ * Counts memory allocated by rasqal while executing the query and
+ * reading the results that has not been freed yet.  Only available
+ * if rasqal was built with memory accounting
+ * (configure --with-memory-accounting).
+ *
+ * Return value: non-0 on failure or if memory accounting is not available
+ **/
+int
+rasqal_query_results_get_memory_usage(rasqal_query_results* query_results,
+                                      size_t* current_p, size_t* peak_p)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+
+  return rasqal_memory_account_get_usage(query_results->memory_account,
+                                         current_p, peak_p);
+}
+
+
 /*
  * rasqal_query_results_next_internal:
  * @query_results: #rasqal_query_results query_results
@@ -1447,6 +1544,608 @@ rasqal_query_results_next_triple(rasqal_query_results* query_results)
 }
 
 
+/*
+ * Streaming CONSTRUCT
+ *
+ * The CONSTRUCT template is compiled once into a table of parts.
+ * Each template triple part is either a constant #raptor_term shared
+ * by every result or a reference to a slot.  A slot is a query
+ * results row offset for a variable or a template blank node and its
+ * term is made once per result row and shared by all the template
+ * triples that mention it.
+ */
+
+/* Initial number of buckets in the distinct triples hash; power of 2 */
+#define RASQAL_CONSTRUCT_SEEN_BUCKETS 1024
+
+typedef struct rasqal_construct_seen_s {
+  struct rasqal_construct_seen_s* next;
+  unsigned long hash;
+  raptor_statement* statement;
+} rasqal_construct_seen;
+
+typedef struct {
+  /* constant term (or NULL) */
+  raptor_term* term;
+
+  /* slot index or <0 if none */
+  int slot;
+} rasqal_construct_part;
+
+typedef struct {
+  rasqal_query_results* query_results;
+
+  /* number of template triples */
+  int triples_count;
+
+  /* template triple parts: 3 * @triples_count */
+  rasqal_construct_part* parts;
+
+  /* number of slots */
+  int slots_count;
+
+  /* per slot: query results row offset or <0 for a blank node */
+  int* slot_offsets;
+
+  /* per slot: template blank node label (or NULL) */
+  const unsigned char** slot_bnodes;
+
+  /* per slot: term for the current result row (or NULL) */
+  raptor_term** slot_terms;
+
+  /* distinct triples hash buckets (or NULL if not distinct) */
+  rasqal_construct_seen** seen;
+  unsigned long seen_size;
+  unsigned long seen_count;
+} rasqal_construct_template;
+
+
+static void
+rasqal_free_construct_template(rasqal_construct_template* ct)
+{
+  int i;
+
+  if(ct->parts) {
+    for(i = 0; i < ct->triples_count * 3; i++) {
+      if(ct->parts[i].term)
+        raptor_free_term(ct->parts[i].term);
+    }
+    RASQAL_FREE(rasqal_construct_part*, ct->parts);
+  }
+
+  if(ct->slot_terms) {
+    for(i = 0; i < ct->slots_count; i++) {
+      if(ct->slot_terms[i])
+        raptor_free_term(ct->slot_terms[i]);
+    }
+    RASQAL_FREE(raptor_term**, ct->slot_terms);
+  }
+
+  if(ct->slot_offsets)
+    RASQAL_FREE(int*, ct->slot_offsets);
+
+  if(ct->slot_bnodes)
+    RASQAL_FREE(unsigned char**, ct->slot_bnodes);
+
+  if(ct->seen) {
+    unsigned long b;
+
+    for(b = 0; b < ct->seen_size; b++) {
+      rasqal_construct_seen* entry;
+      rasqal_construct_seen* next;
+
+      for(entry = ct->seen[b]; entry; entry = next) {
+        next = entry->next;
+        raptor_free_statement(entry->statement);
+        RASQAL_FREE(rasqal_construct_seen*, entry);
+      }
+    }
+    RASQAL_FREE(rasqal_construct_seen**, ct->seen);
+  }
+}
+
+
+/*
+ * rasqal_construct_template_add_slot:
+ * @ct: construct template
+ * @offset: query results row offset or <0
+ * @bnode: template blank node label or NULL
+ *
+ * INTERNAL - find or add a slot for a variable or template blank node
+ *
+ * Return value: slot index
+ */
+static int
+rasqal_construct_template_add_slot(rasqal_construct_template* ct,
+                                   int offset, const unsigned char* bnode)
+{
+  int i;
+
+  for(i = 0; i < ct->slots_count; i++) {
+    if(bnode) {
+      if(ct->slot_bnodes[i] &&
+         !strcmp(RASQAL_GOOD_CAST(const char*, ct->slot_bnodes[i]),
+                 RASQAL_GOOD_CAST(const char*, bnode)))
+        return i;
+    } else if(!ct->slot_bnodes[i] && ct->slot_offsets[i] == offset)
+      return i;
+  }
+
+  i = ct->slots_count++;
+  ct->slot_offsets[i] = offset;
+  ct->slot_bnodes[i] = bnode;
+
+  return i;
+}
+
+
+/*
+ * rasqal_construct_template_init:
+ * @ct: construct template
+ * @query_results: query results with a current row
+ * @distinct: non-0 to suppress duplicate triples
+ *
+ * INTERNAL - compile the query CONSTRUCT template
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_construct_template_init(rasqal_construct_template* ct,
+                               rasqal_query_results* query_results,
+                               int distinct)
+{
+  rasqal_query* query = query_results->query;
+  int i;
+  size_t size;
+
+  memset(ct, '\0', sizeof(*ct));
+  ct->query_results = query_results;
+  ct->triples_count = raptor_sequence_size(query->constructs);
+
+  size = RASQAL_GOOD_CAST(size_t, ct->triples_count) * 3;
+  ct->parts = RASQAL_CALLOC(rasqal_construct_part*, size + 1,
+                            sizeof(rasqal_construct_part));
+  ct->slot_offsets = RASQAL_CALLOC(int*, size + 1, sizeof(int));
+  ct->slot_bnodes = RASQAL_CALLOC(const unsigned char**, size + 1,
+                                  sizeof(unsigned char*));
+  ct->slot_terms = RASQAL_CALLOC(raptor_term**, size + 1,
+                                 sizeof(raptor_term*));
+  if(!ct->parts || !ct->slot_offsets || !ct->slot_bnodes || !ct->slot_terms)
+    return 1;
+
+  if(distinct) {
+    ct->seen_size = RASQAL_CONSTRUCT_SEEN_BUCKETS;
+    ct->seen = RASQAL_CALLOC(rasqal_construct_seen**, ct->seen_size,
+                             sizeof(rasqal_construct_seen*));
+    if(!ct->seen)
+      return 1;
+  }
+
+  for(i = 0; i < ct->triples_count; i++) {
+    rasqal_triple* t;
+    rasqal_literal* lits[3];
+    int j;
+
+    t = (rasqal_triple*)raptor_sequence_get_at(query->constructs, i);
+    lits[0] = t->subject;
+    lits[1] = t->predicate;
+    lits[2] = t->object;
+
+    for(j = 0; j < 3; j++) {
+      rasqal_construct_part* part = &ct->parts[i * 3 + j];
+      rasqal_literal* l = lits[j];
+
+      part->term = NULL;
+      part->slot = -1;
+
+      if(l->type == RASQAL_LITERAL_VARIABLE) {
+        rasqal_variable* v = l->value.variable;
+        rasqal_variable* rv;
+
+        /* a variable not in the results is never bound; part stays NULL */
+        rv = rasqal_variables_table_get_by_name(query_results->vars_table,
+                                                v->type, v->name);
+        if(rv)
+          part->slot = rasqal_construct_template_add_slot(ct, rv->offset,
+                                                          NULL);
+      } else if(l->type == RASQAL_LITERAL_BLANK) {
+        part->slot = rasqal_construct_template_add_slot(ct, -1, l->string);
+      } else
+        part->term = rasqal_literal_to_result_term(query_results, l);
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_results_value_to_term:
+ * @query_results: query results
+ * @l: result row value
+ *
+ * INTERNAL - turn a result row value into a new term without copying the literal
+ *
+ * Return value: new term or NULL
+ */
+static raptor_term*
+rasqal_query_results_value_to_term(rasqal_query_results* query_results,
+                                   rasqal_literal* l)
+{
+  raptor_world* raptor_world_ptr = query_results->world->raptor_world_ptr;
+
+  switch(l->type) {
+    case RASQAL_LITERAL_URI:
+      return raptor_new_term_from_uri(raptor_world_ptr, l->value.uri);
+
+    case RASQAL_LITERAL_BLANK:
+      return raptor_new_term_from_blank(raptor_world_ptr, l->string);
+
+    case RASQAL_LITERAL_STRING:
+      return raptor_new_term_from_literal(raptor_world_ptr,
+                                          l->string,
+                                          l->datatype,
+                                          RASQAL_GOOD_CAST(const unsigned char*, l->language));
+
+    case RASQAL_LITERAL_UNKNOWN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_XSD_STRING:
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_DOUBLE:
+    case RASQAL_LITERAL_FLOAT:
+    case RASQAL_LITERAL_VARIABLE:
+    case RASQAL_LITERAL_DECIMAL:
+    case RASQAL_LITERAL_DATE:
+    case RASQAL_LITERAL_DATETIME:
+    case RASQAL_LITERAL_UDT:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+    default:
+      return rasqal_literal_to_result_term(query_results, l);
+  }
+}
+
+
+/*
+ * rasqal_construct_template_bind_row:
+ * @ct: construct template
+ * @row: current result row
+ *
+ * INTERNAL - make the slot terms for the current result row
+ */
+static void
+rasqal_construct_template_bind_row(rasqal_construct_template* ct,
+                                   rasqal_row* row)
+{
+  rasqal_query_results* query_results = ct->query_results;
+  int i;
+
+  for(i = 0; i < ct->slots_count; i++) {
+    raptor_term* term = NULL;
+
+    if(ct->slot_terms[i]) {
+      raptor_free_term(ct->slot_terms[i]);
+      ct->slot_terms[i] = NULL;
+    }
+
+    if(ct->slot_bnodes[i]) {
+      /* genuine blank node in template: new one every result */
+      unsigned char* nodeid;
+
+      nodeid = rasqal_prefix_id(query_results->result_count,
+                                ct->slot_bnodes[i]);
+      if(nodeid) {
+        term = raptor_new_term_from_blank(query_results->world->raptor_world_ptr,
+                                          nodeid);
+        RASQAL_FREE(char*, nodeid);
+      }
+    } else {
+      int offset = ct->slot_offsets[i];
+
+      if(offset < row->size && row->values[offset])
+        term = rasqal_query_results_value_to_term(query_results,
+                                                  row->values[offset]);
+    }
+
+    ct->slot_terms[i] = term;
+  }
+}
+
+
+static unsigned long
+rasqal_construct_hash_bytes(unsigned long hash, const unsigned char* str,
+                            size_t len)
+{
+  size_t i;
+
+  /* FNV-1a */
+  for(i = 0; i < len; i++)
+    hash = (hash ^ str[i]) * 16777619UL;
+
+  return hash;
+}
+
+
+static unsigned long
+rasqal_construct_hash_term(unsigned long hash, raptor_term* term)
+{
+  const unsigned char* str;
+  size_t len;
+  unsigned char type = RASQAL_GOOD_CAST(unsigned char, term->type);
+
+  hash = rasqal_construct_hash_bytes(hash, &type, 1);
+
+  switch(term->type) {
+    case RAPTOR_TERM_TYPE_URI:
+      str = raptor_uri_as_counted_string(term->value.uri, &len);
+      hash = rasqal_construct_hash_bytes(hash, str, len);
+      break;
+
+    case RAPTOR_TERM_TYPE_LITERAL:
+      hash = rasqal_construct_hash_bytes(hash, term->value.literal.string,
+                                         term->value.literal.string_len);
+      if(term->value.literal.datatype) {
+        str = raptor_uri_as_counted_string(term->value.literal.datatype, &len);
+        hash = rasqal_construct_hash_bytes(hash, str, len);
+      }
+      if(term->value.literal.language)
+        hash = rasqal_construct_hash_bytes(hash, term->value.literal.language,
+                                           term->value.literal.language_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_BLANK:
+      hash = rasqal_construct_hash_bytes(hash, term->value.blank.string,
+                                         term->value.blank.string_len);
+      break;
+
+    case RAPTOR_TERM_TYPE_UNKNOWN:
+    default:
+      break;
+  }
+
+  return hash;
+}
+
+
+/*
+ * rasqal_construct_template_seen:
+ * @ct: construct template
+ * @statement: triple about to be emitted
+ *
+ * INTERNAL - check and record a triple for distinct output
+ *
+ * Return value: >0 if already emitted, 0 if new, <0 on failure
+ */
+static int
+rasqal_construct_template_seen(rasqal_construct_template* ct,
+                               raptor_statement* statement)
+{
+  raptor_world* raptor_world_ptr = ct->query_results->world->raptor_world_ptr;
+  rasqal_construct_seen* entry;
+  unsigned long hash = 2166136261UL;
+  unsigned long bucket;
+
+  hash = rasqal_construct_hash_term(hash, statement->subject);
+  hash = rasqal_construct_hash_term(hash, statement->predicate);
+  hash = rasqal_construct_hash_term(hash, statement->object);
+
+  bucket = hash & (ct->seen_size - 1);
+  for(entry = ct->seen[bucket]; entry; entry = entry->next) {
+    if(entry->hash == hash &&
+       raptor_statement_equals(entry->statement, statement))
+      return 1;
+  }
+
+  /* grow when the load factor passes 1 */
+  if(ct->seen_count >= ct->seen_size) {
+    unsigned long new_size = ct->seen_size << 1;
+    rasqal_construct_seen** new_seen;
+    unsigned long b;
+
+    new_seen = RASQAL_CALLOC(rasqal_construct_seen**, new_size,
+                             sizeof(rasqal_construct_seen*));
+    if(!new_seen)
+      return -1;
+
+    for(b = 0; b < ct->seen_size; b++) {
+      rasqal_construct_seen* next;
+
+      for(entry = ct->seen[b]; entry; entry = next) {
+        unsigned long nb = entry->hash & (new_size - 1);
+
+        next = entry->next;
+        entry->next = new_seen[nb];
+        new_seen[nb] = entry;
+      }
+    }
+
+    RASQAL_FREE(rasqal_construct_seen**, ct->seen);
+    ct->seen = new_seen;
+    ct->seen_size = new_size;
+    bucket = hash & (new_size - 1);
+  }
+
+  entry = RASQAL_MALLOC(rasqal_construct_seen*, sizeof(*entry));
+  if(!entry)
+    return -1;
+
+  entry->hash = hash;
+  entry->statement = raptor_new_statement_from_nodes(raptor_world_ptr,
+                                                     raptor_term_copy(statement->subject),
+                                                     raptor_term_copy(statement->predicate),
+                                                     raptor_term_copy(statement->object),
+                                                     NULL);
+  if(!entry->statement) {
+    RASQAL_FREE(rasqal_construct_seen*, entry);
+    return -1;
+  }
+
+  entry->next = ct->seen[bucket];
+  ct->seen[bucket] = entry;
+  ct->seen_count++;
+
+  return 0;
+}
+
+
+static raptor_term*
+rasqal_construct_template_get_term(rasqal_construct_template* ct,
+                                   rasqal_construct_part* part)
+{
+  if(part->slot >= 0)
+    return ct->slot_terms[part->slot];
+
+  return part->term;
+}
+
+
+/**
+ * rasqal_query_results_write_graph:
+ * @query_results: #rasqal_query_results query_results
+ * @serializer: started #raptor_serializer to write to
+ * @flags: bitmask of #rasqal_query_results_graph_flags
+ *
+ * Write all remaining graph results to a serializer.
+ *
+ * This is a faster alternative to looping with
+ * rasqal_query_results_get_triple() and
+ * rasqal_query_results_next_triple().  The CONSTRUCT template is
+ * compiled once and each result row is turned into triples that are
+ * passed straight to @serializer without being stored.  Triples with
+ * non-RDF terms are skipped with a warning as with
+ * rasqal_query_results_get_triple().
+ *
+ * The caller must start the serializer with
+ * raptor_serializer_start_to_iostream() or similar before calling
+ * this and end it with raptor_serializer_serialize_end() afterwards.
+ *
+ * If @flags contains #RASQAL_QUERY_RESULTS_GRAPH_DISTINCT, duplicate
+ * triples are written only once, at the cost of remembering every
+ * triple written.
+ *
+ * DESCRIBE is not supported and writes no triples.
+ *
+ * Return value: number of triples written or <0 on failure
+ **/
+int
+rasqal_query_results_write_graph(rasqal_query_results* query_results,
+                                 raptor_serializer* serializer,
+                                 unsigned int flags)
+{
+  rasqal_query* query;
+  rasqal_construct_template ct;
+  int count = 0;
+  int i;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, -1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(serializer, raptor_serializer, -1);
+
+  if(query_results->failed)
+    return -1;
+
+  if(!rasqal_query_results_is_graph(query_results))
+    return -1;
+
+  query = query_results->query;
+  if(!query)
+    return -1;
+
+  /* no DESCRIBE triples are returned, as with get_triple() */
+  if(query->verb == RASQAL_QUERY_VERB_DESCRIBE)
+    return 0;
+
+  if(query_results->finished)
+    return 0;
+
+  /* the first row sets up the results variables table */
+  if(rasqal_query_results_ensure_have_row_internal(query_results))
+    return query_results->failed ? -1 : 0;
+
+  if(rasqal_construct_template_init(&ct, query_results,
+                                    (flags & RASQAL_QUERY_RESULTS_GRAPH_DISTINCT))) {
+    rasqal_free_construct_template(&ct);
+    return -1;
+  }
+
+  /* resume after any triples already returned by get_triple() */
+  i = query_results->current_triple_result;
+  if(i < 0)
+    i = 0;
+
+  while(query_results->row) {
+    rasqal_construct_template_bind_row(&ct, query_results->row);
+
+    for(; i < ct.triples_count; i++) {
+      rasqal_construct_part* parts = &ct.parts[i * 3];
+      raptor_statement statement;
+      int rc;
+
+      raptor_statement_init(&statement, query_results->world->raptor_world_ptr);
+
+      statement.subject = rasqal_construct_template_get_term(&ct, &parts[0]);
+      if(!statement.subject ||
+         statement.subject->type == RAPTOR_TERM_TYPE_LITERAL) {
+        rasqal_log_warning_simple(query_results->world,
+                                  RASQAL_WARNING_LEVEL_BAD_TRIPLE,
+                                  &query->locator,
+                                  "Triple with non-RDF subject term skipped");
+        continue;
+      }
+
+      statement.predicate = rasqal_construct_template_get_term(&ct, &parts[1]);
+      if(!statement.predicate ||
+         statement.predicate->type != RAPTOR_TERM_TYPE_URI) {
+        rasqal_log_warning_simple(query_results->world,
+                                  RASQAL_WARNING_LEVEL_BAD_TRIPLE,
+                                  &query->locator,
+                                  "Triple with non-RDF predicate term skipped");
+        continue;
+      }
+
+      statement.object = rasqal_construct_template_get_term(&ct, &parts[2]);
+      if(!statement.object) {
+        rasqal_log_warning_simple(query_results->world,
+                                  RASQAL_WARNING_LEVEL_BAD_TRIPLE,
+                                  &query->locator,
+                                  "Triple with non-RDF object term skipped");
+        continue;
+      }
+
+      if(ct.seen) {
+        rc = rasqal_construct_template_seen(&ct, &statement);
+        if(rc < 0) {
+          query_results->failed = 1;
+          break;
+        }
+        if(rc)
+          continue;
+      }
+
+      /* terms are shared with the template so the statement is not cleared */
+      if(raptor_serializer_serialize_statement(serializer, &statement)) {
+        query_results->failed = 1;
+        break;
+      }
+
+      count++;
+    }
+
+    if(query_results->failed)
+      break;
+
+    i = 0;
+    query_results->current_triple_result = -1;
+    if(rasqal_query_results_next_internal(query_results))
+      break;
+  }
+
+  rasqal_free_construct_template(&ct);
+
+  return query_results->failed ? -1 : count;
+}
+
+
 /**
  * rasqal_query_results_get_boolean:
  * @query_results: #rasqal_query_results query_results
@@ -1662,7 +2361,8 @@ rasqal_query_results_execute_and_store_results(rasqal_query_results* query_resul
     rasqal_engine_error execution_error = RASQAL_ENGINE_OK;
     
     seq = query_results->execution_factory->get_all_rows(query_results->execution_data, &execution_error);
-    if(execution_error == RASQAL_ENGINE_FAILED)
+    if(execution_error == RASQAL_ENGINE_FAILED ||
+       execution_error == RASQAL_ENGINE_ABORTED)
       query_results->failed = 1;
   }
 
@@ -1954,6 +2654,273 @@ const struct {
 };
 
 
+/* strings needing every kind of N-Triples escape between plain runs
+ * longer than the test write buffer */
+static const struct {
+  const char* string;
+  /* length or 0 for the whole string */
+  size_t len;
+} escape_test_strings[] = {
+  { "", 0 },
+  { "plain", 0 },
+  { "say \"hi\", ok", 0 },
+  { "back\\slash and \"quotes\" and 'apostrophes'", 0 },
+  { "tab\there\nnewline\rreturn\bbackspace\fformfeed\x01\x1f\x7f", 0 },
+  { "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", 0 },
+  { "a long plain run that crosses the end of the buffer\t"
+    "another long plain run after an escape\xc3\xa9x", 0 },
+  /* a NUL ends the string */
+  { "before a NUL\0after it", sizeof("before a NUL\0after it") - 1 },
+  { NULL, 0 }
+};
+
+/* delimiters passed by the JSON, CSV and TSV writers */
+static const char escape_test_delims[] = { '"', '\0' };
+
+#define ESCAPE_TEST_BUFFER_SIZE 8
+
+
+/*
+ * Check rasqal_write_buffer_write_ntriples_string() escapes as
+ * raptor_string_ntriples_write() used by the old result writers
+ *
+ * Return value: number of failures
+ */
+static int
+escape_tests(const char* program, raptor_world* raptor_world_ptr)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; escape_test_strings[i].string; i++) {
+    const unsigned char* str;
+    size_t len;
+    int d;
+
+    str = RASQAL_GOOD_CAST(const unsigned char*, escape_test_strings[i].string);
+    len = escape_test_strings[i].len;
+    if(!len)
+      len = strlen(escape_test_strings[i].string);
+
+    for(d = 0; d < RASQAL_GOOD_CAST(int, sizeof(escape_test_delims)); d++) {
+      const char delim = escape_test_delims[d];
+      void* expected = NULL;
+      size_t expected_len = 0;
+      void* result = NULL;
+      size_t result_len = 0;
+      raptor_iostream* iostr;
+      rasqal_write_buffer* wb;
+
+      iostr = raptor_new_iostream_to_string(raptor_world_ptr,
+                                            &expected, &expected_len, NULL);
+      if(!iostr)
+        return failures + 1;
+      raptor_string_ntriples_write(str, len, delim, iostr);
+      raptor_free_iostream(iostr);
+
+      iostr = raptor_new_iostream_to_string(raptor_world_ptr,
+                                            &result, &result_len, NULL);
+      if(!iostr) {
+        raptor_free_memory(expected);
+        return failures + 1;
+      }
+      wb = rasqal_new_write_buffer(iostr, ESCAPE_TEST_BUFFER_SIZE);
+      if(!wb ||
+         rasqal_write_buffer_write_ntriples_string(wb, str, len, delim)) {
+        fprintf(stderr, "%s: escaping string %d delimiter %d FAILED\n",
+                program, i, d);
+        failures++;
+      }
+      rasqal_free_write_buffer(wb);
+      raptor_free_iostream(iostr);
+
+      if(result_len != expected_len ||
+         memcmp(result, expected, expected_len)) {
+        fprintf(stderr, "%s: escaping string %d delimiter %d FAILED returned '%s' expected '%s'\n",
+                program, i, d, (char*)result, (char*)expected);
+        failures++;
+      }
+
+      raptor_free_memory(expected);
+      raptor_free_memory(result);
+    }
+  }
+
+  return failures;
+}
+
+
+/* values of ?s and ?v in each row: a URI, blank node or string with
+ * an optional language or NULL for unbound */
+static const struct {
+  const char* s;
+  int s_blank;
+  const char* v;
+  const char* v_language;
+} format_test_rows[] = {
+  { "http://example.org/a", 0, "say \"hi\", ok", NULL },
+  { "b1", 1, "caf\xc3\xa9\tx \xf0\x9f\x98\x80", "fr" },
+  { NULL, 0, "line1\nline2", NULL }
+};
+
+#define FORMAT_TEST_ROWS_COUNT 3
+
+/* output of the result writers before they were buffered */
+static const struct {
+  const char* name;
+  const char* expected;
+} format_tests[] = {
+  { "tsv",
+    "?s\t?v\n"
+    "<http://example.org/a>\t\"say \\\"hi\\\", ok\"\n"
+    "_:b1\t\"caf\\u00E9\\tx \\U0001F600\"@fr\n"
+    "\t\"line1\\nline2\"\n" },
+  { "csv",
+    "s,v\r\n"
+    "http://example.org/a,\"say \"\"hi\"\", ok\"\r\n"
+    "_:b1,caf\xc3\xa9\tx \xf0\x9f\x98\x80\r\n"
+    ",\"line1\nline2\"\r\n" },
+  { "json",
+    "{\n"
+    "  \"head\": {\n"
+    "    \"vars\": [ \"s\", \"v\" ]\n"
+    "  },\n"
+    "  \"results\": {\n"
+    "    \"bindings\" : [\n"
+    "      {\n"
+    "        \"s\" : { \"type\": \"uri\", \"value\": \"http://example.org/a\" },\n"
+    "        \"v\" : { \"type\": \"literal\", \"value\": \"say \\\"hi\\\", ok\" }\n"
+    "      },\n"
+    "      {\n"
+    "        \"s\" : { \"type\": \"bnode\", \"value\": \"b1\" },\n"
+    "        \"v\" : { \"type\": \"literal\", \"value\": \"caf\\u00E9\\tx \\U0001F600\",\n"
+    "      \"xml:lang\" : \"fr\" }\n"
+    "      },\n"
+    "      {\n"
+    "        \"s\" : { \"type\": \"unbound\", \"value\": null },\n"
+    "        \"v\" : { \"type\": \"literal\", \"value\": \"line1\\nline2\" }\n"
+    "      }\n"
+    "    ]\n"
+    "  }\n"
+    "}\n" },
+  { NULL, NULL }
+};
+
+
+static unsigned char*
+copy_string(const char* string)
+{
+  size_t len = strlen(string);
+  unsigned char* copy = RASQAL_MALLOC(unsigned char*, len + 1);
+
+  if(copy)
+    memcpy(copy, string, len + 1);
+  return copy;
+}
+
+
+/*
+ * Write the format test rows with the JSON, CSV and TSV writers and
+ * compare to the output of the old writers
+ *
+ * Return value: number of failures
+ */
+static int
+write_format_tests(const char* program, rasqal_world* world,
+                   raptor_uri* base_uri)
+{
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(world);
+  rasqal_query_results* results;
+  rasqal_variables_table* vt;
+  int failures = 0;
+  int i;
+
+  results = rasqal_new_query_results2(world, NULL,
+                                      RASQAL_QUERY_RESULTS_BINDINGS);
+  if(!results)
+    return 1;
+
+  vt = rasqal_query_results_get_variables_table(results);
+  rasqal_free_variable(rasqal_variables_table_add2(vt, RASQAL_VARIABLE_TYPE_NORMAL,
+                                                   (const unsigned char*)"s", 1,
+                                                   NULL));
+  rasqal_free_variable(rasqal_variables_table_add2(vt, RASQAL_VARIABLE_TYPE_NORMAL,
+                                                   (const unsigned char*)"v", 1,
+                                                   NULL));
+
+  for(i = 0; i < FORMAT_TEST_ROWS_COUNT; i++) {
+    rasqal_row* row;
+    rasqal_literal* l = NULL;
+
+    row = rasqal_new_row_for_size(world, 2);
+    if(!row) {
+      rasqal_free_query_results(results);
+      return failures + 1;
+    }
+
+    if(format_test_rows[i].s_blank)
+      l = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK,
+                                    copy_string(format_test_rows[i].s));
+    else if(format_test_rows[i].s)
+      l = rasqal_new_uri_literal(world,
+                                 raptor_new_uri(raptor_world_ptr,
+                                                (const unsigned char*)format_test_rows[i].s));
+    if(l) {
+      rasqal_row_set_value_at(row, 0, l);
+      rasqal_free_literal(l);
+    }
+
+    l = rasqal_new_string_literal(world, copy_string(format_test_rows[i].v),
+                                  format_test_rows[i].v_language ?
+                                  (const char*)copy_string(format_test_rows[i].v_language) : NULL,
+                                  NULL, NULL);
+    if(l) {
+      rasqal_row_set_value_at(row, 1, l);
+      rasqal_free_literal(l);
+    }
+
+    rasqal_query_results_add_row(results, row);
+  }
+
+  for(i = 0; format_tests[i].name; i++) {
+    const char* name = format_tests[i].name;
+    raptor_iostream* iostr;
+    void* string = NULL;
+    size_t string_len = 0;
+
+    rasqal_query_results_rewind(results);
+
+    iostr = raptor_new_iostream_to_string(raptor_world_ptr,
+                                          &string, &string_len, NULL);
+    if(!iostr) {
+      failures++;
+      break;
+    }
+
+    if(rasqal_query_results_write(iostr, results, name, NULL, NULL,
+                                  base_uri)) {
+      fprintf(stderr, "%s: writing %s results FAILED\n", program, name);
+      failures++;
+    }
+    raptor_free_iostream(iostr);
+
+    if(!string || strcmp((const char*)string, format_tests[i].expected)) {
+      fprintf(stderr, "%s: writing %s results FAILED returned\n%s\nexpected\n%s\n",
+              program, name, string ? (const char*)string : "NULL",
+              format_tests[i].expected);
+      failures++;
+    }
+
+    if(string)
+      raptor_free_memory(string);
+  }
+
+  rasqal_free_query_results(results);
+
+  return failures;
+}
+
+
 #if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
 static void
 print_bindings_results_simple(rasqal_query_results *results, FILE* output)
@@ -2038,6 +3005,15 @@ main(int argc, char *argv[])
       rasqal_free_query_results(qr);
   }
 
+  failures += escape_tests(program, raptor_world_ptr);
+
+  if(1) {
+    raptor_uri* base_uri = raptor_new_uri(raptor_world_ptr,
+                                          (const unsigned char*)"http://example.org/");
+    failures += write_format_tests(program, world, base_uri);
+    raptor_free_uri(base_uri);
+  }
+
   if(world)
     rasqal_free_world(world);
 
@@ -1056,6 +1056,16 @@ rasqal_expression_foreach_fold(void *user_data, rasqal_expression *e)
 }
 
 
+static int
+rasqal_expression_foreach_prepare_in_set(void *user_data, rasqal_expression *e)
+{
+  /* a set that cannot be made leaves the list to be evaluated */
+  rasqal_expression_prepare_in_set(e);
+
+  return 0;
+}
+
+
 static int
 rasqal_query_expression_fold(rasqal_query* rq, rasqal_expression* e)
 {
@@ -1071,6 +1081,9 @@ rasqal_query_expression_fold(rasqal_query* rq, rasqal_expression* e)
       break;
   }
 
+  if(!st.failed)
+    rasqal_expression_visit(e, rasqal_expression_foreach_prepare_in_set, NULL);
+
   return st.failed;
 }
 
@@ -1132,6 +1145,395 @@ rasqal_query_fold_expressions(rasqal_query* rq)
 }
 
 
+/* non-0 if two literals are the same term or the same variable */
+static int
+rasqal_expression_literal_same(rasqal_literal* l1, rasqal_literal* l2)
+{
+  if(!l1 || !l2)
+    return (l1 == l2);
+
+  if(l1->type != l2->type)
+    return 0;
+
+  if(l1->type == RASQAL_LITERAL_VARIABLE)
+    return (l1->value.variable == l2->value.variable);
+
+  if(l1->type == RASQAL_LITERAL_URI)
+    return raptor_uri_equals(l1->value.uri, l2->value.uri);
+
+  if(l1->string_len != l2->string_len || !l1->string != !l2->string ||
+     (l1->string && memcmp(l1->string, l2->string, l1->string_len)))
+    return 0;
+
+  if(!l1->language != !l2->language ||
+     (l1->language && strcmp(l1->language, l2->language)))
+    return 0;
+
+  if(!l1->datatype != !l2->datatype ||
+     (l1->datatype && !raptor_uri_equals(l1->datatype, l2->datatype)))
+    return 0;
+
+  if(!l1->flags != !l2->flags ||
+     (l1->flags && strcmp(RASQAL_GOOD_CAST(const char*, l1->flags),
+                          RASQAL_GOOD_CAST(const char*, l2->flags))))
+    return 0;
+
+  return 1;
+}
+
+
+/*
+ * rasqal_expression_same:
+ * @e1: first expression
+ * @e2: second expression
+ *
+ * INTERNAL - Check if two expressions are written the same
+ *
+ * Unlike rasqal_expression_compare() this does not compare the values
+ * of variables or promote literals so equal expressions always give
+ * the same result for the same variable values.
+ *
+ * Return value: non-0 if the same
+ */
+static int
+rasqal_expression_same(rasqal_expression* e1, rasqal_expression* e2)
+{
+  int size;
+  int i;
+
+  if(e1 == e2)
+    return 1;
+
+  if(!e1 || !e2)
+    return 0;
+
+  if(e1->op != e2->op || e1->flags != e2->flags)
+    return 0;
+
+  if(!e1->name != !e2->name ||
+     (e1->name && !raptor_uri_equals(e1->name, e2->name)))
+    return 0;
+
+  if(!rasqal_expression_literal_same(e1->literal, e2->literal))
+    return 0;
+
+  if(!rasqal_expression_same(e1->arg1, e2->arg1) ||
+     !rasqal_expression_same(e1->arg2, e2->arg2) ||
+     !rasqal_expression_same(e1->arg3, e2->arg3) ||
+     !rasqal_expression_same(e1->arg4, e2->arg4))
+    return 0;
+
+  if(!e1->args || !e2->args)
+    return (e1->args == e2->args);
+
+  size = raptor_sequence_size(e1->args);
+  if(size != raptor_sequence_size(e2->args))
+    return 0;
+
+  for(i = 0; i < size; i++) {
+    if(!rasqal_expression_same((rasqal_expression*)raptor_sequence_get_at(e1->args, i),
+                               (rasqal_expression*)raptor_sequence_get_at(e2->args, i)))
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/* for use with rasqal_expression_visit: non-0 if the result can
+ * differ for the same variable values */
+static int
+rasqal_expression_memo_unsafe_visitor(void *user_data, rasqal_expression *e)
+{
+  switch(e->op) {
+    case RASQAL_EXPR_RAND:
+    case RASQAL_EXPR_BNODE:
+    case RASQAL_EXPR_UUID:
+    case RASQAL_EXPR_STRUUID:
+    case RASQAL_EXPR_NOW:
+    case RASQAL_EXPR_CURRENT_DATETIME:
+    case RASQAL_EXPR_FUNCTION:
+    case RASQAL_EXPR_VARSTAR:
+      return 1;
+
+    default:
+      return (e->flags & RASQAL_EXPR_FLAG_AGGREGATE) ? 1 : 0;
+  }
+}
+
+
+/* for use with rasqal_expression_visit and user_data=raptor_sequence
+ * of shared variables: add the variables mentioned */
+static int
+rasqal_expression_memo_variables_visitor(void *user_data, rasqal_expression *e)
+{
+  raptor_sequence* seq = (raptor_sequence*)user_data;
+  rasqal_variable* v;
+  int i;
+
+  if(e->op != RASQAL_EXPR_LITERAL || !e->literal)
+    return 0;
+
+  v = rasqal_literal_as_variable(e->literal);
+  if(!v)
+    return 0;
+
+  for(i = 0; i < raptor_sequence_size(seq); i++) {
+    if(raptor_sequence_get_at(seq, i) == v)
+      return 0;
+  }
+
+  return raptor_sequence_push(seq, v);
+}
+
+
+/*
+ * rasqal_expression_make_memo:
+ * @e: expression
+ *
+ * INTERNAL - Make a per-row memo for an expression if it can have one
+ *
+ * Return value: new memo or NULL if @e is not deterministic, mentions
+ * no variables or on failure
+ */
+static rasqal_expression_memo*
+rasqal_expression_make_memo(rasqal_expression* e)
+{
+  raptor_sequence* seq;
+  rasqal_variable** variables = NULL;
+  int size;
+  int i;
+
+  if(rasqal_expression_visit(e, rasqal_expression_memo_unsafe_visitor, NULL))
+    return NULL;
+
+  seq = raptor_new_sequence(NULL, NULL);
+  if(!seq)
+    return NULL;
+
+  if(rasqal_expression_visit(e, rasqal_expression_memo_variables_visitor,
+                             seq))
+    goto tidy;
+
+  size = raptor_sequence_size(seq);
+  if(!size)
+    goto tidy;
+
+  variables = RASQAL_CALLOC(rasqal_variable**, RASQAL_GOOD_CAST(size_t, size),
+                            sizeof(rasqal_variable*));
+  if(!variables)
+    goto tidy;
+
+  for(i = 0; i < size; i++)
+    variables[i] = (rasqal_variable*)raptor_sequence_get_at(seq, i);
+
+  raptor_free_sequence(seq);
+
+  /* takes ownership of variables */
+  return rasqal_new_expression_memo(variables, size);
+
+  tidy:
+  raptor_free_sequence(seq);
+  return NULL;
+}
+
+
+/* for use with rasqal_expression_visit and user_data=raptor_sequence
+ * of shared expressions: add subexpressions that may be memoised */
+static int
+rasqal_expression_foreach_cse_candidate(void *user_data, rasqal_expression *e)
+{
+  raptor_sequence* seq = (raptor_sequence*)user_data;
+
+  switch(e->op) {
+    case RASQAL_EXPR_LITERAL:
+    case RASQAL_EXPR_ORDER_COND_ASC:
+    case RASQAL_EXPR_ORDER_COND_DESC:
+    case RASQAL_EXPR_GROUP_COND_ASC:
+    case RASQAL_EXPR_GROUP_COND_DESC:
+      return 0;
+
+    default:
+      if(RASQAL_EXPRESSION_INTERNAL(e)->memo)
+        return 0;
+      return raptor_sequence_push(seq, e);
+  }
+}
+
+
+static int
+rasqal_graph_pattern_cse_candidates(rasqal_graph_pattern* gp,
+                                    raptor_sequence* seq)
+{
+  int i;
+
+  if(gp->graph_patterns) {
+    for(i = 0; i < raptor_sequence_size(gp->graph_patterns); i++) {
+      rasqal_graph_pattern *sgp;
+
+      sgp = (rasqal_graph_pattern*)raptor_sequence_get_at(gp->graph_patterns, i);
+      if(rasqal_graph_pattern_cse_candidates(sgp, seq))
+        return 1;
+    }
+  }
+
+  /* FILTER and LET (BIND) expressions */
+  if(gp->filter_expression)
+    return rasqal_expression_visit(gp->filter_expression,
+                                   rasqal_expression_foreach_cse_candidate,
+                                   seq);
+
+  return 0;
+}
+
+
+static int
+rasqal_expression_sequence_cse_candidates(raptor_sequence* exprs_seq,
+                                          raptor_sequence* seq)
+{
+  int i;
+
+  if(!exprs_seq)
+    return 0;
+
+  for(i = 0; i < raptor_sequence_size(exprs_seq); i++) {
+    rasqal_expression* e;
+
+    e = (rasqal_expression*)raptor_sequence_get_at(exprs_seq, i);
+    if(rasqal_expression_visit(e, rasqal_expression_foreach_cse_candidate,
+                               seq))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_share_common_expressions:
+ * @query: query
+ * @projection: query projection or NULL
+ *
+ * INTERNAL - Share one per-row result between equal subexpressions
+ *
+ * Finds deterministic subexpressions that are written more than once
+ * in the FILTER, BIND, SELECT, GROUP BY, HAVING and ORDER BY
+ * expressions of the query and gives them one shared
+ * #rasqal_expression_memo so the expression is evaluated once per
+ * row and the result is reused by the others.  The memos are also
+ * kept in the query so they can be reset when it is executed.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_query_share_common_expressions(rasqal_query* query,
+                                      rasqal_projection* projection)
+{
+  raptor_sequence* seq;
+  rasqal_expression** exprs = NULL;
+  int size;
+  int i;
+  int rc = 1;
+
+  seq = raptor_new_sequence(NULL, NULL);
+  if(!seq)
+    return 1;
+
+  if(query->query_graph_pattern &&
+     rasqal_graph_pattern_cse_candidates(query->query_graph_pattern, seq))
+    goto tidy;
+
+  if(projection && projection->variables) {
+    for(i = 0; i < raptor_sequence_size(projection->variables); i++) {
+      rasqal_variable* v;
+
+      v = (rasqal_variable*)raptor_sequence_get_at(projection->variables, i);
+      if(v && v->expression &&
+         rasqal_expression_visit(v->expression,
+                                 rasqal_expression_foreach_cse_candidate, seq))
+        goto tidy;
+    }
+  }
+
+  if(rasqal_expression_sequence_cse_candidates(rasqal_query_get_group_conditions_sequence(query), seq) ||
+     rasqal_expression_sequence_cse_candidates(rasqal_query_get_having_conditions_sequence(query), seq) ||
+     rasqal_expression_sequence_cse_candidates(rasqal_query_get_order_conditions_sequence(query), seq))
+    goto tidy;
+
+  size = raptor_sequence_size(seq);
+  if(size < 2) {
+    rc = 0;
+    goto tidy;
+  }
+
+  exprs = RASQAL_CALLOC(rasqal_expression**, RASQAL_GOOD_CAST(size_t, size),
+                        sizeof(rasqal_expression*));
+  if(!exprs)
+    goto tidy;
+
+  for(i = 0; i < size; i++)
+    exprs[i] = (rasqal_expression*)raptor_sequence_get_at(seq, i);
+
+  for(i = 0; i < size; i++) {
+    rasqal_expression* first = exprs[i];
+    rasqal_expression_memo* memo;
+    int count = 1;
+    int j;
+
+    if(!first)
+      continue;
+
+    for(j = i + 1; j < size; j++) {
+      if(exprs[j] && rasqal_expression_same(first, exprs[j]))
+        count++;
+    }
+
+    if(count < 2)
+      continue;
+
+    memo = rasqal_expression_make_memo(first);
+    if(memo) {
+      if(!query->expression_memos) {
+        query->expression_memos = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression_memo, NULL);
+        if(!query->expression_memos) {
+          rasqal_free_expression_memo(memo);
+          goto tidy;
+        }
+      }
+
+      if(raptor_sequence_push(query->expression_memos,
+                              rasqal_new_expression_memo_from_expression_memo(memo))) {
+        rasqal_free_expression_memo(memo);
+        goto tidy;
+      }
+    }
+
+    for(j = i; j < size; j++) {
+      rasqal_expression* e = exprs[j];
+
+      if(!e || !rasqal_expression_same(first, e))
+        continue;
+
+      exprs[j] = NULL;
+      if(memo && !RASQAL_EXPRESSION_INTERNAL(e)->memo)
+        RASQAL_EXPRESSION_INTERNAL(e)->memo = rasqal_new_expression_memo_from_expression_memo(memo);
+    }
+
+    if(memo)
+      rasqal_free_expression_memo(memo);
+  }
+
+  rc = 0;
+
+  tidy:
+  if(exprs)
+    RASQAL_FREE(rasqal_expression**, exprs);
+  raptor_free_sequence(seq);
+
+  return rc;
+}
+
+
 static int
 rasqal_query_prepare_count_graph_pattern(rasqal_query* query,
                                          rasqal_graph_pattern* gp,
@@ -1380,6 +1782,10 @@ rasqal_query_prepare_common(rasqal_query *query)
 
   }
 
+  rc = rasqal_query_share_common_expressions(query, projection);
+  if(rc)
+    goto done;
+
 
   rc = 0;
 
@@ -36,6 +36,9 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -143,7 +146,11 @@ rasqal_query_write_sparql_literal(sparql_writer_context *wc,
       break;
 
     case RASQAL_LITERAL_INTEGER:
-      raptor_iostream_decimal_write(l->value.integer, iostr);
+      if(l->value.integer >= INT_MIN && l->value.integer <= INT_MAX)
+        raptor_iostream_decimal_write(RASQAL_GOOD_CAST(int, l->value.integer),
+                                      iostr);
+      else
+        raptor_iostream_counted_string_write(l->string, l->string_len, iostr);
       break;
 
     case RASQAL_LITERAL_BOOLEAN:
@@ -36,6 +36,13 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -43,35 +50,105 @@
 
 struct rasqal_raptor_triple_s {
   struct rasqal_raptor_triple_s *next;
+  /* next triple in the same subject index bucket */
+  struct rasqal_raptor_triple_s *next_subject;
+  /* next triple in the same predicate index bucket */
+  struct rasqal_raptor_triple_s *next_predicate;
   rasqal_triple *triple;
+  /* graph epoch when the triple was added */
+  unsigned long epoch;
 };
 
 typedef struct rasqal_raptor_triple_s rasqal_raptor_triple;
 
-typedef struct {
+
+/*
+ * A graph parsed from a data graph.  Once loaded it is never changed
+ * so it may be shared by many triples sources and, when it was read
+ * from a URI, kept in the world loaded graphs cache.  The exception is
+ * an appendable graph that only the cache is using, which may be
+ * extended with the lines appended to its file.
+ */
+struct rasqal_raptor_loaded_graph_s {
   rasqal_world* world;
 
+  int usage;
+
+  /* next graph in world->loaded_graphs */
+  struct rasqal_raptor_loaded_graph_s* next;
+
+  /* non-0 if in world->loaded_graphs which then holds a reference */
+  unsigned int cached : 1;
+
+  /* non-0 if kept in the cache while there are no other users */
+  unsigned int pinned : 1;
+
+  /* cache key: data graph fields (copies) plus modification time */
+  raptor_uri* uri;
+  raptor_uri* name_uri;
+  raptor_uri* base_uri;
+  char* format_name;
+  /* modification time of a file: URI or 0 */
+  time_t mtime;
+
+  /* size of a file: URI when read or 0 */
+  size_t file_size;
+
+  /* non-0 if read from a file: URI in a line-based format so that
+   * lines appended to the file can be parsed on their own */
+  unsigned int appendable : 1;
+
+  /* FNV-1a hash of the first file_size bytes of an appendable file */
+  unsigned long file_hash;
+
+  /* world loaded graphs epoch when the graph was loaded or last
+   * extended; identifies the triples of the graph */
+  unsigned long epoch;
+
+  /* epoch when the graph was loaded; identifies the graph the later
+   * epochs only added triples to */
+  unsigned long load_epoch;
+
+  /* URI literal of the graph name or NULL for a background graph;
+   * shared by all the triples and freed with the graph */
+  rasqal_literal* origin;
+
   rasqal_raptor_triple *head;
   rasqal_raptor_triple *tail;
 
-  /* index used while reading triples into the two arrays below.
-   * This is used to connect a triple to the URI literal of the source
-   */
-  int source_index;
+  /* number of triples */
+  unsigned long triples_count;
 
-  /* size of the two arrays below */
-  int sources_count;
-  
-  /* shared pointers into query->data_graph uris */
-  raptor_uri* source_uri;
+  /* array of the triples in graph order for scanning in parallel */
+  rasqal_raptor_triple** triples;
 
-  /* array of URI literals (allocated here) */
-  rasqal_literal **source_literals;
+  /* graph subject (GSPO) and predicate (GPOS) indexes: hash buckets
+   * of triples in graph order, index_size (a power of 2) of each */
+  rasqal_raptor_triple** subject_index;
+  rasqal_raptor_triple** predicate_index;
+  unsigned long index_size;
 
-  /* genid base for mapping user bnodes */
+  /* genid base for mapping user bnodes; kept for an appendable graph
+   * so that appended lines map blank nodes the same way */
   unsigned char* mapped_id_base;
   /* length of above string */
   size_t mapped_id_base_len;
+};
+
+
+typedef struct {
+  rasqal_world* world;
+
+  /* size of the array below */
+  int sources_count;
+  
+  /* array of loaded graphs, one per data graph, each holding a reference */
+  rasqal_raptor_loaded_graph** graphs;
+
+  /* window of triple epochs matched: after epoch_after and up to
+   * epoch_until; 0 for no bound */
+  unsigned long epoch_after;
+  unsigned long epoch_until;
 } rasqal_raptor_triples_source_user_data;
 
 
@@ -79,6 +156,7 @@ typedef struct {
 static int rasqal_raptor_init_triples_match(rasqal_triples_match* rtm, rasqal_triples_source *rts, void *user_data, rasqal_triple_meta *m, rasqal_triple *t);
 static int rasqal_raptor_triple_present(rasqal_triples_source *rts, void *user_data, rasqal_triple *t);
 static void rasqal_raptor_free_triples_source(void *user_data);
+static void rasqal_raptor_free_loaded_graph(rasqal_raptor_loaded_graph* lg);
 
 
 rasqal_triple*
@@ -99,28 +177,161 @@ static void
 rasqal_raptor_statement_handler(void *user_data,
                                 raptor_statement *statement)
 {
-  rasqal_raptor_triples_source_user_data* rtsc;
+  rasqal_raptor_loaded_graph* lg;
   rasqal_raptor_triple *triple;
   
-  rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
+  lg = (rasqal_raptor_loaded_graph*)user_data;
 
-  triple = RASQAL_MALLOC(rasqal_raptor_triple*, sizeof(rasqal_raptor_triple));
-  triple->next = NULL;
-  triple->triple = raptor_statement_as_rasqal_triple(rtsc->world,
+  triple = RASQAL_CALLOC(rasqal_raptor_triple*, 1, sizeof(*triple));
+  triple->triple = raptor_statement_as_rasqal_triple(lg->world,
                                                      statement);
 
   /* this origin URI literal is shared amongst the triples and
-   * freed only in rasqal_raptor_free_triples_source
+   * freed only in rasqal_raptor_free_loaded_graph
    */
-  rasqal_triple_set_origin(triple->triple, 
-                           rtsc->source_literals[rtsc->source_index]);
+  rasqal_triple_set_origin(triple->triple, lg->origin);
 
-  if(rtsc->tail)
-    rtsc->tail->next = triple;
+  if(lg->tail)
+    lg->tail->next = triple;
   else
-    rtsc->head = triple;
+    lg->head = triple;
+
+  lg->tail = triple;
+  lg->triples_count++;
+}
+
+
+/* hash of a URI or blank node literal used by the graph indexes */
+static unsigned long
+rasqal_raptor_literal_hash(rasqal_literal* l)
+{
+  /* FNV-1a */
+  unsigned long hash = 2166136261UL;
+  const unsigned char* string;
+  size_t len;
+  size_t i;
+
+  if(l->type == RASQAL_LITERAL_URI)
+    string = raptor_uri_as_counted_string(l->value.uri, &len);
+  else if(l->type == RASQAL_LITERAL_BLANK) {
+    string = l->string;
+    len = l->string_len;
+  } else
+    return 0;
+
+  for(i = 0; i < len; i++) {
+    hash ^= string[i];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+/*
+ * rasqal_raptor_index_loaded_graph:
+ * @lg: loaded graph
+ *
+ * INTERNAL - Build the subject and predicate indexes of a loaded graph
+ *
+ * Each bucket keeps its triples in graph order so that matching with
+ * an index returns the same triples in the same order as a scan.
+ * Any existing indexes are replaced.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_raptor_index_loaded_graph(rasqal_raptor_loaded_graph* lg)
+{
+  rasqal_raptor_triple** subject_tails;
+  rasqal_raptor_triple** predicate_tails;
+  rasqal_raptor_triple* cur;
+  unsigned long size = 16;
+  unsigned long i;
+
+  if(lg->triples) {
+    RASQAL_FREE(rasqal_raptor_triple**, lg->triples);
+    lg->triples = NULL;
+  }
+  if(lg->subject_index) {
+    RASQAL_FREE(rasqal_raptor_triple**, lg->subject_index);
+    lg->subject_index = NULL;
+  }
+  if(lg->predicate_index) {
+    RASQAL_FREE(rasqal_raptor_triple**, lg->predicate_index);
+    lg->predicate_index = NULL;
+  }
+  lg->index_size = 0;
+
+  if(!lg->head)
+    return 0;
+
+  while(size < lg->triples_count)
+    size <<= 1;
+
+  lg->triples = RASQAL_MALLOC(rasqal_raptor_triple**,
+                              sizeof(rasqal_raptor_triple*) * lg->triples_count);
+  if(!lg->triples)
+    return 1;
+
+  lg->subject_index = RASQAL_CALLOC(rasqal_raptor_triple**, size,
+                                    sizeof(rasqal_raptor_triple*));
+  lg->predicate_index = RASQAL_CALLOC(rasqal_raptor_triple**, size,
+                                      sizeof(rasqal_raptor_triple*));
+  subject_tails = RASQAL_CALLOC(rasqal_raptor_triple**, size,
+                                sizeof(rasqal_raptor_triple*));
+  predicate_tails = RASQAL_CALLOC(rasqal_raptor_triple**, size,
+                                  sizeof(rasqal_raptor_triple*));
+  if(!lg->subject_index || !lg->predicate_index ||
+     !subject_tails || !predicate_tails) {
+    if(subject_tails)
+      RASQAL_FREE(rasqal_raptor_triple**, subject_tails);
+    if(predicate_tails)
+      RASQAL_FREE(rasqal_raptor_triple**, predicate_tails);
+    return 1;
+  }
+
+  lg->index_size = size;
+
+  for(i = 0, cur = lg->head; cur; i++, cur = cur->next) {
+    unsigned long bucket;
+
+    lg->triples[i] = cur;
+    cur->next_subject = NULL;
+    cur->next_predicate = NULL;
+
+    bucket = rasqal_raptor_literal_hash(cur->triple->subject) & (size - 1);
+    if(subject_tails[bucket])
+      subject_tails[bucket]->next_subject = cur;
+    else
+      lg->subject_index[bucket] = cur;
+    subject_tails[bucket] = cur;
+
+    bucket = rasqal_raptor_literal_hash(cur->triple->predicate) & (size - 1);
+    if(predicate_tails[bucket])
+      predicate_tails[bucket]->next_predicate = cur;
+    else
+      lg->predicate_index[bucket] = cur;
+    predicate_tails[bucket] = cur;
+  }
+
+  RASQAL_FREE(rasqal_raptor_triple**, subject_tails);
+  RASQAL_FREE(rasqal_raptor_triple**, predicate_tails);
+
+  return 0;
+}
+
+
+/* set the epoch of the triples added after @last (or all if NULL)
+ * to the graph epoch */
+static void
+rasqal_raptor_set_triples_epoch(rasqal_raptor_loaded_graph* lg,
+                                rasqal_raptor_triple* last)
+{
+  rasqal_raptor_triple* cur;
 
-  rtsc->tail = triple;
+  for(cur = last ? last->next : lg->head; cur; cur = cur->next)
+    cur->epoch = lg->epoch;
 }
 
 
@@ -156,26 +367,26 @@ static unsigned char*
 rasqal_raptor_generate_id_handler(void *user_data,
                                   unsigned char *user_bnodeid) 
 {
-  rasqal_raptor_triples_source_user_data* rtsc;
+  rasqal_raptor_loaded_graph* lg;
 
-  rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
+  lg = (rasqal_raptor_loaded_graph*)user_data;
 
   if(user_bnodeid) {
     unsigned char *mapped_id;
     size_t user_bnodeid_len = strlen(RASQAL_GOOD_CAST(const char*, user_bnodeid));
     
     mapped_id = RASQAL_MALLOC(unsigned char*, 
-                              rtsc->mapped_id_base_len + 1 + user_bnodeid_len + 1);
-    memcpy(mapped_id, rtsc->mapped_id_base, rtsc->mapped_id_base_len);
-    mapped_id[rtsc->mapped_id_base_len] = '_';
-    memcpy(mapped_id + rtsc->mapped_id_base_len + 1,
+                              lg->mapped_id_base_len + 1 + user_bnodeid_len + 1);
+    memcpy(mapped_id, lg->mapped_id_base, lg->mapped_id_base_len);
+    mapped_id[lg->mapped_id_base_len] = '_';
+    memcpy(mapped_id + lg->mapped_id_base_len + 1,
            user_bnodeid, user_bnodeid_len + 1);
 
     raptor_free_memory(user_bnodeid);
     return mapped_id;
   }
   
-  return rasqal_raptor_get_genid(rtsc->world, RASQAL_GOOD_CAST(const unsigned char*, "genid"), -1);
+  return rasqal_raptor_get_genid(lg->world, RASQAL_GOOD_CAST(const unsigned char*, "genid"), -1);
 }
 
 
@@ -185,6 +396,7 @@ rasqal_raptor_support_feature(void *user_data,
 {
   switch(feature) {
     case RASQAL_TRIPLES_SOURCE_FEATURE_IOSTREAM_DATA_GRAPH:
+    case RASQAL_TRIPLES_SOURCE_FEATURE_GRAPH_VARIABLE:
       return 1;
       
     default:
@@ -194,277 +406,1319 @@ rasqal_raptor_support_feature(void *user_data,
 }
 
 
-static int
-rasqal_raptor_init_triples_source_common(rasqal_world* world,
-                                         raptor_sequence* data_graphs,
-                                         rasqal_query* rdf_query,
-                                         void *factory_user_data,
-                                         void *user_data,
-                                         rasqal_triples_source *rts,
-                                         rasqal_triples_error_handler handler1,
-                                         rasqal_triples_error_handler2 handler2,
-                                         unsigned int flags)
+/*
+ * rasqal_raptor_data_graph_mtime:
+ * @uri: data graph URI
+ * @size_p: pointer to store file size
+ *
+ * INTERNAL - Get the modification time and size of a file: URI
+ *
+ * Return value: modification time or 0 if not a file or unknown
+ */
+static time_t
+rasqal_raptor_data_graph_mtime(raptor_uri* uri, size_t* size_p)
 {
-  rasqal_raptor_triples_source_user_data* rtsc;
-  raptor_parser *parser;
-  int i;
-  int rc = 0;
+  time_t mtime = 0;
+#ifdef HAVE_SYS_STAT_H
+  const unsigned char* uri_string = raptor_uri_as_string(uri);
+
+  if(raptor_uri_uri_string_is_file_uri(uri_string)) {
+    char* filename = raptor_uri_uri_string_to_filename(uri_string);
+    struct stat buf;
+
+    if(filename) {
+      if(!stat(filename, &buf)) {
+        mtime = buf.st_mtime;
+        *size_p = RASQAL_GOOD_CAST(size_t, buf.st_size);
+      }
+      raptor_free_memory(filename);
+    }
+  }
+#endif
 
-  rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
+  return mtime;
+}
 
-  /* Max API version this triples source generates */
-  rts->version = 2;
-  
-  rts->init_triples_match = rasqal_raptor_init_triples_match;
-  rts->triple_present = rasqal_raptor_triple_present;
-  rts->free_triples_source = rasqal_raptor_free_triples_source;
-  rts->support_feature = rasqal_raptor_support_feature;
 
-  rtsc->world = world;
+/*
+ * rasqal_raptor_format_is_appendable:
+ * @format_name: data graph parser name
+ *
+ * INTERNAL - Check if a format can be parsed from any line onwards
+ *
+ * Return value: non-0 if lines appended to a graph can be parsed alone
+ */
+static int
+rasqal_raptor_format_is_appendable(const char* format_name)
+{
+  return format_name && (!strcmp(format_name, "ntriples") ||
+                         !strcmp(format_name, "nquads"));
+}
 
-  if(data_graphs)
-    rtsc->sources_count = raptor_sequence_size(data_graphs);
-  else
-    /* No data graph - assume there is just a background graph */
-    rtsc->sources_count = 0;
-  
-  if(rtsc->sources_count) {
-    rtsc->source_literals = RASQAL_CALLOC(rasqal_literal**,
-                                          RASQAL_GOOD_CAST(size_t, rtsc->sources_count),
-                                          sizeof(rasqal_literal*));
-    if(!rtsc->source_literals)
-      return 1;
-  } else {
-    /* No sources so the work is done */
-    return 0;
+
+static unsigned long
+rasqal_raptor_bytes_hash(unsigned long hash, const unsigned char* bytes,
+                         size_t len)
+{
+  /* FNV-1a */
+  size_t i;
+
+  for(i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
   }
 
-  for(i = 0; i < rtsc->sources_count; i++) {
-    rasqal_data_graph *dg;
-    raptor_uri* uri = NULL;
-    raptor_uri* name_uri;
-    int free_name_uri = 0;
-    const char* parser_name;
-    raptor_iostream* iostr = NULL;
-    
-    dg = (rasqal_data_graph*)raptor_sequence_get_at(data_graphs, i);
-    uri = dg->uri;
-    name_uri = dg->name_uri;
-    iostr = dg->iostr;
-
-    rtsc->source_index = i;
-    if(uri)
-      rtsc->source_uri = raptor_uri_copy(uri);
-
-    if(name_uri)
-      rtsc->source_literals[i] = rasqal_new_uri_literal(world,
-                                                        raptor_uri_copy(name_uri)
-                                                        );
-    else if(uri) {
-      name_uri = raptor_uri_copy(uri);
-      free_name_uri = 1;
-    }
+  return hash;
+}
+
+
+/*
+ * rasqal_raptor_parse_appended:
+ * @lg: appendable loaded graph
+ * @parser: parser
+ * @base_uri: base URI
+ *
+ * INTERNAL - Parse the lines of a graph file after those already loaded
+ *
+ * The first @lg->file_size bytes of the file are only hashed and must
+ * match the hash of the bytes parsed before and end a line.  The rest
+ * of the file is parsed a chunk at a time adding triples to @lg and
+ * the file size and hash are updated.
+ *
+ * Return value: 0 on success, <0 if the file does not start with the
+ * bytes parsed before or >0 on failure
+ */
+static int
+rasqal_raptor_parse_appended(rasqal_raptor_loaded_graph* lg,
+                             raptor_parser* parser, raptor_uri* base_uri)
+{
+  unsigned char buffer[4096];
+  unsigned long hash = 2166136261UL;
+  unsigned char last = '\n';
+  size_t offset = 0;
+  size_t len;
+  int started = 0;
+  char* filename;
+  FILE* fh;
+  int rc = 0;
 
-    rtsc->mapped_id_base = rasqal_raptor_get_genid(world,
-                                                   RASQAL_GOOD_CAST(const unsigned char*, "graphid"),
-                                                   i);
-    rtsc->mapped_id_base_len = strlen(RASQAL_GOOD_CAST(const char*, rtsc->mapped_id_base));
-
-    parser_name = dg->format_name;
-    if(parser_name) {
-      if(!raptor_world_is_parser_name(world->raptor_world_ptr, parser_name)) {
-        if(rdf_query)
-          handler1(rdf_query, /* locator */ NULL,
-                   "Invalid data graph parser name ignored");
-        else
-          handler2(world, /* locator */ NULL,
-                   "Invalid data graph parser name ignored");
-        parser_name = NULL;
+  filename = raptor_uri_uri_string_to_filename(raptor_uri_as_string(lg->uri));
+  if(!filename)
+    return 1;
+
+  fh = fopen(filename, "rb");
+  raptor_free_memory(filename);
+  if(!fh)
+    return 1;
+
+  while((len = fread(buffer, 1, sizeof(buffer), fh)) > 0) {
+    size_t start = 0;
+
+    if(offset < lg->file_size) {
+      start = lg->file_size - offset;
+      if(start > len)
+        start = len;
+
+      hash = rasqal_raptor_bytes_hash(hash, buffer, start);
+      last = buffer[start - 1];
+      offset += start;
+      if(offset == lg->file_size && hash != lg->file_hash) {
+        rc = -1;
+        break;
       }
     }
-    if(!parser_name)
-      parser_name = "guess";
-    
-    parser = raptor_new_parser(world->raptor_world_ptr, parser_name);
-    raptor_parser_set_statement_handler(parser, rtsc, rasqal_raptor_statement_handler);
-    raptor_world_set_generate_bnodeid_handler(world->raptor_world_ptr,
-                                              rtsc,
-                                              rasqal_raptor_generate_id_handler);
 
-#ifdef RAPTOR_FEATURE_NO_NET
-    if(flags & 1)
-      raptor_set_feature(parser, RAPTOR_FEATURE_NO_NET,
-                         rdf_query->features[RASQAL_FEATURE_NO_NET]);
-#endif
+    if(start < len) {
+      if(!started) {
+        if(last != '\n') {
+          rc = -1;
+          break;
+        }
+        if(raptor_parser_parse_start(parser, base_uri)) {
+          rc = 1;
+          break;
+        }
+        started = 1;
+      }
 
-    if(iostr) {
-      rc = raptor_parser_parse_iostream(parser, iostr, dg->base_uri);
-    } else {
-      rc = raptor_parser_parse_uri(parser, uri, name_uri);
+      hash = rasqal_raptor_bytes_hash(hash, buffer + start, len - start);
+      offset += len - start;
+      if(raptor_parser_parse_chunk(parser, buffer + start, len - start, 0)) {
+        rc = 1;
+        break;
+      }
     }
-    
-    raptor_free_parser(parser);
+  }
+
+  if(!rc) {
+    if(ferror(fh))
+      rc = 1;
+    else if(offset < lg->file_size)
+      /* file was truncated */
+      rc = -1;
+    else if(started && raptor_parser_parse_chunk(parser, NULL, 0, 1))
+      rc = 1;
+  }
+
+  fclose(fh);
+
+  if(!rc) {
+    lg->file_size = offset;
+    lg->file_hash = hash;
+  }
+
+  return rc;
+}
+
+
+static int
+rasqal_raptor_uri_equals(raptor_uri* uri1, raptor_uri* uri2)
+{
+  if(!uri1 || !uri2)
+    return (uri1 == uri2);
+
+  return raptor_uri_equals(uri1, uri2);
+}
 
-    raptor_free_uri(rtsc->source_uri);
 
-    if(free_name_uri)
-      raptor_free_uri(name_uri);
+/*
+ * rasqal_raptor_find_loaded_graph:
+ * @world: rasqal_world object
+ * @dg: data graph
+ *
+ * INTERNAL - Find the cached graph loaded from a data graph
+ *
+ * The modification time is not compared.
+ *
+ * Return value: shared graph or NULL if not cached
+ */
+static rasqal_raptor_loaded_graph*
+rasqal_raptor_find_loaded_graph(rasqal_world* world, rasqal_data_graph* dg)
+{
+  rasqal_raptor_loaded_graph* lg;
+
+  if(!dg->uri || dg->iostr)
+    return NULL;
 
-    /* Reset raptor genid handler to default */
-    /* FIXME: this should be per-parser not raptor-wide */
-    raptor_world_set_generate_bnodeid_handler(world->raptor_world_ptr,
-                                              NULL, NULL);
+  for(lg = world->loaded_graphs; lg; lg = lg->next) {
+    if(!rasqal_raptor_uri_equals(lg->uri, dg->uri) ||
+       !rasqal_raptor_uri_equals(lg->name_uri, dg->name_uri) ||
+       !rasqal_raptor_uri_equals(lg->base_uri, dg->base_uri))
+      continue;
 
-    /* This is freed in rasqal_raptor_free_triples_source() */
-    /* rasqal_free_literal(rtsc->source_literal); */
-    RASQAL_FREE(char*, rtsc->mapped_id_base);
+    if(!lg->format_name || !dg->format_name) {
+      if(lg->format_name != dg->format_name)
+        continue;
+    } else if(strcmp(lg->format_name, dg->format_name))
+      continue;
+
+    return lg;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * rasqal_raptor_uncache_loaded_graph:
+ * @lg: cached graph
+ *
+ * INTERNAL - Remove a graph from the world cache and drop the cache reference
+ *
+ * The graph is freed if there are no other users.
+ */
+static void
+rasqal_raptor_uncache_loaded_graph(rasqal_raptor_loaded_graph* lg)
+{
+  rasqal_raptor_loaded_graph** prev_p;
 
-    if(rc)
+  for(prev_p = &lg->world->loaded_graphs; *prev_p; prev_p = &(*prev_p)->next) {
+    if(*prev_p == lg) {
+      *prev_p = lg->next;
       break;
+    }
+  }
+
+  lg->next = NULL;
+  lg->cached = 0;
+  lg->pinned = 0;
+  rasqal_raptor_free_loaded_graph(lg);
+}
+
+
+static void
+rasqal_raptor_free_loaded_graph(rasqal_raptor_loaded_graph* lg)
+{
+  rasqal_raptor_triple *cur;
+
+  if(!lg)
+    return;
+
+  if(--lg->usage) {
+    /* only the cache is left holding an unpinned graph */
+    if(lg->usage == 1 && lg->cached && !lg->pinned)
+      rasqal_raptor_uncache_loaded_graph(lg);
+    return;
+  }
+
+  cur = lg->head;
+  while(cur) {
+    rasqal_raptor_triple *next = cur->next;
+    rasqal_triple_set_origin(cur->triple, NULL); /* shared URI literal */
+    rasqal_free_triple(cur->triple);
+    RASQAL_FREE(rasqal_raptor_triple, cur);
+    cur = next;
   }
 
+  if(lg->triples)
+    RASQAL_FREE(rasqal_raptor_triple**, lg->triples);
+  if(lg->subject_index)
+    RASQAL_FREE(rasqal_raptor_triple**, lg->subject_index);
+  if(lg->predicate_index)
+    RASQAL_FREE(rasqal_raptor_triple**, lg->predicate_index);
+
+  if(lg->origin)
+    rasqal_free_literal(lg->origin);
+
+  if(lg->uri)
+    raptor_free_uri(lg->uri);
+  if(lg->name_uri)
+    raptor_free_uri(lg->name_uri);
+  if(lg->base_uri)
+    raptor_free_uri(lg->base_uri);
+  if(lg->format_name)
+    RASQAL_FREE(char*, lg->format_name);
+  if(lg->mapped_id_base)
+    RASQAL_FREE(char*, lg->mapped_id_base);
+
+  RASQAL_FREE(rasqal_raptor_loaded_graph, lg);
+}
+
+
+/*
+ * rasqal_raptor_parse_loaded_graph:
+ * @lg: loaded graph
+ * @parser_name: parser name
+ * @iostr: iostream to parse or NULL to parse the graph URI
+ * @base_uri: base URI
+ * @flags: 1 to deny network requests
+ *
+ * INTERNAL - Parse triples into a loaded graph
+ *
+ * An appendable graph is read from its file after the bytes that
+ * were parsed before.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_raptor_parse_loaded_graph(rasqal_raptor_loaded_graph* lg,
+                                 const char* parser_name,
+                                 raptor_iostream* iostr,
+                                 raptor_uri* base_uri,
+                                 unsigned int flags)
+{
+  rasqal_world* world = lg->world;
+  raptor_parser *parser;
+  int rc;
+
+  parser = raptor_new_parser(world->raptor_world_ptr, parser_name);
+  if(!parser)
+    return 1;
+
+  raptor_parser_set_statement_handler(parser, lg, rasqal_raptor_statement_handler);
+  raptor_world_set_generate_bnodeid_handler(world->raptor_world_ptr,
+                                            lg,
+                                            rasqal_raptor_generate_id_handler);
+
+#ifdef RAPTOR_FEATURE_NO_NET
+  if(flags & 1)
+    raptor_set_feature(parser, RAPTOR_FEATURE_NO_NET, 1);
+#endif
+
+  if(lg->appendable)
+    rc = rasqal_raptor_parse_appended(lg, parser, base_uri);
+  else if(iostr)
+    rc = raptor_parser_parse_iostream(parser, iostr, base_uri);
+  else
+    rc = raptor_parser_parse_uri(parser, lg->uri, base_uri);
+  
+  raptor_free_parser(parser);
+
+  /* Reset raptor genid handler to default */
+  /* FIXME: this should be per-parser not raptor-wide */
+  raptor_world_set_generate_bnodeid_handler(world->raptor_world_ptr,
+                                            NULL, NULL);
+
   return rc;
 }
 
 
+/*
+ * rasqal_raptor_extend_loaded_graph:
+ * @lg: appendable cached graph with no other users
+ * @mtime: file modification time
+ *
+ * INTERNAL - Add the triples of the lines appended to the file of a graph
+ *
+ * Only the appended lines are parsed; the indexes are then rebuilt.
+ * On failure the graph may hold some of the appended triples and must
+ * be parsed again.
+ *
+ * Return value: non-0 on failure
+ */
 static int
-rasqal_raptor_init_triples_source2(rasqal_world* world,
-                                   raptor_sequence* data_graphs,
-                                   void *factory_user_data,
-                                   void *user_data,
-                                   rasqal_triples_source *rts,
-                                   rasqal_triples_error_handler2 handler,
-                                   unsigned int flags)
+rasqal_raptor_extend_loaded_graph(rasqal_raptor_loaded_graph* lg,
+                                  time_t mtime)
 {
-  return rasqal_raptor_init_triples_source_common(world,
-                                                  data_graphs,
-                                                  NULL /* rdf_query */,
-                                                  factory_user_data,
-                                                  user_data,
-                                                  rts,
-                                                  NULL /* handler 1 */,
-                                                  handler,
-                                                  flags);
+  raptor_uri* base_uri = lg->name_uri ? lg->name_uri : lg->uri;
+  rasqal_raptor_triple* last = lg->tail;
+
+  if(rasqal_raptor_parse_loaded_graph(lg, lg->format_name, NULL, base_uri, 0))
+    return 1;
+
+  if(rasqal_raptor_index_loaded_graph(lg))
+    return 1;
+
+  lg->mtime = mtime;
+  lg->epoch = ++lg->world->loaded_graphs_epoch;
+  rasqal_raptor_set_triples_epoch(lg, last);
+
+  return 0;
 }
 
 
-static int
-rasqal_raptor_init_triples_source(rasqal_query* rdf_query,
-                                  void *factory_user_data,
-                                  void *user_data,
-                                  rasqal_triples_source *rts,
-                                  rasqal_triples_error_handler handler)
-{
-  unsigned int flags = 0;
+static rasqal_raptor_loaded_graph*
+rasqal_raptor_load_graph_common(rasqal_world* world,
+                                rasqal_data_graph* dg,
+                                rasqal_query* rdf_query,
+                                rasqal_triples_error_handler handler1,
+                                rasqal_triples_error_handler2 handler2,
+                                unsigned int flags)
+{
+  rasqal_raptor_loaded_graph* lg;
+  raptor_uri* base_uri;
+  const char* parser_name;
+  int cacheable = (dg->uri && !dg->iostr);
+  unsigned int pinned = 0;
+  time_t mtime = 0;
+  size_t file_size = 0;
+
+  if(cacheable) {
+    mtime = rasqal_raptor_data_graph_mtime(dg->uri, &file_size);
+
+    lg = rasqal_raptor_find_loaded_graph(world, dg);
+    if(lg) {
+      if(lg->mtime == mtime && lg->file_size == file_size) {
+        RASQAL_DEBUG2("Using cached graph loaded from %s\n",
+                      raptor_uri_as_string(dg->uri));
+        lg->usage++;
+        return lg;
+      }
+
+      if(lg->appendable && lg->usage == 1 && file_size >= lg->file_size &&
+         !rasqal_raptor_extend_loaded_graph(lg, mtime)) {
+        RASQAL_DEBUG2("Extended cached graph loaded from %s\n",
+                      raptor_uri_as_string(dg->uri));
+        lg->usage++;
+        return lg;
+      }
+
+      /* file changed: current users keep the old graph */
+      pinned = lg->pinned;
+      rasqal_raptor_uncache_loaded_graph(lg);
+    }
+  }
+
+  lg = RASQAL_CALLOC(rasqal_raptor_loaded_graph*, 1, sizeof(*lg));
+  if(!lg)
+    return NULL;
+
+  lg->world = world;
+  lg->usage = 1;
+  lg->mtime = mtime;
+
+  if(dg->uri)
+    lg->uri = raptor_uri_copy(dg->uri);
+  if(dg->name_uri)
+    lg->name_uri = raptor_uri_copy(dg->name_uri);
+  if(dg->base_uri)
+    lg->base_uri = raptor_uri_copy(dg->base_uri);
+  if(dg->format_name) {
+    size_t len = strlen(dg->format_name);
+    lg->format_name = RASQAL_MALLOC(char*, len + 1);
+    if(!lg->format_name)
+      goto failed;
+    memcpy(lg->format_name, dg->format_name, len + 1);
+  }
+
+  if(dg->name_uri) {
+    lg->origin = rasqal_new_uri_literal(world, raptor_uri_copy(dg->name_uri));
+    if(!lg->origin)
+      goto failed;
+  }
+
+  /* unique per loaded graph since cached graphs are used together */
+  lg->mapped_id_base = rasqal_raptor_get_genid(world,
+                                               RASQAL_GOOD_CAST(const unsigned char*, "graphid"),
+                                               world->loaded_graphs_counter++);
+  if(!lg->mapped_id_base)
+    goto failed;
+  lg->mapped_id_base_len = strlen(RASQAL_GOOD_CAST(const char*, lg->mapped_id_base));
+
+  parser_name = dg->format_name;
+  if(parser_name) {
+    if(!raptor_world_is_parser_name(world->raptor_world_ptr, parser_name)) {
+      if(rdf_query)
+        handler1(rdf_query, /* locator */ NULL,
+                 "Invalid data graph parser name ignored");
+      else
+        handler2(world, /* locator */ NULL,
+                 "Invalid data graph parser name ignored");
+      parser_name = NULL;
+    }
+  }
+  if(!parser_name)
+    parser_name = "guess";
+
+  /* a file: URI in a line-based format; the whole file is read below */
+  if(mtime && rasqal_raptor_format_is_appendable(parser_name))
+    lg->appendable = 1;
+  else
+    lg->file_size = file_size;
+
+  if(dg->iostr)
+    base_uri = dg->base_uri;
+  else
+    base_uri = dg->name_uri ? dg->name_uri : dg->uri;
+
+  if(rasqal_raptor_parse_loaded_graph(lg, parser_name, dg->iostr, base_uri,
+                                      flags))
+    goto failed;
+
+  if(!lg->appendable) {
+    RASQAL_FREE(char*, lg->mapped_id_base);
+    lg->mapped_id_base = NULL;
+  }
+
+  if(rasqal_raptor_index_loaded_graph(lg))
+    goto failed;
+
+  lg->epoch = ++world->loaded_graphs_epoch;
+  lg->load_epoch = lg->epoch;
+  rasqal_raptor_set_triples_epoch(lg, NULL);
+
+  if(cacheable) {
+    lg->usage++;
+    lg->cached = 1;
+    lg->pinned = pinned;
+    lg->next = world->loaded_graphs;
+    world->loaded_graphs = lg;
+  }
+
+  return lg;
+
+  failed:
+  rasqal_raptor_free_loaded_graph(lg);
+  return NULL;
+}
+
+
+/*
+ * rasqal_raptor_load_graph:
+ * @world: rasqal_world object
+ * @dg: data graph
+ * @rdf_query: query for errors via @handler1 (or NULL)
+ * @handler1: query error handler
+ * @handler2: world error handler used if @rdf_query is NULL
+ * @flags: 1 to deny network requests
+ *
+ * INTERNAL - Get the parsed graph for a data graph
+ *
+ * A graph read from a URI is shared with the world loaded graphs
+ * cache: an unchanged cached graph is returned without parsing and
+ * a newly parsed graph is added to the cache.  When the file of an
+ * appendable cached graph has grown and nothing but the cache uses
+ * the graph, only the appended lines are parsed into it.  A graph
+ * read from an iostream is always parsed and never shared.
+ *
+ * A shared graph outlives the query that loaded it so it is parsed
+ * with memory accounting suspended and not charged to that query.
+ *
+ * Return value: new reference to a graph or NULL on failure
+ */
+static rasqal_raptor_loaded_graph*
+rasqal_raptor_load_graph(rasqal_world* world,
+                         rasqal_data_graph* dg,
+                         rasqal_query* rdf_query,
+                         rasqal_triples_error_handler handler1,
+                         rasqal_triples_error_handler2 handler2,
+                         unsigned int flags)
+{
+  rasqal_raptor_loaded_graph* lg;
+  rasqal_memory_account* previous_account;
+
+  if(!dg->uri || dg->iostr)
+    return rasqal_raptor_load_graph_common(world, dg, rdf_query,
+                                           handler1, handler2, flags);
+
+  previous_account = rasqal_memory_account_enter(NULL);
+  lg = rasqal_raptor_load_graph_common(world, dg, rdf_query,
+                                       handler1, handler2, flags);
+  rasqal_memory_account_leave(previous_account);
+
+  return lg;
+}
+
+
+static int
+rasqal_raptor_init_triples_source_common(rasqal_world* world,
+                                         raptor_sequence* data_graphs,
+                                         rasqal_query* rdf_query,
+                                         void *factory_user_data,
+                                         void *user_data,
+                                         rasqal_triples_source *rts,
+                                         rasqal_triples_error_handler handler1,
+                                         rasqal_triples_error_handler2 handler2,
+                                         unsigned int flags)
+{
+  rasqal_raptor_triples_source_user_data* rtsc;
+  int i;
+
+  rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
+
+  /* Max API version this triples source generates */
+  rts->version = 2;
+  
+  rts->init_triples_match = rasqal_raptor_init_triples_match;
+  rts->triple_present = rasqal_raptor_triple_present;
+  rts->free_triples_source = rasqal_raptor_free_triples_source;
+  rts->support_feature = rasqal_raptor_support_feature;
+
+  rtsc->world = world;
+
+  if(data_graphs)
+    rtsc->sources_count = raptor_sequence_size(data_graphs);
+  else
+    /* No data graph - assume there is just a background graph */
+    rtsc->sources_count = 0;
+  
+  if(rtsc->sources_count) {
+    rtsc->graphs = RASQAL_CALLOC(rasqal_raptor_loaded_graph**,
+                                 RASQAL_GOOD_CAST(size_t, rtsc->sources_count),
+                                 sizeof(rasqal_raptor_loaded_graph*));
+    if(!rtsc->graphs)
+      return 1;
+  } else {
+    /* No sources so the work is done */
+    return 0;
+  }
+
+  for(i = 0; i < rtsc->sources_count; i++) {
+    rasqal_data_graph *dg;
+
+    dg = (rasqal_data_graph*)raptor_sequence_get_at(data_graphs, i);
+
+    rtsc->graphs[i] = rasqal_raptor_load_graph(world, dg, rdf_query,
+                                               handler1, handler2, flags);
+    if(!rtsc->graphs[i])
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_raptor_init_triples_source2(rasqal_world* world,
+                                   raptor_sequence* data_graphs,
+                                   void *factory_user_data,
+                                   void *user_data,
+                                   rasqal_triples_source *rts,
+                                   rasqal_triples_error_handler2 handler,
+                                   unsigned int flags)
+{
+  return rasqal_raptor_init_triples_source_common(world,
+                                                  data_graphs,
+                                                  NULL /* rdf_query */,
+                                                  factory_user_data,
+                                                  user_data,
+                                                  rts,
+                                                  NULL /* handler 1 */,
+                                                  handler,
+                                                  flags);
+}
+
+
+static int
+rasqal_raptor_init_triples_source(rasqal_query* rdf_query,
+                                  void *factory_user_data,
+                                  void *user_data,
+                                  rasqal_triples_source *rts,
+                                  rasqal_triples_error_handler handler)
+{
+  unsigned int flags = 0;
+
+  if(rdf_query->features[RASQAL_FEATURE_NO_NET])
+    flags |= 1;
+  return rasqal_raptor_init_triples_source_common(rdf_query->world,
+                                                  rdf_query->data_graphs,
+                                                  rdf_query,
+                                                  factory_user_data,
+                                                  user_data, rts,
+                                                  handler,
+                                                  NULL /* handler 2 */,
+                                                  flags);
+}
+
+static int
+rasqal_raptor_new_triples_source(rasqal_query* rdf_query,
+                                 void *factory_user_data,
+                                 void *user_data,
+                                 rasqal_triples_source *rts)
+{
+  return rasqal_raptor_init_triples_source_common(rdf_query->world,
+                                                  rdf_query->data_graphs,
+                                                  NULL,
+                                                  factory_user_data,
+                                                  user_data, rts,
+                                                  NULL /* handler 1 */,
+                                                  rasqal_triples_source_error_handler2,
+                                                  0);
+}
+
+
+/**
+ * rasqal_raptor_triple_match:
+ * @world: rasqal_world object
+ * @triple: #rasqal_triple to match against
+ * @match: #rasqal_triple with wildcards
+ * @parts: parts of the triple to match - XOR of #rasqal_triple_parts bits
+ * .
+ * 
+ * Match a rasqal_triple against a rasqal_triple with NULL
+ * signifying wildcard fields in the rasqal_triple.
+ * 
+ * Return value: non-0 on match
+ **/
+int
+rasqal_raptor_triple_match(rasqal_world* world,
+                           rasqal_triple *triple,
+                           rasqal_triple *match,
+                           unsigned int parts)
+{
+  int rc = 0;
+  
+#if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
+  RASQAL_DEBUG1("\ntriple ");
+  rasqal_triple_print(triple, stderr);
+  fputs("\nmatch  ", stderr);
+  rasqal_triple_print(match, stderr);
+  fputs("\n", stderr);
+#endif
+
+  if(match->subject && (parts & RASQAL_TRIPLE_SUBJECT)) {
+    if(!rasqal_literal_equals_flags(triple->subject, match->subject,
+                                    RASQAL_COMPARE_RDF, NULL))
+      goto done;
+  }
+
+  if(match->predicate && (parts & RASQAL_TRIPLE_PREDICATE)) {
+    if(!rasqal_literal_equals_flags(triple->predicate, match->predicate,
+                                    RASQAL_COMPARE_RDF, NULL))
+      goto done;
+  }
+
+  if(match->object && (parts & RASQAL_TRIPLE_OBJECT)) {
+    if(!rasqal_literal_equals_flags(triple->object, match->object,
+                                    RASQAL_COMPARE_RDF, NULL))
+      goto done;
+  }
+
+  if(parts & RASQAL_TRIPLE_ORIGIN) {
+    /* Binding a graph */
+    
+    /* If expecting a graph and triple has none then no match */
+    if(!triple->origin)
+      goto done;
+      
+    if(match->origin) {
+      if(match->origin->type == RASQAL_LITERAL_URI ) {
+        raptor_uri* triple_uri = triple->origin->value.uri;
+        raptor_uri* match_uri = match->origin->value.uri;
+        if(!raptor_uri_equals(triple_uri, match_uri))
+          goto done;
+      }
+    }
+    
+  } else {
+    /* Not binding a graph */
+    
+    /* If triple has a GRAPH and there is none in the triple pattern, no match */
+    if(triple->origin)
+      goto done;
+  }
+  
+  rc = 1;
+  done:
+  
+#if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
+  RASQAL_DEBUG2("result: %s\n", (rc ? "match" : "no match"));
+#endif
+
+  return rc;
+}
+
+
+typedef struct rasqal_raptor_scan_s rasqal_raptor_scan;
+
+
+typedef enum {
+  RASQAL_RAPTOR_INDEX_NONE,
+  RASQAL_RAPTOR_INDEX_SUBJECT,
+  RASQAL_RAPTOR_INDEX_PREDICATE
+} rasqal_raptor_index;
+
+
+typedef struct {
+  rasqal_raptor_triple *cur;
+  /* index into source_context->graphs of the graph containing cur */
+  int graph_index;
+  rasqal_raptor_triples_source_user_data* source_context;
+  rasqal_triple match;
+
+  /* parts of the triple above to match: always (S,P,O) sometimes C */
+  rasqal_triple_parts parts;
+
+  unsigned int bind_parts;
+
+  /* graph index used to find the triples */
+  rasqal_raptor_index index;
+
+  /* parallel scan returning the triples that may match (or NULL) */
+  rasqal_raptor_scan* scan;
+} rasqal_raptor_triples_match_context;
+
+
+/* choose the graph index for the match: subject then predicate */
+static void
+rasqal_raptor_match_choose_index(rasqal_raptor_triples_match_context* rtmc)
+{
+  rasqal_literal* s = rtmc->match.subject;
+  rasqal_literal* p = rtmc->match.predicate;
+
+  if(s && (s->type == RASQAL_LITERAL_URI || s->type == RASQAL_LITERAL_BLANK))
+    rtmc->index = RASQAL_RAPTOR_INDEX_SUBJECT;
+  else if(p && p->type == RASQAL_LITERAL_URI &&
+          !rtmc->source_context->epoch_after)
+    /* the newest triples are found faster by skipping the older ones
+     * than by walking a predicate bucket from its start */
+    rtmc->index = RASQAL_RAPTOR_INDEX_PREDICATE;
+  else
+    rtmc->index = RASQAL_RAPTOR_INDEX_NONE;
+}
+
+
+/* non-0 if @triple is in the epoch window of the triples source and
+ * matches */
+static int
+rasqal_raptor_match_triple(rasqal_raptor_triples_match_context* rtmc,
+                           rasqal_raptor_triple* triple,
+                           rasqal_triple* match)
+{
+  rasqal_raptor_triples_source_user_data* rtsc = rtmc->source_context;
+
+  if(triple->epoch <= rtsc->epoch_after ||
+     (rtsc->epoch_until && triple->epoch > rtsc->epoch_until))
+    return 0;
+
+  return rasqal_raptor_triple_match(rtsc->world, triple->triple, match,
+                                    rtmc->parts);
+}
+
+
+/* first triple of @lg added after @epoch or NULL */
+static rasqal_raptor_triple*
+rasqal_raptor_first_triple_after(rasqal_raptor_loaded_graph* lg,
+                                 unsigned long epoch)
+{
+  unsigned long low = 0;
+  unsigned long high = lg->triples_count;
+
+  /* the triples are in epoch order */
+  while(low < high) {
+    unsigned long mid = low + (high - low) / 2;
+
+    if(lg->triples[mid]->epoch <= epoch)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return (low < lg->triples_count) ? lg->triples[low] : NULL;
+}
+
+
+/*
+ * rasqal_raptor_match_first_triple:
+ * @rtmc: match context
+ * @lg: loaded graph
+ *
+ * INTERNAL - Get the first triple of a graph that may match
+ *
+ * Graphs that cannot match are skipped whole: named graphs when the
+ * pattern has no graph, the background graph when it has one and any
+ * other named graph when it is a graph URI.
+ *
+ * Return value: triple or NULL if there are none
+ */
+static rasqal_raptor_triple*
+rasqal_raptor_match_first_triple(rasqal_raptor_triples_match_context* rtmc,
+                                 rasqal_raptor_loaded_graph* lg)
+{
+  unsigned long bucket;
+
+  if(rtmc->parts & RASQAL_TRIPLE_ORIGIN) {
+    rasqal_literal* origin = rtmc->match.origin;
+
+    if(!lg->origin)
+      return NULL;
+
+    if(origin && origin->type == RASQAL_LITERAL_URI &&
+       !raptor_uri_equals(lg->origin->value.uri, origin->value.uri))
+      return NULL;
+  } else if(lg->origin)
+    return NULL;
+
+  if(!lg->index_size)
+    return lg->head;
+
+  switch(rtmc->index) {
+    case RASQAL_RAPTOR_INDEX_SUBJECT:
+      bucket = rasqal_raptor_literal_hash(rtmc->match.subject);
+      return lg->subject_index[bucket & (lg->index_size - 1)];
+
+    case RASQAL_RAPTOR_INDEX_PREDICATE:
+      bucket = rasqal_raptor_literal_hash(rtmc->match.predicate);
+      return lg->predicate_index[bucket & (lg->index_size - 1)];
+
+    case RASQAL_RAPTOR_INDEX_NONE:
+    default:
+      if(rtmc->source_context->epoch_after)
+        return rasqal_raptor_first_triple_after(lg,
+                                                rtmc->source_context->epoch_after);
+      return lg->head;
+  }
+}
+
+
+#ifdef HAVE_PTHREAD
+
+/* triples in each morsel of a parallel scan */
+#define RASQAL_RAPTOR_SCAN_MORSEL_SIZE 4096
+
+/* fewest triples scanned in parallel */
+#define RASQAL_RAPTOR_SCAN_MIN_SIZE (4 * RASQAL_RAPTOR_SCAN_MORSEL_SIZE)
+
+/* maximum number of threads used by rasqal_raptor_match_scan() */
+#define RASQAL_RAPTOR_SCAN_MAX_THREADS 64
+
+/* morsels each thread may scan ahead of the reader */
+#define RASQAL_RAPTOR_SCAN_MORSELS_PER_THREAD 4
+
+/* values of rasqal_raptor_scan morsel_state */
+#define RASQAL_RAPTOR_MORSEL_PENDING 0
+#define RASQAL_RAPTOR_MORSEL_MATCHED 1
+#define RASQAL_RAPTOR_MORSEL_UNMATCHED 2
+
+/*
+ * A parallel scan of the graphs a triple pattern may match, split
+ * into morsels of up to RASQAL_RAPTOR_SCAN_MORSEL_SIZE triples of
+ * one graph.
+ *
+ * The threads take the next morsel in turn and put its matches in a
+ * bounded queue of morsels.  The thread reading the triples match
+ * takes them out in morsel order so the triples are returned in the
+ * same order for any number of threads.  It scans a morsel itself
+ * when no thread has taken it yet.  The threads stay at most @window
+ * morsels ahead of the reader so rows are returned as soon as the
+ * first morsels are scanned and a match that is not read to the end
+ * does not scan every triple.
+ */
+struct rasqal_raptor_scan_s
+{
+  rasqal_raptor_triples_match_context* rtmc;
+
+  /* graph index and first triple offset of each morsel */
+  int* morsel_graphs;
+  unsigned long* morsel_starts;
+  int morsels_count;
+
+  /* next morsel to scan */
+  int next_morsel;
+
+  /* next morsel to read; the queue holds the morsels from here to
+   * @next_morsel */
+  int next_read;
+
+  /* most morsels in the queue */
+  int window;
+
+  /* per morsel: RASQAL_RAPTOR_MORSEL_ state, matching triples (or
+   * NULL if none) and count.  An UNMATCHED morsel is scanned by the
+   * reader: no thread took it or its matches could not be stored. */
+  char* morsel_state;
+  rasqal_raptor_triple*** morsel_matches;
+  unsigned long* morsel_matches_counts;
+
+  /* set to make the threads finish */
+  int stop;
+
+  pthread_t thread_ids[RASQAL_RAPTOR_SCAN_MAX_THREADS];
+  int threads_count;
+
+  pthread_mutex_t lock;
+
+  /* signalled when a morsel is scanned, one is read or on stop */
+  pthread_cond_t cond;
+
+  /* morsel being read: matching triples from a thread or, when NULL,
+   * the triples of graph @graph_index up to offset @end */
+  rasqal_raptor_triple** matches;
+  unsigned long matches_count;
+  int graph_index;
+  unsigned long offset;
+  unsigned long end;
+};
+
+
+static void*
+rasqal_raptor_scan_worker(void* user_data)
+{
+  rasqal_raptor_scan* scan = (rasqal_raptor_scan*)user_data;
+  rasqal_raptor_triples_match_context* rtmc = scan->rtmc;
+  rasqal_raptor_triples_source_user_data* rtsc = rtmc->source_context;
+  rasqal_raptor_triple* found[RASQAL_RAPTOR_SCAN_MORSEL_SIZE];
+
+  pthread_mutex_lock(&scan->lock);
+
+  while(1) {
+    rasqal_raptor_loaded_graph* lg;
+    rasqal_raptor_triple** matches = NULL;
+    unsigned long start;
+    unsigned long end;
+    unsigned long count = 0;
+    unsigned long i;
+    int morsel;
+
+    while(!scan->stop && scan->next_morsel < scan->morsels_count &&
+          scan->next_morsel >= scan->next_read + scan->window)
+      pthread_cond_wait(&scan->cond, &scan->lock);
+
+    if(scan->stop || scan->next_morsel >= scan->morsels_count)
+      break;
+
+    morsel = scan->next_morsel++;
+    pthread_mutex_unlock(&scan->lock);
+
+    lg = rtsc->graphs[scan->morsel_graphs[morsel]];
+    start = scan->morsel_starts[morsel];
+    end = start + RASQAL_RAPTOR_SCAN_MORSEL_SIZE;
+    if(end > lg->triples_count)
+      end = lg->triples_count;
+
+    /* matching only reads the shared triples and match literals */
+    for(i = start; i < end; i++) {
+      if(rasqal_raptor_triple_match(rtsc->world, lg->triples[i]->triple,
+                                    &rtmc->match, rtmc->parts))
+        found[count++] = lg->triples[i];
+    }
+
+    if(count) {
+      matches = RASQAL_MALLOC(rasqal_raptor_triple**,
+                              sizeof(rasqal_raptor_triple*) * count);
+      if(matches)
+        memcpy(matches, found, sizeof(rasqal_raptor_triple*) * count);
+    }
+
+    pthread_mutex_lock(&scan->lock);
+    scan->morsel_matches[morsel] = matches;
+    scan->morsel_matches_counts[morsel] = count;
+    scan->morsel_state[morsel] = (count && !matches) ?
+      RASQAL_RAPTOR_MORSEL_UNMATCHED : RASQAL_RAPTOR_MORSEL_MATCHED;
+    pthread_cond_broadcast(&scan->cond);
+  }
+
+  pthread_mutex_unlock(&scan->lock);
+
+  return NULL;
+}
+
+
+/*
+ * rasqal_raptor_scan_next_triple:
+ * @scan: parallel scan
+ *
+ * INTERNAL - Get the next triple of a parallel scan that may match
+ *
+ * Return value: triple or NULL when there are no more
+ */
+static rasqal_raptor_triple*
+rasqal_raptor_scan_next_triple(rasqal_raptor_scan* scan)
+{
+  rasqal_raptor_triples_source_user_data* rtsc = scan->rtmc->source_context;
+
+  while(1) {
+    rasqal_raptor_loaded_graph* lg;
+    int morsel;
+    int state;
+
+    if(scan->matches) {
+      if(scan->offset < scan->matches_count)
+        return scan->matches[scan->offset++];
+
+      RASQAL_FREE(rasqal_raptor_triple**, scan->matches);
+      scan->matches = NULL;
+    } else if(scan->offset < scan->end)
+      return rtsc->graphs[scan->graph_index]->triples[scan->offset++];
+
+    if(scan->next_read >= scan->morsels_count)
+      return NULL;
+
+    pthread_mutex_lock(&scan->lock);
+    morsel = scan->next_read;
+    if(scan->next_morsel == morsel) {
+      /* not taken by a thread */
+      scan->next_morsel++;
+      state = RASQAL_RAPTOR_MORSEL_UNMATCHED;
+    } else {
+      while(scan->morsel_state[morsel] == RASQAL_RAPTOR_MORSEL_PENDING)
+        pthread_cond_wait(&scan->cond, &scan->lock);
+      state = scan->morsel_state[morsel];
+    }
+    scan->next_read++;
+    pthread_cond_broadcast(&scan->cond);
+    pthread_mutex_unlock(&scan->lock);
+
+    scan->offset = 0;
+    scan->end = 0;
+    if(state == RASQAL_RAPTOR_MORSEL_MATCHED) {
+      scan->matches = scan->morsel_matches[morsel];
+      scan->matches_count = scan->morsel_matches_counts[morsel];
+      scan->morsel_matches[morsel] = NULL;
+    } else {
+      /* the triples are matched again by the caller */
+      scan->graph_index = scan->morsel_graphs[morsel];
+      lg = rtsc->graphs[scan->graph_index];
+      scan->offset = scan->morsel_starts[morsel];
+      scan->end = scan->offset + RASQAL_RAPTOR_SCAN_MORSEL_SIZE;
+      if(scan->end > lg->triples_count)
+        scan->end = lg->triples_count;
+    }
+  }
+}
+
+
+/*
+ * rasqal_raptor_free_scan:
+ * @scan: parallel scan
+ *
+ * INTERNAL - Stop the threads of a parallel scan and free it
+ */
+static void
+rasqal_raptor_free_scan(rasqal_raptor_scan* scan)
+{
+  int i;
+
+  if(scan->threads_count) {
+    pthread_mutex_lock(&scan->lock);
+    scan->stop = 1;
+    pthread_cond_broadcast(&scan->cond);
+    pthread_mutex_unlock(&scan->lock);
+
+    for(i = 0; i < scan->threads_count; i++)
+      pthread_join(scan->thread_ids[i], NULL);
+  }
+
+  pthread_cond_destroy(&scan->cond);
+  pthread_mutex_destroy(&scan->lock);
+
+  if(scan->morsel_matches) {
+    for(i = 0; i < scan->morsels_count; i++) {
+      if(scan->morsel_matches[i])
+        RASQAL_FREE(rasqal_raptor_triple**, scan->morsel_matches[i]);
+    }
+    RASQAL_FREE(rasqal_raptor_triple***, scan->morsel_matches);
+  }
+  if(scan->morsel_matches_counts)
+    RASQAL_FREE(unsigned long*, scan->morsel_matches_counts);
+  if(scan->morsel_state)
+    RASQAL_FREE(char*, scan->morsel_state);
+  if(scan->morsel_starts)
+    RASQAL_FREE(unsigned long*, scan->morsel_starts);
+  if(scan->morsel_graphs)
+    RASQAL_FREE(int*, scan->morsel_graphs);
+  if(scan->matches)
+    RASQAL_FREE(rasqal_raptor_triple**, scan->matches);
+
+  RASQAL_FREE(rasqal_raptor_scan, scan);
+}
+
+
+/*
+ * rasqal_raptor_match_scan:
+ * @rtmc: match context
+ * @threads: number of threads
+ *
+ * INTERNAL - Start scanning the graphs for a triple pattern in parallel
+ *
+ * Sets the parallel scan of @rtmc that returns the triples that may
+ * match in the same order as a scan by one thread.  Nothing is done
+ * when there are too few triples to scan.  The variables are bound
+ * from the matches later by the calling thread.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_raptor_match_scan(rasqal_raptor_triples_match_context* rtmc,
+                         int threads)
+{
+  rasqal_raptor_triples_source_user_data* rtsc = rtmc->source_context;
+  rasqal_raptor_scan* scan;
+  unsigned long total = 0;
+  unsigned long offset;
+  int morsels_count = 0;
+  int g;
+  int i;
+
+  for(g = 0; g < rtsc->sources_count; g++) {
+    rasqal_raptor_loaded_graph* lg = rtsc->graphs[g];
+
+    if(!rasqal_raptor_match_first_triple(rtmc, lg))
+      continue;
+
+    total += lg->triples_count;
+    morsels_count += RASQAL_GOOD_CAST(int, (lg->triples_count + RASQAL_RAPTOR_SCAN_MORSEL_SIZE - 1) / RASQAL_RAPTOR_SCAN_MORSEL_SIZE);
+  }
+
+  if(total < RASQAL_RAPTOR_SCAN_MIN_SIZE)
+    return 0;
+
+  scan = RASQAL_CALLOC(rasqal_raptor_scan*, 1, sizeof(*scan));
+  if(!scan)
+    return 1;
+
+  scan->rtmc = rtmc;
+  scan->morsels_count = morsels_count;
+
+  if(pthread_mutex_init(&scan->lock, NULL)) {
+    RASQAL_FREE(rasqal_raptor_scan, scan);
+    return 1;
+  }
+  if(pthread_cond_init(&scan->cond, NULL)) {
+    pthread_mutex_destroy(&scan->lock);
+    RASQAL_FREE(rasqal_raptor_scan, scan);
+    return 1;
+  }
+
+  scan->morsel_graphs = RASQAL_CALLOC(int*, RASQAL_GOOD_CAST(size_t, morsels_count),
+                                      sizeof(int));
+  scan->morsel_starts = RASQAL_CALLOC(unsigned long*,
+                                      RASQAL_GOOD_CAST(size_t, morsels_count),
+                                      sizeof(unsigned long));
+  scan->morsel_state = RASQAL_CALLOC(char*, RASQAL_GOOD_CAST(size_t, morsels_count),
+                                     sizeof(char));
+  scan->morsel_matches = RASQAL_CALLOC(rasqal_raptor_triple***,
+                                       RASQAL_GOOD_CAST(size_t, morsels_count),
+                                       sizeof(rasqal_raptor_triple**));
+  scan->morsel_matches_counts = RASQAL_CALLOC(unsigned long*,
+                                              RASQAL_GOOD_CAST(size_t, morsels_count),
+                                              sizeof(unsigned long));
+  if(!scan->morsel_graphs || !scan->morsel_starts || !scan->morsel_state ||
+     !scan->morsel_matches || !scan->morsel_matches_counts) {
+    rasqal_raptor_free_scan(scan);
+    return 1;
+  }
+
+  i = 0;
+  for(g = 0; g < rtsc->sources_count; g++) {
+    rasqal_raptor_loaded_graph* lg = rtsc->graphs[g];
+
+    if(!rasqal_raptor_match_first_triple(rtmc, lg))
+      continue;
+
+    for(offset = 0; offset < lg->triples_count;
+        offset += RASQAL_RAPTOR_SCAN_MORSEL_SIZE) {
+      scan->morsel_graphs[i] = g;
+      scan->morsel_starts[i] = offset;
+      i++;
+    }
+  }
+
+  if(threads > RASQAL_RAPTOR_SCAN_MAX_THREADS)
+    threads = RASQAL_RAPTOR_SCAN_MAX_THREADS;
+  if(threads > morsels_count)
+    threads = morsels_count;
+  scan->window = threads * RASQAL_RAPTOR_SCAN_MORSELS_PER_THREAD;
+
+  /* the reader scans the morsels no thread takes so it does not
+   * matter if a thread cannot be started */
+  for(i = 0; i < threads; i++) {
+    if(pthread_create(&scan->thread_ids[scan->threads_count], NULL,
+                      rasqal_raptor_scan_worker, scan))
+      break;
+    scan->threads_count++;
+  }
+
+  rtmc->scan = scan;
+
+  RASQAL_DEBUG3("Parallel scan of %d morsels with %d threads\n",
+                morsels_count, scan->threads_count);
 
-  if(rdf_query->features[RASQAL_FEATURE_NO_NET])
-    flags |= 1;
-  return rasqal_raptor_init_triples_source_common(rdf_query->world,
-                                                  rdf_query->data_graphs,
-                                                  rdf_query,
-                                                  factory_user_data,
-                                                  user_data, rts,
-                                                  handler,
-                                                  NULL /* handler 2 */,
-                                                  flags);
+  return 0;
 }
 
-static int
-rasqal_raptor_new_triples_source(rasqal_query* rdf_query,
-                                 void *factory_user_data,
-                                 void *user_data,
-                                 rasqal_triples_source *rts)
-{
-  return rasqal_raptor_init_triples_source_common(rdf_query->world,
-                                                  rdf_query->data_graphs,
-                                                  NULL,
-                                                  factory_user_data,
-                                                  user_data, rts,
-                                                  NULL /* handler 1 */,
-                                                  rasqal_triples_source_error_handler2,
-                                                  0);
-}
+#endif
 
 
-/**
- * rasqal_raptor_triple_match:
- * @world: rasqal_world object
- * @triple: #rasqal_triple to match against
- * @match: #rasqal_triple with wildcards
- * @parts: parts of the triple to match - XOR of #rasqal_triple_parts bits
- * .
- * 
- * Match a rasqal_triple against a rasqal_triple with NULL
- * signifying wildcard fields in the rasqal_triple.
- * 
- * Return value: non-0 on match
- **/
-int
-rasqal_raptor_triple_match(rasqal_world* world,
-                           rasqal_triple *triple,
-                           rasqal_triple *match,
-                           unsigned int parts)
+/* advance rtmc->cur to the next triple that may match over all the
+ * loaded graphs; NULL rtmc->cur starts the graph after
+ * rtmc->graph_index */
+static void
+rasqal_raptor_match_next_triple(rasqal_raptor_triples_match_context* rtmc)
 {
-  int rc = 0;
-  
-#if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
-  RASQAL_DEBUG1("\ntriple ");
-  rasqal_triple_print(triple, stderr);
-  fputs("\nmatch  ", stderr);
-  rasqal_triple_print(match, stderr);
-  fputs("\n", stderr);
-#endif
+  rasqal_raptor_triples_source_user_data* rtsc = rtmc->source_context;
+  rasqal_raptor_triple* triple = rtmc->cur;
 
-  if(match->subject && (parts & RASQAL_TRIPLE_SUBJECT)) {
-    if(!rasqal_literal_equals_flags(triple->subject, match->subject,
-                                    RASQAL_COMPARE_RDF, NULL))
-      goto done;
+#ifdef HAVE_PTHREAD
+  if(rtmc->scan) {
+    rtmc->cur = rasqal_raptor_scan_next_triple(rtmc->scan);
+    return;
   }
+#endif
 
-  if(match->predicate && (parts & RASQAL_TRIPLE_PREDICATE)) {
-    if(!rasqal_literal_equals_flags(triple->predicate, match->predicate,
-                                    RASQAL_COMPARE_RDF, NULL))
-      goto done;
+  if(triple) {
+    if(rtmc->index == RASQAL_RAPTOR_INDEX_SUBJECT)
+      triple = triple->next_subject;
+    else if(rtmc->index == RASQAL_RAPTOR_INDEX_PREDICATE)
+      triple = triple->next_predicate;
+    else
+      triple = triple->next;
   }
 
-  if(match->object && (parts & RASQAL_TRIPLE_OBJECT)) {
-    if(!rasqal_literal_equals_flags(triple->object, match->object,
-                                    RASQAL_COMPARE_RDF, NULL))
-      goto done;
-  }
+  while(1) {
+    /* the rest of the graph was added after the epoch window */
+    if(triple && rtsc->epoch_until && triple->epoch > rtsc->epoch_until)
+      triple = NULL;
 
-  if(parts & RASQAL_TRIPLE_ORIGIN) {
-    /* Binding a graph */
-    
-    /* If expecting a graph and triple has none then no match */
-    if(!triple->origin)
-      goto done;
-      
-    if(match->origin) {
-      if(match->origin->type == RASQAL_LITERAL_URI ) {
-        raptor_uri* triple_uri = triple->origin->value.uri;
-        raptor_uri* match_uri = match->origin->value.uri;
-        if(!raptor_uri_equals(triple_uri, match_uri))
-          goto done;
-      }
-    }
-    
-  } else {
-    /* Not binding a graph */
-    
-    /* If triple has a GRAPH and there is none in the triple pattern, no match */
-    if(triple->origin)
-      goto done;
+    if(triple || rtmc->graph_index + 1 >= rtsc->sources_count)
+      break;
+
+    rtmc->graph_index++;
+    triple = rasqal_raptor_match_first_triple(rtmc,
+                                              rtsc->graphs[rtmc->graph_index]);
   }
-  
-  rc = 1;
-  done:
-  
-#if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
-  RASQAL_DEBUG2("result: %s\n", (rc ? "match" : "no match"));
-#endif
 
-  return rc;
+  rtmc->cur = triple;
 }
 
 
@@ -473,17 +1727,22 @@ static int
 rasqal_raptor_triple_present(rasqal_triples_source *rts, void *user_data, 
                              rasqal_triple *t) 
 {
-  rasqal_raptor_triples_source_user_data* rtsc;
-  rasqal_raptor_triple *triple;
-  unsigned int parts = RASQAL_TRIPLE_SPO;
-  
-  rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
-
+  rasqal_raptor_triples_match_context rtmc;
+
+  memset(&rtmc, '\0', sizeof(rtmc));
+  rtmc.source_context = (rasqal_raptor_triples_source_user_data*)user_data;
+  rtmc.graph_index = -1;
+  /* shallow copy: the literals are not freed */
+  rtmc.match = *t;
+  rtmc.parts = RASQAL_TRIPLE_SPO;
   if(t->origin)
-    parts = (rasqal_triple_parts)(parts | RASQAL_TRIPLE_GRAPH);
+    rtmc.parts = (rasqal_triple_parts)(rtmc.parts | RASQAL_TRIPLE_GRAPH);
+  rasqal_raptor_match_choose_index(&rtmc);
 
-  for(triple = rtsc->head; triple; triple = triple->next) {
-    if(rasqal_raptor_triple_match(rtsc->world, triple->triple, t, parts))
+  for(rasqal_raptor_match_next_triple(&rtmc);
+      rtmc.cur;
+      rasqal_raptor_match_next_triple(&rtmc)) {
+    if(rasqal_raptor_match_triple(&rtmc, rtmc.cur, t))
       return 1;
   }
 
@@ -496,25 +1755,17 @@ static void
 rasqal_raptor_free_triples_source(void *user_data)
 {
   rasqal_raptor_triples_source_user_data* rtsc;
-  rasqal_raptor_triple *cur;
   int i;
 
   rtsc = (rasqal_raptor_triples_source_user_data*)user_data;
-  cur = rtsc->head;
-  while(cur) {
-    rasqal_raptor_triple *next = cur->next;
-    rasqal_triple_set_origin(cur->triple, NULL); /* shared URI literal */
-    rasqal_free_triple(cur->triple);
-    RASQAL_FREE(rasqal_raptor_triple, cur);
-    cur = next;
-  }
 
-  for(i = 0; i < rtsc->sources_count; i++) {
-    if(rtsc->source_literals[i])
-      rasqal_free_literal(rtsc->source_literals[i]);
+  if(rtsc->graphs) {
+    for(i = 0; i < rtsc->sources_count; i++) {
+      if(rtsc->graphs[i])
+        rasqal_raptor_free_loaded_graph(rtsc->graphs[i]);
+    }
+    RASQAL_FREE(rasqal_raptor_loaded_graph**, rtsc->graphs);
   }
-  if(rtsc->source_literals)
-    RASQAL_FREE(raptor_literal_ptr, rtsc->source_literals);
 }
 
 
@@ -535,18 +1786,6 @@ rasqal_raptor_register_triples_source_factory(rasqal_triples_source_factory *fac
 }
 
 
-typedef struct {
-  rasqal_raptor_triple *cur;
-  rasqal_raptor_triples_source_user_data* source_context;
-  rasqal_triple match;
-
-  /* parts of the triple above to match: always (S,P,O) sometimes C */
-  rasqal_triple_parts parts;
-
-  unsigned int bind_parts;
-} rasqal_raptor_triples_match_context;
-
-
 static rasqal_triple_parts
 rasqal_raptor_bind_match(struct rasqal_triples_match_s* rtm,
                          void *user_data,
@@ -675,7 +1914,7 @@ rasqal_raptor_next_match(struct rasqal_triples_match_s* rtm, void *user_data)
 #endif
 
   while(rtmc->cur) {
-    rtmc->cur = rtmc->cur->next;
+    rasqal_raptor_match_next_triple(rtmc);
 #ifdef RASQAL_DEBUG
     if(!rtmc->cur) {
       RASQAL_DEBUG1("triple match ended when matching ");
@@ -683,9 +1922,7 @@ rasqal_raptor_next_match(struct rasqal_triples_match_s* rtm, void *user_data)
       fputc('\n', stderr);
     }
 #endif
-    if(rtmc->cur &&
-       rasqal_raptor_triple_match(rtm->world, rtmc->cur->triple, &rtmc->match,
-                                  rtmc->parts))
+    if(rtmc->cur && rasqal_raptor_match_triple(rtmc, rtmc->cur, &rtmc->match))
       break;
   }
 }
@@ -709,6 +1946,12 @@ rasqal_raptor_finish_triples_match(struct rasqal_triples_match_s* rtm,
 
   rtmc = (rasqal_raptor_triples_match_context*)rtm->user_data;
 
+#ifdef HAVE_PTHREAD
+  /* before the match literals the threads read are freed */
+  if(rtmc->scan)
+    rasqal_raptor_free_scan(rtmc->scan);
+#endif
+
   if(rtmc->match.subject)
     rasqal_free_literal(rtmc->match.subject);
 
@@ -748,7 +1991,7 @@ rasqal_raptor_init_triples_match(rasqal_triples_match* rtm,
   rtm->user_data = rtmc;
 
   rtmc->source_context = rtsc;
-  rtmc->cur = rtsc->head;
+  rtmc->graph_index = -1;
   
   /* Parts we bind */
   rtmc->bind_parts = m->parts;
@@ -807,18 +2050,271 @@ rasqal_raptor_init_triples_match(rasqal_triples_match* rtm,
     rtmc->parts = (rasqal_triple_parts)(rtmc->parts | RASQAL_TRIPLE_GRAPH);
   }
   
+  rasqal_raptor_match_choose_index(rtmc);
 
-  while(rtmc->cur) {
-    if(rasqal_raptor_triple_match(rtm->world, rtmc->cur->triple, &rtmc->match,
-                                  rtmc->parts))
+#ifdef HAVE_PTHREAD
+  if(rtmc->index == RASQAL_RAPTOR_INDEX_NONE && rts->query &&
+     !rtsc->epoch_after && !rtsc->epoch_until) {
+    int threads;
+
+    threads = rts->query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SCAN_THREADS)];
+    if(threads > 1 && rasqal_raptor_match_scan(rtmc, threads))
+      return -1;
+  }
+#endif
+
+  for(rasqal_raptor_match_next_triple(rtmc);
+      rtmc->cur;
+      rasqal_raptor_match_next_triple(rtmc)) {
+    if(rasqal_raptor_match_triple(rtmc, rtmc->cur, &rtmc->match))
       break;
-    rtmc->cur = rtmc->cur->next;
   }
   
   return 0;
 }
 
 
+/*
+ * rasqal_raptor_data_graph_epoch:
+ * @world: rasqal_world object
+ * @dg: data graph
+ *
+ * INTERNAL - Get the epoch of the cached graph loaded from a data graph
+ *
+ * The epoch changes whenever the triples a query would see for @dg
+ * change, so it can be used as the version of the data graph.
+ *
+ * Return value: epoch or 0 if the default triples source is not in
+ * use, the graph is not cached or its file has changed
+ */
+unsigned long
+rasqal_raptor_data_graph_epoch(rasqal_world* world, rasqal_data_graph* dg)
+{
+  rasqal_raptor_loaded_graph* lg;
+  size_t file_size = 0;
+  time_t mtime;
+
+  if(!rasqal_raptor_is_triples_source(world))
+    return 0;
+
+  lg = rasqal_raptor_find_loaded_graph(world, dg);
+  if(!lg)
+    return 0;
+
+  mtime = rasqal_raptor_data_graph_mtime(dg->uri, &file_size);
+  if(lg->mtime != mtime || lg->file_size != file_size)
+    return 0;
+
+  return lg->epoch;
+}
+
+
+/*
+ * rasqal_raptor_is_triples_source:
+ * @world: rasqal_world object
+ *
+ * INTERNAL - Check if queries use the raptor triples source
+ *
+ * Return value: non-0 if the world triples source factory is this one
+ */
+int
+rasqal_raptor_is_triples_source(rasqal_world* world)
+{
+  return (world->triples_source_factory.init_triples_source2 ==
+          rasqal_raptor_init_triples_source2);
+}
+
+
+/*
+ * rasqal_raptor_triples_source_set_epochs:
+ * @rts: triples source
+ * @after: match triples added after this epoch or 0
+ * @until: match triples added up to this epoch or 0
+ *
+ * INTERNAL - Restrict the triples a raptor triples source matches to
+ * those added to its graphs in a window of epochs
+ *
+ * Used to match only the triples appended to a graph since an
+ * earlier evaluation or only the triples it had then.
+ *
+ * Return value: non-0 if @rts is not a raptor triples source
+ */
+int
+rasqal_raptor_triples_source_set_epochs(rasqal_triples_source* rts,
+                                        unsigned long after,
+                                        unsigned long until)
+{
+  rasqal_raptor_triples_source_user_data* rtsc;
+
+  if(rts->init_triples_match != rasqal_raptor_init_triples_match)
+    return 1;
+
+  rtsc = (rasqal_raptor_triples_source_user_data*)rts->user_data;
+  rtsc->epoch_after = after;
+  rtsc->epoch_until = until;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_raptor_triples_source_get_graph_epochs:
+ * @rts: triples source
+ * @i: graph index
+ * @load_epoch_p: pointer to store the epoch the graph was loaded
+ * @epoch_p: pointer to store the epoch the graph was last extended
+ *
+ * INTERNAL - Get the epochs of a graph of a raptor triples source
+ *
+ * While the load epoch of a graph is unchanged, later epochs have
+ * only added triples to it.
+ *
+ * Return value: non-0 if @rts is not a raptor triples source or has
+ * no graph @i
+ */
+int
+rasqal_raptor_triples_source_get_graph_epochs(rasqal_triples_source* rts,
+                                              int i,
+                                              unsigned long* load_epoch_p,
+                                              unsigned long* epoch_p)
+{
+  rasqal_raptor_triples_source_user_data* rtsc;
+
+  if(rts->init_triples_match != rasqal_raptor_init_triples_match)
+    return 1;
+
+  rtsc = (rasqal_raptor_triples_source_user_data*)rts->user_data;
+  if(i < 0 || i >= rtsc->sources_count)
+    return 1;
+
+  *load_epoch_p = rtsc->graphs[i]->load_epoch;
+  *epoch_p = rtsc->graphs[i]->epoch;
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_preload_data_graph:
+ * @world: rasqal_world object
+ * @dg: data graph read from a URI
+ *
+ * Load a data graph into the world loaded graphs cache and pin it.
+ *
+ * Queries executed with the default triples source that use a data
+ * graph with the same URI, name URI, base URI and format name then
+ * share the loaded graph instead of parsing it again.  A graph read
+ * from a file: URI is parsed again if the file modification time or
+ * size changes.  An N-Triples or N-Quads graph (named by the format
+ * name) whose file has only had lines appended has just those lines
+ * parsed and added when no query is using it.
+ *
+ * A graph loaded by a query without preloading is not pinned: it is
+ * only reused by queries that run while another query still holds
+ * it and is dropped from the cache when the last such query is
+ * freed.  Preloading keeps a graph loaded until it is unpinned with
+ * rasqal_world_pin_data_graph() or evicted with
+ * rasqal_world_evict_data_graph().  Queries using
+ * #RASQAL_FEATURE_INCREMENTAL only process the appended triples of
+ * preloaded graphs.
+ *
+ * Data graphs read from an iostream cannot be shared.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_world_preload_data_graph(rasqal_world* world, rasqal_data_graph* dg)
+{
+  rasqal_raptor_loaded_graph* lg;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(dg, rasqal_data_graph, 1);
+
+  if(!dg->uri || dg->iostr)
+    return 1;
+
+  lg = rasqal_raptor_load_graph(world, dg, NULL, NULL,
+                                rasqal_triples_source_error_handler2, 0);
+  if(!lg)
+    return 1;
+
+  lg->pinned = 1;
+  rasqal_raptor_free_loaded_graph(lg);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_pin_data_graph:
+ * @world: rasqal_world object
+ * @dg: data graph
+ * @pin: non-0 to pin, 0 to unpin
+ *
+ * Set whether a loaded data graph is kept in the world loaded graphs cache.
+ *
+ * An unpinned graph is removed from the cache once no query is using it
+ * so it is only reused by queries that run while another query still
+ * holds it.
+ *
+ * Return value: non-0 on failure such as the graph not being loaded
+ **/
+int
+rasqal_world_pin_data_graph(rasqal_world* world, rasqal_data_graph* dg,
+                            int pin)
+{
+  rasqal_raptor_loaded_graph* lg;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(dg, rasqal_data_graph, 1);
+
+  lg = rasqal_raptor_find_loaded_graph(world, dg);
+  if(!lg)
+    return 1;
+
+  lg->pinned = (pin != 0);
+  if(!pin && lg->usage == 1)
+    rasqal_raptor_uncache_loaded_graph(lg);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_evict_data_graph:
+ * @world: rasqal_world object
+ * @dg: data graph or NULL for all graphs
+ *
+ * Remove a loaded data graph from the world loaded graphs cache.
+ *
+ * Queries already using the graph keep using it; it is freed when
+ * the last of them finishes.  Later queries parse the graph again.
+ *
+ * Return value: non-0 on failure such as the graph not being loaded
+ **/
+int
+rasqal_world_evict_data_graph(rasqal_world* world, rasqal_data_graph* dg)
+{
+  rasqal_raptor_loaded_graph* lg;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  if(!dg) {
+    while(world->loaded_graphs)
+      rasqal_raptor_uncache_loaded_graph(world->loaded_graphs);
+    return 0;
+  }
+
+  lg = rasqal_raptor_find_loaded_graph(world, dg);
+  if(!lg)
+    return 1;
+
+  rasqal_raptor_uncache_loaded_graph(lg);
+
+  return 0;
+}
+
+
 int
 rasqal_raptor_init(rasqal_world* world)
 {
@@ -827,3 +2323,10 @@ rasqal_raptor_init(rasqal_world* world)
                                     (void*)NULL);
   return 0;
 }
+
+
+void
+rasqal_raptor_finish(rasqal_world* world)
+{
+  rasqal_world_evict_data_graph(world, NULL);
+}
@@ -0,0 +1,928 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_results_cache.c - Rasqal world cache of query results
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+/*
+ * Stored results of a query in the world results cache
+ */
+struct rasqal_results_cache_entry_s {
+  /* next entry in most recently used first order */
+  struct rasqal_results_cache_entry_s* next;
+
+  /* key made by rasqal_results_cache_make_key() (owned) */
+  unsigned char* key;
+  size_t key_len;
+  unsigned long hash;
+
+  /* variables and rows encoded by rasqal_results_cache_encode_rows()
+   * (owned) */
+  unsigned char* data;
+  size_t data_len;
+};
+
+
+/* growable byte buffer for encoding keys and rows */
+typedef struct {
+  unsigned char* data;
+  size_t len;
+  size_t size;
+  int failed;
+} rasqal_results_cache_buffer;
+
+
+/* encoded literal tags */
+#define RASQAL_RESULTS_CACHE_LITERAL_NULL   0
+#define RASQAL_RESULTS_CACHE_LITERAL_URI    1
+#define RASQAL_RESULTS_CACHE_LITERAL_BLANK  2
+#define RASQAL_RESULTS_CACHE_LITERAL_STRING 3
+
+
+static void
+rasqal_results_cache_write_bytes(rasqal_results_cache_buffer* b,
+                                 const unsigned char* bytes, size_t len)
+{
+  if(b->failed)
+    return;
+
+  if(b->len + len > b->size) {
+    size_t size = b->size ? b->size : 256;
+    unsigned char* data;
+
+    while(size < b->len + len)
+      size <<= 1;
+
+    data = RASQAL_MALLOC(unsigned char*, size);
+    if(!data) {
+      b->failed = 1;
+      return;
+    }
+    if(b->data) {
+      memcpy(data, b->data, b->len);
+      RASQAL_FREE(char*, b->data);
+    }
+    b->data = data;
+    b->size = size;
+  }
+
+  if(len) {
+    memcpy(b->data + b->len, bytes, len);
+    b->len += len;
+  }
+}
+
+
+/* unsigned LEB128: 7 bits a byte, low bits first */
+static void
+rasqal_results_cache_write_number(rasqal_results_cache_buffer* b,
+                                  size_t value)
+{
+  unsigned char bytes[16];
+  size_t len = 0;
+
+  do {
+    unsigned char byte = RASQAL_GOOD_CAST(unsigned char, value & 0x7f);
+
+    value >>= 7;
+    if(value)
+      byte |= 0x80;
+    bytes[len++] = byte;
+  } while(value);
+
+  rasqal_results_cache_write_bytes(b, bytes, len);
+}
+
+
+static void
+rasqal_results_cache_write_int(rasqal_results_cache_buffer* b, int value)
+{
+  rasqal_results_cache_write_number(b, RASQAL_GOOD_CAST(size_t, RASQAL_GOOD_CAST(unsigned int, value)));
+}
+
+
+static void
+rasqal_results_cache_write_counted_string(rasqal_results_cache_buffer* b,
+                                          const unsigned char* string,
+                                          size_t len)
+{
+  rasqal_results_cache_write_number(b, len);
+  rasqal_results_cache_write_bytes(b, string, len);
+}
+
+
+/*
+ * rasqal_results_cache_write_literal:
+ * @b: buffer
+ * @l: literal or NULL
+ *
+ * INTERNAL - Encode a result value
+ *
+ * Values other than URIs and blank nodes are written as their lexical
+ * form, language and datatype URI so they read back with the same
+ * type and are written out exactly as before.
+ *
+ * Return value: non-0 if @l is not a result value
+ */
+static int
+rasqal_results_cache_write_literal(rasqal_results_cache_buffer* b,
+                                   rasqal_literal* l)
+{
+  const unsigned char* str;
+  size_t len;
+  raptor_uri* dt_uri;
+
+  if(!l) {
+    rasqal_results_cache_write_number(b, RASQAL_RESULTS_CACHE_LITERAL_NULL);
+    return 0;
+  }
+
+  switch(l->type) {
+    case RASQAL_LITERAL_URI:
+      str = raptor_uri_as_counted_string(l->value.uri, &len);
+      rasqal_results_cache_write_number(b, RASQAL_RESULTS_CACHE_LITERAL_URI);
+      rasqal_results_cache_write_counted_string(b, str, len);
+      return 0;
+
+    case RASQAL_LITERAL_BLANK:
+      rasqal_results_cache_write_number(b, RASQAL_RESULTS_CACHE_LITERAL_BLANK);
+      rasqal_results_cache_write_counted_string(b, l->string, l->string_len);
+      return 0;
+
+    case RASQAL_LITERAL_STRING:
+    case RASQAL_LITERAL_XSD_STRING:
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_FLOAT:
+    case RASQAL_LITERAL_DOUBLE:
+    case RASQAL_LITERAL_DECIMAL:
+    case RASQAL_LITERAL_DATETIME:
+    case RASQAL_LITERAL_DATE:
+    case RASQAL_LITERAL_UDT:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+      str = rasqal_literal_as_counted_string(l, &len, 0, NULL);
+      if(!str)
+        return 1;
+      rasqal_results_cache_write_number(b, RASQAL_RESULTS_CACHE_LITERAL_STRING);
+      rasqal_results_cache_write_counted_string(b, str, len);
+
+      if(l->language)
+        rasqal_results_cache_write_counted_string(b, RASQAL_GOOD_CAST(const unsigned char*, l->language), strlen(l->language));
+      else
+        rasqal_results_cache_write_number(b, 0);
+
+      dt_uri = l->datatype;
+      if(!dt_uri && l->type != RASQAL_LITERAL_STRING)
+        dt_uri = rasqal_xsd_datatype_type_to_uri(l->world, l->type);
+      if(dt_uri) {
+        str = raptor_uri_as_counted_string(dt_uri, &len);
+        rasqal_results_cache_write_counted_string(b, str, len);
+      } else
+        rasqal_results_cache_write_number(b, 0);
+      return 0;
+
+    case RASQAL_LITERAL_UNKNOWN:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_VARIABLE:
+    default:
+      break;
+  }
+
+  /* not a result value */
+  return 1;
+}
+
+
+/* reader of an encoded buffer */
+typedef struct {
+  const unsigned char* p;
+  const unsigned char* end;
+} rasqal_results_cache_reader;
+
+
+static int
+rasqal_results_cache_read_number(rasqal_results_cache_reader* r,
+                                 size_t* value_p)
+{
+  size_t value = 0;
+  unsigned int shift = 0;
+
+  while(r->p < r->end) {
+    unsigned char byte = *r->p++;
+
+    value |= RASQAL_GOOD_CAST(size_t, byte & 0x7f) << shift;
+    if(!(byte & 0x80)) {
+      *value_p = value;
+      return 0;
+    }
+    shift += 7;
+  }
+
+  return 1;
+}
+
+
+/* returns new NUL-terminated string or NULL; empty string if length is 0 */
+static unsigned char*
+rasqal_results_cache_read_counted_string(rasqal_results_cache_reader* r,
+                                         size_t* len_p)
+{
+  unsigned char* string;
+  size_t len;
+
+  if(rasqal_results_cache_read_number(r, &len) ||
+     len > RASQAL_GOOD_CAST(size_t, r->end - r->p))
+    return NULL;
+
+  string = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!string)
+    return NULL;
+
+  memcpy(string, r->p, len);
+  string[len] = '\0';
+  r->p += len;
+
+  if(len_p)
+    *len_p = len;
+
+  return string;
+}
+
+
+static int
+rasqal_results_cache_read_literal(rasqal_world* world,
+                                  rasqal_results_cache_reader* r,
+                                  rasqal_literal** l_p)
+{
+  unsigned char* string;
+  unsigned char* language;
+  unsigned char* datatype;
+  raptor_uri* uri;
+  size_t len;
+  size_t tag;
+
+  *l_p = NULL;
+
+  if(rasqal_results_cache_read_number(r, &tag))
+    return 1;
+
+  switch(tag) {
+    case RASQAL_RESULTS_CACHE_LITERAL_NULL:
+      return 0;
+
+    case RASQAL_RESULTS_CACHE_LITERAL_URI:
+      string = rasqal_results_cache_read_counted_string(r, &len);
+      if(!string)
+        return 1;
+      uri = raptor_new_uri_from_counted_string(world->raptor_world_ptr,
+                                               string, len);
+      RASQAL_FREE(char*, string);
+      if(!uri)
+        return 1;
+      *l_p = rasqal_new_uri_literal(world, uri);
+      break;
+
+    case RASQAL_RESULTS_CACHE_LITERAL_BLANK:
+      string = rasqal_results_cache_read_counted_string(r, NULL);
+      if(!string)
+        return 1;
+      *l_p = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK, string);
+      break;
+
+    case RASQAL_RESULTS_CACHE_LITERAL_STRING:
+      string = rasqal_results_cache_read_counted_string(r, NULL);
+      if(!string)
+        return 1;
+
+      language = rasqal_results_cache_read_counted_string(r, &len);
+      if(language && !len) {
+        RASQAL_FREE(char*, language);
+        language = NULL;
+      } else if(!language) {
+        RASQAL_FREE(char*, string);
+        return 1;
+      }
+
+      uri = NULL;
+      datatype = rasqal_results_cache_read_counted_string(r, &len);
+      if(datatype && len)
+        uri = raptor_new_uri_from_counted_string(world->raptor_world_ptr,
+                                                 datatype, len);
+      if(!datatype || (len && !uri)) {
+        if(datatype)
+          RASQAL_FREE(char*, datatype);
+        if(language)
+          RASQAL_FREE(char*, language);
+        RASQAL_FREE(char*, string);
+        return 1;
+      }
+      RASQAL_FREE(char*, datatype);
+
+      /* takes ownership of string, language and uri */
+      *l_p = rasqal_new_string_literal_node(world, string,
+                                            RASQAL_GOOD_CAST(const char*, language),
+                                            uri);
+      break;
+
+    default:
+      return 1;
+  }
+
+  return (*l_p == NULL);
+}
+
+
+/*
+ * rasqal_results_cache_encode_rows:
+ * @b: buffer
+ * @rows: sequence of #rasqal_row
+ *
+ * INTERNAL - Encode the variables and values of stored result rows
+ *
+ * The variable names are taken from the rowsource of the first row.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_results_cache_encode_rows(rasqal_results_cache_buffer* b,
+                                 raptor_sequence* rows)
+{
+  int rows_count = raptor_sequence_size(rows);
+  int vars_count = 0;
+  int i;
+
+  if(rows_count > 0) {
+    rasqal_row* row = (rasqal_row*)raptor_sequence_get_at(rows, 0);
+
+    while(rasqal_row_get_variable_by_offset(row, vars_count))
+      vars_count++;
+
+    rasqal_results_cache_write_int(b, vars_count);
+    for(i = 0; i < vars_count; i++) {
+      rasqal_variable* v = rasqal_row_get_variable_by_offset(row, i);
+
+      rasqal_results_cache_write_int(b, RASQAL_GOOD_CAST(int, v->type));
+      rasqal_results_cache_write_counted_string(b, v->name, strlen(RASQAL_GOOD_CAST(const char*, v->name)));
+    }
+  } else
+    rasqal_results_cache_write_int(b, 0);
+
+  rasqal_results_cache_write_int(b, rows_count);
+  for(i = 0; i < rows_count; i++) {
+    rasqal_row* row = (rasqal_row*)raptor_sequence_get_at(rows, i);
+    int j;
+
+    rasqal_results_cache_write_int(b, row->size);
+    for(j = 0; j < row->size; j++) {
+      if(rasqal_results_cache_write_literal(b, row->values[j]))
+        return 1;
+    }
+  }
+
+  return b->failed;
+}
+
+
+/*
+ * rasqal_results_cache_decode_rows:
+ * @world: world
+ * @data: encoded variables and rows
+ * @data_len: length of @data
+ * @vars_table: variables table to add the variables to
+ *
+ * INTERNAL - Decode stored result rows
+ *
+ * Return value: new sequence of #rasqal_row or NULL on failure
+ */
+static raptor_sequence*
+rasqal_results_cache_decode_rows(rasqal_world* world,
+                                 const unsigned char* data, size_t data_len,
+                                 rasqal_variables_table* vars_table)
+{
+  rasqal_results_cache_reader r;
+  raptor_sequence* seq;
+  size_t vars_count;
+  size_t rows_count;
+  size_t i;
+
+  r.p = data;
+  r.end = data + data_len;
+
+  if(rasqal_results_cache_read_number(&r, &vars_count))
+    return NULL;
+
+  for(i = 0; i < vars_count; i++) {
+    unsigned char* name;
+    size_t type;
+    rasqal_variable* v;
+
+    if(rasqal_results_cache_read_number(&r, &type))
+      return NULL;
+    name = rasqal_results_cache_read_counted_string(&r, NULL);
+    if(!name)
+      return NULL;
+
+    v = rasqal_variables_table_add2(vars_table,
+                                    (rasqal_variable_type)type,
+                                    name, /* name len */ 0,
+                                    /* value */ NULL);
+    RASQAL_FREE(char*, name);
+    if(!v)
+      return NULL;
+    rasqal_free_variable(v);
+  }
+
+  if(rasqal_results_cache_read_number(&r, &rows_count))
+    return NULL;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                            (raptor_data_print_handler)rasqal_row_print);
+  if(!seq)
+    return NULL;
+
+  for(i = 0; i < rows_count; i++) {
+    rasqal_row* row;
+    size_t size;
+    int j;
+
+    if(rasqal_results_cache_read_number(&r, &size))
+      goto failed;
+
+    row = rasqal_new_row_for_size(world, RASQAL_GOOD_CAST(int, size));
+    if(!row)
+      goto failed;
+
+    row->offset = RASQAL_GOOD_CAST(int, i);
+    for(j = 0; j < row->size; j++) {
+      if(rasqal_results_cache_read_literal(world, &r, &row->values[j])) {
+        rasqal_free_row(row);
+        goto failed;
+      }
+    }
+
+    if(raptor_sequence_push(seq, row))
+      goto failed;
+  }
+
+  return seq;
+
+  failed:
+  raptor_free_sequence(seq);
+  return NULL;
+}
+
+
+/* for use with rasqal_expression_visit: non-0 if the result can
+ * differ between executions over the same data */
+static int
+rasqal_results_cache_volatile_visitor(void *user_data, rasqal_expression *e)
+{
+  switch(e->op) {
+    case RASQAL_EXPR_RAND:
+    case RASQAL_EXPR_BNODE:
+    case RASQAL_EXPR_UUID:
+    case RASQAL_EXPR_STRUUID:
+    case RASQAL_EXPR_NOW:
+    case RASQAL_EXPR_CURRENT_DATETIME:
+    case RASQAL_EXPR_FUNCTION:
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+
+static int
+rasqal_results_cache_volatile_sequence(raptor_sequence* seq)
+{
+  int i;
+
+  if(!seq)
+    return 0;
+
+  for(i = 0; i < raptor_sequence_size(seq); i++) {
+    rasqal_expression* e = (rasqal_expression*)raptor_sequence_get_at(seq, i);
+
+    if(rasqal_expression_visit(e, rasqal_results_cache_volatile_visitor, NULL))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_results_cache_volatile_select(rasqal_projection* projection,
+                                     rasqal_solution_modifier* modifier)
+{
+  int i;
+
+  if(projection && projection->variables) {
+    for(i = 0; i < raptor_sequence_size(projection->variables); i++) {
+      rasqal_variable* v;
+
+      v = (rasqal_variable*)raptor_sequence_get_at(projection->variables, i);
+      if(v && v->expression &&
+         rasqal_expression_visit(v->expression,
+                                 rasqal_results_cache_volatile_visitor, NULL))
+        return 1;
+    }
+  }
+
+  if(modifier &&
+     (rasqal_results_cache_volatile_sequence(modifier->group_conditions) ||
+      rasqal_results_cache_volatile_sequence(modifier->having_conditions) ||
+      rasqal_results_cache_volatile_sequence(modifier->order_conditions)))
+    return 1;
+
+  return 0;
+}
+
+
+static int
+rasqal_results_cache_volatile_graph_pattern(rasqal_graph_pattern* gp)
+{
+  int i;
+
+  /* results of a remote query can change at any time */
+  if(gp->op == RASQAL_GRAPH_PATTERN_OPERATOR_SERVICE)
+    return 1;
+
+  if(gp->filter_expression &&
+     rasqal_expression_visit(gp->filter_expression,
+                             rasqal_results_cache_volatile_visitor, NULL))
+    return 1;
+
+  /* sub-SELECT */
+  if(rasqal_results_cache_volatile_select(gp->projection, gp->modifier))
+    return 1;
+
+  if(gp->graph_patterns) {
+    for(i = 0; i < raptor_sequence_size(gp->graph_patterns); i++) {
+      rasqal_graph_pattern *sgp;
+
+      sgp = (rasqal_graph_pattern*)raptor_sequence_get_at(gp->graph_patterns, i);
+      if(rasqal_results_cache_volatile_graph_pattern(sgp))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_results_cache_make_key:
+ * @query: prepared query
+ * @key_len_p: pointer to store key length
+ *
+ * INTERNAL - Make the world results cache key for executing a query
+ *
+ * The key is the query key made when preparing, the LIMIT, OFFSET,
+ * features and bound parameters of the query and the flags and epoch
+ * of each data graph.  A query using functions such as RAND() or
+ * NOW() or SERVICE, a data graph that is not held in the world loaded
+ * graphs cache or another triples source has no key.
+ *
+ * Return value: new key or NULL if the results cannot be cached or on failure
+ */
+unsigned char*
+rasqal_results_cache_make_key(rasqal_query* query, size_t* key_len_p)
+{
+  rasqal_world* world = query->world;
+  rasqal_results_cache_buffer b;
+  int size;
+  int i;
+
+  if(!query->results_cache_key || !rasqal_raptor_is_triples_source(world))
+    return NULL;
+
+  if((query->query_graph_pattern &&
+      rasqal_results_cache_volatile_graph_pattern(query->query_graph_pattern)) ||
+     rasqal_results_cache_volatile_select(query->projection, query->modifier))
+    return NULL;
+
+  memset(&b, '\0', sizeof(b));
+
+  rasqal_results_cache_write_bytes(&b, query->results_cache_key,
+                                   query->results_cache_key_len);
+  rasqal_results_cache_write_int(&b, rasqal_query_get_limit(query));
+  rasqal_results_cache_write_int(&b, rasqal_query_get_offset(query));
+
+  for(i = 0; i <= RASQAL_FEATURE_LAST; i++)
+    rasqal_results_cache_write_int(&b, query->features[i]);
+
+  size = query->parameters ? raptor_sequence_size(query->parameters) : 0;
+  for(i = 0; i < size; i++) {
+    rasqal_query_parameter* parameter;
+    const unsigned char* name;
+
+    parameter = (rasqal_query_parameter*)raptor_sequence_get_at(query->parameters, i);
+    if(!parameter->value)
+      continue;
+
+    name = parameter->variable->name;
+    rasqal_results_cache_write_counted_string(&b, name, strlen(RASQAL_GOOD_CAST(const char*, name)));
+    if(rasqal_results_cache_write_literal(&b, parameter->value))
+      goto failed;
+  }
+
+  size = raptor_sequence_size(query->data_graphs);
+  rasqal_results_cache_write_int(&b, size);
+  for(i = 0; i < size; i++) {
+    rasqal_data_graph* dg;
+    unsigned long epoch;
+
+    dg = (rasqal_data_graph*)raptor_sequence_get_at(query->data_graphs, i);
+    epoch = rasqal_raptor_data_graph_epoch(world, dg);
+    if(!epoch)
+      goto failed;
+
+    rasqal_results_cache_write_int(&b, dg->flags);
+    rasqal_results_cache_write_number(&b, RASQAL_GOOD_CAST(size_t, epoch));
+  }
+
+  if(b.failed)
+    goto failed;
+
+  *key_len_p = b.len;
+
+  return b.data;
+
+  failed:
+  if(b.data)
+    RASQAL_FREE(char*, b.data);
+  return NULL;
+}
+
+
+static unsigned long
+rasqal_results_cache_hash(const unsigned char* key, size_t key_len)
+{
+  /* FNV-1a */
+  unsigned long hash = 2166136261UL;
+  size_t i;
+
+  for(i = 0; i < key_len; i++) {
+    hash ^= key[i];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+
+static size_t
+rasqal_results_cache_entry_size(rasqal_results_cache_entry* entry)
+{
+  return sizeof(*entry) + entry->key_len + entry->data_len;
+}
+
+
+static void
+rasqal_free_results_cache_entry(rasqal_results_cache_entry* entry)
+{
+  if(entry->data)
+    RASQAL_FREE(char*, entry->data);
+
+  if(entry->key)
+    RASQAL_FREE(char*, entry->key);
+
+  RASQAL_FREE(rasqal_results_cache_entry, entry);
+}
+
+
+/*
+ * rasqal_results_cache_get:
+ * @world: world
+ * @key: key from rasqal_results_cache_make_key()
+ * @key_len: length of @key
+ * @vars_table: variables table to add the result variables to
+ *
+ * INTERNAL - Find stored query results in the world results cache
+ *
+ * Counts a hit or a miss.
+ *
+ * Return value: new sequence of #rasqal_row or NULL if not cached
+ */
+raptor_sequence*
+rasqal_results_cache_get(rasqal_world* world, const unsigned char* key,
+                         size_t key_len, rasqal_variables_table* vars_table)
+{
+  rasqal_results_cache_entry** prev_p;
+  rasqal_results_cache_entry* entry;
+  unsigned long hash = rasqal_results_cache_hash(key, key_len);
+
+  for(prev_p = &world->results_cache; (entry = *prev_p); prev_p = &entry->next) {
+    if(entry->hash == hash && entry->key_len == key_len &&
+       !memcmp(entry->key, key, key_len)) {
+      raptor_sequence* seq;
+
+      seq = rasqal_results_cache_decode_rows(world, entry->data,
+                                             entry->data_len, vars_table);
+      if(!seq)
+        break;
+
+      /* move to the front as the most recently used */
+      *prev_p = entry->next;
+      entry->next = world->results_cache;
+      world->results_cache = entry;
+
+      world->results_cache_hits++;
+      return seq;
+    }
+  }
+
+  world->results_cache_misses++;
+  return NULL;
+}
+
+
+/* remove least recently used entries beyond @size bytes */
+static void
+rasqal_results_cache_trim(rasqal_world* world, size_t size)
+{
+  rasqal_results_cache_entry** prev_p = &world->results_cache;
+  size_t used = 0;
+
+  while(*prev_p) {
+    size_t entry_size = rasqal_results_cache_entry_size(*prev_p);
+
+    if(used + entry_size > size)
+      break;
+    used += entry_size;
+    prev_p = &(*prev_p)->next;
+  }
+
+  while(*prev_p) {
+    rasqal_results_cache_entry* entry = *prev_p;
+
+    *prev_p = entry->next;
+    world->results_cache_used -= rasqal_results_cache_entry_size(entry);
+    rasqal_free_results_cache_entry(entry);
+  }
+}
+
+
+/*
+ * rasqal_results_cache_add:
+ * @world: world
+ * @key: key from rasqal_results_cache_make_key() (ownership taken)
+ * @key_len: length of @key
+ * @rows: stored result rows
+ *
+ * INTERNAL - Add stored query results to the world results cache
+ *
+ * Results larger than the whole cache are not added.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_results_cache_add(rasqal_world* world, unsigned char* key,
+                         size_t key_len, raptor_sequence* rows)
+{
+  rasqal_results_cache_entry* entry;
+  rasqal_results_cache_buffer b;
+  size_t entry_size;
+
+  memset(&b, '\0', sizeof(b));
+
+  if(rasqal_results_cache_encode_rows(&b, rows))
+    goto failed;
+
+  entry_size = sizeof(*entry) + key_len + b.len;
+  if(entry_size > world->results_cache_size) {
+    RASQAL_FREE(char*, b.data);
+    RASQAL_FREE(char*, key);
+    return 0;
+  }
+
+  entry = RASQAL_CALLOC(rasqal_results_cache_entry*, 1, sizeof(*entry));
+  if(!entry)
+    goto failed;
+
+  entry->key = key;
+  entry->key_len = key_len;
+  entry->hash = rasqal_results_cache_hash(key, key_len);
+  entry->data = b.data;
+  entry->data_len = b.len;
+
+  entry->next = world->results_cache;
+  world->results_cache = entry;
+  world->results_cache_used += entry_size;
+
+  rasqal_results_cache_trim(world, world->results_cache_size);
+
+  return 0;
+
+  failed:
+  if(b.data)
+    RASQAL_FREE(char*, b.data);
+  RASQAL_FREE(char*, key);
+  return 1;
+}
+
+
+/**
+ * rasqal_world_set_results_cache_size:
+ * @world: world
+ * @size: maximum number of bytes of query results to keep or 0 to disable
+ *
+ * Set the size of the world cache of query results.
+ *
+ * When the cache is enabled, executing a query that stores its
+ * results (see rasqal_query_set_store_results()) first looks for the
+ * results of an earlier execution of the same query over the same
+ * data.  The key is the query language, base URI and query string as
+ * normalised for rasqal_world_set_query_cache_size(), the LIMIT,
+ * OFFSET, features and bound parameters of the query and the version
+ * of each data graph.  On a hit the result rows are read from the
+ * cache and the query is not evaluated.
+ *
+ * Only queries prepared while the cache is enabled that use the
+ * default triples source are cached.  Their data graphs must be read
+ * from URIs and kept loaded in the world loaded graphs cache, such as
+ * with rasqal_world_preload_data_graph(), and they must not use
+ * RAND(), NOW(), BNODE(), UUID(), STRUUID(), extension functions or
+ * SERVICE.
+ *
+ * Results are kept in a compact encoded form and the least recently
+ * used are removed when they take more than @size bytes.  The cache
+ * is disabled by default.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_world_set_results_cache_size(rasqal_world* world, size_t size)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  world->results_cache_size = size;
+  rasqal_results_cache_trim(world, size);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_get_results_cache_counts:
+ * @world: world
+ * @hits_p: pointer to store the number of executions answered from the cache (or NULL)
+ * @misses_p: pointer to store the number of cacheable executions not found in the cache (or NULL)
+ *
+ * Get the hit and miss counts of the world cache of query results.
+ *
+ * See rasqal_world_set_results_cache_size().
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_world_get_results_cache_counts(rasqal_world* world,
+                                      unsigned long* hits_p,
+                                      unsigned long* misses_p)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  if(hits_p)
+    *hits_p = world->results_cache_hits;
+  if(misses_p)
+    *misses_p = world->results_cache_misses;
+
+  return 0;
+}
@@ -175,6 +175,8 @@ rasqal_free_row(rasqal_row* row)
     }
     RASQAL_FREE(array, row->order_values);
   }
+  if(row->order_key)
+    RASQAL_FREE(char*, row->order_key);
 
   if(row->rowsource)
     rasqal_free_rowsource(row->rowsource);
@@ -720,3 +722,45 @@ rasqal_row_get_variable_by_offset(rasqal_row* row, int offset)
 
   return rasqal_rowsource_get_variable_by_offset(row->rowsource, offset);
 }
+
+
+/*
+ * rasqal_row_get_size_estimate:
+ * @row: row
+ *
+ * INTERNAL - Estimate the memory used by a row
+ *
+ * Values are counted as if they were not shared with other rows.
+ *
+ * Return value: estimated size in bytes
+ */
+size_t
+rasqal_row_get_size_estimate(rasqal_row* row)
+{
+  size_t size;
+  int i;
+
+  size = sizeof(*row);
+
+  if(row->size > 0) {
+    size += RASQAL_GOOD_CAST(size_t, row->size) * sizeof(rasqal_literal*);
+    for(i = 0; i < row->size; i++) {
+      rasqal_literal* l = row->values[i];
+      if(l)
+        size += sizeof(*l) + l->string_len;
+    }
+  }
+
+  if(row->order_size > 0) {
+    size += RASQAL_GOOD_CAST(size_t, row->order_size) * sizeof(rasqal_literal*);
+    for(i = 0; i < row->order_size; i++) {
+      rasqal_literal* l = row->order_values[i];
+      if(l)
+        size += sizeof(*l) + l->string_len;
+    }
+  }
+
+  size += row->order_key_len;
+
+  return size;
+}
@@ -91,6 +91,11 @@ rasqal_new_rowsource_from_handler(rasqal_world* world,
   rowsource->size = 0;
 
   rowsource->generate_group = 0;
+
+  rowsource->limit = -1;
+
+  if(query && query->memory_account)
+    rowsource->memory_account = rasqal_new_memory_account(query->memory_account);
   
   if(vars_table)
     rowsource->vars_table = rasqal_new_variables_table_from_variables_table(vars_table);
@@ -161,6 +166,9 @@ rasqal_free_rowsource(rasqal_rowsource *rowsource)
   if(rowsource->rows_sequence)
     raptor_free_sequence(rowsource->rows_sequence);
 
+  if(rowsource->memory_account)
+    rasqal_free_memory_account(rowsource->memory_account);
+
   RASQAL_FREE(rasqal_rowsource, rowsource);
 }
 
@@ -250,6 +258,9 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
   if(!rowsource || rowsource->finished)
     return NULL;
 
+  if(rasqal_query_check_budget(rowsource->query))
+    return NULL;
+
   if(rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVED_ROWS) {
 	int i;
 
@@ -291,12 +302,23 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
     if(row)
       row = rasqal_new_row_from_row(row);
     /* row is owned by us */
+  } else if(rowsource->limit >= 0 && rowsource->count >= rowsource->limit) {
+    /* no reader needs more rows so end early; any saved rows are
+     * complete for the next reset */
+    row = NULL;
   } else {
     if(rasqal_rowsource_ensure_variables(rowsource))
       return NULL;
 
     if(rowsource->handler->read_row) {
-      row = rowsource->handler->read_row(rowsource, rowsource->user_data);
+      if(rowsource->memory_account) {
+        rasqal_memory_account* previous_account;
+
+        previous_account = rasqal_memory_account_enter(rowsource->memory_account);
+        row = rowsource->handler->read_row(rowsource, rowsource->user_data);
+        rasqal_memory_account_leave(previous_account);
+      } else
+        row = rowsource->handler->read_row(rowsource, rowsource->user_data);
       /* row is owned by us */
 
       if(row && rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVE_ROWS) {
@@ -308,6 +330,11 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
         /* copy to save it away */
         row = rasqal_new_row_from_row(row);
         raptor_sequence_push(rowsource->rows_sequence, row);
+
+        if(rasqal_query_budget_add_row(rowsource->query, row)) {
+          rasqal_free_row(row);
+          return NULL;
+        }
       }
     } else {
       if(!rowsource->rows_sequence) {
@@ -412,8 +439,18 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
   if(rasqal_rowsource_ensure_variables(rowsource))
     return NULL;
 
-  if(rowsource->handler->read_all_rows) {
-    seq = rowsource->handler->read_all_rows(rowsource, rowsource->user_data);
+  /* With a row limit hint, read rows one by one if possible so that
+   * reading stops at the limit */
+  if(rowsource->handler->read_all_rows &&
+     !(rowsource->limit >= 0 && rowsource->handler->read_row)) {
+    if(rowsource->memory_account) {
+      rasqal_memory_account* previous_account;
+
+      previous_account = rasqal_memory_account_enter(rowsource->memory_account);
+      seq = rowsource->handler->read_all_rows(rowsource, rowsource->user_data);
+      rasqal_memory_account_leave(previous_account);
+    } else
+      seq = rowsource->handler->read_all_rows(rowsource, rowsource->user_data);
     if(!seq) {
       seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
                                 (raptor_data_print_handler)rasqal_row_print);
@@ -450,6 +487,14 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
       row->group_id = 0;
 
     raptor_sequence_push(seq, row);
+
+    if(rasqal_query_budget_add_row(rowsource->query, row))
+      break;
+  }
+
+  if(rowsource->query && rowsource->query->budget.aborted) {
+    raptor_free_sequence(seq);
+    return NULL;
   }
 
   done:
@@ -784,6 +829,49 @@ rasqal_rowsource_set_requirements(rasqal_rowsource* rowsource, unsigned int flag
 }
 
 
+/*
+ * rasqal_rowsource_set_limit:
+ * @rowsource: rowsource
+ * @limit: maximum number of rows that will be read (or <0 for no limit)
+ *
+ * INTERNAL - Set a row limit hint on a rowsource
+ *
+ * The hint is the most rows any reader will take from @rowsource
+ * between resets.  The rowsource ends after returning @limit rows,
+ * which bounds saved rows and rasqal_rowsource_read_all_rows().
+ *
+ * Rowsources that return a known number of rows per inner row, such
+ * as project and union, pass a hint on to their inner rowsources with
+ * the set_limit handler.  Others such as filter, sort or distinct do
+ * not, which stops the hint there.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_rowsource_set_limit(rasqal_rowsource* rowsource, int limit)
+{
+  if(!rowsource)
+    return 1;
+
+  if(limit < 0)
+    return 0;
+
+  /* keep the smallest hint */
+  if(rowsource->limit >= 0 && rowsource->limit <= limit)
+    return 0;
+
+  RASQAL_DEBUG4("setting %s rowsource %p row limit to %d\n",
+                rowsource->handler->name, rowsource, limit);
+  rowsource->limit = limit;
+
+  if(rowsource->handler->set_limit)
+    return rowsource->handler->set_limit(rowsource, rowsource->user_data,
+                                         limit);
+
+  return 0;
+}
+
+
 int
 rasqal_rowsource_request_grouping(rasqal_rowsource* rowsource)
 {
@@ -149,6 +149,13 @@ typedef struct
   /* literal for computation (e.g. current MAX, MIN seen) */
   rasqal_literal* l;
 
+  /* sort key of @l for MAX and MIN: buffer, size, key length (0 if
+   * none) and non-0 if the key is exact */
+  unsigned char* key;
+  size_t key_size;
+  size_t key_len;
+  int key_exact;
+
   /* number of steps executed - used for AVG in calculating result */
   int count;
 
@@ -163,10 +170,7 @@ typedef struct
 } rasqal_builtin_agg_expression_execute;
 
 
-static void rasqal_builtin_agg_expression_execute_finish(void* user_data);  
-
-
-static void*
+void*
 rasqal_builtin_agg_expression_execute_init(rasqal_world *world,
                                            rasqal_expression* expr)
 {
@@ -197,7 +201,7 @@ rasqal_builtin_agg_expression_execute_init(rasqal_world *world,
 }
 
 
-static void
+void
 rasqal_builtin_agg_expression_execute_finish(void* user_data)
 {
   rasqal_builtin_agg_expression_execute* b;
@@ -207,6 +211,9 @@ rasqal_builtin_agg_expression_execute_finish(void* user_data)
   if(b->l)
     rasqal_free_literal(b->l);
 
+  if(b->key)
+    RASQAL_FREE(char*, b->key);
+
   if(b->sb)
     raptor_free_stringbuffer(b->sb);
   
@@ -228,6 +235,7 @@ rasqal_builtin_agg_expression_execute_reset(void* user_data)
     rasqal_free_literal(b->l);
     b->l = 0;
   }
+  b->key_len = 0;
 
   if(b->sb) {
     raptor_free_stringbuffer(b->sb);
@@ -240,7 +248,93 @@ rasqal_builtin_agg_expression_execute_reset(void* user_data)
 }
 
 
+/*
+ * rasqal_builtin_agg_expression_set_key:
+ * @b: aggregate execution
+ * @l: new MAX or MIN value
+ *
+ * INTERNAL - Store the sort key of a new MAX or MIN value
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_builtin_agg_expression_set_key(rasqal_builtin_agg_expression_execute* b,
+                                      rasqal_literal* l)
+{
+  size_t len;
+
+  b->key_len = 0;
+  b->key_exact = 1;
+
+  len = rasqal_literal_sort_key(l, NULL, NULL);
+  if(!len)
+    return 0;
+
+  if(len > b->key_size) {
+    if(b->key)
+      RASQAL_FREE(char*, b->key);
+    b->key_size = 0;
+
+    b->key = RASQAL_MALLOC(unsigned char*, len);
+    if(!b->key)
+      return 1;
+    b->key_size = len;
+  }
+
+  b->key_len = rasqal_literal_sort_key(l, b->key, &b->key_exact);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_builtin_agg_expression_compare:
+ * @b: aggregate execution
+ * @l: literal
+ *
+ * INTERNAL - Compare the current MAX or MIN value to a literal
+ *
+ * Uses sort keys, in SPARQL ORDER BY order, when both values have
+ * one so most comparisons need no promoted literals.
+ *
+ * Return value: <0, 0 or >0 comparison
+ */
 static int
+rasqal_builtin_agg_expression_compare(rasqal_builtin_agg_expression_execute* b,
+                                      rasqal_literal* l)
+{
+  unsigned char buffer[64];
+  unsigned char* key = buffer;
+  size_t len;
+  int exact = 1;
+  int result;
+
+  len = rasqal_literal_sort_key(l, NULL, NULL);
+  if(!len || !b->key_len)
+    return rasqal_literal_compare(b->l, l, 0, &b->error);
+
+  if(len > sizeof(buffer)) {
+    key = RASQAL_MALLOC(unsigned char*, len);
+    if(!key) {
+      b->error = 1;
+      return 0;
+    }
+  }
+
+  rasqal_literal_sort_key(l, key, &exact);
+  result = memcmp(b->key, key, (len < b->key_len) ? len : b->key_len);
+
+  if(key != buffer)
+    RASQAL_FREE(char*, key);
+
+  if(!result && !(exact && b->key_exact))
+    result = rasqal_literal_compare(b->l, l, RASQAL_COMPARE_XQUERY, &b->error);
+
+  return result;
+}
+
+
+int
 rasqal_builtin_agg_expression_execute_step(void* user_data,
                                            raptor_sequence* literals)
 {
@@ -295,23 +389,26 @@ rasqal_builtin_agg_expression_execute_step(void* user_data,
     }
   
     
-    if(!b->l)
+    if(!b->l) {
       result = rasqal_new_literal_from_literal(l);
-    else {
+      if((b->expr->op == RASQAL_EXPR_MIN || b->expr->op == RASQAL_EXPR_MAX) &&
+         rasqal_builtin_agg_expression_set_key(b, l))
+        b->error = 1;
+    } else {
       if(b->expr->op == RASQAL_EXPR_SUM || b->expr->op == RASQAL_EXPR_AVG) {
         result = rasqal_literal_add(b->l, l, &b->error);
-      } else if(b->expr->op == RASQAL_EXPR_MIN) {
-        int cmp = rasqal_literal_compare(b->l, l, 0, &b->error);
+      } else if(b->expr->op == RASQAL_EXPR_MIN ||
+                b->expr->op == RASQAL_EXPR_MAX) {
+        int cmp = rasqal_builtin_agg_expression_compare(b, l);
+        if(b->expr->op == RASQAL_EXPR_MAX)
+          cmp = -cmp;
         if(cmp <= 0)
           result = rasqal_new_literal_from_literal(b->l);
-        else
-          result = rasqal_new_literal_from_literal(l);
-      } else if(b->expr->op == RASQAL_EXPR_MAX) {
-        int cmp = rasqal_literal_compare(b->l, l, 0, &b->error);
-        if(cmp >= 0)
-          result = rasqal_new_literal_from_literal(b->l);
-        else
+        else {
           result = rasqal_new_literal_from_literal(l);
+          if(rasqal_builtin_agg_expression_set_key(b, l))
+            b->error = 1;
+        }
       } else {
         RASQAL_FATAL2("Builtin aggregation operation %u is not implemented",
                       b->expr->op);
@@ -336,7 +433,7 @@ rasqal_builtin_agg_expression_execute_step(void* user_data,
 }
 
 
-static rasqal_literal*
+rasqal_literal*
 rasqal_builtin_agg_expression_execute_result(void* user_data)
 {
   rasqal_builtin_agg_expression_execute* b;
@@ -786,6 +883,7 @@ static const rasqal_rowsource_handler rasqal_aggregation_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_aggregation_rowsource_get_inner_rowsource,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
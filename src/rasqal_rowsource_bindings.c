@@ -150,6 +150,7 @@ static const rasqal_rowsource_handler rasqal_bindings_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin =       */ NULL,
+  /* .set_limit =        */ NULL,
 };
 
 
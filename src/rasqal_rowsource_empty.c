@@ -112,6 +112,7 @@ static const rasqal_rowsource_handler rasqal_empty_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -0,0 +1,522 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_rowsource_exchange.c - Rasqal exchange rowsource class
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+#include <pthread.h>
+#endif
+
+#include <raptor.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_SYNC_BUILTINS)
+
+/* rows a worker thread may evaluate ahead of the reader */
+#define RASQAL_EXCHANGE_QUEUE_SIZE 256
+
+/*
+ * An exchange rowsource evaluates a subtree of the query algebra on a
+ * worker thread and returns its rows on the calling thread.
+ *
+ * The subtree is evaluated by a worker query: the query prepared
+ * again by rasqal_new_worker_query() so the thread binds its own
+ * variables and evaluates its own triple patterns.  Only the loaded
+ * graphs and their literals are shared; literal reference counts are
+ * atomic and matching only reads them.
+ *
+ * The thread starts when the rowsource is created so several exchange
+ * rowsources under one UNION are evaluated at the same time.  It puts
+ * the values of each row in a bounded queue and waits while the queue
+ * is full.
+ */
+typedef struct
+{
+  /* worker query and its triples source */
+  rasqal_query* worker_query;
+  rasqal_triples_source* triples_source;
+
+  /* worker query variables of the subtree rows */
+  raptor_sequence* worker_vars_seq;
+
+  /* rowsource of the subtree in the worker query; only used by the
+   * thread while it runs */
+  rasqal_rowsource* inner;
+
+  /* query variables of the rows returned */
+  raptor_sequence* vars_seq;
+  int size;
+
+  pthread_t thread;
+  int running;
+
+  pthread_mutex_t lock;
+
+  /* signalled when a row is added or taken and when the thread
+   * finishes or must stop */
+  pthread_cond_t cond;
+
+  /* ring of row values arrays */
+  rasqal_literal** queue[RASQAL_EXCHANGE_QUEUE_SIZE];
+  int queue_head;
+  int queue_count;
+
+  /* set by the thread when the subtree has no more rows */
+  int done;
+
+  /* set by the thread if the worker query was aborted or the row
+   * values could not be stored */
+  int aborted;
+  int failed;
+
+  /* set to make the thread finish */
+  int stop;
+
+  /* row offset for read_row() */
+  int offset;
+} rasqal_exchange_rowsource_context;
+
+
+static void*
+rasqal_exchange_rowsource_worker(void* user_data)
+{
+  rasqal_exchange_rowsource_context* con;
+
+  con = (rasqal_exchange_rowsource_context*)user_data;
+
+  while(1) {
+    rasqal_row* row;
+    rasqal_literal** values = NULL;
+    int i;
+
+    row = rasqal_rowsource_read_row(con->inner);
+    if(row) {
+      /* take the values out of the row: the row belongs to the
+       * worker query */
+      values = RASQAL_CALLOC(rasqal_literal**,
+                             RASQAL_GOOD_CAST(size_t, con->size + 1),
+                             sizeof(rasqal_literal*));
+      if(values) {
+        for(i = 0; i < con->size && i < row->size; i++) {
+          values[i] = row->values[i];
+          row->values[i] = NULL;
+        }
+      }
+      rasqal_free_row(row);
+    }
+
+    pthread_mutex_lock(&con->lock);
+
+    if(!values) {
+      con->aborted = con->worker_query->budget.aborted;
+      con->failed = (row != NULL);
+      con->done = 1;
+      pthread_cond_broadcast(&con->cond);
+      pthread_mutex_unlock(&con->lock);
+      break;
+    }
+
+    while(!con->stop && con->queue_count == RASQAL_EXCHANGE_QUEUE_SIZE)
+      pthread_cond_wait(&con->cond, &con->lock);
+
+    if(con->stop) {
+      pthread_mutex_unlock(&con->lock);
+      for(i = 0; i < con->size; i++) {
+        if(values[i])
+          rasqal_free_literal(values[i]);
+      }
+      RASQAL_FREE(rasqal_literal**, values);
+      break;
+    }
+
+    con->queue[(con->queue_head + con->queue_count) % RASQAL_EXCHANGE_QUEUE_SIZE] = values;
+    con->queue_count++;
+    pthread_cond_broadcast(&con->cond);
+    pthread_mutex_unlock(&con->lock);
+  }
+
+  return NULL;
+}
+
+
+static int
+rasqal_exchange_rowsource_start(rasqal_exchange_rowsource_context* con)
+{
+  con->done = 0;
+  con->aborted = 0;
+  con->failed = 0;
+  con->stop = 0;
+
+  if(rasqal_query_budget_start(con->worker_query))
+    return 1;
+
+  if(pthread_create(&con->thread, NULL, rasqal_exchange_rowsource_worker, con))
+    return 1;
+
+  con->running = 1;
+
+  return 0;
+}
+
+
+/* stop the thread and drop the rows it queued */
+static void
+rasqal_exchange_rowsource_stop(rasqal_exchange_rowsource_context* con)
+{
+  if(con->running) {
+    pthread_mutex_lock(&con->lock);
+    con->stop = 1;
+    pthread_cond_broadcast(&con->cond);
+    pthread_mutex_unlock(&con->lock);
+
+    /* end a long evaluation between rows too; the worker query stops
+     * without an error */
+    con->worker_query->cancelled = 1;
+
+    pthread_join(con->thread, NULL);
+    con->running = 0;
+  }
+
+  while(con->queue_count) {
+    rasqal_literal** values = con->queue[con->queue_head];
+    int i;
+
+    for(i = 0; i < con->size; i++) {
+      if(values[i])
+        rasqal_free_literal(values[i]);
+    }
+    RASQAL_FREE(rasqal_literal**, values);
+
+    con->queue_head = (con->queue_head + 1) % RASQAL_EXCHANGE_QUEUE_SIZE;
+    con->queue_count--;
+  }
+  con->queue_head = 0;
+}
+
+
+static int
+rasqal_exchange_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_exchange_rowsource_context* con;
+
+  con = (rasqal_exchange_rowsource_context*)user_data;
+
+  rasqal_exchange_rowsource_stop(con);
+
+  pthread_cond_destroy(&con->cond);
+  pthread_mutex_destroy(&con->lock);
+
+  if(con->inner)
+    rasqal_free_rowsource(con->inner);
+
+  if(con->worker_vars_seq)
+    raptor_free_sequence(con->worker_vars_seq);
+
+  if(con->vars_seq)
+    raptor_free_sequence(con->vars_seq);
+
+  if(con->triples_source)
+    rasqal_free_triples_source(con->triples_source);
+
+  if(con->worker_query)
+    rasqal_free_query(con->worker_query);
+
+  RASQAL_FREE(rasqal_exchange_rowsource_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_exchange_rowsource_ensure_variables(rasqal_rowsource* rowsource,
+                                           void *user_data)
+{
+  rasqal_exchange_rowsource_context* con;
+  rasqal_variable* v;
+  int i;
+
+  con = (rasqal_exchange_rowsource_context*)user_data;
+
+  rowsource->size = 0;
+  for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(con->vars_seq, i)); i++) {
+    if(rasqal_rowsource_add_variable(rowsource, v) < 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static rasqal_row*
+rasqal_exchange_rowsource_read_row(rasqal_rowsource* rowsource,
+                                   void *user_data)
+{
+  rasqal_exchange_rowsource_context* con;
+  rasqal_query* query = rowsource->query;
+  rasqal_literal** values = NULL;
+  rasqal_row* row;
+  int aborted;
+  int failed;
+  int i;
+
+  con = (rasqal_exchange_rowsource_context*)user_data;
+
+  /* restart after a reset */
+  if(!con->running && !con->done && rasqal_exchange_rowsource_start(con)) {
+    rasqal_query_budget_abort(query, "cannot start a worker thread");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&con->lock);
+  while(!con->queue_count && !con->done)
+    pthread_cond_wait(&con->cond, &con->lock);
+
+  if(con->queue_count) {
+    values = con->queue[con->queue_head];
+    con->queue_head = (con->queue_head + 1) % RASQAL_EXCHANGE_QUEUE_SIZE;
+    con->queue_count--;
+    pthread_cond_broadcast(&con->cond);
+  }
+  aborted = con->aborted;
+  failed = con->failed;
+  pthread_mutex_unlock(&con->lock);
+
+  if(!values) {
+    /* the worker query stops on cancellation of this query or at its
+     * deadline; report it here before the deadline is seen */
+    if(aborted && !rasqal_query_check_budget(query))
+      rasqal_query_budget_abort(query, "timeout");
+    else if(failed)
+      rasqal_query_budget_abort(query, "out of memory in a worker thread");
+    return NULL;
+  }
+
+  row = rasqal_new_row(rowsource);
+  if(row) {
+    for(i = 0; i < row->size && i < con->size; i++) {
+      row->values[i] = values[i];
+      values[i] = NULL;
+    }
+    row->offset = con->offset++;
+  }
+
+  for(i = 0; i < con->size; i++) {
+    if(values[i])
+      rasqal_free_literal(values[i]);
+  }
+  RASQAL_FREE(rasqal_literal**, values);
+
+  return row;
+}
+
+
+static int
+rasqal_exchange_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_exchange_rowsource_context* con;
+
+  con = (rasqal_exchange_rowsource_context*)user_data;
+
+  rasqal_exchange_rowsource_stop(con);
+
+  /* the thread is started again by the next read */
+  con->done = 0;
+  con->offset = 0;
+
+  return rasqal_rowsource_reset(con->inner);
+}
+
+
+static const rasqal_rowsource_handler rasqal_exchange_rowsource_handler = {
+  /* .version = */ 1,
+  "exchange",
+  /* .init = */ NULL,
+  /* .finish = */ rasqal_exchange_rowsource_finish,
+  /* .ensure_variables = */ rasqal_exchange_rowsource_ensure_variables,
+  /* .read_row = */ rasqal_exchange_rowsource_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ rasqal_exchange_rowsource_reset,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ NULL,
+  /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
+};
+
+
+/* copy @vars_seq mapping each variable to the one of the same name
+ * in @vars_table */
+static raptor_sequence*
+rasqal_exchange_rowsource_map_variables(raptor_sequence* vars_seq,
+                                        rasqal_variables_table* vars_table)
+{
+  raptor_sequence* seq;
+  rasqal_variable* v;
+  int i;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                            (raptor_data_print_handler)rasqal_variable_print);
+  if(!seq)
+    return NULL;
+
+  for(i = 0; (v = (rasqal_variable*)raptor_sequence_get_at(vars_seq, i)); i++) {
+    rasqal_variable* v2;
+
+    v2 = rasqal_variables_table_get_by_name(vars_table, v->type, v->name);
+    if(!v2 ||
+       raptor_sequence_push(seq, rasqal_new_variable_from_variable(v2))) {
+      raptor_free_sequence(seq);
+      return NULL;
+    }
+  }
+
+  return seq;
+}
+
+
+/**
+ * rasqal_new_exchange_rowsource:
+ * @world: world object
+ * @query: query object
+ * @node: algebra node to evaluate on a worker thread
+ *
+ * INTERNAL - create a new exchange rowsource
+ *
+ * Only a basic graph pattern of the query triples without a filter
+ * can be evaluated on a worker thread: it binds no values of @query
+ * and only reads the shared graphs.  The query must have a query
+ * string and no bound parameters.
+ *
+ * Return value: new rowsource or NULL if @node cannot be evaluated on
+ * a worker thread or on failure
+ */
+rasqal_rowsource*
+rasqal_new_exchange_rowsource(rasqal_world *world,
+                              rasqal_query* query,
+                              rasqal_algebra_node* node)
+{
+  rasqal_exchange_rowsource_context* con;
+  rasqal_rowsource* rowsource;
+  raptor_sequence* triples;
+  int flags = 0;
+
+  if(node->op != RASQAL_ALGEBRA_OPERATOR_BGP || node->expr ||
+     !node->triples || node->start_column < 0 ||
+     node->triples != rasqal_query_get_triple_sequence(query) ||
+     query->parameters || !query->query_string)
+    return NULL;
+
+  con = RASQAL_CALLOC(rasqal_exchange_rowsource_context*, 1, sizeof(*con));
+  if(!con)
+    return NULL;
+
+  if(pthread_mutex_init(&con->lock, NULL)) {
+    RASQAL_FREE(rasqal_exchange_rowsource_context, con);
+    return NULL;
+  }
+  if(pthread_cond_init(&con->cond, NULL)) {
+    pthread_mutex_destroy(&con->lock);
+    RASQAL_FREE(rasqal_exchange_rowsource_context, con);
+    return NULL;
+  }
+
+  con->worker_query = rasqal_new_worker_query(query);
+  if(!con->worker_query)
+    goto failed;
+
+  /* prepared from the same query string so the columns are the same */
+  triples = rasqal_query_get_triple_sequence(con->worker_query);
+  if(!triples || raptor_sequence_size(triples) <= node->end_column)
+    goto failed;
+
+  if(node->vars_seq) {
+    con->worker_vars_seq = rasqal_exchange_rowsource_map_variables(node->vars_seq,
+                                                                   con->worker_query->vars_table);
+    if(!con->worker_vars_seq)
+      goto failed;
+  }
+
+  /* the graphs are loaded or shared on this thread */
+  con->triples_source = rasqal_new_triples_source(con->worker_query);
+  if(!con->triples_source)
+    goto failed;
+
+  con->inner = rasqal_new_triples_rowsource(world, con->worker_query,
+                                            con->triples_source,
+                                            triples,
+                                            node->start_column,
+                                            node->end_column,
+                                            NULL, con->worker_vars_seq);
+  if(!con->inner || rasqal_rowsource_ensure_variables(con->inner))
+    goto failed;
+
+  con->size = rasqal_rowsource_get_size(con->inner);
+  con->vars_seq = rasqal_exchange_rowsource_map_variables(con->inner->variables_sequence,
+                                                          query->vars_table);
+  if(!con->vars_seq)
+    goto failed;
+
+  rowsource = rasqal_new_rowsource_from_handler(world, query,
+                                                con,
+                                                &rasqal_exchange_rowsource_handler,
+                                                query->vars_table,
+                                                flags);
+  if(!rowsource)
+    return NULL;
+
+  if(rasqal_exchange_rowsource_start(con)) {
+    rasqal_free_rowsource(rowsource);
+    return NULL;
+  }
+
+  return rowsource;
+
+  failed:
+  rasqal_exchange_rowsource_finish(NULL, con);
+  return NULL;
+}
+
+#else
+
+rasqal_rowsource*
+rasqal_new_exchange_rowsource(rasqal_world *world,
+                              rasqal_query* query,
+                              rasqal_algebra_node* node)
+{
+  /* rows are evaluated on the calling thread */
+  return NULL;
+}
+
+#endif
@@ -203,6 +203,7 @@ static const rasqal_rowsource_handler rasqal_filter_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_filter_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .set_limit =        */ NULL,
 };
 
 
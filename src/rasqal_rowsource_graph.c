@@ -89,6 +89,10 @@ typedef struct
 
   int finished;
 
+  /* non-0 if the inner rowsource binds the variable while matching
+   * all the graphs in one pass */
+  int single_pass;
+
 } rasqal_graph_rowsource_context;
 
 
@@ -153,6 +157,9 @@ rasqal_graph_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   con->dg_offset = -1;
   con->offset = 0;
 
+  if(con->single_pass)
+    return 0;
+
   /* Do not care if finished at this stage (it is not an
    * error). rasqal_graph_rowsource_read_row() will deal with
    * returning NULL for an empty result.
@@ -214,6 +221,11 @@ rasqal_graph_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     row = rasqal_rowsource_read_row(con->rowsource);
     if(row)
       break;
+
+    if(con->single_pass) {
+      con->finished = 1;
+      break;
+    }
     
     if(rasqal_graph_next_dg(con)) {
       con->finished = 1;
@@ -263,7 +275,8 @@ rasqal_graph_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
   con->dg_offset = -1;
   con->offset = 0;
 
-  rasqal_graph_next_dg(con);
+  if(!con->single_pass)
+    rasqal_graph_next_dg(con);
   
   return rasqal_rowsource_reset(con->rowsource);
 }
@@ -282,6 +295,32 @@ rasqal_graph_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_graph_rowsource_set_origin(rasqal_rowsource* rowsource,
+                                  void *user_data, rasqal_literal *origin)
+{
+  rasqal_graph_rowsource_context *con;
+  con = (rasqal_graph_rowsource_context*)user_data;
+
+  /* the inner rowsource matches all the named graphs whatever the
+   * graph of an outer GRAPH so do not visit it */
+  return con->single_pass;
+}
+
+
+static int
+rasqal_graph_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                 void *user_data, int limit)
+{
+  rasqal_graph_rowsource_context *con;
+  con = (rasqal_graph_rowsource_context*)user_data;
+
+  /* the inner rowsource is reset for each graph and a graph may
+   * provide all the rows */
+  return rasqal_rowsource_set_limit(con->rowsource, limit);
+}
+
+
 static const rasqal_rowsource_handler rasqal_graph_rowsource_handler = {
   /* .version =          */ 1,
   "graph",
@@ -293,7 +332,8 @@ static const rasqal_rowsource_handler rasqal_graph_rowsource_handler = {
   /* .reset =            */ rasqal_graph_rowsource_reset,
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_graph_rowsource_get_inner_rowsource,
-  /* .set_origin =       */ NULL,
+  /* .set_origin =       */ rasqal_graph_rowsource_set_origin,
+  /* .set_limit =        */ rasqal_graph_rowsource_set_limit,
 };
 
 
@@ -303,18 +343,25 @@ static const rasqal_rowsource_handler rasqal_graph_rowsource_handler = {
  * @query: query object
  * @rowsource: input rowsource
  * @var: graph variable
+ * @single_pass: non-0 if @rowsource binds @var itself
  *
  * INTERNAL - create a new GRAPH rowsource that binds a variable
  *
  * The @rowsource becomes owned by the new rowsource
  *
+ * If @single_pass is 0, @rowsource is evaluated once per named graph
+ * with the origin set to the graph.  Otherwise it is evaluated once
+ * with @var as the origin of its triple patterns, binding @var to
+ * the graph of each match.
+ *
  * Return value: new rowsource or NULL on failure
  */
 rasqal_rowsource*
 rasqal_new_graph_rowsource(rasqal_world *world,
                            rasqal_query *query,
                            rasqal_rowsource* rowsource,
-                           rasqal_variable *var)
+                           rasqal_variable *var,
+                           int single_pass)
 {
   rasqal_graph_rowsource_context *con;
   int flags = 0;
@@ -328,6 +375,7 @@ rasqal_new_graph_rowsource(rasqal_world *world,
 
   con->rowsource = rowsource;
   con->var = var;
+  con->single_pass = single_pass;
 
   return rasqal_new_rowsource_from_handler(world, query,
                                            con,
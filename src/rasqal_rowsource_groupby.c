@@ -331,11 +331,17 @@ rasqal_groupby_rowsource_process(rasqal_rowsource* rowsource,
       /* after this, node owns the row */
       raptor_sequence_push(node->rows, row);
 
+      if(rasqal_query_budget_add_row(rowsource->query, row))
+        break;
     }
   }
 
   rasqal_variables_table_install_bindings(rowsource->query->vars_table, bindings);
 
+  /* inner rowsource stopped early */
+  if(rasqal_query_check_budget(rowsource->query))
+    return 1;
+
 #ifdef RASQAL_DEBUG
   fputs("Grouping ", DEBUG_FH);
   raptor_avltree_print(con->tree, DEBUG_FH);
@@ -460,6 +466,7 @@ static const rasqal_rowsource_handler rasqal_groupby_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_groupby_rowsource_get_inner_rowsource,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -316,6 +316,11 @@ rasqal_join_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     int bresult = 1;
     int compatible = 1;
 
+    if(rasqal_query_check_budget(query)) {
+      con->failed = 1;
+      return NULL;
+    }
+
     if(con->state == JS_START) {
 
 	  /* start right */
@@ -536,6 +541,25 @@ rasqal_join_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_join_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                void *user_data, int limit)
+{
+  rasqal_join_rowsource_context *con;
+  con = (rasqal_join_rowsource_context*)user_data;
+
+  /* A LEFT JOIN returns at least one row for each left row so no
+   * more left rows than the limit are needed.  A natural join may
+   * return no row for a left row and the right rowsource is read
+   * again for every left row so neither side gets a limit.
+   */
+  if(con->join_type == RASQAL_JOIN_TYPE_LEFT)
+    return rasqal_rowsource_set_limit(con->left, limit);
+
+  return 0;
+}
+
+
 static const rasqal_rowsource_handler rasqal_join_rowsource_handler = {
   /* .version = */ 1,
   "join",
@@ -548,6 +572,7 @@ static const rasqal_rowsource_handler rasqal_join_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_join_rowsource_get_inner_rowsource,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ rasqal_join_rowsource_set_limit,
 };
 
 
@@ -220,6 +220,18 @@ rasqal_project_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_project_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                   void *user_data, int limit)
+{
+  rasqal_project_rowsource_context *con;
+  con = (rasqal_project_rowsource_context*)user_data;
+
+  /* one projected row per inner row */
+  return rasqal_rowsource_set_limit(con->rowsource, limit);
+}
+
+
 static const rasqal_rowsource_handler rasqal_project_rowsource_handler = {
   /* .version =          */ 1,
   "project",
@@ -232,6 +244,7 @@ static const rasqal_rowsource_handler rasqal_project_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_project_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .set_limit =        */ rasqal_project_rowsource_set_limit,
 };
 
 
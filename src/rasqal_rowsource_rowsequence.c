@@ -213,6 +213,7 @@ static const rasqal_rowsource_handler rasqal_rowsequence_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -137,6 +137,19 @@ rasqal_service_rowsource_read_all_rows(rasqal_rowsource* rowsource,
   return rasqal_rowsource_read_all_rows(con->rowsource);
 }
 
+static int
+rasqal_service_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                   void *user_data, int limit)
+{
+  rasqal_service_rowsource_context* con;
+
+  con = (rasqal_service_rowsource_context*)user_data;
+
+  /* stop reading the service results at the limit */
+  return rasqal_rowsource_set_limit(con->rowsource, limit);
+}
+
+
 static const rasqal_rowsource_handler rasqal_service_rowsource_handler = {
   /* .version = */ 1,
   "service",
@@ -149,6 +162,7 @@ static const rasqal_rowsource_handler rasqal_service_rowsource_handler = {
   /* .set_preserve = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ rasqal_service_rowsource_set_limit,
 };
 
 
@@ -34,6 +34,10 @@
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+/* for INT_MAX */
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 
 #include <raptor.h>
 
@@ -89,7 +93,8 @@ rasqal_slice_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   con->input_offset = 1;
   con->output_offset = 1;
 
-  return 0;
+  /* no more than offset + limit inner rows are ever needed */
+  return rasqal_rowsource_set_limit(rowsource, con->row_limit);
 }
 
 
@@ -182,6 +187,29 @@ rasqal_slice_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_slice_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                 void *user_data, int limit)
+{
+  rasqal_slice_rowsource_context *con;
+  int offset;
+
+  con = (rasqal_slice_rowsource_context*)user_data;
+
+  if(con->row_limit >= 0 && con->row_limit < limit)
+    limit = con->row_limit;
+
+  /* rows before the offset are read and skipped */
+  offset = (con->row_offset > 0) ? con->row_offset : 0;
+
+  /* no limit if the sum does not fit */
+  if(offset > INT_MAX - limit)
+    return 0;
+
+  return rasqal_rowsource_set_limit(con->rowsource, offset + limit);
+}
+
+
 static const rasqal_rowsource_handler rasqal_slice_rowsource_handler = {
   /* .version =          */ 1,
   "slice",
@@ -194,6 +222,7 @@ static const rasqal_rowsource_handler rasqal_slice_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_slice_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .set_limit =        */ rasqal_slice_rowsource_set_limit,
 };
 
 
@@ -44,6 +44,19 @@
 #define DEBUG_FH stderr
 
 
+/*
+ * A sorted run of rows spilled to a temporary file
+ */
+typedef struct
+{
+  /* temporary file (deleted when closed) */
+  FILE* fh;
+
+  /* next row of the run in sort order or NULL when the run is exhausted */
+  rasqal_row* row;
+} rasqal_sort_run;
+
+
 typedef struct 
 {
   /* inner rowsource to sort */
@@ -63,6 +76,35 @@ typedef struct
 
   /* sequence of rows (owned here) */
   raptor_sequence* seq;
+
+  /* non-0 when all rows from the inner rowsource have been sorted */
+  int processed;
+
+  /* offset into @seq of the next row for read_row */
+  int seq_offset;
+
+  /* estimated bytes of rows allowed in @map before a run is spilled
+   * or 0 to always sort in memory */
+  size_t max_bytes;
+
+  /* estimated bytes of rows currently in @map */
+  size_t bytes;
+
+  /* sorted runs spilled to temporary files */
+  rasqal_sort_run* runs;
+  int runs_count;
+  int runs_size;
+
+  /* non-0 if reading or writing a run failed */
+  int failed;
+
+  /* number of threads sorting @rows instead of using @map or 0 */
+  int threads;
+
+  /* rows read for rasqal_engine_rowsort_sort_rows() (owned) */
+  rasqal_row** rows;
+  int rows_count;
+  int rows_size;
 } rasqal_sort_rowsource_context;
 
 
@@ -71,6 +113,7 @@ rasqal_sort_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_query *query = rowsource->query;
   rasqal_sort_rowsource_context *con;
+  int sort_memory;
 
   con = (rasqal_sort_rowsource_context*)user_data;
   
@@ -83,7 +126,16 @@ rasqal_sort_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   
   con->map = NULL;
 
-  if(con->order_size > 0 ) {
+  /* DISTINCT needs all rows at once to remove duplicates so never spills */
+  sort_memory = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SORT_MEMORY)];
+  if(sort_memory > 0 && !con->distinct)
+    con->max_bytes = RASQAL_GOOD_CAST(size_t, sort_memory) * 1024;
+
+  /* rows that may spill are sorted in a map */
+  if(!con->max_bytes)
+    con->threads = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SORT_THREADS)];
+
+  if(con->order_size > 0 && !con->threads) {
     /* make a row:NULL map in order to sort or do distinct
      * FIXME: should DISTINCT be separate? 
      */
@@ -100,6 +152,542 @@ rasqal_sort_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 }
 
 
+/* Temporary file row format; native byte order as it is never shared */
+
+/* literal tags */
+#define RASQAL_SORT_LITERAL_NULL     0
+#define RASQAL_SORT_LITERAL_URI      1
+#define RASQAL_SORT_LITERAL_BLANK    2
+#define RASQAL_SORT_LITERAL_FLOATING 3
+#define RASQAL_SORT_LITERAL_STRING   4
+
+static int
+rasqal_sort_write_int(FILE* fh, int value)
+{
+  return (fwrite(&value, sizeof(value), 1, fh) != 1);
+}
+
+
+static int
+rasqal_sort_write_counted_string(FILE* fh, const unsigned char* string,
+                                 size_t len)
+{
+  if(rasqal_sort_write_int(fh, RASQAL_GOOD_CAST(int, len)))
+    return 1;
+
+  return (len && fwrite(string, 1, len, fh) != len);
+}
+
+
+/* lexical form, language and datatype URI of a literal */
+static int
+rasqal_sort_write_lexical(FILE* fh, rasqal_literal* l)
+{
+  const unsigned char* str;
+  size_t len;
+  raptor_uri* dt_uri;
+
+  if(rasqal_sort_write_counted_string(fh, l->string, l->string_len))
+    return 1;
+
+  if(l->language)
+    str = RASQAL_GOOD_CAST(const unsigned char*, l->language);
+  else
+    str = RASQAL_GOOD_CAST(const unsigned char*, "");
+  if(rasqal_sort_write_counted_string(fh, str, strlen(RASQAL_GOOD_CAST(const char*, str))))
+    return 1;
+
+  dt_uri = l->datatype;
+  if(!dt_uri && l->type != RASQAL_LITERAL_STRING)
+    dt_uri = rasqal_xsd_datatype_type_to_uri(l->world, l->type);
+  if(dt_uri)
+    str = raptor_uri_as_counted_string(dt_uri, &len);
+  else
+    len = 0;
+  return rasqal_sort_write_counted_string(fh, str, len);
+}
+
+
+static int
+rasqal_sort_write_literal(FILE* fh, rasqal_literal* l)
+{
+  const unsigned char* str;
+  size_t len;
+
+  if(!l)
+    return (fputc(RASQAL_SORT_LITERAL_NULL, fh) == EOF);
+
+  switch(l->type) {
+    case RASQAL_LITERAL_URI:
+      str = raptor_uri_as_counted_string(l->value.uri, &len);
+      return (fputc(RASQAL_SORT_LITERAL_URI, fh) == EOF ||
+              rasqal_sort_write_counted_string(fh, str, len));
+
+    case RASQAL_LITERAL_BLANK:
+      return (fputc(RASQAL_SORT_LITERAL_BLANK, fh) == EOF ||
+              rasqal_sort_write_counted_string(fh, l->string, l->string_len));
+
+    case RASQAL_LITERAL_DOUBLE:
+    case RASQAL_LITERAL_FLOAT:
+      /* the raw value too as a computed value's lexical form may
+       * lose precision */
+      return (fputc(RASQAL_SORT_LITERAL_FLOATING, fh) == EOF ||
+              rasqal_sort_write_lexical(fh, l) ||
+              fwrite(&l->value.floating, sizeof(double), 1, fh) != 1);
+
+    case RASQAL_LITERAL_STRING:
+    case RASQAL_LITERAL_XSD_STRING:
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_DECIMAL:
+    case RASQAL_LITERAL_DATETIME:
+    case RASQAL_LITERAL_DATE:
+    case RASQAL_LITERAL_UDT:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+      /* lexical form is promoted back to the same type when read */
+      return (fputc(RASQAL_SORT_LITERAL_STRING, fh) == EOF ||
+              rasqal_sort_write_lexical(fh, l));
+
+    case RASQAL_LITERAL_UNKNOWN:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_VARIABLE:
+    default:
+      break;
+  }
+
+  /* not a result value */
+  return 1;
+}
+
+
+static int
+rasqal_sort_write_row(FILE* fh, rasqal_row* row)
+{
+  int i;
+
+  if(rasqal_sort_write_int(fh, row->offset) ||
+     rasqal_sort_write_int(fh, row->group_id) ||
+     rasqal_sort_write_int(fh, row->size) ||
+     rasqal_sort_write_int(fh, row->order_size))
+    return 1;
+
+  for(i = 0; i < row->size; i++) {
+    if(rasqal_sort_write_literal(fh, row->values[i]))
+      return 1;
+  }
+
+  for(i = 0; i < row->order_size; i++) {
+    if(rasqal_sort_write_literal(fh, row->order_values[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_sort_read_int(FILE* fh, int* value_p)
+{
+  return (fread(value_p, sizeof(*value_p), 1, fh) != 1);
+}
+
+
+/* returns new NUL-terminated string or NULL; empty string if length is 0 */
+static unsigned char*
+rasqal_sort_read_counted_string(FILE* fh, size_t* len_p)
+{
+  int len;
+  unsigned char* string;
+
+  if(rasqal_sort_read_int(fh, &len) || len < 0)
+    return NULL;
+
+  string = RASQAL_MALLOC(unsigned char*, RASQAL_GOOD_CAST(size_t, len) + 1);
+  if(!string)
+    return NULL;
+
+  if(len && fread(string, 1, RASQAL_GOOD_CAST(size_t, len), fh) != RASQAL_GOOD_CAST(size_t, len)) {
+    RASQAL_FREE(char*, string);
+    return NULL;
+  }
+  string[len] = '\0';
+
+  if(len_p)
+    *len_p = RASQAL_GOOD_CAST(size_t, len);
+
+  return string;
+}
+
+
+/* lexical form, language and datatype URI written by
+ * rasqal_sort_write_lexical() as a literal of the original type */
+static rasqal_literal*
+rasqal_sort_read_lexical(rasqal_world* world, FILE* fh)
+{
+  unsigned char* string;
+  unsigned char* language;
+  unsigned char* datatype;
+  raptor_uri* uri = NULL;
+  size_t len;
+
+  string = rasqal_sort_read_counted_string(fh, NULL);
+  if(!string)
+    return NULL;
+
+  language = rasqal_sort_read_counted_string(fh, &len);
+  if(language && !len) {
+    RASQAL_FREE(char*, language);
+    language = NULL;
+  } else if(!language) {
+    RASQAL_FREE(char*, string);
+    return NULL;
+  }
+
+  datatype = rasqal_sort_read_counted_string(fh, &len);
+  if(datatype && len)
+    uri = raptor_new_uri_from_counted_string(world->raptor_world_ptr,
+                                             datatype, len);
+  if(!datatype || (len && !uri)) {
+    if(datatype)
+      RASQAL_FREE(char*, datatype);
+    if(language)
+      RASQAL_FREE(char*, language);
+    RASQAL_FREE(char*, string);
+    return NULL;
+  }
+  RASQAL_FREE(char*, datatype);
+
+  /* not canonicalized so the term is the same as the one written;
+   * takes ownership of string, language and uri */
+  return rasqal_new_string_literal(world, string,
+                                   RASQAL_GOOD_CAST(const char*, language),
+                                   uri, NULL);
+}
+
+
+static int
+rasqal_sort_read_literal(rasqal_world* world, FILE* fh, rasqal_literal** l_p)
+{
+  unsigned char* string;
+  raptor_uri* uri;
+  size_t len;
+  double d;
+  int tag;
+
+  *l_p = NULL;
+
+  tag = fgetc(fh);
+  switch(tag) {
+    case RASQAL_SORT_LITERAL_NULL:
+      return 0;
+
+    case RASQAL_SORT_LITERAL_URI:
+      string = rasqal_sort_read_counted_string(fh, &len);
+      if(!string)
+        return 1;
+      uri = raptor_new_uri_from_counted_string(world->raptor_world_ptr,
+                                               string, len);
+      RASQAL_FREE(char*, string);
+      if(!uri)
+        return 1;
+      *l_p = rasqal_new_uri_literal(world, uri);
+      break;
+
+    case RASQAL_SORT_LITERAL_BLANK:
+      string = rasqal_sort_read_counted_string(fh, NULL);
+      if(!string)
+        return 1;
+      *l_p = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK, string);
+      break;
+
+    case RASQAL_SORT_LITERAL_FLOATING:
+      *l_p = rasqal_sort_read_lexical(world, fh);
+      if(!*l_p)
+        return 1;
+      if(fread(&d, sizeof(d), 1, fh) != 1) {
+        rasqal_free_literal(*l_p);
+        *l_p = NULL;
+        return 1;
+      }
+      if((*l_p)->type == RASQAL_LITERAL_DOUBLE ||
+         (*l_p)->type == RASQAL_LITERAL_FLOAT)
+        (*l_p)->value.floating = d;
+      break;
+
+    case RASQAL_SORT_LITERAL_STRING:
+      *l_p = rasqal_sort_read_lexical(world, fh);
+      break;
+
+    default:
+      return 1;
+  }
+
+  return (*l_p == NULL);
+}
+
+
+/*
+ * rasqal_sort_read_row:
+ * @rowsource: sort rowsource
+ * @con: sort rowsource context
+ * @fh: run file
+ *
+ * INTERNAL - Read the next row from a run file
+ *
+ * Return value: new row or NULL at the end of the run or on failure (@con->failed is set)
+ */
+static rasqal_row*
+rasqal_sort_read_row(rasqal_rowsource* rowsource,
+                     rasqal_sort_rowsource_context* con, FILE* fh)
+{
+  rasqal_row* row;
+  int offset;
+  int group_id;
+  int size;
+  int order_size;
+  int i;
+
+  /* end of run */
+  if(rasqal_sort_read_int(fh, &offset))
+    return NULL;
+
+  if(rasqal_sort_read_int(fh, &group_id) ||
+     rasqal_sort_read_int(fh, &size) ||
+     rasqal_sort_read_int(fh, &order_size))
+    goto failed;
+
+  row = rasqal_new_row_for_size(rowsource->world, size);
+  if(!row)
+    goto failed;
+
+  if(rasqal_row_set_order_size(row, order_size))
+    goto failed_row;
+
+  rasqal_row_set_rowsource(row, con->rowsource);
+  row->offset = offset;
+  row->group_id = group_id;
+
+  for(i = 0; i < size; i++) {
+    if(rasqal_sort_read_literal(rowsource->world, fh, &row->values[i]))
+      goto failed_row;
+  }
+
+  for(i = 0; i < order_size; i++) {
+    if(rasqal_sort_read_literal(rowsource->world, fh, &row->order_values[i]))
+      goto failed_row;
+  }
+
+  if(rasqal_engine_rowsort_calculate_order_key(rowsource->query,
+                                               con->order_seq, row))
+    goto failed_row;
+
+  return row;
+
+  failed_row:
+  rasqal_free_row(row);
+  failed:
+  con->failed = 1;
+  return NULL;
+}
+
+
+/*
+ * rasqal_sort_rowsource_spill:
+ * @rowsource: sort rowsource
+ * @con: sort rowsource context
+ *
+ * INTERNAL - Write the rows sorted so far to a new run and empty the map
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_sort_rowsource_spill(rasqal_rowsource* rowsource,
+                            rasqal_sort_rowsource_context* con)
+{
+  rasqal_query *query = rowsource->query;
+  raptor_sequence* seq;
+  rasqal_sort_run* run;
+  rasqal_row* row;
+  int i;
+
+  if(con->runs_count == con->runs_size) {
+    int new_size = con->runs_size ? con->runs_size * 2 : 8;
+    rasqal_sort_run* new_runs;
+
+    new_runs = RASQAL_CALLOC(rasqal_sort_run*, RASQAL_GOOD_CAST(size_t, new_size),
+                             sizeof(*new_runs));
+    if(!new_runs)
+      return 1;
+
+    if(con->runs) {
+      memcpy(new_runs, con->runs,
+             RASQAL_GOOD_CAST(size_t, con->runs_count) * sizeof(*new_runs));
+      RASQAL_FREE(rasqal_sort_run*, con->runs);
+    }
+    con->runs = new_runs;
+    con->runs_size = new_size;
+  }
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                            (raptor_data_print_handler)rasqal_row_print);
+  if(!seq)
+    return 1;
+
+  rasqal_engine_rowsort_map_to_sequence(con->map, seq);
+  rasqal_free_map(con->map);
+  con->map = NULL;
+  con->bytes = 0;
+
+  run = &con->runs[con->runs_count];
+
+  /* anonymous file in the system temporary directory, removed on close */
+  run->fh = tmpfile();
+  if(!run->fh) {
+    raptor_free_sequence(seq);
+    rasqal_log_error_simple(rowsource->world, RAPTOR_LOG_LEVEL_ERROR,
+                            &query->locator,
+                            "Failed to create a temporary file for sorting");
+    return 1;
+  }
+  run->row = NULL;
+  con->runs_count++;
+
+  for(i = 0; (row = (rasqal_row*)raptor_sequence_get_at(seq, i)); i++) {
+    if(rasqal_sort_write_row(run->fh, row)) {
+      raptor_free_sequence(seq);
+      rasqal_log_error_simple(rowsource->world, RAPTOR_LOG_LEVEL_ERROR,
+                              &query->locator,
+                              "Failed to write a temporary file for sorting");
+      return 1;
+    }
+  }
+  raptor_free_sequence(seq);
+
+  RASQAL_DEBUG3("sort rowsource %p spilled run %d\n", rowsource,
+                con->runs_count);
+
+  con->map = rasqal_engine_new_rowsort_map(con->distinct,
+                                           query->compare_flags,
+                                           con->order_seq);
+  return (con->map == NULL);
+}
+
+
+/*
+ * rasqal_sort_rowsource_start_runs:
+ * @rowsource: sort rowsource
+ * @con: sort rowsource context
+ *
+ * INTERNAL - (Re)start merging the spilled runs from their first rows
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_sort_rowsource_start_runs(rasqal_rowsource* rowsource,
+                                 rasqal_sort_rowsource_context* con)
+{
+  int i;
+
+  for(i = 0; i < con->runs_count; i++) {
+    rasqal_sort_run* run = &con->runs[i];
+
+    if(run->row) {
+      rasqal_free_row(run->row);
+      run->row = NULL;
+    }
+
+    rewind(run->fh);
+    run->row = rasqal_sort_read_row(rowsource, con, run->fh);
+  }
+
+  return con->failed;
+}
+
+
+/*
+ * rasqal_sort_rowsource_next_merged_row:
+ * @rowsource: sort rowsource
+ * @con: sort rowsource context
+ *
+ * INTERNAL - Get the next row of the merge of all spilled runs
+ *
+ * Return value: next row or NULL when finished or on failure
+ */
+static rasqal_row*
+rasqal_sort_rowsource_next_merged_row(rasqal_rowsource* rowsource,
+                                      rasqal_sort_rowsource_context* con)
+{
+  rasqal_sort_run* best = NULL;
+  rasqal_row* row;
+  int i;
+
+  if(con->failed)
+    return NULL;
+
+  /* there are few runs (input size / memory limit) so scan them */
+  for(i = 0; i < con->runs_count; i++) {
+    rasqal_sort_run* run = &con->runs[i];
+
+    if(!run->row)
+      continue;
+
+    if(!best ||
+       rasqal_engine_rowsort_compare_rows(con->order_seq,
+                                          rowsource->query->compare_flags,
+                                          run->row, best->row) < 0)
+      best = run;
+  }
+
+  if(!best)
+    return NULL;
+
+  row = best->row;
+  best->row = rasqal_sort_read_row(rowsource, con, best->fh);
+
+  return row;
+}
+
+
+/*
+ * rasqal_sort_rowsource_add_row:
+ * @con: sort rowsource context
+ * @row: row (ownership taken)
+ *
+ * INTERNAL - Add a row to the rows to sort with threads
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_sort_rowsource_add_row(rasqal_sort_rowsource_context* con,
+                              rasqal_row* row)
+{
+  if(con->rows_count == con->rows_size) {
+    int size = con->rows_size ? con->rows_size * 2 : 1024;
+    rasqal_row** rows;
+
+    rows = RASQAL_MALLOC(rasqal_row**,
+                         RASQAL_GOOD_CAST(size_t, size) * sizeof(rasqal_row*));
+    if(!rows) {
+      rasqal_free_row(row);
+      return 1;
+    }
+
+    if(con->rows) {
+      memcpy(rows, con->rows,
+             RASQAL_GOOD_CAST(size_t, con->rows_count) * sizeof(rasqal_row*));
+      RASQAL_FREE(rasqal_row**, con->rows);
+    }
+    con->rows = rows;
+    con->rows_size = size;
+  }
+
+  con->rows[con->rows_count++] = row;
+
+  return 0;
+}
+
+
 static int
 rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
                               rasqal_sort_rowsource_context* con)
@@ -107,8 +695,10 @@ rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
   int offset = 0;
 
   /* already processed */
-  if(con->seq)
-    return 0;
+  if(con->processed)
+    return con->failed;
+
+  con->processed = 1;
 
   con->seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
                                  (raptor_data_print_handler)rasqal_row_print);
@@ -131,9 +721,60 @@ rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
 
     row->offset = offset;
 
-    /* after this, row is owned by map */
-    if(!rasqal_engine_rowsort_map_add_row(con->map, row))
+    if(rasqal_query_budget_add_row(rowsource->query, row)) {
+      rasqal_free_row(row);
+      return 1;
+    }
+
+    if(con->max_bytes)
+      con->bytes += rasqal_row_get_size_estimate(row);
+
+    if(con->threads) {
+      if(rasqal_sort_rowsource_add_row(con, row))
+        return 1;
       offset++;
+    } else if(!rasqal_engine_rowsort_map_add_row(con->map, row))
+      /* after this, row is owned by map */
+      offset++;
+
+    if(con->max_bytes && con->bytes > con->max_bytes) {
+      if(rasqal_sort_rowsource_spill(rowsource, con)) {
+        con->failed = 1;
+        return 1;
+      }
+    }
+  }
+
+  /* inner rowsource stopped early */
+  if(rasqal_query_check_budget(rowsource->query))
+    return 1;
+
+  if(con->threads) {
+    int rc;
+
+    /* rows become owned by seq */
+    rc = rasqal_engine_rowsort_sort_rows(con->rows, con->rows_count,
+                                         con->distinct,
+                                         rowsource->query->compare_flags,
+                                         con->order_seq, con->threads,
+                                         con->seq);
+    RASQAL_FREE(rasqal_row**, con->rows);
+    con->rows = NULL;
+    con->rows_count = 0;
+
+    return rc;
+  }
+
+  if(con->runs_count) {
+    /* spill the rest and merge all the runs when reading */
+    if(rasqal_sort_rowsource_spill(rowsource, con) ||
+       rasqal_sort_rowsource_start_runs(rowsource, con)) {
+      con->failed = 1;
+      return 1;
+    }
+
+    rasqal_free_map(con->map); con->map = NULL;
+    return 0;
   }
   
 #ifdef RASQAL_DEBUG
@@ -171,6 +812,8 @@ static int
 rasqal_sort_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_sort_rowsource_context *con;
+  int i;
+
   con = (rasqal_sort_rowsource_context*)user_data;
 
   if(con->rowsource)
@@ -182,12 +825,61 @@ rasqal_sort_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->seq)
     raptor_free_sequence(con->seq);
 
+  if(con->rows) {
+    for(i = 0; i < con->rows_count; i++)
+      rasqal_free_row(con->rows[i]);
+    RASQAL_FREE(rasqal_row**, con->rows);
+  }
+
+  if(con->runs) {
+    /* closing removes the temporary files */
+    for(i = 0; i < con->runs_count; i++) {
+      if(con->runs[i].row)
+        rasqal_free_row(con->runs[i].row);
+      if(con->runs[i].fh)
+        fclose(con->runs[i].fh);
+    }
+    RASQAL_FREE(rasqal_sort_run*, con->runs);
+  }
+
   RASQAL_FREE(rasqal_sort_rowsource_context, con);
 
   return 0;
 }
 
 
+static rasqal_row*
+rasqal_sort_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_sort_rowsource_context *con;
+  rasqal_row* row;
+
+  con = (rasqal_sort_rowsource_context*)user_data;
+
+  /* if there were no ordering conditions, pass it all on to inner rowsource */
+  if(con->order_size <= 0)
+    return rasqal_rowsource_read_row(con->rowsource);
+
+  /* need to sort */
+  if(rasqal_sort_rowsource_process(rowsource, con))
+    return NULL;
+
+  if(con->runs_count)
+    return rasqal_sort_rowsource_next_merged_row(rowsource, con);
+
+  if(!con->seq)
+    return NULL;
+
+  row = (rasqal_row*)raptor_sequence_get_at(con->seq, con->seq_offset);
+  if(!row)
+    return NULL;
+
+  con->seq_offset++;
+
+  return rasqal_new_row_from_row(row);
+}
+
+
 static raptor_sequence*
 rasqal_sort_rowsource_read_all_rows(rasqal_rowsource* rowsource,
                                     void *user_data)
@@ -206,6 +898,26 @@ rasqal_sort_rowsource_read_all_rows(rasqal_rowsource* rowsource,
   if(rasqal_sort_rowsource_process(rowsource, con))
     return NULL;
 
+  if(con->runs_count) {
+    rasqal_row* row;
+
+    /* caller wants all rows in memory */
+    seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                              (raptor_data_print_handler)rasqal_row_print);
+    if(!seq)
+      return NULL;
+
+    while((row = rasqal_sort_rowsource_next_merged_row(rowsource, con)))
+      raptor_sequence_push(seq, row);
+
+    if(con->failed) {
+      raptor_free_sequence(seq);
+      seq = NULL;
+    }
+
+    return seq;
+  }
+
   if(con->seq) {
     /* pass ownership of seq back to caller */
     seq = con->seq;
@@ -216,6 +928,25 @@ rasqal_sort_rowsource_read_all_rows(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_sort_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_sort_rowsource_context *con;
+
+  con = (rasqal_sort_rowsource_context*)user_data;
+
+  if(con->order_size <= 0)
+    return rasqal_rowsource_reset(con->rowsource);
+
+  if(con->runs_count)
+    return rasqal_sort_rowsource_start_runs(rowsource, con);
+
+  con->seq_offset = 0;
+
+  return 0;
+}
+
+
 static rasqal_rowsource*
 rasqal_sort_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
                                           void *user_data, int offset)
@@ -235,12 +966,13 @@ static const rasqal_rowsource_handler rasqal_sort_rowsource_handler = {
   /* .init =             */ rasqal_sort_rowsource_init,
   /* .finish =           */ rasqal_sort_rowsource_finish,
   /* .ensure_variables = */ rasqal_sort_rowsource_ensure_variables,
-  /* .read_row =         */ NULL,
+  /* .read_row =         */ rasqal_sort_rowsource_read_row,
   /* .read_all_rows =    */ rasqal_sort_rowsource_read_all_rows,
-  /* .reset =            */ NULL,
+  /* .reset =            */ rasqal_sort_rowsource_reset,
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_sort_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .set_limit =        */ NULL,
 };
 
 
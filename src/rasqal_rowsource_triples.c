@@ -48,6 +48,11 @@ typedef struct
   /* source of triple pattern matches */
   rasqal_triples_source* triples_source;
 
+  /* array of the source of the matches of each triple pattern indexed
+   * by column or NULL to use #triples_source for all; an entry may be
+   * NULL for #triples_source.  SHARED */
+  rasqal_triples_source** triples_sources;
+
   /* sequence of triple SHARED with query */
   raptor_sequence* triples;
 
@@ -75,9 +80,338 @@ typedef struct
   
   /* GRAPH origin to use */
   rasqal_literal *origin;
+
+  /* array of the triple parts that are constants - bound query
+   * parameters or variables fixed by an equality filter - one per
+   * triple pattern (or NULL if there are none) */
+  unsigned int* constant_parts;
+
+  /* array of constant values, one per variable in the row (or NULL
+   * if there are none); SHARED with the query or #filter_expr */
+  rasqal_literal** constant_values;
+
+  /* filter pushed down into the triple patterns (or NULL); SHARED */
+  rasqal_expression* filter_expr;
+
+  /* variables to return in rows (or NULL for all bound variables);
+   * the others are only matched.  SHARED */
+  raptor_sequence* vars_seq;
+
+  /* sequence of the conjuncts of #filter_expr (or NULL) */
+  raptor_sequence* filters;
+
+  /* array of the column each of #filters is evaluated after or -1 if
+   * the triple patterns match it by a constant */
+  int* filter_columns;
 } rasqal_triples_rowsource_context;
 
 
+/* source of the matches of the triple pattern in @column */
+static rasqal_triples_source*
+rasqal_triples_rowsource_get_source(rasqal_triples_rowsource_context* con,
+                                    int column)
+{
+  if(con->triples_sources && con->triples_sources[column])
+    return con->triples_sources[column];
+
+  return con->triples_source;
+}
+
+
+/*
+ * rasqal_triples_rowsource_get_constant:
+ * @rowsource: triples rowsource
+ * @con: triples rowsource context
+ * @v: variable (or NULL)
+ *
+ * INTERNAL - Get the constant value of a variable in the triple patterns
+ *
+ * Return value: shared value or NULL if @v is not a constant
+ */
+static rasqal_literal*
+rasqal_triples_rowsource_get_constant(rasqal_rowsource* rowsource,
+                                      rasqal_triples_rowsource_context* con,
+                                      rasqal_variable* v)
+{
+  rasqal_literal* value;
+  int offset;
+
+  value = rasqal_query_get_parameter_value(rowsource->query, v);
+  if(value || !v || !con->constant_values)
+    return value;
+
+  offset = rasqal_rowsource_get_variable_offset_by_name(rowsource, v->name);
+  return (offset < 0) ? NULL : con->constant_values[offset];
+}
+
+
+/*
+ * rasqal_triples_rowsource_bind_constants:
+ * @rowsource: triples rowsource
+ * @con: triples rowsource context
+ * @t: triple pattern
+ * @parts: parts of @t that are constants
+ *
+ * INTERNAL - Make a triple pattern with constant variables replaced by their values
+ *
+ * Return value: new triple or NULL on failure
+ */
+static rasqal_triple*
+rasqal_triples_rowsource_bind_constants(rasqal_rowsource* rowsource,
+                                        rasqal_triples_rowsource_context* con,
+                                        rasqal_triple* t,
+                                        unsigned int parts)
+{
+  rasqal_literal* s = t->subject;
+  rasqal_literal* p = t->predicate;
+  rasqal_literal* o = t->object;
+  rasqal_triple* bound_t;
+
+  if(parts & RASQAL_TRIPLE_SUBJECT)
+    s = rasqal_triples_rowsource_get_constant(rowsource, con,
+                                              rasqal_literal_as_variable(s));
+  if(parts & RASQAL_TRIPLE_PREDICATE)
+    p = rasqal_triples_rowsource_get_constant(rowsource, con,
+                                              rasqal_literal_as_variable(p));
+  if(parts & RASQAL_TRIPLE_OBJECT)
+    o = rasqal_triples_rowsource_get_constant(rowsource, con,
+                                              rasqal_literal_as_variable(o));
+
+  bound_t = rasqal_new_triple(rasqal_new_literal_from_literal(s),
+                              rasqal_new_literal_from_literal(p),
+                              rasqal_new_literal_from_literal(o));
+  if(bound_t && t->origin)
+    rasqal_triple_set_origin(bound_t, rasqal_new_literal_from_literal(t->origin));
+
+  return bound_t;
+}
+
+
+/*
+ * rasqal_triples_rowsource_get_equality:
+ * @e: filter conjunct
+ * @value_p: pointer to store the IRI value
+ *
+ * INTERNAL - Get the variable a filter conjunct fixes to an IRI
+ *
+ * Both ?v = <iri> and sameTerm(?v, <iri>) are true exactly when ?v
+ * is that IRI so the triple patterns can match the IRI instead.
+ *
+ * Return value: variable or NULL if @e is not such an equality
+ */
+static rasqal_variable*
+rasqal_triples_rowsource_get_equality(rasqal_expression* e,
+                                      rasqal_literal** value_p)
+{
+  rasqal_literal* l1;
+  rasqal_literal* l2;
+  rasqal_variable* v;
+
+  if(e->op != RASQAL_EXPR_EQ && e->op != RASQAL_EXPR_SAMETERM)
+    return NULL;
+
+  if(e->arg1->op != RASQAL_EXPR_LITERAL || e->arg2->op != RASQAL_EXPR_LITERAL)
+    return NULL;
+
+  l1 = e->arg1->literal;
+  l2 = e->arg2->literal;
+  v = rasqal_literal_as_variable(l1);
+  if(!v) {
+    v = rasqal_literal_as_variable(l2);
+    l2 = l1;
+  }
+
+  if(!v || l2->type != RASQAL_LITERAL_URI)
+    return NULL;
+
+  *value_p = l2;
+  return v;
+}
+
+
+typedef struct {
+  rasqal_rowsource* rowsource;
+  rasqal_triples_rowsource_context* con;
+  int column;
+} rasqal_triples_rowsource_filter_scope;
+
+
+static int
+rasqal_triples_rowsource_filter_column_visit(void *user_data,
+                                             rasqal_expression *e)
+{
+  rasqal_triples_rowsource_filter_scope* scope;
+  rasqal_triples_rowsource_context* con;
+  rasqal_variable* v;
+  int column;
+
+  scope = (rasqal_triples_rowsource_filter_scope*)user_data;
+  con = scope->con;
+
+  if(e->op != RASQAL_EXPR_LITERAL)
+    return 0;
+
+  v = rasqal_literal_as_variable(e->literal);
+  if(!v || rasqal_triples_rowsource_get_constant(scope->rowsource, con, v))
+    return 0;
+
+  /* the first column binding the variable */
+  for(column = con->start_column; column < con->end_column; column++) {
+    if(rasqal_query_variable_bound_in_triple(scope->rowsource->query, v,
+                                             column))
+      break;
+  }
+
+  if(column > scope->column)
+    scope->column = column;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_triples_rowsource_init_filters:
+ * @rowsource: triples rowsource
+ * @con: triples rowsource context
+ *
+ * INTERNAL - Split the filter and find where each conjunct can be evaluated
+ *
+ * Equality with an IRI becomes a constant in the triple patterns and
+ * any other conjunct is evaluated after the column where the last of
+ * its variables is bound.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_triples_rowsource_init_filters(rasqal_rowsource* rowsource,
+                                      rasqal_triples_rowsource_context* con)
+{
+  rasqal_query *query = rowsource->query;
+  rasqal_expression* e;
+  int i;
+
+  con->filters = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression,
+                                     (raptor_data_print_handler)rasqal_expression_print);
+  if(!con->filters)
+    return 1;
+
+  if(rasqal_expression_get_conjuncts(con->filter_expr, con->filters))
+    return 1;
+
+  con->filter_columns = RASQAL_CALLOC(int*,
+                                      RASQAL_GOOD_CAST(size_t, raptor_sequence_size(con->filters) + 1),
+                                      sizeof(int));
+  if(!con->filter_columns)
+    return 1;
+
+  for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(con->filters, i)); i++) {
+    rasqal_literal* value = NULL;
+    rasqal_variable* v;
+    int offset;
+    int column;
+
+    v = rasqal_triples_rowsource_get_equality(e, &value);
+    if(!v)
+      continue;
+
+    offset = rasqal_rowsource_get_variable_offset_by_name(rowsource, v->name);
+    if(offset < 0 || rasqal_triples_rowsource_get_constant(rowsource, con, v))
+      continue;
+
+    /* a GRAPH variable cannot be replaced in the triple patterns */
+    for(column = con->start_column; column <= con->end_column; column++) {
+      if(rasqal_query_variable_bound_in_triple(query, v, column) &
+         RASQAL_TRIPLE_ORIGIN)
+        break;
+    }
+    if(column <= con->end_column)
+      continue;
+
+    RASQAL_DEBUG2("filter fixes variable %s to a constant\n", v->name);
+    con->constant_values[offset] = value;
+    con->filter_columns[i] = -1;
+  }
+
+  for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(con->filters, i)); i++) {
+    rasqal_triples_rowsource_filter_scope scope;
+
+    if(con->filter_columns[i] < 0)
+      continue;
+
+    scope.rowsource = rowsource;
+    scope.con = con;
+    scope.column = con->start_column;
+    rasqal_expression_visit(e, rasqal_triples_rowsource_filter_column_visit,
+                            &scope);
+    con->filter_columns[i] = scope.column;
+
+    RASQAL_DEBUG3("filter conjunct %d is evaluated after column %d\n", i,
+                  scope.column);
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_triples_rowsource_check_filters:
+ * @rowsource: triples rowsource
+ * @con: triples rowsource context
+ *
+ * INTERNAL - Evaluate the filter conjuncts that can be evaluated after the current column
+ *
+ * Return value: non-0 if the conjuncts are all true
+ */
+static int
+rasqal_triples_rowsource_check_filters(rasqal_rowsource* rowsource,
+                                       rasqal_triples_rowsource_context* con)
+{
+  rasqal_query *query = rowsource->query;
+  rasqal_expression* e;
+  int i;
+
+  for(i = 0; (e = (rasqal_expression*)raptor_sequence_get_at(con->filters, i)); i++) {
+    rasqal_literal* result;
+    int bresult;
+    int error = 0;
+
+    if(con->filter_columns[i] != con->column)
+      continue;
+
+    result = rasqal_expression_evaluate2(e, query->eval_context, &error);
+    if(error)
+      return 0;
+
+    bresult = rasqal_literal_as_boolean(result, &error);
+    rasqal_free_literal(result);
+    if(error || !bresult) {
+      RASQAL_DEBUG3("filter conjunct %d failed at column %d\n", i,
+                    con->column);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/* check if variable @v is one of the variables to return in rows */
+static int
+rasqal_triples_rowsource_returns_variable(rasqal_triples_rowsource_context* con,
+                                          rasqal_variable* v)
+{
+  rasqal_variable* v2;
+  int i;
+
+  for(i = 0; (v2 = (rasqal_variable*)raptor_sequence_get_at(con->vars_seq, i)); i++) {
+    if(v2 == v)
+      return 1;
+  }
+
+  return 0;
+}
+
+
 static int
 rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 {
@@ -87,6 +421,7 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   int rc = 0;
   int size;
   int i;
+  rasqal_variable* graph_var = NULL;
   
   con = (rasqal_triples_rowsource_context*)user_data;
 
@@ -97,6 +432,9 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   for(i = 0; i < size; i++) {
     rasqal_variable *v;
     v = rasqal_variables_table_get(rowsource->vars_table, i);
+
+    if(con->vars_seq && !rasqal_triples_rowsource_returns_variable(con, v))
+      continue;
     
     for(column = con->start_column; column <= con->end_column; column++) {
       if(rasqal_query_variable_bound_in_triple(query, v, column)) {
@@ -109,6 +447,28 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
     }
   }
 
+  /* bound query parameters and variables fixed by the filter are
+   * constants in the triple patterns */
+  if(query->parameters || con->filter_expr) {
+    con->constant_values = RASQAL_CALLOC(rasqal_literal**,
+                                         RASQAL_GOOD_CAST(size_t, con->size + 1),
+                                         sizeof(rasqal_literal*));
+    con->constant_parts = RASQAL_CALLOC(unsigned int*,
+                                        RASQAL_GOOD_CAST(size_t, con->triples_count),
+                                        sizeof(unsigned int));
+    if(!con->constant_values || !con->constant_parts)
+      return -1;
+
+    for(i = 0; i < con->size; i++) {
+      rasqal_variable *v;
+      v = (rasqal_variable*)raptor_sequence_get_at(rowsource->variables_sequence, i);
+      con->constant_values[i] = rasqal_query_get_parameter_value(query, v);
+    }
+  }
+
+  if(con->filter_expr && rasqal_triples_rowsource_init_filters(rowsource, con))
+    return -1;
+
   con->column = con->start_column;
 
   for(column = con->start_column; column <= con->end_column; column++) {
@@ -121,6 +481,26 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
     m->parts = (rasqal_triple_parts)0;
 
     t = (rasqal_triple*)raptor_sequence_get_at(con->triples, column);
+
+    if(con->constant_parts) {
+      unsigned int constant_parts = 0;
+
+      if(rasqal_triples_rowsource_get_constant(rowsource, con, rasqal_literal_as_variable(t->subject)))
+        constant_parts |= RASQAL_TRIPLE_SUBJECT;
+      if(rasqal_triples_rowsource_get_constant(rowsource, con, rasqal_literal_as_variable(t->predicate)))
+        constant_parts |= RASQAL_TRIPLE_PREDICATE;
+      if(rasqal_triples_rowsource_get_constant(rowsource, con, rasqal_literal_as_variable(t->object)))
+        constant_parts |= RASQAL_TRIPLE_OBJECT;
+
+      con->constant_parts[column - con->start_column] = constant_parts;
+
+      /* constants are matched, not bound */
+      if(constant_parts) {
+        RASQAL_DEBUG3("triple pattern column %d has constant parts %s\n",
+                      column,
+                      rasqal_engine_get_parts_string((rasqal_triple_parts)constant_parts));
+      }
+    }
     
     if((v = rasqal_literal_as_variable(t->subject)) &&
        rasqal_query_variable_bound_in_triple(query, v, column) & RASQAL_TRIPLE_SUBJECT)
@@ -134,6 +514,18 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
        rasqal_query_variable_bound_in_triple(query, v, column) & RASQAL_TRIPLE_OBJECT)
       m->parts = (rasqal_triple_parts)(m->parts | RASQAL_TRIPLE_OBJECT);
 
+    if(con->constant_parts)
+      m->parts = (rasqal_triple_parts)(m->parts & ~con->constant_parts[column - con->start_column]);
+
+    /* A GRAPH variable set as the origin by the graph rowsource is
+     * bound by the first triple pattern and restricts the others to
+     * the same graph */
+    if(t->origin && (v = rasqal_literal_as_variable(t->origin)) &&
+       !graph_var) {
+      graph_var = v;
+      m->parts = (rasqal_triple_parts)(m->parts | RASQAL_TRIPLE_ORIGIN);
+    }
+
     RASQAL_DEBUG4("triple pattern column %d has parts %s (%u)\n", column,
                   rasqal_engine_get_parts_string(m->parts), m->parts);
 
@@ -177,6 +569,18 @@ rasqal_triples_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->origin)
     rasqal_free_literal(con->origin);
 
+  if(con->constant_parts)
+    RASQAL_FREE(unsigned int*, con->constant_parts);
+
+  if(con->constant_values)
+    RASQAL_FREE(rasqal_literal**, con->constant_values);
+
+  if(con->filters)
+    raptor_free_sequence(con->filters);
+
+  if(con->filter_columns)
+    RASQAL_FREE(int*, con->filter_columns);
+
   RASQAL_FREE(rasqal_triples_rowsource_context, con);
 
   return 0;
@@ -189,10 +593,32 @@ rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource,
 {
   rasqal_query *query = rowsource->query;
   rasqal_engine_error error = RASQAL_ENGINE_OK;
+  int i;
+
+  /* constants are not bound by matching so give the variables their
+   * values for evaluating filters here and above this rowsource */
+  if(con->constant_values) {
+    for(i = 0; i < con->size; i++) {
+      rasqal_variable* v;
+
+      if(!con->constant_values[i])
+        continue;
+
+      v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
+      if(v->value != con->constant_values[i])
+        rasqal_variable_set_value(v, rasqal_new_literal_from_literal(con->constant_values[i]));
+    }
+  }
   
   while(con->column >= con->start_column) {
     rasqal_triple_meta *m;
     rasqal_triple *t;
+    rasqal_triples_source* triples_source;
+
+    if(rasqal_query_check_budget(query)) {
+      error = RASQAL_ENGINE_ABORTED;
+      break;
+    }
 
     m = &con->triple_meta[con->column - con->start_column];
     t = (rasqal_triple*)raptor_sequence_get_at(con->triples, con->column);
@@ -200,10 +626,52 @@ rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource,
     error = RASQAL_ENGINE_OK;
 
     if(!m->triples_match) {
+      unsigned int constant_parts = 0;
+
+      triples_source = rasqal_triples_rowsource_get_source(con, con->column);
+
+      if(con->constant_parts)
+        constant_parts = con->constant_parts[con->column - con->start_column];
+
       /* Column has no triples match so create a new query */
-      m->triples_match = rasqal_new_triples_match(query,
-                                                  con->triples_source,
-                                                  m, t);
+      if(constant_parts) {
+        /* match the constant values so the triples source can use them */
+        rasqal_triple* bound_t;
+
+        bound_t = rasqal_triples_rowsource_bind_constants(rowsource, con, t,
+                                                          constant_parts);
+        if(!bound_t) {
+          error = RASQAL_ENGINE_FAILED;
+          break;
+        }
+
+        if(!rasqal_literal_as_variable(bound_t->subject) &&
+           !rasqal_literal_as_variable(bound_t->predicate) &&
+           !rasqal_literal_as_variable(bound_t->object) &&
+           !(bound_t->origin &&
+             rasqal_literal_as_variable(bound_t->origin)) &&
+           !triples_source->triple_present(triples_source,
+                                           triples_source->user_data,
+                                           bound_t)) {
+          RASQAL_DEBUG2("bound triple pattern for column %d is not present\n",
+                        con->column);
+          rasqal_free_triple(bound_t);
+
+          /* no match so move to next match in previous column */
+          con->column--;
+          if(con->column < con->start_column) {
+            error = RASQAL_ENGINE_FINISHED;
+            break;
+          }
+          continue;
+        }
+
+        m->triples_match = rasqal_new_triples_match(query, triples_source,
+                                                    m, bound_t);
+        rasqal_free_triple(bound_t);
+      } else
+        m->triples_match = rasqal_new_triples_match(query, triples_source,
+                                                    m, t);
       if(!m->triples_match) {
         /* triples matching setup failed - matching state is unknown */
         RASQAL_DEBUG2("Failed to make a triple match for column %d\n",
@@ -243,6 +711,11 @@ rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource,
       RASQAL_DEBUG2("Nothing to bind_match for column %d\n", con->column);
     }
 
+    if(con->filters && !rasqal_triples_rowsource_check_filters(rowsource, con)) {
+      rasqal_triples_match_next_match(m->triples_match);
+      continue;
+    }
+
     rasqal_triples_match_next_match(m->triples_match);
     
     if(con->column == con->end_column)
@@ -297,7 +770,10 @@ rasqal_triples_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
     if(row->values[i])
       rasqal_free_literal(row->values[i]);
-    row->values[i] = rasqal_new_literal_from_literal(v->value);
+    if(con->constant_values && con->constant_values[i])
+      row->values[i] = rasqal_new_literal_from_literal(con->constant_values[i]);
+    else
+      row->values[i] = rasqal_new_literal_from_literal(v->value);
   }
 
   row->offset = con->offset++;
@@ -374,7 +850,8 @@ static const rasqal_rowsource_handler rasqal_triples_rowsource_handler = {
   /* .reset = */ rasqal_triples_rowsource_reset,
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
-  /* .set_origin = */ rasqal_triples_rowsource_set_origin
+  /* .set_origin = */ rasqal_triples_rowsource_set_origin,
+  /* .set_limit = */ NULL,
 };
 
 
@@ -386,7 +863,8 @@ static const rasqal_rowsource_handler rasqal_triples_rowsource_handler = {
  * @triples: shared triples sequence
  * @start_column: start column in triples sequence
  * @end_column: end column in triples sequence
- * @bound_in: array marking the triples that bind a variable
+ * @filter_expr: filter to evaluate while matching (SHARED) or NULL
+ * @vars_seq: variables to return in rows (SHARED) or NULL for all
  *
  * INTERNAL - create a new triples rowsource
  *
@@ -397,7 +875,9 @@ rasqal_new_triples_rowsource(rasqal_world *world,
                              rasqal_query *query,
                              rasqal_triples_source* triples_source,
                              raptor_sequence* triples,
-                             int start_column, int end_column)
+                             int start_column, int end_column,
+                             rasqal_expression* filter_expr,
+                             raptor_sequence* vars_seq)
 {
   rasqal_triples_rowsource_context *con;
   int flags = 0;
@@ -417,6 +897,8 @@ rasqal_new_triples_rowsource(rasqal_world *world,
   con->start_column = start_column;
   con->end_column = end_column;
   con->column = -1;
+  con->filter_expr = filter_expr;
+  con->vars_seq = vars_seq;
 
   con->triples_count = con->end_column - con->start_column + 1;
 
@@ -435,6 +917,35 @@ rasqal_new_triples_rowsource(rasqal_world *world,
 }
 
 
+/*
+ * rasqal_triples_rowsource_set_triples_sources:
+ * @rowsource: triples rowsource
+ * @triples_sources: array of triples sources indexed by column (SHARED)
+ *
+ * INTERNAL - Set the triples source matching each triple pattern
+ *
+ * A NULL entry in @triples_sources uses the triples source the
+ * rowsource was created with.  Used to match some triple patterns
+ * against only part of the data.
+ *
+ * Return value: non-0 if @rowsource is not a triples rowsource
+ */
+int
+rasqal_triples_rowsource_set_triples_sources(rasqal_rowsource* rowsource,
+                                             rasqal_triples_source** triples_sources)
+{
+  rasqal_triples_rowsource_context *con;
+
+  if(rowsource->handler != &rasqal_triples_rowsource_handler)
+    return 1;
+
+  con = (rasqal_triples_rowsource_context*)rowsource->user_data;
+  con->triples_sources = triples_sources;
+
+  return 0;
+}
+
+
 #endif /* not STANDALONE */
 
 
@@ -451,6 +962,172 @@ FROM <%s> \
 WHERE { ?s ?p ?o }\
 "
 
+/* <http://example.org#subject> <http://example.org#predicate> "object" . */
+#define SUBJECT_URI_STRING RASQAL_GOOD_CAST(const unsigned char*, "http://example.org#subject")
+#define PREDICATE_URI_STRING RASQAL_GOOD_CAST(const unsigned char*, "http://example.org#predicate")
+#define OBJECT_STRING "object"
+
+#define FILTER_QUERY_FORMAT "\
+SELECT ?s ?p ?o \
+FROM <%s> \
+WHERE { ?s ?p ?o FILTER(%s) }\
+"
+
+static const struct {
+  const char* filter;
+  int rows_count;
+} filter_test_data[] = {
+  /* IRI equalities become constants in the triple pattern */
+  { "?p = <http://example.org#predicate>", 1 },
+  { "sameTerm(<http://example.org#subject>, ?s)", 1 },
+  { "?p = <http://example.org#other>", 0 },
+  /* the object is a literal */
+  { "?o = <http://example.org#predicate>", 0 },
+  /* the second equality is evaluated against the first constant */
+  { "?p = <http://example.org#predicate> && ?p = <http://example.org#other>", 0 },
+  /* a constant and a conjunct evaluated after the match */
+  { "?s = <http://example.org#subject> && ?o = \"object\"", 1 },
+  { "?s = <http://example.org#subject> && ?o != \"object\"", 0 },
+  { NULL, 0 }
+};
+
+
+static int
+find_bgp_node(rasqal_query* query, rasqal_algebra_node* node, void* user_data)
+{
+  if(node->op != RASQAL_ALGEBRA_OPERATOR_BGP)
+    return 0;
+
+  *(rasqal_algebra_node**)user_data = node;
+  return 1;
+}
+
+
+/*
+ * Match the triple pattern of the BGP each filter is pushed down
+ * into and check the number of rows and their subject and predicate
+ *
+ * Return value: number of failures
+ */
+static int
+filter_tests(rasqal_world* world, raptor_uri* base_uri, const char* data_file,
+             const char* program)
+{
+  raptor_uri* s_uri;
+  raptor_uri* p_uri;
+  unsigned char *data_string;
+  int failures = 0;
+  int i;
+
+  s_uri = raptor_new_uri(world->raptor_world_ptr, SUBJECT_URI_STRING);
+  p_uri = raptor_new_uri(world->raptor_world_ptr, PREDICATE_URI_STRING);
+  data_string = raptor_uri_filename_to_uri_string(data_file);
+
+  for(i = 0; filter_test_data[i].filter; i++) {
+    const char* filter = filter_test_data[i].filter;
+    rasqal_query* query = NULL;
+    rasqal_algebra_node* node = NULL;
+    rasqal_algebra_node* bgp = NULL;
+    rasqal_triples_source* triples_source = NULL;
+    rasqal_rowsource* rowsource = NULL;
+    unsigned char* query_string;
+    size_t qs_len;
+    int rows_count = 0;
+
+    qs_len = strlen(RASQAL_GOOD_CAST(const char*, data_string)) +
+             strlen(filter) + strlen(FILTER_QUERY_FORMAT);
+    query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+    if(!query_string) {
+      failures++;
+      break;
+    }
+    PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+    snprintf(RASQAL_GOOD_CAST(char*, query_string), qs_len, FILTER_QUERY_FORMAT,
+             data_string, filter);
+    PRAGMA_IGNORE_WARNING_END
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+      fprintf(stderr, "%s: failed to prepare query '%s'\n", program,
+              query_string);
+      failures++;
+      goto tidy;
+    }
+
+    node = rasqal_algebra_query_to_algebra(query);
+    if(node)
+      rasqal_algebra_node_visit(query, node, find_bgp_node, &bgp);
+    if(!bgp || !bgp->expr) {
+      fprintf(stderr, "%s: FILTER(%s) was not pushed down into the triple pattern\n",
+              program, filter);
+      failures++;
+      goto tidy;
+    }
+
+    triples_source = rasqal_new_triples_source(query);
+    if(triples_source)
+      rowsource = rasqal_new_triples_rowsource(world, query, triples_source,
+                                               bgp->triples,
+                                               bgp->start_column,
+                                               bgp->end_column,
+                                               bgp->expr, bgp->vars_seq);
+    if(!rowsource) {
+      fprintf(stderr, "%s: failed to create triples rowsource\n", program);
+      failures++;
+      goto tidy;
+    }
+
+    while(1) {
+      rasqal_row* row;
+      rasqal_literal *s;
+      rasqal_literal *p;
+
+      row = rasqal_rowsource_read_row(rowsource);
+      if(!row)
+        break;
+
+      s = row->values[0];
+      p = row->values[1];
+      if(!s || s->type != RASQAL_LITERAL_URI ||
+         !raptor_uri_equals(s->value.uri, s_uri) ||
+         !p || p->type != RASQAL_LITERAL_URI ||
+         !raptor_uri_equals(p->value.uri, p_uri)) {
+        fprintf(stderr, "%s: FILTER(%s) returned 's' %s and 'p' %s\n",
+                program, filter, rasqal_literal_as_string(s),
+                rasqal_literal_as_string(p));
+        failures++;
+      }
+
+      rasqal_free_row(row);
+      rows_count++;
+    }
+
+    if(rows_count != filter_test_data[i].rows_count) {
+      fprintf(stderr, "%s: FILTER(%s) returned %d rows, expected %d\n",
+              program, filter, rows_count, filter_test_data[i].rows_count);
+      failures++;
+    }
+
+    tidy:
+    if(rowsource)
+      rasqal_free_rowsource(rowsource);
+    if(triples_source)
+      rasqal_free_triples_source(triples_source);
+    if(node)
+      rasqal_free_algebra_node(node);
+    if(query)
+      rasqal_free_query(query);
+    RASQAL_FREE(char*, query_string);
+  }
+
+  raptor_free_memory(data_string);
+  raptor_free_uri(s_uri);
+  raptor_free_uri(p_uri);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -470,10 +1147,6 @@ main(int argc, char *argv[])
   raptor_uri *base_uri = NULL;
   unsigned char *data_string = NULL;
   unsigned char *uri_string = NULL;
-  /* <http://example.org#subject> <http://example.org#predicate> "object" . */
-#define SUBJECT_URI_STRING RASQAL_GOOD_CAST(const unsigned char*, "http://example.org#subject")
-#define PREDICATE_URI_STRING RASQAL_GOOD_CAST(const unsigned char*, "http://example.org#predicate")
-#define OBJECT_STRING "object"
   raptor_uri* s_uri = NULL;
   raptor_uri* p_uri = NULL;
   const char *data_file;
@@ -537,7 +1210,8 @@ main(int argc, char *argv[])
   triples_source = rasqal_new_triples_source(query);
   
   rowsource = rasqal_new_triples_rowsource(world, query, triples_source,
-                                           triples, start_column, end_column);
+                                           triples, start_column, end_column,
+                                           NULL, NULL);
   if(!rowsource) {
     fprintf(stderr, "%s: failed to create triples rowsource\n", program);
     failures++;
@@ -595,6 +1269,8 @@ main(int argc, char *argv[])
       break;
   }
 
+  failures += filter_tests(world, base_uri, data_file, program);
+
   tidy:
   raptor_free_uri(base_uri);
   if(s_uri)
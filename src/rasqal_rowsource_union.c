@@ -47,19 +47,22 @@
 
 typedef struct 
 {
-  rasqal_rowsource* left;
+  /* array of branch rowsources, read in order */
+  rasqal_rowsource** branches;
 
-  rasqal_rowsource* right;
+  /* number of branches */
+  int branches_count;
 
-  /* array of size (number of variables in @right) with this row offset value */
-  int* right_map;
+  /* per branch array of size (number of variables in the branch) with
+   * this row offset value; the first branch needs no map */
+  int** maps;
 
-  /* array of size (number of variables in @right) holding right row
-   * temporarily - no extra reference count is added */
-  rasqal_literal** right_tmp_values;
+  /* array of size (largest number of variables in a branch) holding a
+   * branch row temporarily - no extra reference count is added */
+  rasqal_literal** tmp_values;
 
-  /* 0 = reading from left rs, 1 = reading from right rs, 2 = finished */
-  int state;
+  /* index of branch being read; branches_count when finished */
+  int branch;
 
   int failed;
 
@@ -72,14 +75,16 @@ static int
 rasqal_union_rowsource_init(rasqal_rowsource* rowsource, void *user_data) 
 {
   rasqal_union_rowsource_context* con;
+  int i;
 
   con = (rasqal_union_rowsource_context*)user_data;
-  con->state = 0;
+  con->branch = 0;
 
   con->failed = 0;
 
-  rasqal_rowsource_set_requirements(con->left, RASQAL_ROWSOURCE_REQUIRE_RESET);
-  rasqal_rowsource_set_requirements(con->right, RASQAL_ROWSOURCE_REQUIRE_RESET);
+  for(i = 0; i < con->branches_count; i++)
+    rasqal_rowsource_set_requirements(con->branches[i],
+                                      RASQAL_ROWSOURCE_REQUIRE_RESET);
 
   return 0;
 }
@@ -89,18 +94,28 @@ static int
 rasqal_union_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_union_rowsource_context* con;
+  int i;
+
   con = (rasqal_union_rowsource_context*)user_data;
-  if(con->left)
-    rasqal_free_rowsource(con->left);
-  
-  if(con->right)
-    rasqal_free_rowsource(con->right);
-  
-  if(con->right_map)
-    RASQAL_FREE(int, con->right_map);
+
+  if(con->branches) {
+    for(i = 0; i < con->branches_count; i++) {
+      if(con->branches[i])
+        rasqal_free_rowsource(con->branches[i]);
+    }
+    RASQAL_FREE(ptrarray, con->branches);
+  }
+
+  if(con->maps) {
+    for(i = 0; i < con->branches_count; i++) {
+      if(con->maps[i])
+        RASQAL_FREE(int, con->maps[i]);
+    }
+    RASQAL_FREE(ptrarray, con->maps);
+  }
   
-  if(con->right_tmp_values)
-    RASQAL_FREE(ptrarray, con->right_tmp_values);
+  if(con->tmp_values)
+    RASQAL_FREE(ptrarray, con->tmp_values);
   
   RASQAL_FREE(rasqal_union_rowsource_context, con);
 
@@ -113,74 +128,112 @@ rasqal_union_rowsource_ensure_variables(rasqal_rowsource* rowsource,
                                         void *user_data)
 {
   rasqal_union_rowsource_context* con;
-  int map_size;
+  int max_size = 0;
+  int b;
   int i;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
-  if(rasqal_rowsource_ensure_variables(con->left))
-    return 1;
+  for(b = 0; b < con->branches_count; b++) {
+    int size;
 
-  if(rasqal_rowsource_ensure_variables(con->right))
-    return 1;
+    if(rasqal_rowsource_ensure_variables(con->branches[b]))
+      return 1;
+
+    size = rasqal_rowsource_get_size(con->branches[b]);
+    if(size > max_size)
+      max_size = size;
+  }
 
-  map_size = rasqal_rowsource_get_size(con->right);
-  con->right_map = RASQAL_MALLOC(int*, RASQAL_GOOD_CAST(size_t,
-                                                        sizeof(int) * RASQAL_GOOD_CAST(size_t, map_size)));
-  if(!con->right_map)
+  con->maps = RASQAL_CALLOC(int**, RASQAL_GOOD_CAST(size_t, con->branches_count),
+                            sizeof(int*));
+  if(!con->maps)
     return 1;
 
-  con->right_tmp_values = RASQAL_MALLOC(rasqal_literal**,
-                                        sizeof(rasqal_literal*) * RASQAL_GOOD_CAST(size_t, map_size));
-  if(!con->right_tmp_values)
+  con->tmp_values = RASQAL_MALLOC(rasqal_literal**,
+                                  sizeof(rasqal_literal*) * RASQAL_GOOD_CAST(size_t, max_size + 1));
+  if(!con->tmp_values)
     return 1;
 
   rowsource->size = 0;
 
-  /* copy in variables from left rowsource */
-  if(rasqal_rowsource_copy_variables(rowsource, con->left))
+  /* copy in variables from the first branch */
+  if(rasqal_rowsource_copy_variables(rowsource, con->branches[0]))
     return 1;
   
-  /* add any new variables not already seen from right rowsource */
-  for(i = 0; i < map_size; i++) {
-    rasqal_variable* v;
-    int offset;
-    
-    v = rasqal_rowsource_get_variable_by_offset(con->right, i);
-    if(!v)
-      break;
-    offset = rasqal_rowsource_add_variable(rowsource, v);
-    if(offset < 0)
+  /* add any new variables not already seen from the other branches */
+  for(b = 1; b < con->branches_count; b++) {
+    int map_size = rasqal_rowsource_get_size(con->branches[b]);
+
+    con->maps[b] = RASQAL_MALLOC(int*,
+                                 sizeof(int) * RASQAL_GOOD_CAST(size_t, map_size + 1));
+    if(!con->maps[b])
       return 1;
 
-    con->right_map[i] = offset;
+    for(i = 0; i < map_size; i++) {
+      rasqal_variable* v;
+      int offset;
+    
+      v = rasqal_rowsource_get_variable_by_offset(con->branches[b], i);
+      if(!v)
+        break;
+      offset = rasqal_rowsource_add_variable(rowsource, v);
+      if(offset < 0)
+        return 1;
+
+      con->maps[b][i] = offset;
+    }
   }
 
   return 0;
 }
 
 
-static void
-rasqal_union_rowsource_adjust_right_row(rasqal_rowsource *rowsource,
-                                        rasqal_union_rowsource_context* con,
-                                        rasqal_row *row)
+/*
+ * rasqal_union_rowsource_adjust_row:
+ * @rowsource: union rowsource
+ * @con: union rowsource context
+ * @b: branch index
+ * @row: row read from branch @b
+ *
+ * INTERNAL - Transform a branch row to match the union projection
+ *
+ * The first branch variables are first so its rows only need
+ * resizing; the other rows are moved into place in one step however
+ * many branches there are.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_union_rowsource_adjust_row(rasqal_rowsource *rowsource,
+                                  rasqal_union_rowsource_context* con,
+                                  int b, rasqal_row *row)
 {
-  rasqal_rowsource *right_rowsource = con->right;
+  rasqal_rowsource *branch_rowsource = con->branches[b];
   int i;
 
-  /* save right row values - without adding a reference count */
-  for(i = 0; i < right_rowsource->size; i++)
-    con->right_tmp_values[i] = row->values[i];
+  if(rasqal_row_expand_size(row, rowsource->size))
+    return 1;
+
+  if(b > 0) {
+    /* save branch row values - without adding a reference count */
+    for(i = 0; i < branch_rowsource->size; i++)
+      con->tmp_values[i] = row->values[i];
 
-  /* NULL out other pointers */
-  for(i = 0; i < rowsource->size; i++)
-    row->values[i] = NULL;
+    /* NULL out other pointers */
+    for(i = 0; i < rowsource->size; i++)
+      row->values[i] = NULL;
 
-  /* map them into correct order in result row */
-  for(i = 0; i < right_rowsource->size; i++) {
-    int offset = con->right_map[i];
-    row->values[offset] = con->right_tmp_values[i];
+    /* map them into correct order in result row */
+    for(i = 0; i < branch_rowsource->size; i++) {
+      int offset = con->maps[b][i];
+      row->values[offset] = con->tmp_values[i];
+    }
   }
+
+  rasqal_row_set_rowsource(row, rowsource);
+
+  return 0;
 }
 
 
@@ -192,13 +245,14 @@ rasqal_union_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 
   con = (rasqal_union_rowsource_context*)user_data;
   
-  if(con->failed || con->state > 1)
+  if(con->failed)
     return NULL;
 
-  if(con->state == 0) {
-    row = rasqal_rowsource_read_row(con->left);
+  while(con->branch < con->branches_count) {
+    row = rasqal_rowsource_read_row(con->branches[con->branch]);
 #ifdef RASQAL_DEBUG
-    RASQAL_DEBUG2("rowsource %p read left row : ", rowsource);
+    RASQAL_DEBUG3("rowsource %p read branch %d row : ", rowsource,
+                  con->branch);
     if(row)
       rasqal_row_print(row, stderr);
     else
@@ -206,44 +260,23 @@ rasqal_union_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     fputs("\n", stderr);
 #endif
 
-	if (!row) {
-		con->state = 1;
-		// reset left such that variable bindings (from triple sources, assignments, etc.) are reseted
-		rasqal_rowsource_reset(con->left);
-	} else {
-      /* otherwise: rows from left are correct order but wrong size */
-      if(rasqal_row_expand_size(row, rowsource->size)) {
-        rasqal_free_row(row);
-        return NULL;
-      }
-    }
-  }
-  if(!row && con->state == 1) {
-    row = rasqal_rowsource_read_row(con->right);
-#ifdef RASQAL_DEBUG
-    RASQAL_DEBUG2("rowsource %p read right row : ", rowsource);
     if(row)
-      rasqal_row_print(row, stderr);
-    else
-      fputs("NONE", stderr);
-    fputs("\n", stderr);
-#endif
+      break;
 
-    if(!row)
-      /* finished */
-      con->state = 2;
-    else {
-      if(rasqal_row_expand_size(row, rowsource->size)) {
-        rasqal_free_row(row);
-        return NULL;
-      }
-      /* transform row from right to match new projection */
-      rasqal_union_rowsource_adjust_right_row(rowsource, con, row);
-    }
+    /* reset a finished branch before the next so that the variable
+     * bindings it made (from triple sources, assignments, etc.) are
+     * reset */
+    if(con->branch < con->branches_count - 1)
+      rasqal_rowsource_reset(con->branches[con->branch]);
+    con->branch++;
   }
 
   if(row) {
-    rasqal_row_set_rowsource(row, rowsource);
+    if(rasqal_union_rowsource_adjust_row(rowsource, con, con->branch, row)) {
+      rasqal_free_row(row);
+      con->failed = 1;
+      return NULL;
+    }
     row->offset = con->offset++;
   }
   
@@ -256,69 +289,70 @@ rasqal_union_rowsource_read_all_rows(rasqal_rowsource* rowsource,
                                      void *user_data)
 {
   rasqal_union_rowsource_context* con;
-  raptor_sequence* seq1 = NULL;
-  raptor_sequence* seq2 = NULL;
-  int left_size;
-  int right_size;
-  int i;
+  raptor_sequence* seq = NULL;
+  int offset = 0;
+  int b;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
   if(con->failed)
     return NULL;
   
-  seq1 = rasqal_rowsource_read_all_rows(con->left);
-  if(!seq1) {
-    con->failed = 1;
-    return NULL;
-  }
+  for(b = 0; b < con->branches_count; b++) {
+    raptor_sequence* branch_seq;
+    int size;
+    int i;
+
+    branch_seq = rasqal_rowsource_read_all_rows(con->branches[b]);
+    if(!branch_seq) {
+      con->failed = 1;
+      goto failed;
+    }
 
-  rasqal_rowsource_reset(con->left);
-
-  seq2 = rasqal_rowsource_read_all_rows(con->right);
-  if(!seq2) {
-    con->failed = 1;
-    raptor_free_sequence(seq1);
-    return NULL;
-  }
+    if(b < con->branches_count - 1)
+      rasqal_rowsource_reset(con->branches[b]);
 
 #ifdef RASQAL_DEBUG
-  fprintf(DEBUG_FH, "left rowsource (%d vars):\n",
-          rasqal_rowsource_get_size(con->left));
-  rasqal_rowsource_print_row_sequence(con->left, seq1, DEBUG_FH);
-
-  fprintf(DEBUG_FH, "right rowsource (%d vars):\n",
-          rasqal_rowsource_get_size(con->right));
-  rasqal_rowsource_print_row_sequence(con->right, seq2, DEBUG_FH);
+    fprintf(DEBUG_FH, "branch %d rowsource (%d vars):\n", b,
+            rasqal_rowsource_get_size(con->branches[b]));
+    rasqal_rowsource_print_row_sequence(con->branches[b], branch_seq,
+                                        DEBUG_FH);
 #endif
 
-  /* transform rows from left to match new projection */
-  left_size = raptor_sequence_size(seq1);
-  for(i = 0; i < left_size; i++) {
-    rasqal_row *row = (rasqal_row*)raptor_sequence_get_at(seq1, i);
-    /* rows from left are correct order but wrong size */
-    rasqal_row_expand_size(row, rowsource->size);
-    rasqal_row_set_rowsource(row, rowsource);
-  }
-  /* transform rows from right to match new projection */
-  right_size = raptor_sequence_size(seq2);
-  for(i = 0; i < right_size; i++) {
-    rasqal_row *row = (rasqal_row*)raptor_sequence_get_at(seq2, i);
-    /* rows from right need resizing and adjusting by offset */
-    rasqal_row_expand_size(row, rowsource->size);
-    rasqal_union_rowsource_adjust_right_row(rowsource, con, row);
-    row->offset += left_size;
-    rasqal_row_set_rowsource(row, rowsource);
-  }
-
-  if(raptor_sequence_join(seq1, seq2)) {
-    raptor_free_sequence(seq1);
-    seq1 = NULL;
-  }
-  raptor_free_sequence(seq2);
-  
-  con->state = 2;
-  return seq1;
+    /* transform rows from the branch to match new projection */
+    size = raptor_sequence_size(branch_seq);
+    for(i = 0; i < size; i++) {
+      rasqal_row *row = (rasqal_row*)raptor_sequence_get_at(branch_seq, i);
+
+      if(rasqal_union_rowsource_adjust_row(rowsource, con, b, row)) {
+        raptor_free_sequence(branch_seq);
+        con->failed = 1;
+        goto failed;
+      }
+      row->offset += offset;
+    }
+    offset += size;
+
+    if(!seq)
+      seq = branch_seq;
+    else {
+      int rc = raptor_sequence_join(seq, branch_seq);
+
+      raptor_free_sequence(branch_seq);
+      if(rc) {
+        con->failed = 1;
+        goto failed;
+      }
+    }
+  }
+
+  con->branch = con->branches_count;
+  return seq;
+
+  failed:
+  if(seq)
+    raptor_free_sequence(seq);
+  return NULL;
 }
 
 
@@ -327,17 +361,20 @@ rasqal_union_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_union_rowsource_context* con;
   int rc;
+  int i;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
-  con->state = 0;
+  con->branch = 0;
   con->failed = 0;
 
-  rc = rasqal_rowsource_reset(con->left);
-  if(rc)
-    return rc;
+  for(i = 0; i < con->branches_count; i++) {
+    rc = rasqal_rowsource_reset(con->branches[i]);
+    if(rc)
+      return rc;
+  }
 
-  return rasqal_rowsource_reset(con->right);
+  return 0;
 }
 
 
@@ -348,15 +385,32 @@ rasqal_union_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
   rasqal_union_rowsource_context *con;
   con = (rasqal_union_rowsource_context*)user_data;
 
-  if(offset == 0)
-    return con->left;
-  else if(offset == 1)
-    return con->right;
+  if(offset >= 0 && offset < con->branches_count)
+    return con->branches[offset];
   else
     return NULL;
 }
 
 
+static int
+rasqal_union_rowsource_set_limit(rasqal_rowsource* rowsource,
+                                 void *user_data, int limit)
+{
+  rasqal_union_rowsource_context *con;
+  int i;
+
+  con = (rasqal_union_rowsource_context*)user_data;
+
+  /* any branch may provide all the rows */
+  for(i = 0; i < con->branches_count; i++) {
+    if(rasqal_rowsource_set_limit(con->branches[i], limit))
+      return 1;
+  }
+
+  return 0;
+}
+
+
 static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
   /* .version = */ 1,
   "union",
@@ -369,9 +423,67 @@ static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_union_rowsource_get_inner_rowsource,
   /* .set_origin = */ NULL,
+  /* .set_limit = */ rasqal_union_rowsource_set_limit,
 };
 
 
+/*
+ * rasqal_union_rowsource_add_branches:
+ * @con: union rowsource context
+ * @rs: rowsource (ownership taken)
+ *
+ * INTERNAL - Add a rowsource as branches of a UNION
+ *
+ * The branches of an unshared union rowsource that has not been read
+ * are added in place of it so that nested UNIONs become one union
+ * moving each row once.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_union_rowsource_add_branches(rasqal_union_rowsource_context* con,
+                                    rasqal_rowsource* rs)
+{
+  rasqal_union_rowsource_context* inner_con = NULL;
+  int count = 1;
+  rasqal_rowsource** branches;
+  int i;
+
+  if(rs->handler == &rasqal_union_rowsource_handler && rs->usage == 1 &&
+     !rs->updated_variables) {
+    inner_con = (rasqal_union_rowsource_context*)rs->user_data;
+    count = inner_con->branches_count;
+  }
+
+  branches = RASQAL_MALLOC(rasqal_rowsource**,
+                           sizeof(rasqal_rowsource*) * RASQAL_GOOD_CAST(size_t, con->branches_count + count));
+  if(!branches) {
+    rasqal_free_rowsource(rs);
+    return 1;
+  }
+
+  if(con->branches_count)
+    memcpy(branches, con->branches,
+           sizeof(rasqal_rowsource*) * RASQAL_GOOD_CAST(size_t, con->branches_count));
+  if(con->branches)
+    RASQAL_FREE(ptrarray, con->branches);
+  con->branches = branches;
+
+  if(!inner_con) {
+    con->branches[con->branches_count++] = rs;
+    return 0;
+  }
+
+  /* take the inner branches and free the now empty inner union */
+  for(i = 0; i < count; i++)
+    con->branches[con->branches_count++] = inner_con->branches[i];
+  inner_con->branches_count = 0;
+  rasqal_free_rowsource(rs);
+
+  return 0;
+}
+
+
 /**
  * rasqal_new_union_rowsource:
  * @world: world object
@@ -386,6 +498,11 @@ static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
  * sequence are the same.  If not, construction fails and NULL is
  * returned.
  *
+ * If @left or @right is itself a union rowsource, its branches are
+ * used directly.  The branches are read one after another; a branch
+ * that is an exchange rowsource is evaluated on a worker thread ahead
+ * of the reads.
+ *
  * The @left and @right rowsources become owned by the new rowsource.
  *
  * Return value: new rowsource or NULL on failure
@@ -406,8 +523,17 @@ rasqal_new_union_rowsource(rasqal_world *world,
   if(!con)
     goto fail;
 
-  con->left = left;
-  con->right = right;
+  if(rasqal_union_rowsource_add_branches(con, left)) {
+    left = NULL;
+    goto fail_con;
+  }
+  left = NULL;
+
+  if(rasqal_union_rowsource_add_branches(con, right)) {
+    right = NULL;
+    goto fail_con;
+  }
+  right = NULL;
   
   return rasqal_new_rowsource_from_handler(world, query,
                                            con,
@@ -415,6 +541,8 @@ rasqal_new_union_rowsource(rasqal_world *world,
                                            query->vars_table,
                                            flags);
 
+  fail_con:
+  rasqal_union_rowsource_finish(NULL, con);
   fail:
   if(left)
     rasqal_free_rowsource(left);
@@ -466,6 +594,19 @@ const char* const union_2_data_3x4_rows[] =
 };
 
 
+const char* const union_3_data_2x2_rows[] =
+{
+  /* 2 variable names and 2 rows */
+  "a",   NULL, "d",   NULL,
+  /* row 1 data */
+  "ant", NULL, "dog", NULL,
+  /* row 2 data */
+  "axe", NULL, "dew", NULL,
+  /* end of data */
+  NULL, NULL, NULL, NULL
+};
+
+
 #define EXPECTED_ROWS_COUNT (3 + 4)
 
 /* there is one duplicate variable 'b' */
@@ -473,6 +614,163 @@ const char* const union_2_data_3x4_rows[] =
 const char* const union_result_vars[] = { "a" , "b" , "c", "d" };
 
 
+#define NARY_EXPECTED_ROWS_COUNT (3 + 4 + 2)
+
+/* values of the first (a) and last (d) columns of the 3 branch union */
+const char* const nary_union_expected_a[NARY_EXPECTED_ROWS_COUNT] = {
+  "foo", "baz", "bob", NULL, NULL, NULL, NULL, "ant", "axe"
+};
+const char* const nary_union_expected_d[NARY_EXPECTED_ROWS_COUNT] = {
+  NULL, NULL, NULL, "yellow", "violet", "gold", "bronze", "dog", "dew"
+};
+
+
+static rasqal_rowsource*
+make_rowsequence_rowsource(rasqal_world* world, rasqal_query* query,
+                           const char* const data[], int vars_count)
+{
+  raptor_sequence* seq;
+  raptor_sequence* vars_seq = NULL;
+
+  seq = rasqal_new_row_sequence(world, query->vars_table, data, vars_count,
+                                &vars_seq);
+  if(!seq)
+    return NULL;
+
+  /* seq and vars_seq become owned by the rowsource */
+  return rasqal_new_rowsequence_rowsource(world, query, query->vars_table,
+                                          seq, vars_seq);
+}
+
+
+/* non-0 if column @i of @row is not the string @expected or unbound */
+static int
+check_row_value(rasqal_row* row, int i, const char* expected)
+{
+  rasqal_literal* l = row->values[i];
+
+  if(!expected)
+    return (l != NULL);
+
+  return (!l || strcmp((const char*)rasqal_literal_as_string(l), expected));
+}
+
+
+static int
+check_nary_union_row(const char* program, const char* label, rasqal_row* row,
+                     int i)
+{
+  if(!row) {
+    fprintf(stderr, "%s: %s: row %d is missing\n", program, label, i);
+    return 1;
+  }
+
+  if(row->offset != i ||
+     check_row_value(row, 0, nary_union_expected_a[i]) ||
+     check_row_value(row, 3, nary_union_expected_d[i])) {
+    fprintf(stderr, "%s: %s: row %d (offset %d) is wrong\n", program, label,
+            i, row->offset);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * (A UNION B) UNION C is one union of three branches returning the
+ * rows of A, B and C in order from read_row() or read_all_rows()
+ */
+static int
+nary_union_test(rasqal_world* world, rasqal_query* query, const char* program,
+                int read_all)
+{
+  rasqal_rowsource* rs_a;
+  rasqal_rowsource* rs_b;
+  rasqal_rowsource* rs_c;
+  rasqal_rowsource* inner = NULL;
+  rasqal_rowsource* rowsource = NULL;
+  raptor_sequence* seq = NULL;
+  int failures = 0;
+  int i;
+
+  rs_a = make_rowsequence_rowsource(world, query, union_1_data_2x3_rows, 2);
+  rs_b = make_rowsequence_rowsource(world, query, union_2_data_3x4_rows, 3);
+  rs_c = make_rowsequence_rowsource(world, query, union_3_data_2x2_rows, 2);
+  if(!rs_a || !rs_b || !rs_c) {
+    fprintf(stderr, "%s: failed to create branch rowsources\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  inner = rasqal_new_union_rowsource(world, query, rs_a, rs_b);
+  rs_a = rs_b = NULL;
+  if(!inner) {
+    fprintf(stderr, "%s: failed to create inner union rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  rowsource = rasqal_new_union_rowsource(world, query, inner, rs_c);
+  inner = rs_c = NULL;
+  if(!rowsource) {
+    fprintf(stderr, "%s: failed to create outer union rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(!rasqal_rowsource_get_inner_rowsource(rowsource, 2) ||
+     rasqal_rowsource_get_inner_rowsource(rowsource, 3)) {
+    fprintf(stderr, "%s: nested union did not become 3 branches\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(!read_all) {
+    for(i = 0; i < NARY_EXPECTED_ROWS_COUNT; i++) {
+      rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+
+      failures += check_nary_union_row(program, "read_row", row, i);
+      if(!row)
+        goto tidy;
+      rasqal_free_row(row);
+    }
+    if(rasqal_rowsource_read_row(rowsource)) {
+      fprintf(stderr, "%s: read_row returned too many rows\n", program);
+      failures++;
+    }
+    goto tidy;
+  }
+
+  seq = rasqal_rowsource_read_all_rows(rowsource);
+  if(!seq || raptor_sequence_size(seq) != NARY_EXPECTED_ROWS_COUNT) {
+    fprintf(stderr, "%s: read_all_rows returned %d rows, expected %d\n",
+            program, seq ? raptor_sequence_size(seq) : -1,
+            NARY_EXPECTED_ROWS_COUNT);
+    failures++;
+    goto tidy;
+  }
+  for(i = 0; i < NARY_EXPECTED_ROWS_COUNT; i++)
+    failures += check_nary_union_row(program, "read_all_rows",
+                                     (rasqal_row*)raptor_sequence_get_at(seq, i),
+                                     i);
+
+  tidy:
+  if(seq)
+    raptor_free_sequence(seq);
+  if(rs_a)
+    rasqal_free_rowsource(rs_a);
+  if(rs_b)
+    rasqal_free_rowsource(rs_b);
+  if(rs_c)
+    rasqal_free_rowsource(rs_c);
+  if(rowsource)
+    rasqal_free_rowsource(rowsource);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -602,6 +900,9 @@ main(int argc, char *argv[])
   rasqal_rowsource_print_row_sequence(rowsource, seq, DEBUG_FH);
 #endif
 
+  failures += nary_union_test(world, query, program, 0);
+  failures += nary_union_test(world, query, program, 1);
+
   tidy:
   if(seq)
     raptor_free_sequence(seq);
@@ -0,0 +1,611 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_strings.c - Rasqal string search, case and length kernels
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+#ifndef STANDALONE
+
+/*
+ * SSE2 is part of every x86-64 CPU; AVX2 versions are compiled with a
+ * function target attribute and chosen when the running CPU has it.
+ */
+#if defined(HAVE_IMMINTRIN_H) && defined(__GNUC__) && \
+  (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define RASQAL_STRINGS_X86 1
+#include <immintrin.h>
+
+#if defined(__clang__) || \
+  (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define RASQAL_STRINGS_AVX2 1
+#define RASQAL_AVX2_FUNCTION __attribute__((target("avx2")))
+#define RASQAL_HAVE_AVX2 __builtin_cpu_supports("avx2")
+#endif
+#endif
+
+
+#ifdef RASQAL_STRINGS_AVX2
+RASQAL_AVX2_FUNCTION
+static size_t
+rasqal_string_ascii_prefix_length_avx2(const unsigned char* s, size_t len)
+{
+  size_t i = 0;
+
+  for(; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(RASQAL_GOOD_CAST(const __m256i*, s + i));
+    unsigned int mask = RASQAL_GOOD_CAST(unsigned int, _mm256_movemask_epi8(v));
+
+    if(mask)
+      return i + RASQAL_GOOD_CAST(size_t, __builtin_ctz(mask));
+  }
+
+  return i;
+}
+#endif
+
+
+/*
+ * rasqal_string_ascii_prefix_length:
+ * @s: string
+ * @len: length of @s in bytes
+ *
+ * INTERNAL - Count the bytes before the first non-ASCII byte of a string
+ *
+ * Return value: length of the ASCII prefix of @s
+ */
+size_t
+rasqal_string_ascii_prefix_length(const unsigned char* s, size_t len)
+{
+  size_t i = 0;
+
+#ifdef RASQAL_STRINGS_X86
+#ifdef RASQAL_STRINGS_AVX2
+  if(len >= 32 && RASQAL_HAVE_AVX2) {
+    i = rasqal_string_ascii_prefix_length_avx2(s, len);
+    if(i + 32 <= len)
+      return i;
+  }
+#endif
+
+  for(; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(RASQAL_GOOD_CAST(const __m128i*, s + i));
+    unsigned int mask = RASQAL_GOOD_CAST(unsigned int, _mm_movemask_epi8(v));
+
+    if(mask)
+      return i + RASQAL_GOOD_CAST(size_t, __builtin_ctz(mask));
+  }
+#endif
+
+  for(; i < len; i++) {
+    if(s[i] & 0x80)
+      break;
+  }
+
+  return i;
+}
+
+
+/*
+ * rasqal_utf8_strlen:
+ * @s: UTF-8 string
+ * @len: length of @s in bytes
+ *
+ * INTERNAL - Count the Unicode codepoints in a UTF-8 string
+ *
+ * The ASCII prefix is counted a vector at a time and the rest of the
+ * string is counted and checked by raptor_unicode_utf8_strlen().
+ *
+ * Return value: number of codepoints or <0 if @s is not valid UTF-8
+ */
+int
+rasqal_utf8_strlen(const unsigned char* s, size_t len)
+{
+  size_t prefix_len = rasqal_string_ascii_prefix_length(s, len);
+  int rest_len;
+
+  if(prefix_len == len)
+    return RASQAL_GOOD_CAST(int, len);
+
+  rest_len = raptor_unicode_utf8_strlen(s + prefix_len, len - prefix_len);
+  if(rest_len < 0)
+    return rest_len;
+
+  return RASQAL_GOOD_CAST(int, prefix_len) + rest_len;
+}
+
+
+#ifdef RASQAL_STRINGS_AVX2
+RASQAL_AVX2_FUNCTION
+static const unsigned char*
+rasqal_string_search_avx2(const unsigned char* haystack, size_t haystack_len,
+                          const unsigned char* needle, size_t needle_len,
+                          size_t* offset_p)
+{
+  __m256i first = _mm256_set1_epi8(RASQAL_GOOD_CAST(char, needle[0]));
+  __m256i last = _mm256_set1_epi8(RASQAL_GOOD_CAST(char, needle[needle_len - 1]));
+  size_t i;
+
+  for(i = 0; i + needle_len - 1 + 32 <= haystack_len; i += 32) {
+    const unsigned char* p = haystack + i;
+    __m256i eq_first, eq_last;
+    unsigned int mask;
+
+    eq_first = _mm256_cmpeq_epi8(first, _mm256_loadu_si256(RASQAL_GOOD_CAST(const __m256i*, p)));
+    eq_last = _mm256_cmpeq_epi8(last, _mm256_loadu_si256(RASQAL_GOOD_CAST(const __m256i*, p + needle_len - 1)));
+    mask = RASQAL_GOOD_CAST(unsigned int,
+                            _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last)));
+
+    while(mask) {
+      size_t bit = RASQAL_GOOD_CAST(size_t, __builtin_ctz(mask));
+
+      if(!memcmp(p + bit + 1, needle + 1, needle_len - 2))
+        return p + bit;
+
+      mask &= mask - 1;
+    }
+  }
+
+  *offset_p = i;
+  return NULL;
+}
+#endif
+
+
+/*
+ * rasqal_string_search:
+ * @haystack: string to search
+ * @haystack_len: length of @haystack in bytes
+ * @needle: string to find
+ * @needle_len: length of @needle in bytes
+ *
+ * INTERNAL - Find the first occurrence of a counted string in another
+ *
+ * Candidate positions where the first and last bytes of @needle both
+ * match are found a vector at a time and only those are compared in
+ * full.
+ *
+ * Return value: pointer to the first match in @haystack or NULL
+ */
+const unsigned char*
+rasqal_string_search(const unsigned char* haystack, size_t haystack_len,
+                     const unsigned char* needle, size_t needle_len)
+{
+  size_t i = 0;
+  unsigned char first;
+  unsigned char last;
+
+  if(!needle_len)
+    return haystack;
+
+  if(needle_len > haystack_len)
+    return NULL;
+
+  if(needle_len == 1)
+    return RASQAL_GOOD_CAST(const unsigned char*,
+                            memchr(haystack, needle[0], haystack_len));
+
+#ifdef RASQAL_STRINGS_X86
+#ifdef RASQAL_STRINGS_AVX2
+  if(haystack_len - needle_len + 1 >= 32 && RASQAL_HAVE_AVX2) {
+    const unsigned char* p;
+
+    p = rasqal_string_search_avx2(haystack, haystack_len,
+                                  needle, needle_len, &i);
+    if(p)
+      return p;
+  }
+#endif
+
+  if(1) {
+    __m128i first_v = _mm_set1_epi8(RASQAL_GOOD_CAST(char, needle[0]));
+    __m128i last_v = _mm_set1_epi8(RASQAL_GOOD_CAST(char, needle[needle_len - 1]));
+
+    for(; i + needle_len - 1 + 16 <= haystack_len; i += 16) {
+      const unsigned char* p = haystack + i;
+      __m128i eq_first, eq_last;
+      unsigned int mask;
+
+      eq_first = _mm_cmpeq_epi8(first_v, _mm_loadu_si128(RASQAL_GOOD_CAST(const __m128i*, p)));
+      eq_last = _mm_cmpeq_epi8(last_v, _mm_loadu_si128(RASQAL_GOOD_CAST(const __m128i*, p + needle_len - 1)));
+      mask = RASQAL_GOOD_CAST(unsigned int,
+                              _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last)));
+
+      while(mask) {
+        size_t bit = RASQAL_GOOD_CAST(size_t, __builtin_ctz(mask));
+
+        if(!memcmp(p + bit + 1, needle + 1, needle_len - 2))
+          return p + bit;
+
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
+
+  first = needle[0];
+  last = needle[needle_len - 1];
+  for(; i + needle_len <= haystack_len; i++) {
+    const unsigned char* p = haystack + i;
+
+    if(p[0] == first && p[needle_len - 1] == last &&
+       !memcmp(p + 1, needle + 1, needle_len - 2))
+      return p;
+  }
+
+  return NULL;
+}
+
+
+#ifdef RASQAL_STRINGS_AVX2
+RASQAL_AVX2_FUNCTION
+static size_t
+rasqal_string_set_case_avx2(unsigned char* dest, const unsigned char* src,
+                            size_t len, unsigned char from)
+{
+  __m256i below = _mm256_set1_epi8(RASQAL_GOOD_CAST(char, from - 1));
+  __m256i above = _mm256_set1_epi8(RASQAL_GOOD_CAST(char, from + 26));
+  __m256i bit = _mm256_set1_epi8(0x20);
+  size_t i;
+
+  for(i = 0; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(RASQAL_GOOD_CAST(const __m256i*, src + i));
+    /* bytes >= 0x80 are negative so never in range */
+    __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(v, below),
+                                        _mm256_cmpgt_epi8(above, v));
+
+    v = _mm256_xor_si256(v, _mm256_and_si256(in_range, bit));
+    _mm256_storeu_si256(RASQAL_GOOD_CAST(__m256i*, dest + i), v);
+  }
+
+  return i;
+}
+#endif
+
+
+/*
+ * rasqal_string_set_case:
+ * @dest: output buffer of at least @len bytes
+ * @src: UTF-8 string
+ * @len: length of @src in bytes
+ * @upper: non-0 to upper case, 0 to lower case
+ *
+ * INTERNAL - Copy a UTF-8 string changing the case of ASCII letters
+ *
+ * Bytes that are not ASCII letters, including all bytes of multi-byte
+ * UTF-8 sequences, are copied unchanged.
+ */
+void
+rasqal_string_set_case(unsigned char* dest, const unsigned char* src,
+                       size_t len, int upper)
+{
+  unsigned char from = upper ? 'a' : 'A';
+  size_t i = 0;
+
+#ifdef RASQAL_STRINGS_X86
+#ifdef RASQAL_STRINGS_AVX2
+  if(len >= 32 && RASQAL_HAVE_AVX2)
+    i = rasqal_string_set_case_avx2(dest, src, len, from);
+#endif
+
+  if(1) {
+    __m128i below = _mm_set1_epi8(RASQAL_GOOD_CAST(char, from - 1));
+    __m128i above = _mm_set1_epi8(RASQAL_GOOD_CAST(char, from + 26));
+    __m128i bit = _mm_set1_epi8(0x20);
+
+    for(; i + 16 <= len; i += 16) {
+      __m128i v = _mm_loadu_si128(RASQAL_GOOD_CAST(const __m128i*, src + i));
+      /* bytes >= 0x80 are negative so never in range */
+      __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, below),
+                                       _mm_cmpgt_epi8(above, v));
+
+      v = _mm_xor_si128(v, _mm_and_si128(in_range, bit));
+      _mm_storeu_si128(RASQAL_GOOD_CAST(__m128i*, dest + i), v);
+    }
+  }
+#endif
+
+  for(; i < len; i++) {
+    unsigned char c = src[i];
+
+    if(c >= from && c < from + 26)
+      c ^= 0x20;
+    dest[i] = c;
+  }
+}
+
+#endif /* not STANDALONE */
+
+
+#ifdef STANDALONE
+#include <stdio.h>
+
+int main(int argc, char *argv[]);
+
+
+/* longest haystack: past two 32 byte vectors plus the longest needle */
+#define MAX_HAYSTACK_LEN 100
+
+static const size_t search_test_needle_lens[] = { 0, 1, 2, 33 };
+#define SEARCH_TEST_NEEDLE_LENS_COUNT 4
+
+
+/* first occurrence by comparing at every offset */
+static const unsigned char*
+search_reference(const unsigned char* haystack, size_t haystack_len,
+                 const unsigned char* needle, size_t needle_len)
+{
+  size_t i;
+
+  for(i = 0; i + needle_len <= haystack_len; i++) {
+    if(!memcmp(haystack + i, needle, needle_len))
+      return haystack + i;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Search every haystack length with @needle placed nowhere, at the
+ * start, in the middle and at the end, after a near miss with the same
+ * first and last bytes.  The haystack is allocated at its exact length
+ * so memory checkers see reads past the end.
+ *
+ * Return value: number of failures
+ */
+static int
+search_tests(const char* program, const unsigned char* needle,
+             size_t needle_len)
+{
+  int failures = 0;
+  size_t haystack_len;
+
+  for(haystack_len = 0; haystack_len <= MAX_HAYSTACK_LEN; haystack_len++) {
+    unsigned char* haystack;
+    int place;
+
+    haystack = RASQAL_MALLOC(unsigned char*, haystack_len + 1);
+    if(!haystack)
+      return failures + 1;
+
+    for(place = 0; place < 4; place++) {
+      const unsigned char* expected = NULL;
+      const unsigned char* p;
+      size_t i;
+
+      /* filler with embedded NULs and no 'N' so only the needle matches */
+      for(i = 0; i < haystack_len; i++)
+        haystack[i] = (i % 3) ? RASQAL_GOOD_CAST(unsigned char, 'a' + i % 7) : '\0';
+
+      /* an empty needle is always found at the start */
+      if(!needle_len)
+        expected = haystack;
+      else if(place && needle_len <= haystack_len) {
+        size_t offset;
+
+        if(place == 1)
+          offset = 0;
+        else if(place == 2)
+          offset = (haystack_len - needle_len) / 2;
+        else
+          offset = haystack_len - needle_len;
+
+        /* a near miss before the needle */
+        if(needle_len > 2 && offset >= needle_len) {
+          memcpy(haystack + offset - needle_len, needle, needle_len);
+          haystack[offset - needle_len + 1] = 'x';
+        }
+
+        memcpy(haystack + offset, needle, needle_len);
+        expected = haystack + offset;
+      }
+
+      p = rasqal_string_search(haystack, haystack_len, needle, needle_len);
+      if(p != expected ||
+         p != search_reference(haystack, haystack_len, needle, needle_len)) {
+        fprintf(stderr,
+                "%s: search for needle length %d in haystack length %d placement %d FAILED returning offset %d, expected %d\n",
+                program, RASQAL_GOOD_CAST(int, needle_len),
+                RASQAL_GOOD_CAST(int, haystack_len), place,
+                p ? RASQAL_GOOD_CAST(int, p - haystack) : -1,
+                expected ? RASQAL_GOOD_CAST(int, expected - haystack) : -1);
+        failures++;
+      }
+    }
+
+    RASQAL_FREE(unsigned char*, haystack);
+  }
+
+  return failures;
+}
+
+
+/* ASCII letters around the case ranges, a NUL and UTF-8 sequences of
+ * 2, 3 and 4 bytes including the upper and lower case e acute */
+static const unsigned char case_test_source[] =
+  "aZ@[`{ Stra\xc3\x9f" "e\0caf\xc3\xa9 \xc3\x89T\xc3\x89 \xe2\x82\xac" "uro \xf0\x9f\x98\x80!";
+#define CASE_TEST_SOURCE_LEN (sizeof(case_test_source) - 1)
+
+/* only the ASCII letters change */
+static const unsigned char case_test_upper[] =
+  "AZ@[`{ STRA\xc3\x9f" "E\0CAF\xc3\xa9 \xc3\x89T\xc3\x89 \xe2\x82\xac" "URO \xf0\x9f\x98\x80!";
+static const unsigned char case_test_lower[] =
+  "az@[`{ stra\xc3\x9f" "e\0caf\xc3\xa9 \xc3\x89t\xc3\x89 \xe2\x82\xac" "uro \xf0\x9f\x98\x80!";
+
+/* codepoints in case_test_source */
+#define CASE_TEST_SOURCE_CHARS 30
+
+
+/*
+ * Change the case of every length of the repeated test string at
+ * every starting offset so the UTF-8 sequences straddle the 16 and 32
+ * byte vectors.
+ *
+ * Return value: number of failures
+ */
+static int
+case_tests(const char* program)
+{
+  unsigned char src[MAX_HAYSTACK_LEN];
+  unsigned char expected[MAX_HAYSTACK_LEN];
+  unsigned char dest[MAX_HAYSTACK_LEN];
+  int failures = 0;
+  int upper;
+  int chars;
+
+  for(upper = 0; upper < 2; upper++) {
+    const unsigned char* converted = upper ? case_test_upper : case_test_lower;
+    size_t start;
+
+    for(start = 0; start < CASE_TEST_SOURCE_LEN; start++) {
+      size_t len;
+
+      for(len = 0; len <= MAX_HAYSTACK_LEN; len++) {
+        size_t i;
+
+        for(i = 0; i < len; i++) {
+          src[i] = case_test_source[(start + i) % CASE_TEST_SOURCE_LEN];
+          expected[i] = converted[(start + i) % CASE_TEST_SOURCE_LEN];
+        }
+
+        memset(dest, 0xff, sizeof(dest));
+        rasqal_string_set_case(dest, src, len, upper);
+        if(memcmp(dest, expected, len) ||
+           (len < MAX_HAYSTACK_LEN && dest[len] != 0xff)) {
+          fprintf(stderr, "%s: %s of length %d from offset %d FAILED\n",
+                  program, upper ? "UCASE" : "LCASE",
+                  RASQAL_GOOD_CAST(int, len), RASQAL_GOOD_CAST(int, start));
+          failures++;
+        }
+      }
+    }
+  }
+
+  /* in place and with the UTF-8 starting past the vectors */
+  memset(src, 'a', sizeof(src));
+  memcpy(src + 40, case_test_source, CASE_TEST_SOURCE_LEN);
+  rasqal_string_set_case(src, src, 40 + CASE_TEST_SOURCE_LEN, 1);
+  for(chars = 0; chars < 40; chars++) {
+    if(src[chars] != 'A')
+      break;
+  }
+  if(chars != 40 ||
+     memcmp(src + 40, case_test_upper, CASE_TEST_SOURCE_LEN)) {
+    fprintf(stderr, "%s: UCASE in place FAILED\n", program);
+    failures++;
+  }
+
+  /* the codepoints are counted after an ASCII prefix */
+  chars = rasqal_utf8_strlen(src, 40 + CASE_TEST_SOURCE_LEN);
+  if(chars != 40 + CASE_TEST_SOURCE_CHARS) {
+    fprintf(stderr, "%s: STRLEN FAILED returning %d, expected %d\n",
+            program, chars, 40 + CASE_TEST_SOURCE_CHARS);
+    failures++;
+  }
+
+  return failures;
+}
+
+
+/*
+ * Find the first non-ASCII byte at every offset of every length.
+ *
+ * Return value: number of failures
+ */
+static int
+ascii_prefix_tests(const char* program)
+{
+  unsigned char s[MAX_HAYSTACK_LEN];
+  int failures = 0;
+  size_t len;
+
+  for(len = 0; len <= MAX_HAYSTACK_LEN; len++) {
+    size_t offset;
+
+    /* offset len is all ASCII */
+    for(offset = 0; offset <= len; offset++) {
+      size_t prefix_len;
+
+      memset(s, 'a', len);
+      if(offset < len)
+        s[offset] = 0xc3;
+
+      prefix_len = rasqal_string_ascii_prefix_length(s, len);
+      if(prefix_len != offset) {
+        fprintf(stderr,
+                "%s: ASCII prefix of length %d string FAILED returning %d, expected %d\n",
+                program, RASQAL_GOOD_CAST(int, len),
+                RASQAL_GOOD_CAST(int, prefix_len),
+                RASQAL_GOOD_CAST(int, offset));
+        failures++;
+      }
+    }
+  }
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = rasqal_basename(argv[0]);
+  unsigned char needle[40];
+  int failures = 0;
+  int i;
+
+  for(i = 0; i < SEARCH_TEST_NEEDLE_LENS_COUNT; i++) {
+    size_t needle_len = search_test_needle_lens[i];
+    size_t j;
+
+    /* 'N' first and last with NULs inside */
+    for(j = 0; j < needle_len; j++)
+      needle[j] = (j % 2) ? '\0' : RASQAL_GOOD_CAST(unsigned char, 'M' + j % 5);
+    if(needle_len) {
+      needle[0] = 'N';
+      needle[needle_len - 1] = 'N';
+    }
+
+    failures += search_tests(program, needle, needle_len);
+  }
+
+  failures += case_tests(program);
+  failures += ascii_prefix_tests(program);
+
+  return failures;
+}
+#endif /* STANDALONE */
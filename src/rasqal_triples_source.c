@@ -275,7 +275,8 @@ rasqal_new_triples_match(rasqal_query* query,
     rtm->is_exact = 1;
     if(rasqal_literal_as_variable(t->predicate) ||
        rasqal_literal_as_variable(t->subject) ||
-       rasqal_literal_as_variable(t->object))
+       rasqal_literal_as_variable(t->object) ||
+       (t->origin && rasqal_literal_as_variable(t->origin)))
       rtm->is_exact = 0;
 
     if(rtm->is_exact) {
@@ -346,25 +346,42 @@ rasqal_xsd_check_integer_format(const unsigned char* string, int flags)
  * Return value: new string or NULL on failure
  */
 unsigned char*
-rasqal_xsd_format_integer(int i, size_t *len_p)
+rasqal_xsd_format_integer(rasqal_int64 i, size_t *len_p)
 {
   unsigned char* string;
-  
   /* Buffer sizes need to format:
    *   4:  8 bit decimal integers (xsd:byte)  "-128" to "127"
    *   6: 16 bit decimal integers (xsd:short) "-32768" to "32767" 
    *  11: 32 bit decimal integers (xsd:int)   "-2147483648" to "2147483647"
    *  20: 64 bit decimal integers (xsd:long)  "-9223372036854775808" to "9223372036854775807"
-   * (the lexical form may have leading 0s in non-canonical representations)
    */
 #define INTEGER_BUFFER_SIZE 20
-  string = RASQAL_MALLOC(unsigned char*, INTEGER_BUFFER_SIZE + 1);
+  unsigned char buffer[INTEGER_BUFFER_SIZE];
+  unsigned char* p = buffer + INTEGER_BUFFER_SIZE;
+  uint64_t u = RASQAL_GOOD_CAST(uint64_t, i);
+  size_t len;
+
+  /* negate as unsigned so the most negative value does not overflow */
+  if(i < 0)
+    u = 0 - u;
+
+  do {
+    *--p = RASQAL_GOOD_CAST(unsigned char, '0' + (u % 10));
+    u /= 10;
+  } while(u);
+
+  if(i < 0)
+    *--p = '-';
+
+  len = RASQAL_GOOD_CAST(size_t, buffer + INTEGER_BUFFER_SIZE - p);
+  string = RASQAL_MALLOC(unsigned char*, len + 1);
   if(!string)
     return NULL;
-  /* snprintf() takes as length the buffer size including NUL */
-  snprintf(RASQAL_GOOD_CAST(char*, string), INTEGER_BUFFER_SIZE + 1, "%d", i);
+
+  memcpy(string, p, len);
+  string[len] = '\0';
   if(len_p)
-    *len_p = strlen(RASQAL_GOOD_CAST(const char*, string));
+    *len_p = len;
 
   return string;
 }
@@ -36,6 +36,9 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 
 #include <rasqal.h>
 #include <rasqal_internal.h>
@@ -2631,7 +2634,12 @@ LimitClause: LIMIT INTEGER_LITERAL
   $$ = -1;
 
   if($2 != NULL) {
-    $$ = $2->value.integer;
+    int error = 0;
+
+    $$ = rasqal_literal_as_integer($2, &error);
+    if(error)
+      /* larger than any number of results */
+      $$ = INT_MAX;
     rasqal_free_literal($2);
   }
   
@@ -2645,7 +2653,12 @@ OffsetClause: OFFSET INTEGER_LITERAL
   $$ = -1;
 
   if($2 != NULL) {
-    $$ = $2->value.integer;
+    int error = 0;
+
+    $$ = rasqal_literal_as_integer($2, &error);
+    if(error)
+      /* larger than any number of results */
+      $$ = INT_MAX;
     rasqal_free_literal($2);
   }
 }
@@ -0,0 +1,312 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_algebra_plan_test.c - Rasqal RDF Query repeated execution Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_algebra_plan_test.nt"
+
+#define NAMED_GRAPH_URI "http://example.org/named"
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* executions of each prepared query */
+#define EXECUTIONS_COUNT 3
+
+static const struct {
+  const char* label;
+  /* non-0 if the query returns rows */
+  int has_rows;
+  const char* query_string;
+} plan_test_queries[] = {
+  { "group by with aggregates", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?g (COUNT(*) AS ?count) (SUM(?v) AS ?sum) (MIN(?v) AS ?min) "
+    "(MAX(?v) AS ?max) (AVG(?v) AS ?avg) "
+    "(GROUP_CONCAT(STR(?v); SEPARATOR=\",\") AS ?values) "
+    "WHERE { ?s ex:group ?g . ?s ex:v ?v } "
+    "GROUP BY ?g HAVING(COUNT(*) > 1) ORDER BY ?g" },
+  { "ungrouped aggregates", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT (COUNT(DISTINCT ?g) AS ?groups) (SUM(?v) AS ?sum) "
+    "WHERE { ?s ex:group ?g . ?s ex:v ?v }" },
+  { "order by with limit and offset", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v WHERE { ?s ex:v ?v } ORDER BY DESC(?v) ?s "
+    "LIMIT 10 OFFSET 3" },
+  { "distinct order by", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT DISTINCT ?v WHERE { ?s ex:v ?v } ORDER BY ?v" },
+  { "graph not in the dataset", 0,
+    "SELECT ?s WHERE { GRAPH <http://example.org/missing> { ?s ?p ?o } }" },
+  { "graph not in the dataset in a union", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v WHERE { "
+    "{ ?s ex:v ?v } UNION { GRAPH <http://example.org/missing> { ?s ex:v ?v } } "
+    "} ORDER BY ?s" },
+  { "named graph", 1,
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s WHERE { GRAPH <" NAMED_GRAPH_URI "> { ?s ex:v 3 } } "
+    "ORDER BY ?s" },
+  { NULL, 0, NULL }
+};
+
+
+static int
+write_data(void)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(DATA_FILE_NAME, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < 20; i++) {
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/group> <http://example.org/g/%d> .\n",
+            i, i % 4);
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> \"%d\"^^<" XSD "integer> .\n",
+            i, i % 7);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and write every row to a new string
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(rasqal_query* query)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return NULL;
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  if(!iostr) {
+    rasqal_free_query_results(results);
+    return NULL;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal_write(rasqal_query_results_get_binding_value(results, i),
+                           iostr);
+      raptor_iostream_write_byte(' ', iostr);
+    }
+    raptor_iostream_write_byte('\n', iostr);
+
+    rasqal_query_results_next(results);
+  }
+  rasqal_free_query_results(results);
+  raptor_free_iostream(iostr);
+
+  return (char*)string;
+}
+
+
+static rasqal_query*
+new_query(const char* program, rasqal_world* world, const char* query_string,
+          raptor_uri* base_uri, raptor_uri* data_uri, raptor_uri* graph_uri)
+{
+  rasqal_query* query;
+  rasqal_data_graph* dg;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query ||
+     rasqal_query_prepare(query, (const unsigned char*)query_string,
+                          base_uri)) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    if(query)
+      rasqal_free_query(query);
+    return NULL;
+  }
+
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                      RASQAL_DATA_GRAPH_BACKGROUND,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg)) {
+    fprintf(stderr, "%s: adding data graph FAILED\n", program);
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, graph_uri,
+                                      RASQAL_DATA_GRAPH_NAMED,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg)) {
+    fprintf(stderr, "%s: adding named data graph FAILED\n", program);
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  return query;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  raptor_uri *graph_uri;
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  if(write_data()) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  graph_uri = raptor_new_uri(world->raptor_world_ptr,
+                             (const unsigned char*)NAMED_GRAPH_URI);
+
+  for(q = 0; plan_test_queries[q].label; q++) {
+    const char* label = plan_test_queries[q].label;
+    rasqal_query* query;
+    struct rasqal_algebra_node_s* plan = NULL;
+    char* expected;
+    int i;
+
+    /* evaluated once by its own query */
+    query = new_query(program, world, plan_test_queries[q].query_string,
+                      base_uri, data_uri, graph_uri);
+    if(!query)
+      return(1);
+    expected = run_query(query);
+    rasqal_free_query(query);
+    if(!expected) {
+      fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+      failures++;
+      continue;
+    }
+
+    if(plan_test_queries[q].has_rows != (*expected != '\0')) {
+      fprintf(stderr, "%s: %s: FAILED returned\n%s", program, label,
+              expected);
+      failures++;
+    }
+
+    query = new_query(program, world, plan_test_queries[q].query_string,
+                      base_uri, data_uri, graph_uri);
+    if(!query)
+      return(1);
+
+    for(i = 0; i < EXECUTIONS_COUNT; i++) {
+      char* result = run_query(query);
+
+      if(!result) {
+        fprintf(stderr, "%s: %s: execution %d FAILED\n", program, label, i);
+        failures++;
+        continue;
+      }
+
+      if(strcmp(result, expected)) {
+        fprintf(stderr, "%s: %s: FAILED execution %d returned\n%sexpected\n%s",
+                program, label, i, result, expected);
+        failures++;
+      }
+      raptor_free_memory(result);
+
+      /* built by the first execution and reused by the others */
+      if(!query->algebra_plan || (i && query->algebra_plan != plan)) {
+        fprintf(stderr, "%s: %s: FAILED execution %d did not reuse the algebra\n",
+                program, label, i);
+        failures++;
+      }
+      plan = query->algebra_plan;
+    }
+
+    rasqal_free_query(query);
+    raptor_free_memory(expected);
+  }
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(graph_uri);
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -0,0 +1,261 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_append_test.c - Rasqal RDF Query appended N-Triples graph Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#define QUERY_STRING "\
+SELECT ?s ?letter \
+WHERE { \
+  ?s <http://example.org#pred> ?letter \
+} \
+ORDER BY ?letter \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_append_test.nt"
+
+/* every triple has the same blank node subject; it keeps its ID only
+ * while the cached graph is extended rather than parsed again */
+#define LINE(letter) "_:n <http://example.org#pred> \"" letter "\" .\n"
+#define LINE_NO_NEWLINE(letter) "_:n <http://example.org#pred> \"" letter "\" ."
+
+static const struct {
+  /* "w" to write the file or "a" to append to it */
+  const char* mode;
+  const char* content;
+  /* letters of the graph in order */
+  const char* expected;
+  /* non-0 if the graph is extended, 0 if parsed again */
+  int extended;
+} append_test_steps[] = {
+  { "w", LINE("a") LINE("b"), "ab", 0 },
+  { "a", LINE("c"), "abc", 1 },
+  { "a", LINE("d"), "abcd", 1 },
+  /* changed prefix: a different first line of the same length */
+  { "w", LINE("x") LINE("b") LINE("c") LINE("d") LINE("e"), "bcdex", 0 },
+  /* the appended line may have no newline... */
+  { "a", LINE_NO_NEWLINE("h"), "bcdehx", 1 },
+  /* ...but then the file cannot be extended after it */
+  { "a", "\n" LINE("i"), "bcdehix", 0 },
+  /* truncated file */
+  { "w", LINE("a") LINE("b"), "ab", 0 },
+  /* grown again from the same prefix */
+  { "w", LINE("a") LINE("b") LINE("f"), "abf", 1 },
+  { NULL, NULL, NULL, 0 }
+};
+
+
+/*
+ * Execute @query and check it returns the letters in @expected with
+ * one blank node subject, copying its ID into @bnode_id
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_results(const char* program, int step, rasqal_query* query,
+              const char* expected, char* bnode_id, size_t bnode_id_len)
+{
+  rasqal_query_results* results;
+  size_t expected_count = strlen(expected);
+  size_t count = 0;
+  int failed = 0;
+
+  bnode_id[0] = '\0';
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: step %d: query execution FAILED\n", program, step);
+    return 1;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_literal* s;
+    rasqal_literal* letter;
+    const char* id;
+    const char* str;
+
+    s = rasqal_query_results_get_binding_value(results, 0);
+    letter = rasqal_query_results_get_binding_value(results, 1);
+
+    str = letter ? (const char*)rasqal_literal_as_string(letter) : NULL;
+    if(count >= expected_count || !str || str[0] != expected[count] ||
+       str[1]) {
+      fprintf(stderr, "%s: step %d: result %d FAILED returning letter '%s'\n",
+              program, step, RASQAL_GOOD_CAST(int, count),
+              str ? str : "NULL");
+      failed = 1;
+    }
+
+    id = (s && s->type == RASQAL_LITERAL_BLANK) ?
+      (const char*)rasqal_literal_as_string(s) : NULL;
+    if(!id || strlen(id) >= bnode_id_len ||
+       (bnode_id[0] && strcmp(id, bnode_id))) {
+      fprintf(stderr, "%s: step %d: result %d FAILED returning subject '%s'\n",
+              program, step, RASQAL_GOOD_CAST(int, count),
+              id ? id : "NULL");
+      failed = 1;
+    } else
+      memcpy(bnode_id, id, strlen(id) + 1);
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  if(count != expected_count) {
+    fprintf(stderr, "%s: step %d: FAILED returned %d results, expected %d\n",
+            program, step, RASQAL_GOOD_CAST(int, count),
+            RASQAL_GOOD_CAST(int, expected_count));
+    failed = 1;
+  }
+
+  return failed;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  rasqal_query *query;
+  rasqal_data_graph* dg;
+  char bnode_id[128];
+  char last_bnode_id[128];
+  int failures = 0;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query ||
+     rasqal_query_prepare(query, (const unsigned char*)QUERY_STRING,
+                          base_uri)) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    return(1);
+  }
+
+  /* only a line-based format can be extended */
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, /* name URI */ NULL,
+                                      RASQAL_DATA_GRAPH_BACKGROUND,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg)) {
+    fprintf(stderr, "%s: adding data graph FAILED\n", program);
+    return(1);
+  }
+
+  last_bnode_id[0] = '\0';
+  for(i = 0; append_test_steps[i].mode; i++) {
+    FILE* fh;
+    int extended;
+
+    fh = fopen(DATA_FILE_NAME, append_test_steps[i].mode);
+    if(!fh) {
+      fprintf(stderr, "%s: step %d: cannot write %s\n", program, i,
+              DATA_FILE_NAME);
+      failures++;
+      break;
+    }
+    fputs(append_test_steps[i].content, fh);
+    fclose(fh);
+
+    /* only a cached graph that no query is using can be extended */
+    if(!i && rasqal_world_preload_data_graph(world, dg)) {
+      fprintf(stderr, "%s: preloading data graph FAILED\n", program);
+      failures++;
+      break;
+    }
+
+    if(check_results(program, i, query, append_test_steps[i].expected,
+                     bnode_id, sizeof(bnode_id))) {
+      failures++;
+      continue;
+    }
+
+    if(i > 0) {
+      extended = !strcmp(bnode_id, last_bnode_id);
+      if(extended != append_test_steps[i].extended) {
+        fprintf(stderr, "%s: step %d: FAILED graph was %s, expected it %s\n",
+                program, i,
+                extended ? "extended" : "parsed again",
+                append_test_steps[i].extended ? "extended" : "parsed again");
+        failures++;
+      }
+    }
+    memcpy(last_bnode_id, bnode_id, sizeof(bnode_id));
+  }
+
+  remove(DATA_FILE_NAME);
+
+  rasqal_free_query(query);
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
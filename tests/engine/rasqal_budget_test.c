@@ -0,0 +1,308 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_budget_test.c - Rasqal RDF Query execution budget Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_budget_test.nt"
+
+#define SUBJECTS_COUNT 1000
+
+/* every pair of subjects: far more rows than can be read in the
+ * shortest timeout */
+#define CROSS_JOIN_QUERY \
+  "SELECT ?a ?b WHERE { ?a <http://example.org/v> ?x . ?b <http://example.org/v> ?y }"
+#define CROSS_JOIN_ROWS_COUNT (SUBJECTS_COUNT * SUBJECTS_COUNT)
+
+/* buffers every row in the sort */
+#define ORDER_QUERY \
+  "SELECT ?s ?v WHERE { ?s <http://example.org/v> ?v } ORDER BY DESC(?v)"
+#define ORDER_ROWS_COUNT SUBJECTS_COUNT
+
+static const struct {
+  const char* label;
+  const char* query_string;
+  /* non-0 if the results are stored so an aborted execution fails */
+  int stored;
+  rasqal_feature feature;
+  int value;
+  /* rows read before rasqal_query_cancel() or -1 to not cancel */
+  int cancel_after;
+  /* non-0 if the execution must be aborted */
+  int aborted;
+  /* rows expected if not aborted */
+  int rows_count;
+} budget_tests[] = {
+  { "cancelled mid-execution", CROSS_JOIN_QUERY, 0,
+    RASQAL_FEATURE_TIMEOUT, 0, 10, 1, 0 },
+  { "zero timeout", ORDER_QUERY, 1,
+    RASQAL_FEATURE_TIMEOUT, 0, -1, 0, ORDER_ROWS_COUNT },
+  { "expired timeout", CROSS_JOIN_QUERY, 0,
+    RASQAL_FEATURE_TIMEOUT, 1, -1, 1, 0 },
+  /* each operator buffering a row counts it */
+  { "rows within the row limit", ORDER_QUERY, 1,
+    RASQAL_FEATURE_MAX_ROWS, ORDER_ROWS_COUNT * 10, -1, 0, ORDER_ROWS_COUNT },
+  { "too many rows", ORDER_QUERY, 1,
+    RASQAL_FEATURE_MAX_ROWS, ORDER_ROWS_COUNT / 2, -1, 1, 0 },
+  { "too much memory", ORDER_QUERY, 1,
+    RASQAL_FEATURE_MAX_MEMORY, 1, -1, 1, 0 },
+  { NULL, NULL, 0, RASQAL_FEATURE_TIMEOUT, 0, -1, 0, 0 }
+};
+
+
+/* engine error of the last get_row or get_all_rows call */
+static rasqal_engine_error last_engine_error;
+
+/* the query engine recording its errors */
+static rasqal_query_execution_factory recording_engine;
+
+
+static raptor_sequence*
+recording_engine_get_all_rows(void* ex_data, rasqal_engine_error *error_p)
+{
+  raptor_sequence* seq;
+
+  seq = rasqal_query_get_engine_by_name(NULL)->get_all_rows(ex_data, error_p);
+  last_engine_error = *error_p;
+
+  return seq;
+}
+
+
+static rasqal_row*
+recording_engine_get_row(void* ex_data, rasqal_engine_error *error_p)
+{
+  rasqal_row* row;
+
+  row = rasqal_query_get_engine_by_name(NULL)->get_row(ex_data, error_p);
+  last_engine_error = *error_p;
+
+  return row;
+}
+
+
+static void
+count_errors_log_handler(void *user_data, raptor_log_message *message)
+{
+  int* errors_count = (int*)user_data;
+
+  if(message->level >= RAPTOR_LOG_LEVEL_ERROR)
+    (*errors_count)++;
+}
+
+
+static int
+write_graph(const char* filename)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(filename, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < SUBJECTS_COUNT; i++)
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> \"%d\"^^<http://www.w3.org/2001/XMLSchema#integer> .\n",
+            i, i);
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query with the recording engine counting the rows and
+ * cancelling it after @cancel_after rows unless that is < 0
+ *
+ * Return value: number of rows or -1 if the query execution failed
+ */
+static int
+run_query(rasqal_query* query, int cancel_after)
+{
+  rasqal_query_results* results;
+  int count = 0;
+
+  last_engine_error = RASQAL_ENGINE_OK;
+
+  results = rasqal_query_execute_with_engine(query, &recording_engine);
+  if(!results)
+    return -1;
+
+  while(!rasqal_query_results_finished(results)) {
+    if(count == cancel_after)
+      rasqal_query_cancel(query);
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  return count;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  int errors_count = 0;
+  int failures = 0;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  rasqal_world_set_log_handler(world, &errors_count, count_errors_log_handler);
+
+  recording_engine = *rasqal_query_get_engine_by_name(NULL);
+  recording_engine.get_all_rows = recording_engine_get_all_rows;
+  recording_engine.get_row = recording_engine_get_row;
+
+  if(write_graph(DATA_FILE_NAME)) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(i = 0; budget_tests[i].label; i++) {
+    const char* label = budget_tests[i].label;
+    rasqal_query* query;
+    rasqal_data_graph* dg;
+    int count;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query,
+                            (const unsigned char*)budget_tests[i].query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: %s: query prepare FAILED\n", program, label);
+      return(1);
+    }
+
+    dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                        RASQAL_DATA_GRAPH_BACKGROUND,
+                                        NULL, "ntriples", NULL);
+    if(!dg || rasqal_query_add_data_graph(query, dg)) {
+      fprintf(stderr, "%s: %s: adding data graph FAILED\n", program, label);
+      return(1);
+    }
+
+    rasqal_query_set_feature(query, budget_tests[i].feature,
+                             budget_tests[i].value);
+
+    errors_count = 0;
+    count = run_query(query, budget_tests[i].cancel_after);
+
+    if(budget_tests[i].aborted) {
+      /* stored results fail; streamed results fail or end early */
+      if(budget_tests[i].stored ? (count >= 0) :
+         (count >= CROSS_JOIN_ROWS_COUNT)) {
+        fprintf(stderr, "%s: %s: FAILED returned %d rows\n", program, label,
+                count);
+        failures++;
+      }
+      if(last_engine_error != RASQAL_ENGINE_ABORTED) {
+        fprintf(stderr, "%s: %s: FAILED engine returned error %d, expected aborted\n",
+                program, label, RASQAL_GOOD_CAST(int, last_engine_error));
+        failures++;
+      }
+      if(errors_count != 1) {
+        fprintf(stderr, "%s: %s: FAILED logged %d errors, expected 1\n",
+                program, label, errors_count);
+        failures++;
+      }
+
+      /* the next execution starts a new budget */
+      rasqal_query_set_feature(query, budget_tests[i].feature, 0);
+      if(budget_tests[i].stored) {
+        count = run_query(query, -1);
+        if(count != ORDER_ROWS_COUNT) {
+          fprintf(stderr, "%s: %s: FAILED execution after abort returned %d rows, expected %d\n",
+                  program, label, count, ORDER_ROWS_COUNT);
+          failures++;
+        }
+      }
+    } else {
+      if(count != budget_tests[i].rows_count ||
+         last_engine_error == RASQAL_ENGINE_ABORTED || errors_count) {
+        fprintf(stderr, "%s: %s: FAILED returned %d rows, expected %d\n",
+                program, label, count, budget_tests[i].rows_count);
+        failures++;
+      }
+    }
+
+    rasqal_free_query(query);
+  }
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -62,6 +62,39 @@ WHERE { \
 #define QUERY_DATA "dc.rdf"
 #define QUERY_EXPECTED_COUNT 4
 
+#ifndef NO_QUERY_LANGUAGE
+/* every row makes the same triple */
+#define DUPLICATES_QUERY_FORMAT "\
+CONSTRUCT { ?s a <http://xmlns.com/foaf/0.1/Person> }\n\
+FROM <%s/%s>\n \
+WHERE { ?s ?p ?o }\n\
+"
+
+#define DESCRIBE_QUERY_FORMAT "\
+DESCRIBE ?s\n\
+FROM <%s/%s>\n \
+WHERE { ?s ?p ?o }\n\
+"
+
+static const struct {
+  const char* label;
+  const char* query_format;
+  /* flags for rasqal_query_results_write_graph() */
+  unsigned int flags;
+  /* triples read with rasqal_query_results_get_triple() first */
+  int skip;
+  int expected_count;
+} write_graph_tests[] = {
+  { "construct", QUERY_FORMAT, 0, 0, QUERY_EXPECTED_COUNT },
+  { "construct after get_triple", QUERY_FORMAT, 0, 1, QUERY_EXPECTED_COUNT },
+  { "construct duplicates", DUPLICATES_QUERY_FORMAT, 0, 0, 3 },
+  { "construct distinct", DUPLICATES_QUERY_FORMAT,
+    RASQAL_QUERY_RESULTS_GRAPH_DISTINCT, 0, 1 },
+  { "describe", DESCRIBE_QUERY_FORMAT, 0, 0, 0 },
+  { NULL, NULL, 0, 0, 0 }
+};
+#endif
+
 #ifdef NO_QUERY_LANGUAGE
 int
 main(int argc, char **argv) {
@@ -71,6 +104,201 @@ main(int argc, char **argv) {
 }
 #else
 
+static rasqal_query_results*
+execute_query(const char* program, rasqal_world* world,
+              const char* query_format, const unsigned char* data_dir_string,
+              raptor_uri* base_uri, rasqal_query** query_p)
+{
+  rasqal_query* query;
+  unsigned char* query_string;
+  size_t qs_len;
+  rasqal_query_results* results = NULL;
+
+  qs_len = strlen((const char*)data_dir_string) + strlen(QUERY_DATA) + strlen(query_format);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  if(!query_string)
+    return NULL;
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len, query_format, data_dir_string,
+           QUERY_DATA);
+  PRAGMA_IGNORE_WARNING_END
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+  } else
+    results = rasqal_query_execute(query);
+
+  RASQAL_FREE(char*, query_string);
+
+  if(!results && query) {
+    rasqal_free_query(query);
+    query = NULL;
+  }
+  *query_p = query;
+
+  return results;
+}
+
+
+/* replace blank node IDs, which differ each time the data is parsed */
+static void
+normalize_blank_nodes(char* string)
+{
+  char* from = string;
+  char* to = string;
+
+  while(*from) {
+    *to++ = *from;
+    if(from[0] == '_' && from[1] == ':') {
+      *to++ = ':';
+      from += 2;
+      while(*from && *from != ' ' && *from != '\n')
+        from++;
+    } else
+      from++;
+  }
+  *to = '\0';
+}
+
+
+/*
+ * Serialize the results of @query_format as N-Triples either with
+ * rasqal_query_results_write_graph() after reading @skip triples or
+ * else with rasqal_query_results_get_triple() if @skip is <0
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+serialize_results(const char* program, rasqal_world* world,
+                  const char* query_format,
+                  const unsigned char* data_dir_string, raptor_uri* base_uri,
+                  unsigned int flags, int skip, int* count_p)
+{
+  rasqal_query* query = NULL;
+  rasqal_query_results* results;
+  raptor_serializer* serializer;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+  int count = 0;
+  int rc = 0;
+
+  results = execute_query(program, world, query_format, data_dir_string,
+                          base_uri, &query);
+  if(!results)
+    return NULL;
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  serializer = raptor_new_serializer(world->raptor_world_ptr, "ntriples");
+  if(!iostr || !serializer) {
+    rc = 1;
+    goto tidy;
+  }
+  raptor_serializer_start_to_iostream(serializer, base_uri, iostr);
+
+  while(skip) {
+    raptor_statement* triple = rasqal_query_results_get_triple(results);
+    if(!triple)
+      break;
+    raptor_serializer_serialize_statement(serializer, triple);
+    count++;
+    if(skip > 0)
+      skip--;
+    if(rasqal_query_results_next_triple(results))
+      break;
+  }
+
+  if(skip >= 0) {
+    int written = rasqal_query_results_write_graph(results, serializer, flags);
+    if(written < 0)
+      rc = 1;
+    else
+      count += written;
+  }
+
+  raptor_serializer_serialize_end(serializer);
+
+  tidy:
+  if(serializer)
+    raptor_free_serializer(serializer);
+  if(iostr)
+    raptor_free_iostream(iostr);
+  rasqal_free_query_results(results);
+  rasqal_free_query(query);
+
+  if(rc || !string) {
+    if(string)
+      raptor_free_memory(string);
+    return NULL;
+  }
+
+  normalize_blank_nodes((char*)string);
+  *count_p = count;
+  return (char*)string;
+}
+
+
+/*
+ * Check rasqal_query_results_write_graph() writes the expected number
+ * of triples and the same triples as rasqal_query_results_get_triple()
+ * when not removing duplicates
+ *
+ * Return value: number of failures
+ */
+static int
+check_write_graph(const char* program, rasqal_world* world,
+                  const unsigned char* data_dir_string, raptor_uri* base_uri)
+{
+  int failures = 0;
+  int i;
+
+  for(i = 0; write_graph_tests[i].label; i++) {
+    const char* label = write_graph_tests[i].label;
+    char* written;
+    char* expected = NULL;
+    int count = 0;
+    int expected_count = 0;
+
+    written = serialize_results(program, world,
+                                write_graph_tests[i].query_format,
+                                data_dir_string, base_uri,
+                                write_graph_tests[i].flags,
+                                write_graph_tests[i].skip, &count);
+    if(!written) {
+      fprintf(stderr, "%s: %s: writing graph FAILED\n", program, label);
+      failures++;
+      continue;
+    }
+
+    if(count != write_graph_tests[i].expected_count) {
+      fprintf(stderr, "%s: %s: FAILED writing %d triples, expected %d\n",
+              program, label, count, write_graph_tests[i].expected_count);
+      failures++;
+    }
+
+    if(!write_graph_tests[i].flags) {
+      expected = serialize_results(program, world,
+                                   write_graph_tests[i].query_format,
+                                   data_dir_string, base_uri, 0, -1,
+                                   &expected_count);
+      if(!expected || expected_count != count || strcmp(written, expected)) {
+        fprintf(stderr, "%s: %s: FAILED writing\n%sexpected from get_triple\n%s",
+                program, label, written, expected ? expected : "NULL\n");
+        failures++;
+      }
+    }
+
+    raptor_free_memory(written);
+    if(expected)
+      raptor_free_memory(expected);
+  }
+
+  return failures;
+}
+
+
 int
 main(int argc, char **argv) {
   const char *program = rasqal_basename(argv[0]);
@@ -84,7 +312,7 @@ main(int argc, char **argv) {
   rasqal_world *world = NULL;
   rasqal_query *query = NULL;
   rasqal_query_results *results = NULL;
-  unsigned char *data_dir_string;
+  unsigned char *data_dir_string = NULL;
   unsigned char *query_string;
   int count = 0;
 #if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
@@ -116,7 +344,6 @@ main(int argc, char **argv) {
   PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
   snprintf((char*)query_string, qs_len, query_format, data_dir_string, data_file);
   PRAGMA_IGNORE_WARNING_END
-  raptor_free_memory(data_dir_string);
 
   query = rasqal_new_query(world, query_language_name, NULL);
   if(!query) {
@@ -182,6 +409,7 @@ main(int argc, char **argv) {
     goto done;
   }
 
+  failures += check_write_graph(program, world, data_dir_string, base_uri);
 
   done:
   if(results)
@@ -190,6 +418,9 @@ main(int argc, char **argv) {
   if(query)
     rasqal_free_query(query);
   
+  if(data_dir_string)
+    raptor_free_memory(data_dir_string);
+
   if(base_uri)
     raptor_free_uri(base_uri);
 
@@ -0,0 +1,230 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_expression_memo_test.c - Rasqal RDF Query repeated subexpression Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+/* LCASE(STR(?letter)) is written four times, RAND() twice */
+#define QUERY_FORMAT "\
+SELECT ?letter (LCASE(STR(?letter)) AS ?lower) \
+  (CONCAT(LCASE(STR(?letter)), \"-\", LCASE(STR(?letter))) AS ?pair) \
+  (RAND() AS ?rand1) (RAND() AS ?rand2) \
+FROM <%s> \
+WHERE { \
+  <http://example.org/> <http://example.org#pred> ?letter \
+  FILTER(LCASE(STR(?letter)) < \"n\") \
+} \
+ORDER BY ?letter \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define EXPECTED_LETTERS "abcdefghijklm"
+
+static const char*
+binding_string(rasqal_query_results* results, int offset)
+{
+  rasqal_literal* value;
+
+  value = rasqal_query_results_get_binding_value(results, offset);
+  if(!value)
+    return NULL;
+
+  return (const char*)rasqal_literal_as_string(value);
+}
+
+
+/*
+ * Execute @query and check every row has the lower case letter and
+ * pair made from the shared subexpression and two different RAND()
+ * values that also differ from the previous row
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_results(const char* program, const char* label, rasqal_query* query)
+{
+  rasqal_query_results* results;
+  size_t expected_count = strlen(EXPECTED_LETTERS);
+  size_t count = 0;
+  char last_rand[64];
+  int failed = 0;
+
+  last_rand[0] = '\0';
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    return 1;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    const char* letter = binding_string(results, 0);
+    const char* lower = binding_string(results, 1);
+    const char* pair = binding_string(results, 2);
+    const char* rand1 = binding_string(results, 3);
+    const char* rand2 = binding_string(results, 4);
+
+    if(count >= expected_count || !letter ||
+       letter[0] != EXPECTED_LETTERS[count] || letter[1]) {
+      fprintf(stderr, "%s: %s: result %d FAILED returning letter '%s'\n",
+              program, label, RASQAL_GOOD_CAST(int, count),
+              letter ? letter : "NULL");
+      failed = 1;
+    } else if(!lower || strcmp(lower, letter) ||
+              !pair || strlen(pair) != 3 || pair[0] != letter[0] ||
+              pair[1] != '-' || pair[2] != letter[0]) {
+      fprintf(stderr, "%s: %s: result %d FAILED returning '%s' and '%s' for letter '%s'\n",
+              program, label, RASQAL_GOOD_CAST(int, count),
+              lower ? lower : "NULL", pair ? pair : "NULL", letter);
+      failed = 1;
+    }
+
+    if(!rand1 || !rand2 || !strcmp(rand1, rand2) ||
+       !strcmp(rand1, last_rand)) {
+      fprintf(stderr, "%s: %s: result %d FAILED returning RAND() values '%s' and '%s' after '%s'\n",
+              program, label, RASQAL_GOOD_CAST(int, count),
+              rand1 ? rand1 : "NULL", rand2 ? rand2 : "NULL", last_rand);
+      failed = 1;
+    }
+    if(rand1 && strlen(rand1) < sizeof(last_rand))
+      memcpy(last_rand, rand1, strlen(rand1) + 1);
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  if(count != expected_count) {
+    fprintf(stderr, "%s: %s: FAILED returned %d results, expected %d\n",
+            program, label, RASQAL_GOOD_CAST(int, count),
+            RASQAL_GOOD_CAST(int, expected_count));
+    failed = 1;
+  }
+
+  return failed;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  unsigned char *uri_string;
+  unsigned char *data_string;
+  unsigned char *query_string;
+  size_t qs_len;
+  rasqal_query *query;
+  int failures = 0;
+
+  if(argc != 2) {
+    fprintf(stderr, "USAGE: %s data-filename\n", program);
+    return(1);
+  }
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  /* the second query shares the memos of the first */
+  rasqal_world_set_query_cache_size(world, 2);
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  data_string = raptor_uri_filename_to_uri_string(argv[1]);
+  qs_len = strlen((const char*)data_string) + strlen(QUERY_FORMAT);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len, QUERY_FORMAT, data_string);
+  PRAGMA_IGNORE_WARNING_END
+  raptor_free_memory(data_string);
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+    return(1);
+  }
+
+  if(!query->expression_memos) {
+    fprintf(stderr, "%s: repeated LCASE(STR(?letter)) was not shared - FAILED\n",
+            program);
+    failures++;
+  }
+
+  failures += check_results(program, "first execution", query);
+  failures += check_results(program, "second execution", query);
+  rasqal_free_query(query);
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+    return(1);
+  }
+  if(!query->template_query) {
+    fprintf(stderr, "%s: query was not shared from the cache - FAILED\n",
+            program);
+    failures++;
+  }
+  failures += check_results(program, "shared from the cache", query);
+  rasqal_free_query(query);
+
+  RASQAL_FREE(char*, query_string);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -0,0 +1,371 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_graph_variable_test.c - Rasqal RDF Query GRAPH variable Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+/* the inner BGP is matched once for all named graphs */
+#define SINGLE_PASS_QUERY_FORMAT "\
+PREFIX ex: <http://example.org/> \
+SELECT * WHERE { %s GRAPH ?g { %s } } \
+"
+/* the FILTER using ?g makes the inner pattern be evaluated per graph */
+#define PER_GRAPH_QUERY_FORMAT "\
+PREFIX ex: <http://example.org/> \
+SELECT * WHERE { %s GRAPH ?g { %s FILTER(?g != ex:none) } } \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define GRAPHS_COUNT 3
+static const struct {
+  const char* filename;
+  /* graph name or NULL for the background graph */
+  const char* name;
+  const char* triples;
+} graph_test_graphs[GRAPHS_COUNT] = {
+  { "rasqal_graph_variable_test_1.nt", "http://example.org/graph1",
+    "<http://example.org/a> <http://example.org/p> <http://example.org/o1> .\n"
+    "<http://example.org/a> <http://example.org/q> \"a1\" .\n"
+    "<http://example.org/b> <http://example.org/p> <http://example.org/o2> .\n"
+    "<http://example.org/o1> <http://example.org/r> \"x1\" .\n" },
+  { "rasqal_graph_variable_test_2.nt", "http://example.org/graph2",
+    "<http://example.org/b> <http://example.org/p> <http://example.org/o3> .\n"
+    "<http://example.org/c> <http://example.org/q> \"c2\" .\n"
+    "<http://example.org/o2> <http://example.org/r> \"x2\" .\n"
+    "<http://example.org/o3> <http://example.org/r> \"x3\" .\n" },
+  { "rasqal_graph_variable_test_bg.nt", NULL,
+    "<http://example.org/a> <http://example.org/p> <http://example.org/bg> .\n"
+    "<http://example.org/d> <http://example.org/q> \"d\" .\n" }
+};
+
+
+static const struct {
+  const char* label;
+  /* non-0 to query the background graph alone */
+  int background_only;
+  /* patterns before the GRAPH */
+  const char* outer;
+  /* BGP inside the GRAPH */
+  const char* inner;
+  int expected_count;
+} graph_test_queries[] = {
+  { "unbound graph variable", 0,
+    "", "?s ex:p ?o", 3 },
+  /* ex:b ex:p ex:o2 in graph1 does not join ex:o2 ex:r in graph2 */
+  { "graph variable bound by the first pattern", 0,
+    "", "?s ex:p ?o . ?o ex:r ?x", 2 },
+  { "graph variable bound by VALUES", 0,
+    "VALUES ?g { <http://example.org/graph2> }", "?s ex:p ?o", 1 },
+  { "subject in one named graph", 0,
+    "", "ex:a ?p ?o", 2 },
+  { "subject and predicate in one named graph", 0,
+    "", "ex:c ex:q ?o", 1 },
+  { "predicate in both named graphs", 0,
+    "", "?s ex:r ?x", 3 },
+  { "subject only in the background graph", 0,
+    "", "ex:d ?p ?o", 0 },
+  { "background graph only", 1,
+    "", "?s ex:p ?o", 0 },
+  { "background graph only with a bound subject", 1,
+    "", "ex:a ?p ?o", 0 },
+  { NULL, 0, NULL, NULL, 0 }
+};
+
+
+static int
+write_graphs(void)
+{
+  int g;
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    FILE* fh;
+
+    fh = fopen(graph_test_graphs[g].filename, "w");
+    if(!fh)
+      return 1;
+    fputs(graph_test_graphs[g].triples, fh);
+    if(fclose(fh))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static rasqal_query*
+new_query(const char* program, rasqal_world* world, const char* format,
+          const char* outer, const char* inner, int background_only,
+          raptor_uri* base_uri, raptor_uri** graph_uris)
+{
+  rasqal_query* query;
+  unsigned char* query_string;
+  size_t qs_len;
+  int g;
+
+  qs_len = strlen(format) + strlen(outer) + strlen(inner);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  if(!query_string)
+    return NULL;
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len + 1, format, outer, inner);
+  PRAGMA_IGNORE_WARNING_END
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+    if(query)
+      rasqal_free_query(query);
+    RASQAL_FREE(char*, query_string);
+    return NULL;
+  }
+  RASQAL_FREE(char*, query_string);
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    rasqal_data_graph* dg;
+    raptor_uri* name_uri = NULL;
+
+    if(graph_test_graphs[g].name) {
+      if(background_only)
+        continue;
+      name_uri = raptor_new_uri(world->raptor_world_ptr,
+                                (const unsigned char*)graph_test_graphs[g].name);
+    }
+
+    dg = rasqal_new_data_graph_from_uri(world, graph_uris[g], name_uri,
+                                        name_uri ? RASQAL_DATA_GRAPH_NAMED :
+                                                   RASQAL_DATA_GRAPH_BACKGROUND,
+                                        NULL, "ntriples", NULL);
+    if(name_uri)
+      raptor_free_uri(name_uri);
+    if(!dg || rasqal_query_add_data_graph(query, dg)) {
+      fprintf(stderr, "%s: adding data graph FAILED\n", program);
+      rasqal_free_query(query);
+      return NULL;
+    }
+  }
+
+  return query;
+}
+
+
+/*
+ * Execute @query and write every row to a new string
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(rasqal_query* query, int* count_p)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+  int count = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return NULL;
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  if(!iostr) {
+    rasqal_free_query_results(results);
+    return NULL;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal_write(rasqal_query_results_get_binding_value(results, i),
+                           iostr);
+      raptor_iostream_write_byte(' ', iostr);
+    }
+    raptor_iostream_write_byte('\n', iostr);
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+  raptor_free_iostream(iostr);
+
+  *count_p = count;
+
+  return (char*)string;
+}
+
+
+/*
+ * Check every triple pattern of @query has graph variable ?g as its
+ * origin, as set when the GRAPH pattern is matched in one pass
+ *
+ * Return value: non-0 if so
+ */
+static int
+is_single_pass(rasqal_query* query)
+{
+  rasqal_triple* t;
+  int i;
+
+  for(i = 0; (t = rasqal_query_get_triple(query, i)); i++) {
+    rasqal_variable* v = t->origin ? rasqal_literal_as_variable(t->origin) :
+                                     NULL;
+
+    if(!v || strcmp((const char*)v->name, "g"))
+      return 0;
+  }
+
+  return (i > 0);
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *graph_uris[GRAPHS_COUNT];
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+  int g;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  if(write_graphs()) {
+    fprintf(stderr, "%s: cannot write graphs\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    uri_string = raptor_uri_filename_to_uri_string(graph_test_graphs[g].filename);
+    graph_uris[g] = raptor_new_uri(world->raptor_world_ptr, uri_string);
+    raptor_free_memory(uri_string);
+  }
+
+  for(q = 0; graph_test_queries[q].label; q++) {
+    const char* label = graph_test_queries[q].label;
+    rasqal_query* query;
+    rasqal_query* per_graph_query;
+    char* result = NULL;
+    char* expected = NULL;
+    int count = 0;
+    int expected_count = 0;
+
+    query = new_query(program, world, SINGLE_PASS_QUERY_FORMAT,
+                      graph_test_queries[q].outer, graph_test_queries[q].inner,
+                      graph_test_queries[q].background_only,
+                      base_uri, graph_uris);
+    per_graph_query = new_query(program, world, PER_GRAPH_QUERY_FORMAT,
+                                graph_test_queries[q].outer,
+                                graph_test_queries[q].inner,
+                                graph_test_queries[q].background_only,
+                                base_uri, graph_uris);
+    if(!query || !per_graph_query)
+      return(1);
+
+    result = run_query(query, &count);
+    expected = run_query(per_graph_query, &expected_count);
+
+    if(!result || !expected) {
+      fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+      failures++;
+    } else {
+      if(!is_single_pass(query)) {
+        fprintf(stderr, "%s: %s: FAILED graph pattern was not matched in one pass\n",
+                program, label);
+        failures++;
+      }
+
+      if(count != graph_test_queries[q].expected_count) {
+        fprintf(stderr, "%s: %s: FAILED returned %d results expected %d\n%s",
+                program, label, count, graph_test_queries[q].expected_count,
+                result);
+        failures++;
+      }
+
+      /* same rows in the same order as matching each graph in turn */
+      if(strcmp(result, expected)) {
+        fprintf(stderr, "%s: %s: FAILED returned\n%sper graph returned\n%s",
+                program, label, result, expected);
+        failures++;
+      }
+    }
+
+    if(result)
+      raptor_free_memory(result);
+    if(expected)
+      raptor_free_memory(expected);
+    rasqal_free_query(per_graph_query);
+    rasqal_free_query(query);
+  }
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    raptor_free_uri(graph_uris[g]);
+    remove(graph_test_graphs[g].filename);
+  }
+
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
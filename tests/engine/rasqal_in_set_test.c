@@ -0,0 +1,332 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_in_set_test.c - Rasqal RDF Query IN and NOT IN set Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+/* the FILTER expression is prepared as a set; the BIND one is not */
+#define FILTER_QUERY_FORMAT "\
+PREFIX ex: <http://example.org/> \
+SELECT ?s \
+WHERE { ?s ex:p ?o OPTIONAL { ?s ex:v ?v } FILTER(%s) } \
+ORDER BY ?s \
+"
+#define BIND_QUERY_FORMAT "\
+PREFIX ex: <http://example.org/> \
+SELECT ?s \
+WHERE { ?s ex:p ?o OPTIONAL { ?s ex:v ?v } BIND((%s) AS ?in) FILTER(?in) } \
+ORDER BY ?s \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_in_set_test.nt"
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* ex:v of subject ex:sN is the Nth line; ex:s8 has no ex:v */
+static const char* const in_set_test_values[] = {
+  "\"1\"^^<" XSD "integer>",
+  "\"1.0\"^^<" XSD "decimal>",
+  "\"1\"",
+  "<http://example.org/a>",
+  "\"1.0e0\"^^<" XSD "double>",
+  "\"true\"^^<" XSD "boolean>",
+  "\"a\"@en",
+  NULL
+};
+
+#define IN_SET_TEST_SUBJECTS_COUNT 8
+
+
+static const struct {
+  const char* expression;
+  /* subject numbers matched or NULL to only compare with the list
+   * evaluated for every row */
+  const char* expected;
+} in_set_tests[] = {
+  /* integers only: looked up by value */
+  { "?v IN (1)", "125" },
+  { "?v IN (1, 2, 3)", "125" },
+  { "?v NOT IN (2, 3)", NULL },
+  /* 1 IN (1.0) */
+  { "?v IN (1.0)", "125" },
+  { "?v IN (1e0)", "125" },
+  { "?v NOT IN (1.0)", NULL },
+  /* URIs only: a URI never fails to compare with another term */
+  { "?v IN (<http://example.org/a>, <http://example.org/b>)", "4" },
+  { "?v NOT IN (<http://example.org/a>)", "123567" },
+  /* mixed types */
+  { "?v IN (<http://example.org/a>, 2, \"a\"@en)", "47" },
+  { "?v IN (1, <http://example.org/a>)", "1245" },
+  { "?v IN (\"1\", true, <http://example.org/b>)", NULL },
+  { "?v NOT IN (\"1\", 1, <http://example.org/a>)", NULL },
+  { "?v IN (\"a\"@en, \"a\", 1.5)", NULL },
+  /* unbound left hand side of ex:s8 is an error */
+  { "?v IN (1, 2)", "125" },
+  { "?v NOT IN (1, 2)", NULL },
+  { "!(?v IN (<http://example.org/b>))", "1234567" },
+  { NULL, NULL }
+};
+
+
+static int
+write_data(void)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(DATA_FILE_NAME, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 1; i <= IN_SET_TEST_SUBJECTS_COUNT; i++) {
+    fprintf(fh, "<http://example.org/s%d> <http://example.org/p> \"%d\" .\n",
+            i, i);
+    if(in_set_test_values[i - 1])
+      fprintf(fh, "<http://example.org/s%d> <http://example.org/v> %s .\n",
+              i, in_set_test_values[i - 1]);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/* for use with rasqal_expression_visit(): count prepared sets */
+static int
+in_set_test_count_sets(void *user_data, rasqal_expression *e)
+{
+  if((e->op == RASQAL_EXPR_IN || e->op == RASQAL_EXPR_NOT_IN) &&
+     RASQAL_EXPRESSION_INTERNAL(e)->in_set)
+    (*(int*)user_data)++;
+
+  return 0;
+}
+
+
+/* for use with rasqal_query_graph_pattern_visit2() */
+static int
+in_set_test_count_gp_sets(rasqal_query* query, rasqal_graph_pattern* gp,
+                          void *user_data)
+{
+  rasqal_expression* e = rasqal_graph_pattern_get_filter_expression(gp);
+
+  if(e)
+    rasqal_expression_visit(e, in_set_test_count_sets, user_data);
+
+  return 0;
+}
+
+
+/*
+ * Execute the query made from @format and @expression and write the
+ * subject numbers of the rows to a new string
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(const char* program, rasqal_world* world, raptor_uri* base_uri,
+          raptor_uri* data_uri, const char* format, const char* expression,
+          int* sets_p)
+{
+  rasqal_query* query;
+  rasqal_data_graph* dg;
+  rasqal_query_results* results = NULL;
+  unsigned char* query_string;
+  size_t qs_len;
+  char* string = NULL;
+  size_t count = 0;
+
+  qs_len = strlen(format) + strlen(expression);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  if(!query_string)
+    return NULL;
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len + 1, format, expression);
+  PRAGMA_IGNORE_WARNING_END
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+    goto tidy;
+  }
+
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                      RASQAL_DATA_GRAPH_BACKGROUND,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg)) {
+    fprintf(stderr, "%s: adding data graph FAILED\n", program);
+    goto tidy;
+  }
+
+  *sets_p = 0;
+  rasqal_query_graph_pattern_visit2(query, in_set_test_count_gp_sets, sets_p);
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: query '%s' execution FAILED\n", program,
+            query_string);
+    goto tidy;
+  }
+
+  string = RASQAL_MALLOC(char*, IN_SET_TEST_SUBJECTS_COUNT + 1);
+  if(!string)
+    goto tidy;
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_literal* value = rasqal_query_results_get_binding_value(results, 0);
+    const char* s = value ? (const char*)rasqal_literal_as_string(value) : NULL;
+    size_t len = s ? strlen(s) : 0;
+
+    /* <http://example.org/sN> */
+    if(count == IN_SET_TEST_SUBJECTS_COUNT || !len) {
+      fprintf(stderr, "%s: query '%s' FAILED returning an unexpected row\n",
+              program, query_string);
+      RASQAL_FREE(char*, string);
+      string = NULL;
+      goto tidy;
+    }
+    string[count++] = s[len - 1];
+
+    rasqal_query_results_next(results);
+  }
+  string[count] = '\0';
+
+  tidy:
+  if(results)
+    rasqal_free_query_results(results);
+  if(query)
+    rasqal_free_query(query);
+  RASQAL_FREE(char*, query_string);
+
+  return string;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  int failures = 0;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  if(write_data()) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(i = 0; in_set_tests[i].expression; i++) {
+    const char* expression = in_set_tests[i].expression;
+    const char* expected = in_set_tests[i].expected;
+    char* result;
+    char* list_result;
+    int sets = 0;
+    int list_sets = 0;
+
+    result = run_query(program, world, base_uri, data_uri,
+                       FILTER_QUERY_FORMAT, expression, &sets);
+    list_result = run_query(program, world, base_uri, data_uri,
+                            BIND_QUERY_FORMAT, expression, &list_sets);
+
+    if(!result || !list_result)
+      failures++;
+    else {
+      if(sets != 1) {
+        fprintf(stderr, "%s: %s: FAILED with %d prepared sets expected 1\n",
+                program, expression, sets);
+        failures++;
+      }
+
+      if(strcmp(result, list_result)) {
+        fprintf(stderr, "%s: %s: FAILED set returned subjects '%s', list returned '%s'\n",
+                program, expression, result, list_result);
+        failures++;
+      }
+
+      if(expected && strcmp(result, expected)) {
+        fprintf(stderr, "%s: %s: FAILED returned subjects '%s' expected '%s'\n",
+                program, expression, result, expected);
+        failures++;
+      }
+    }
+
+    if(result)
+      RASQAL_FREE(char*, result);
+    if(list_result)
+      RASQAL_FREE(char*, list_result);
+  }
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
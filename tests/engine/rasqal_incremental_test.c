@@ -0,0 +1,317 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_incremental_test.c - Rasqal RDF Query incremental evaluation Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_incremental_test.nt"
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+static const struct {
+  const char* label;
+  const char* query_string;
+} incremental_test_queries[] = {
+  { "grouped aggregates of a join and filter",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?g (COUNT(*) AS ?count) (SUM(?v) AS ?sum) "
+    "(MIN(?v) AS ?min) (MAX(?v) AS ?max) "
+    "WHERE { ?s ex:group ?g . ?s ex:v ?v FILTER(?v != 3) } "
+    "GROUP BY ?g ORDER BY ?g" },
+  { "ungrouped count with having",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT (COUNT(?v) AS ?count) (MAX(?v) AS ?max) "
+    "WHERE { ?s ex:group ?g . ?s ex:v ?v } "
+    "HAVING(COUNT(?v) > 1)" },
+  { "rows of a join ordered",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?g ?v "
+    "WHERE { ?s ex:group ?g . ?s ex:v ?v FILTER(?v > 2) } "
+    "ORDER BY ?v ?s ?g" },
+  { NULL, NULL }
+};
+
+
+static const struct {
+  /* "w" to write the file or "a" to append to it */
+  const char* mode;
+  /* range of subjects written */
+  int first;
+  int last;
+  /* value of an extra ex:v triple of subject 0 or -1 for none */
+  int extra;
+} incremental_test_steps[] = {
+  { "w", 0, 10, -1 },
+  { "a", 10, 15, -1 },
+  /* new rows joining old and appended triples */
+  { "a", 15, 16, 20 },
+  /* appended triples matching no pattern */
+  { "a", 0, 0, -1 },
+  /* rewritten: the result must be evaluated again */
+  { "w", 3, 8, -1 },
+  { "a", 8, 12, 1 },
+  { NULL, 0, 0, 0 }
+};
+
+
+static int
+write_step(int step)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(DATA_FILE_NAME, incremental_test_steps[step].mode);
+  if(!fh)
+    return 1;
+
+  for(i = incremental_test_steps[step].first;
+      i < incremental_test_steps[step].last; i++) {
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/group> <http://example.org/g/%d> .\n",
+            i, i % 3);
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> \"%d\"^^<" XSD "integer> .\n",
+            i, i % 7);
+  }
+
+  if(incremental_test_steps[step].extra >= 0)
+    fprintf(fh, "<http://example.org/s/0> <http://example.org/v> \"%d\"^^<" XSD "integer> .\n",
+            incremental_test_steps[step].extra);
+
+  /* a triple matching no pattern of the queries */
+  fprintf(fh, "<http://example.org/s/%d> <http://example.org/other> \"%d\" .\n",
+          step, step);
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and write every row to a new string
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(const char* program, const char* label, rasqal_query* query)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    return NULL;
+  }
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  if(!iostr) {
+    rasqal_free_query_results(results);
+    return NULL;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal_write(rasqal_query_results_get_binding_value(results, i),
+                           iostr);
+      raptor_iostream_write_byte(' ', iostr);
+    }
+    raptor_iostream_write_byte('\n', iostr);
+
+    rasqal_query_results_next(results);
+  }
+  rasqal_free_query_results(results);
+  raptor_free_iostream(iostr);
+
+  return (char*)string;
+}
+
+
+static rasqal_query*
+new_query(const char* program, rasqal_world* world, const char* query_string,
+          raptor_uri* base_uri, raptor_uri* data_uri)
+{
+  rasqal_query* query;
+  rasqal_data_graph* dg;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query ||
+     rasqal_query_prepare(query, (const unsigned char*)query_string,
+                          base_uri)) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    if(query)
+      rasqal_free_query(query);
+    return NULL;
+  }
+
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                      RASQAL_DATA_GRAPH_BACKGROUND,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg)) {
+    fprintf(stderr, "%s: adding data graph FAILED\n", program);
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  return query;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  rasqal_query* queries[3];
+  int failures = 0;
+  int q;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(q = 0; incremental_test_queries[q].label; q++) {
+    queries[q] = new_query(program, world,
+                           incremental_test_queries[q].query_string,
+                           base_uri, data_uri);
+    if(!queries[q])
+      return(1);
+    rasqal_query_set_feature(queries[q], RASQAL_FEATURE_INCREMENTAL, 1);
+  }
+
+  for(i = 0; incremental_test_steps[i].mode; i++) {
+    if(write_step(i)) {
+      fprintf(stderr, "%s: step %d: cannot write %s\n", program, i,
+              DATA_FILE_NAME);
+      failures++;
+      break;
+    }
+
+    /* only a cached graph that no query is using is extended */
+    if(!i) {
+      rasqal_data_graph* dg;
+
+      dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                          RASQAL_DATA_GRAPH_BACKGROUND,
+                                          NULL, "ntriples", NULL);
+      if(!dg || rasqal_world_preload_data_graph(world, dg)) {
+        fprintf(stderr, "%s: preloading data graph FAILED\n", program);
+        return(1);
+      }
+      rasqal_free_data_graph(dg);
+    }
+
+    for(q = 0; incremental_test_queries[q].label; q++) {
+      const char* label = incremental_test_queries[q].label;
+      rasqal_query* query;
+      char* expected;
+      char* result;
+
+      /* evaluated in full by a new query */
+      query = new_query(program, world,
+                        incremental_test_queries[q].query_string,
+                        base_uri, data_uri);
+      if(!query)
+        return(1);
+      expected = run_query(program, label, query);
+      rasqal_free_query(query);
+
+      result = run_query(program, label, queries[q]);
+      if(!expected || !result)
+        failures++;
+      else if(strcmp(result, expected)) {
+        fprintf(stderr, "%s: %s: step %d: FAILED incremental query returned\n%sexpected\n%s",
+                program, label, i, result, expected);
+        failures++;
+      } else if(!queries[q]->incremental) {
+        fprintf(stderr, "%s: %s: step %d: FAILED query was not evaluated incrementally\n",
+                program, label, i);
+        failures++;
+      }
+
+      if(expected)
+        raptor_free_memory(expected);
+      if(result)
+        raptor_free_memory(result);
+    }
+  }
+
+  for(q = 0; incremental_test_queries[q].label; q++)
+    rasqal_free_query(queries[q]);
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+#include <limits.h>
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -91,6 +92,10 @@ typedef struct
 } limit_test;
 
 #define NONE (-1)
+/* 3000000000 in the query string or INT_MAX when set with
+ * rasqal_query_set_limit() or rasqal_query_set_offset() */
+#define ABOVE_INT_MAX (-2)
+#define ABOVE_INT_MAX_STRING "3000000000"
 static limit_test limit_offset_tests[]={
 /* limit offset count results */
   { NONE, NONE,   26, { "jcthzguxwpnefbioqadmrvykls",
@@ -106,6 +111,13 @@ static limit_test limit_offset_tests[]={
                         "fghijklmnopqrstuvwxyz" } },
   { 10,      5,   10, { "guxwpnefbi", "fghijklmno", "fghijklmno" } },
   { 5,      10,    5, { "nefbi", "klmno", "klmno" } },
+  { ABOVE_INT_MAX, NONE, 26, { "jcthzguxwpnefbioqadmrvykls",
+                               "abcdefghijklmnopqrstuvwxyz",
+                               "abcdefghijklmnopqrstuvwxyz" } },
+  { NONE, ABOVE_INT_MAX,  0, { "", "", "" } },
+  { ABOVE_INT_MAX,    5, 21, { "guxwpnefbioqadmrvykls",
+                               "fghijklmnopqrstuvwxyz",
+                               "fghijklmnopqrstuvwxyz" } },
   { NONE, NONE, NONE, { NULL, NULL, NULL } }
 };
 
@@ -167,11 +179,15 @@ main(int argc, char **argv) {
       if(dynamic_limits) {
         char lim[LIM_OFF_BUF_SIZE];
         char off[LIM_OFF_BUF_SIZE];
-        if(test->limit >= 0)
+        if(test->limit == ABOVE_INT_MAX)
+          snprintf(lim, LIM_OFF_BUF_SIZE, "LIMIT " ABOVE_INT_MAX_STRING);
+        else if(test->limit >= 0)
           snprintf(lim, LIM_OFF_BUF_SIZE, "LIMIT %d", test->limit);
         else
           *lim = '\0';
-        if(test->offset >= 0)
+        if(test->offset == ABOVE_INT_MAX)
+          snprintf(off, LIM_OFF_BUF_SIZE, "OFFSET " ABOVE_INT_MAX_STRING);
+        else if(test->offset >= 0)
           snprintf(off, LIM_OFF_BUF_SIZE, "OFFSET %d", test->offset);
         else
           *off = '\0';
@@ -205,8 +221,10 @@ main(int argc, char **argv) {
       }
 
       if(!dynamic_limits) {
-        rasqal_query_set_limit(query, test->limit);
-        rasqal_query_set_offset(query, test->offset);
+        rasqal_query_set_limit(query, (test->limit == ABOVE_INT_MAX) ?
+                               INT_MAX : test->limit);
+        rasqal_query_set_offset(query, (test->offset == ABOVE_INT_MAX) ?
+                                INT_MAX : test->offset);
       }
 
 #if defined(RASQAL_DEBUG) && RASQAL_DEBUG > 1
@@ -0,0 +1,217 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_parameter_test.c - Rasqal RDF Query parameter binding Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#define QUERY_FORMAT "\
+SELECT ?letter \
+FROM <%s> \
+WHERE { \
+  <http://example.org/> <http://example.org#pred> ?letter \
+  FILTER(!BOUND($x) || ?letter = $x) \
+} \
+ORDER BY ?letter \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+static rasqal_literal*
+make_string_literal(rasqal_world* world, const char* str)
+{
+  size_t len = strlen(str);
+  unsigned char* s;
+
+  s = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!s)
+    return NULL;
+  memcpy(s, str, len + 1);
+
+  return rasqal_new_string_literal(world, s, NULL, NULL, NULL);
+}
+
+
+/*
+ * Execute @query and check it returns the letters in @expected in order
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_results(const char* program, const char* label, rasqal_query* query,
+              const char* expected)
+{
+  rasqal_query_results* results;
+  size_t expected_count = strlen(expected);
+  size_t count = 0;
+  int failed = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    return 1;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_literal* letter;
+    const char* str;
+
+    letter = rasqal_query_results_get_binding_value(results, 0);
+
+    str = letter ? (const char*)rasqal_literal_as_string(letter) : NULL;
+    if(count >= expected_count || !str || str[0] != expected[count] ||
+       str[1]) {
+      fprintf(stderr, "%s: %s: result %d FAILED returning letter '%s'\n",
+              program, label, RASQAL_GOOD_CAST(int, count),
+              str ? str : "NULL");
+      failed = 1;
+    }
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  if(count != expected_count) {
+    fprintf(stderr, "%s: %s: FAILED returned %d results, expected %d\n",
+            program, label, RASQAL_GOOD_CAST(int, count),
+            RASQAL_GOOD_CAST(int, expected_count));
+    failed = 1;
+  }
+
+  return failed;
+}
+
+
+#define ALL_LETTERS "abcdefghijklmnopqrstuvwxyz"
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  unsigned char *uri_string;
+  unsigned char *data_string;
+  unsigned char *query_string;
+  size_t qs_len;
+  rasqal_query *query;
+  int failures = 0;
+
+  if(argc != 2) {
+    fprintf(stderr, "USAGE: %s data-filename\n", program);
+    return(1);
+  }
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  data_string = raptor_uri_filename_to_uri_string(argv[1]);
+  qs_len = strlen((const char*)data_string) + strlen(QUERY_FORMAT);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len, QUERY_FORMAT, data_string);
+  PRAGMA_IGNORE_WARNING_END
+  raptor_free_memory(data_string);
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: query prepare '%s' FAILED\n", program, query_string);
+    return(1);
+  }
+
+  failures += check_results(program, "unbound", query, ALL_LETTERS);
+
+  /* bind -> execute -> clear -> execute; $x only appears in the
+   * FILTER so a value left from the last execution would be used */
+  if(rasqal_query_bind_parameter(query, (const unsigned char*)"$x",
+                                 make_string_literal(world, "c"))) {
+    fprintf(stderr, "%s: binding $x FAILED\n", program);
+    return(1);
+  }
+  failures += check_results(program, "bound to c", query, "c");
+
+  rasqal_query_clear_parameters(query);
+  failures += check_results(program, "after clear", query, ALL_LETTERS);
+
+  /* rebinding without preparing again */
+  rasqal_query_bind_parameter(query, (const unsigned char*)"x",
+                              make_string_literal(world, "q"));
+  failures += check_results(program, "bound to q", query, "q");
+
+  rasqal_query_bind_parameter(query, (const unsigned char*)"?x",
+                              make_string_literal(world, "k"));
+  failures += check_results(program, "rebound to k", query, "k");
+
+  /* bind -> execute -> unbind -> execute */
+  rasqal_query_bind_parameter(query, (const unsigned char*)"x", NULL);
+  failures += check_results(program, "after unbind", query, ALL_LETTERS);
+
+  /* no such variable */
+  if(!rasqal_query_bind_parameter(query, (const unsigned char*)"nosuch",
+                                  make_string_literal(world, "a"))) {
+    fprintf(stderr, "%s: binding unknown variable did not FAIL\n", program);
+    failures++;
+  }
+
+  rasqal_free_query(query);
+  RASQAL_FREE(char*, query_string);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
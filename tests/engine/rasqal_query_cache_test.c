@@ -0,0 +1,300 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_query_cache_test.c - Rasqal RDF Query world query cache Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+/* the second form only differs in whitespace and comments */
+#define QUERY_FORMAT_1 "\
+SELECT ?letter \
+FROM <%s> \
+WHERE { \
+  <http://example.org/> <http://example.org#pred> ?letter \
+  FILTER(!BOUND($x) || ?letter = $x) \
+} \
+ORDER BY ?letter \
+"
+#define QUERY_FORMAT_2 "\
+SELECT   ?letter\n\
+FROM <%s>\n\
+WHERE {  # all letters\n\
+  <http://example.org/>   <http://example.org#pred>   ?letter\n\
+  FILTER(!BOUND($x) || ?letter = $x)\n\
+}\n\
+ORDER BY ?letter\n\
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+static rasqal_query*
+prepare_query(rasqal_world* world, const char* format,
+              const unsigned char* data_string, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  unsigned char* query_string;
+  size_t qs_len;
+
+  qs_len = strlen((const char*)data_string) + strlen(format);
+  query_string = RASQAL_MALLOC(unsigned char*, qs_len + 1);
+  if(!query_string)
+    return NULL;
+  PRAGMA_IGNORE_WARNING_FORMAT_NONLITERAL_START
+  snprintf((char*)query_string, qs_len, format, data_string);
+  PRAGMA_IGNORE_WARNING_END
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(query && rasqal_query_prepare(query, query_string, base_uri)) {
+    rasqal_free_query(query);
+    query = NULL;
+  }
+
+  RASQAL_FREE(char*, query_string);
+
+  return query;
+}
+
+
+/*
+ * Read one row from @results and check it is the next letter of
+ * @expected at *@count_p
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_next_row(const char* program, const char* label,
+               rasqal_query_results* results, const char* expected,
+               int* count_p)
+{
+  rasqal_literal* value;
+  const char* str = NULL;
+  int count = *count_p;
+  int expected_count = RASQAL_GOOD_CAST(int, strlen(expected));
+
+  if(rasqal_query_results_finished(results)) {
+    if(count < expected_count) {
+      fprintf(stderr, "%s: %s: FAILED finished after %d results, expected %d\n",
+              program, label, count, expected_count);
+      return 1;
+    }
+    return 0;
+  }
+
+  value = rasqal_query_results_get_binding_value(results, 0);
+  if(value)
+    str = (const char*)rasqal_literal_as_string(value);
+
+  rasqal_query_results_next(results);
+  (*count_p)++;
+
+  if(count >= expected_count || !str || str[0] != expected[count] || str[1]) {
+    fprintf(stderr, "%s: %s: result %d FAILED returning '%s'\n",
+            program, label, count, str ? str : "NULL");
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Execute @query1 and @query2 and read their results interleaved
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_interleaved(const char* program, const char* label,
+                  rasqal_query* query1, const char* expected1,
+                  rasqal_query* query2, const char* expected2)
+{
+  rasqal_query_results* results1;
+  rasqal_query_results* results2;
+  int count1 = 0;
+  int count2 = 0;
+  int failed = 0;
+  int i;
+
+  results1 = rasqal_query_execute(query1);
+  results2 = rasqal_query_execute(query2);
+  if(!results1 || !results2) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    failed = 1;
+    goto tidy;
+  }
+
+  /* one past the longest expected result to check both finish */
+  for(i = 0; i <= 26; i++) {
+    failed |= check_next_row(program, label, results1, expected1, &count1);
+    failed |= check_next_row(program, label, results2, expected2, &count2);
+  }
+
+  if(!rasqal_query_results_finished(results1) ||
+     !rasqal_query_results_finished(results2)) {
+    fprintf(stderr, "%s: %s: FAILED returned too many results\n",
+            program, label);
+    failed = 1;
+  }
+
+  tidy:
+  if(results1)
+    rasqal_free_query_results(results1);
+  if(results2)
+    rasqal_free_query_results(results2);
+
+  return failed;
+}
+
+
+static rasqal_literal*
+make_string_literal(rasqal_world* world, const char* str)
+{
+  size_t len = strlen(str);
+  unsigned char* s;
+
+  s = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!s)
+    return NULL;
+  memcpy(s, str, len + 1);
+
+  return rasqal_new_string_literal(world, s, NULL, NULL, NULL);
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  unsigned char *uri_string;
+  unsigned char *data_string;
+  rasqal_query *query1 = NULL;
+  rasqal_query *query2 = NULL;
+  int failures = 0;
+
+  if(argc != 2) {
+    fprintf(stderr, "USAGE: %s data-filename\n", program);
+    return(1);
+  }
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  rasqal_world_set_query_cache_size(world, 4);
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  data_string = raptor_uri_filename_to_uri_string(argv[1]);
+
+  /* a cached query is not shared while the first query exists */
+  query1 = prepare_query(world, QUERY_FORMAT_1, data_string, base_uri);
+  query2 = prepare_query(world, QUERY_FORMAT_2, data_string, base_uri);
+  if(!query1 || !query2) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    return(1);
+  }
+  if(query1->template_query || query2->template_query) {
+    fprintf(stderr, "%s: query in use was shared from the cache - FAILED\n",
+            program);
+    failures++;
+  }
+
+  rasqal_query_set_limit(query1, 5);
+  rasqal_query_set_offset(query2, 20);
+  failures += check_interleaved(program, "first prepared", query1, "abcde",
+                                query2, "uvwxyz");
+  rasqal_free_query(query1);
+  rasqal_free_query(query2);
+
+  /* the first is shared from the cache, the second is parsed again */
+  query1 = prepare_query(world, QUERY_FORMAT_2, data_string, base_uri);
+  query2 = prepare_query(world, QUERY_FORMAT_1, data_string, base_uri);
+  if(!query1 || !query2) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    return(1);
+  }
+  if(!query1->template_query) {
+    fprintf(stderr, "%s: unused query was not shared from the cache - FAILED\n",
+            program);
+    failures++;
+  }
+  if(query2->template_query) {
+    fprintf(stderr, "%s: query in use was shared from the cache - FAILED\n",
+            program);
+    failures++;
+  }
+
+  /* different solution modifiers and parameters on each */
+  rasqal_query_set_offset(query1, 23);
+  rasqal_query_bind_parameter(query2, (const unsigned char*)"x",
+                              make_string_literal(world, "m"));
+  failures += check_interleaved(program, "shared and parsed", query1, "xyz",
+                                query2, "m");
+
+  /* run again with the parameter cleared and the order swapped */
+  rasqal_query_clear_parameters(query2);
+  rasqal_query_set_limit(query2, 2);
+  failures += check_interleaved(program, "executed again", query2, "ab",
+                                query1, "xyz");
+
+  rasqal_free_query(query1);
+  rasqal_free_query(query2);
+
+  raptor_free_memory(data_string);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -0,0 +1,345 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_results_cache_test.c - Rasqal RDF Query world results cache Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+/* ?letter is first to check the variable order of cached results */
+#define QUERY_STRING "\
+SELECT ?letter ?s \
+WHERE { \
+  ?s <http://example.org#pred> ?letter \
+  FILTER(!BOUND($x) || ?letter = $x) \
+} \
+ORDER BY ?letter \
+"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_results_cache_test.nt"
+
+#define LINE(n, letter) \
+  "<http://example.org/" n "> <http://example.org#pred> \"" letter "\" .\n"
+
+/* the variable names then one row per line */
+#define HEADER "letter s\n"
+#define ROW(n, letter) letter " http://example.org/" n "\n"
+
+#define ALL_ROWS HEADER ROW("1", "a") ROW("2", "b") ROW("3", "c") \
+  ROW("4", "d") ROW("5", "e")
+
+
+static rasqal_literal*
+make_string_literal(rasqal_world* world, const char* str)
+{
+  size_t len = strlen(str);
+  unsigned char* s;
+
+  s = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!s)
+    return NULL;
+  memcpy(s, str, len + 1);
+
+  return rasqal_new_string_literal(world, s, NULL, NULL, NULL);
+}
+
+
+/* append @str to @buffer of @size bytes */
+static void
+describe_append(char* buffer, size_t size, const char* str)
+{
+  size_t len = strlen(buffer);
+
+  if(len + strlen(str) < size)
+    memcpy(buffer + len, str, strlen(str) + 1);
+}
+
+
+/*
+ * Execute @query and check the variable names and rows in order
+ * match @expected and that the execution changed the world results
+ * cache hit and miss counts by @hits and @misses
+ *
+ * Return value: non-0 on failure
+ */
+static int
+check_execution(const char* program, const char* label, rasqal_query* query,
+                const char* expected, unsigned long hits,
+                unsigned long misses)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  unsigned long hits_before;
+  unsigned long misses_before;
+  unsigned long hits_after;
+  unsigned long misses_after;
+  char buffer[1024];
+  int failed = 0;
+  int i;
+
+  rasqal_world_get_results_cache_counts(world, &hits_before, &misses_before);
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    return 1;
+  }
+
+  buffer[0] = '\0';
+  for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+    const unsigned char* name;
+
+    name = rasqal_query_results_get_binding_name(results, i);
+    if(i)
+      describe_append(buffer, sizeof(buffer), " ");
+    describe_append(buffer, sizeof(buffer), name ? (const char*)name : "NULL");
+  }
+  describe_append(buffer, sizeof(buffer), "\n");
+
+  while(!rasqal_query_results_finished(results)) {
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal* value;
+      const char* str = NULL;
+
+      value = rasqal_query_results_get_binding_value(results, i);
+      if(value)
+        str = (const char*)rasqal_literal_as_string(value);
+      if(i)
+        describe_append(buffer, sizeof(buffer), " ");
+      describe_append(buffer, sizeof(buffer), str ? str : "NULL");
+    }
+    describe_append(buffer, sizeof(buffer), "\n");
+
+    rasqal_query_results_next(results);
+  }
+  rasqal_free_query_results(results);
+
+  rasqal_world_get_results_cache_counts(world, &hits_after, &misses_after);
+
+  if(strcmp(buffer, expected)) {
+    fprintf(stderr, "%s: %s: FAILED returned\n%sexpected\n%s", program,
+            label, buffer, expected);
+    failed = 1;
+  }
+
+  if(hits_after - hits_before != hits ||
+     misses_after - misses_before != misses) {
+    fprintf(stderr, "%s: %s: FAILED with %lu cache hits and %lu misses, expected %lu and %lu\n",
+            program, label, hits_after - hits_before,
+            misses_after - misses_before, hits, misses);
+    failed = 1;
+  }
+
+  return failed;
+}
+
+
+static rasqal_query*
+prepare_query(rasqal_world* world, rasqal_data_graph* dg, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  rasqal_data_graph* query_dg;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query)
+    return NULL;
+
+  if(rasqal_query_prepare(query, (const unsigned char*)QUERY_STRING,
+                          base_uri))
+    goto failed;
+
+  query_dg = rasqal_new_data_graph_from_data_graph(dg);
+  if(!query_dg || rasqal_query_add_data_graph(query, query_dg))
+    goto failed;
+
+  return query;
+
+  failed:
+  rasqal_free_query(query);
+  return NULL;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  rasqal_query *query;
+  rasqal_data_graph* dg;
+  FILE* fh;
+  int failures = 0;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  /* before preparing so the queries get a results cache key */
+  rasqal_world_set_results_cache_size(world, 65536);
+
+  fh = fopen(DATA_FILE_NAME, "w");
+  if(!fh) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+  /* not in letter order so only the ORDER BY orders the rows */
+  fputs(LINE("3", "c") LINE("1", "a") LINE("5", "e") LINE("2", "b")
+        LINE("4", "d"), fh);
+  fclose(fh);
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  /* results are only cached for graphs kept in the loaded graphs cache */
+  dg = rasqal_new_data_graph_from_uri(world, data_uri, /* name URI */ NULL,
+                                      RASQAL_DATA_GRAPH_BACKGROUND,
+                                      NULL, "ntriples", NULL);
+  if(!dg || rasqal_world_preload_data_graph(world, dg)) {
+    fprintf(stderr, "%s: preloading data graph FAILED\n", program);
+    return(1);
+  }
+
+  query = prepare_query(world, dg, base_uri);
+  if(!query) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    return(1);
+  }
+
+  failures += check_execution(program, "first execution", query,
+                              ALL_ROWS, 0, 1);
+  failures += check_execution(program, "second execution", query,
+                              ALL_ROWS, 1, 0);
+
+  /* parameters */
+  rasqal_query_bind_parameter(query, (const unsigned char*)"x",
+                              make_string_literal(world, "c"));
+  failures += check_execution(program, "bound to c", query,
+                              HEADER ROW("3", "c"), 0, 1);
+  failures += check_execution(program, "bound to c again", query,
+                              HEADER ROW("3", "c"), 1, 0);
+  rasqal_query_bind_parameter(query, (const unsigned char*)"x",
+                              make_string_literal(world, "d"));
+  failures += check_execution(program, "rebound to d", query,
+                              HEADER ROW("4", "d"), 0, 1);
+  rasqal_query_clear_parameters(query);
+  failures += check_execution(program, "after clear", query,
+                              ALL_ROWS, 1, 0);
+
+  /* LIMIT and OFFSET */
+  rasqal_query_set_limit(query, 2);
+  failures += check_execution(program, "limit 2", query,
+                              HEADER ROW("1", "a") ROW("2", "b"), 0, 1);
+  rasqal_query_set_offset(query, 1);
+  failures += check_execution(program, "limit 2 offset 1", query,
+                              HEADER ROW("2", "b") ROW("3", "c"), 0, 1);
+  rasqal_query_set_limit(query, -1);
+  rasqal_query_set_offset(query, -1);
+  failures += check_execution(program, "no limit or offset", query,
+                              ALL_ROWS, 1, 0);
+
+  /* features */
+  rasqal_query_set_feature(query, RASQAL_FEATURE_SORT_THREADS, 2);
+  failures += check_execution(program, "sort threads feature", query,
+                              ALL_ROWS, 0, 1);
+  rasqal_query_set_feature(query, RASQAL_FEATURE_SORT_THREADS, 0);
+  failures += check_execution(program, "sort threads feature reset", query,
+                              ALL_ROWS, 1, 0);
+
+  /* a changed data graph is not looked up until it is loaded again */
+  fh = fopen(DATA_FILE_NAME, "a");
+  if(!fh) {
+    fprintf(stderr, "%s: cannot append to %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+  fputs(LINE("0", "0"), fh);
+  fclose(fh);
+  failures += check_execution(program, "changed data graph", query,
+                              HEADER ROW("0", "0") ROW("1", "a") ROW("2", "b")
+                              ROW("3", "c") ROW("4", "d") ROW("5", "e"),
+                              0, 0);
+  failures += check_execution(program, "changed data graph again", query,
+                              HEADER ROW("0", "0") ROW("1", "a") ROW("2", "b")
+                              ROW("3", "c") ROW("4", "d") ROW("5", "e"),
+                              1, 0);
+  rasqal_free_query(query);
+
+  /* another query object with the same query string */
+  query = prepare_query(world, dg, base_uri);
+  if(!query) {
+    fprintf(stderr, "%s: query prepare FAILED\n", program);
+    return(1);
+  }
+  failures += check_execution(program, "prepared again", query,
+                              HEADER ROW("0", "0") ROW("1", "a") ROW("2", "b")
+                              ROW("3", "c") ROW("4", "d") ROW("5", "e"),
+                              1, 0);
+  rasqal_free_query(query);
+
+  rasqal_world_evict_data_graph(world, dg);
+  rasqal_free_data_graph(dg);
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
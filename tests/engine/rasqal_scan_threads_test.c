@@ -0,0 +1,282 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_scan_threads_test.c - Rasqal RDF Query parallel triple scan Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+/* Graphs that are only scanned in parallel together: the 2 triples
+ * per subject of each graph are fewer than the smallest parallel scan */
+#define GRAPHS_COUNT 3
+static const struct {
+  const char* filename;
+  int subjects_count;
+} scan_test_graphs[GRAPHS_COUNT] = {
+  { "rasqal_scan_threads_test_a.nt", 5000 },
+  { "rasqal_scan_threads_test_b.nt", 4500 },
+  { "rasqal_scan_threads_test_c.nt", 3501 }
+};
+
+/* every 7th subject has the value "3" */
+#define OBJECT_MODULUS 7
+
+static const struct {
+  const char* label;
+  /* non-0 to add the graphs as named graphs */
+  int named;
+  const char* query_string;
+} scan_test_queries[] = {
+  { "background graphs", 0,
+    "SELECT ?s WHERE { ?s ?p \"3\" }" },
+  { "background graphs with a join", 0,
+    "SELECT ?s ?n WHERE { ?s ?p \"3\" . ?s <http://example.org/n> ?n }" },
+  { "background graphs with a limit", 0,
+    "SELECT ?s WHERE { ?s ?p \"3\" } LIMIT 20" },
+  { "named graphs", 1,
+    "SELECT ?g ?s WHERE { GRAPH ?g { ?s ?p \"3\" } }" },
+  { NULL, 0, NULL }
+};
+
+/* numbers of threads to compare with one */
+static const int scan_test_threads[] = { 2, 4, 8, 0 };
+
+
+/*
+ * Write an N-Triples graph of @count subjects each with a number and
+ * a value
+ *
+ * Return value: non-0 on failure
+ */
+static int
+write_graph(const char* filename, int graph, int count)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(filename, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    fprintf(fh, "<http://example.org/%d/%d> <http://example.org/n> \"%d\" .\n",
+            graph, i, i);
+    fprintf(fh, "<http://example.org/%d/%d> <http://example.org/v> \"%d\" .\n",
+            graph, i, i % OBJECT_MODULUS);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and describe its rows in order by a count and a
+ * hash of every binding string
+ *
+ * Return value: non-0 on failure
+ */
+static int
+run_query(rasqal_query* query, int* count_p, unsigned long* hash_p)
+{
+  rasqal_query_results* results;
+  unsigned long hash = 2166136261UL;
+  int count = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return 1;
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal* value;
+      const unsigned char* str = NULL;
+
+      value = rasqal_query_results_get_binding_value(results, i);
+      if(value)
+        str = rasqal_literal_as_string(value);
+
+      /* FNV-1a including the terminating NUL */
+      do {
+        hash ^= str ? *str : 0;
+        hash *= 16777619UL;
+      } while(str && *str++);
+    }
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  *count_p = count;
+  *hash_p = hash;
+
+  return 0;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *graph_uris[GRAPHS_COUNT];
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+  int g;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    if(write_graph(scan_test_graphs[g].filename, g,
+                   scan_test_graphs[g].subjects_count)) {
+      fprintf(stderr, "%s: cannot write %s\n", program,
+              scan_test_graphs[g].filename);
+      return(1);
+    }
+
+    uri_string = raptor_uri_filename_to_uri_string(scan_test_graphs[g].filename);
+    graph_uris[g] = raptor_new_uri(world->raptor_world_ptr, uri_string);
+    raptor_free_memory(uri_string);
+  }
+
+  for(q = 0; scan_test_queries[q].label; q++) {
+    const char* label = scan_test_queries[q].label;
+    rasqal_query* query;
+    int expected_count;
+    unsigned long expected_hash;
+    int t;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query,
+                            (const unsigned char*)scan_test_queries[q].query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: %s: query prepare FAILED\n", program, label);
+      return(1);
+    }
+
+    for(g = 0; g < GRAPHS_COUNT; g++) {
+      rasqal_data_graph* dg;
+
+      if(scan_test_queries[q].named)
+        dg = rasqal_new_data_graph_from_uri(world, graph_uris[g],
+                                            graph_uris[g],
+                                            RASQAL_DATA_GRAPH_NAMED,
+                                            NULL, "ntriples", NULL);
+      else
+        dg = rasqal_new_data_graph_from_uri(world, graph_uris[g], NULL,
+                                            RASQAL_DATA_GRAPH_BACKGROUND,
+                                            NULL, "ntriples", NULL);
+      if(!dg || rasqal_query_add_data_graph(query, dg)) {
+        fprintf(stderr, "%s: %s: adding data graph FAILED\n", program, label);
+        return(1);
+      }
+    }
+
+    /* one thread */
+    if(run_query(query, &expected_count, &expected_hash)) {
+      fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+      failures++;
+      rasqal_free_query(query);
+      continue;
+    }
+    if(!expected_count) {
+      fprintf(stderr, "%s: %s: FAILED returned no results\n", program, label);
+      failures++;
+    }
+
+    for(t = 0; scan_test_threads[t]; t++) {
+      int count;
+      unsigned long hash;
+
+      rasqal_query_set_feature(query, RASQAL_FEATURE_SCAN_THREADS,
+                               scan_test_threads[t]);
+      if(run_query(query, &count, &hash)) {
+        fprintf(stderr, "%s: %s: query execution with %d threads FAILED\n",
+                program, label, scan_test_threads[t]);
+        failures++;
+        continue;
+      }
+
+      if(count != expected_count || hash != expected_hash) {
+        fprintf(stderr, "%s: %s: FAILED %d threads returned %d different results, one thread returned %d\n",
+                program, label, scan_test_threads[t], count,
+                expected_count);
+        failures++;
+      }
+    }
+
+    rasqal_free_query(query);
+  }
+
+  for(g = 0; g < GRAPHS_COUNT; g++) {
+    raptor_free_uri(graph_uris[g]);
+    remove(scan_test_graphs[g].filename);
+  }
+
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
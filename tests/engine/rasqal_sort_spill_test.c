@@ -0,0 +1,333 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_sort_spill_test.c - Rasqal RDF Query ORDER BY spilled to runs Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_sort_spill_test.nt"
+
+/* a few rows of every value kind per run of the smallest sort memory */
+#define SUBJECTS_COUNT 400
+#define VALUE_KINDS 8
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* kilobytes of rows sorted in memory: the rows are a few hundred
+ * bytes each so this spills tens of runs */
+#define SORT_MEMORY 16
+
+static const struct {
+  const char* label;
+  const char* query_string;
+} spill_test_queries[] = {
+  { "values and a computed double",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?o (?n / 7.0E0 AS ?seventh) "
+    "WHERE { ?s ex:v ?o . ?s ex:n ?n } "
+    "ORDER BY ?o DESC(?n / 7.0E0) ?s" },
+  { "descending with a limit and offset",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?o WHERE { ?s ex:v ?o } "
+    "ORDER BY DESC(?o) ?s LIMIT 50 OFFSET 120" },
+  { NULL, NULL }
+};
+
+
+/*
+ * Write the lexical form of value @i into @buffer: non-canonical
+ * integers, booleans, decimals, doubles and floats and plain, language
+ * tagged and URI terms
+ *
+ * Return value: datatype URI or NULL if the value is not typed
+ */
+static const char*
+value_lexical_form(int i, char* buffer, size_t len)
+{
+  int n = i / VALUE_KINDS;
+
+  switch(i % VALUE_KINDS) {
+    case 0:
+      snprintf(buffer, len, "%03d", n % 50);
+      return XSD "integer";
+    case 1:
+      snprintf(buffer, len, "%d", n % 2);
+      return XSD "boolean";
+    case 2:
+      snprintf(buffer, len, "%d.50", n % 30);
+      return XSD "decimal";
+    case 3:
+      snprintf(buffer, len, "0%d.50e0", n % 40);
+      return XSD "double";
+    case 4:
+      snprintf(buffer, len, "%d.250", n % 20);
+      return XSD "float";
+    case 5:
+    case 6:
+      snprintf(buffer, len, "v%d", n % 25);
+      return NULL;
+    default:
+      snprintf(buffer, len, "http://example.org/o/%d", n % 10);
+      return NULL;
+  }
+}
+
+
+static int
+write_graph(const char* filename)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(filename, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < SUBJECTS_COUNT; i++) {
+    char lexical[64];
+    const char* datatype;
+
+    datatype = value_lexical_form(i, lexical, sizeof(lexical));
+
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> ", i);
+    if(datatype)
+      fprintf(fh, "\"%s\"^^<%s> .\n", lexical, datatype);
+    else if(i % VALUE_KINDS == 5)
+      fprintf(fh, "\"%s\"@en-GB .\n", lexical);
+    else if(i % VALUE_KINDS == 6)
+      fprintf(fh, "\"%s\" .\n", lexical);
+    else
+      fprintf(fh, "<%s> .\n", lexical);
+
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/n> \"%d\"^^<" XSD "integer> .\n",
+            i, i);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and write every row to a new string, checking each
+ * ?o has the lexical form it was written with
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(const char* program, const char* label, rasqal_query* query,
+          int* count_p)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+  int count = 0;
+  int failed = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+    return NULL;
+  }
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  if(!iostr) {
+    rasqal_free_query_results(results);
+    return NULL;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_literal* s;
+    rasqal_literal* o;
+    const char* s_str;
+    const char* o_str;
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal_write(rasqal_query_results_get_binding_value(results, i),
+                           iostr);
+      raptor_iostream_write_byte(' ', iostr);
+    }
+    raptor_iostream_write_byte('\n', iostr);
+
+    s = rasqal_query_results_get_binding_value(results, 0);
+    o = rasqal_query_results_get_binding_value(results, 1);
+    s_str = s ? (const char*)rasqal_literal_as_string(s) : NULL;
+    o_str = o ? (const char*)rasqal_literal_as_string(o) : NULL;
+    if(s_str && o_str && !strncmp(s_str, "http://example.org/s/", 21)) {
+      char lexical[64];
+
+      (void)value_lexical_form(atoi(s_str + 21), lexical, sizeof(lexical));
+      if(strcmp(o_str, lexical)) {
+        fprintf(stderr, "%s: %s: result %d FAILED returning '%s' for %s, expected '%s'\n",
+                program, label, count, o_str, s_str, lexical);
+        failed = 1;
+      }
+    } else {
+      fprintf(stderr, "%s: %s: result %d FAILED returning no value\n",
+              program, label, count);
+      failed = 1;
+    }
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+  raptor_free_iostream(iostr);
+
+  if(failed) {
+    raptor_free_memory(string);
+    return NULL;
+  }
+
+  *count_p = count;
+  return (char*)string;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  if(write_graph(DATA_FILE_NAME)) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(q = 0; spill_test_queries[q].label; q++) {
+    const char* label = spill_test_queries[q].label;
+    rasqal_query* query;
+    rasqal_data_graph* dg;
+    char* expected;
+    char* spilled;
+    int expected_count = 0;
+    int count = 0;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query,
+                            (const unsigned char*)spill_test_queries[q].query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: %s: query prepare FAILED\n", program, label);
+      return(1);
+    }
+
+    dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                        RASQAL_DATA_GRAPH_BACKGROUND,
+                                        NULL, "ntriples", NULL);
+    if(!dg || rasqal_query_add_data_graph(query, dg)) {
+      fprintf(stderr, "%s: %s: adding data graph FAILED\n", program, label);
+      return(1);
+    }
+
+    /* sorted in memory */
+    expected = run_query(program, label, query, &expected_count);
+    if(!expected) {
+      failures++;
+      rasqal_free_query(query);
+      continue;
+    }
+    if(!expected_count) {
+      fprintf(stderr, "%s: %s: FAILED returned no results\n", program, label);
+      failures++;
+    }
+
+    /* spilled to sorted runs and merged */
+    rasqal_query_set_feature(query, RASQAL_FEATURE_SORT_MEMORY, SORT_MEMORY);
+    spilled = run_query(program, label, query, &count);
+    if(!spilled)
+      failures++;
+    else {
+      if(count != expected_count || strcmp(spilled, expected)) {
+        fprintf(stderr, "%s: %s: FAILED spilled sort returned %d results\n%sexpected %d results\n%s",
+                program, label, count, spilled, expected_count, expected);
+        failures++;
+      }
+      raptor_free_memory(spilled);
+    }
+
+    raptor_free_memory(expected);
+    rasqal_free_query(query);
+  }
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
@@ -0,0 +1,363 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_sort_threads_test.c - Rasqal RDF Query parallel sort Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_sort_threads_test.nt"
+
+#define XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* more subjects than a sort block so blocks are merged */
+#define SUBJECTS_COUNT 3000
+
+static const struct {
+  const char* label;
+  const char* query_string;
+} sort_test_queries[] = {
+  { "integer keys with ties",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v WHERE { ?s ex:v ?v } ORDER BY ?v" },
+  { "two descending keys",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v ?m WHERE { ?s ex:v ?v ; ex:m ?m } "
+    "ORDER BY DESC(?m) DESC(?v)" },
+  { "distinct values",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT DISTINCT ?v WHERE { ?s ex:v ?v } ORDER BY DESC(?v)" },
+  { "distinct rows",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT DISTINCT ?m ?v WHERE { ?s ex:v ?v ; ex:m ?m } ORDER BY ?m ?v" },
+  { "inexact decimal keys",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?d WHERE { ?s ex:d ?d } ORDER BY ?d" },
+  { "distinct inexact decimal keys",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT DISTINCT ?d WHERE { ?s ex:d ?d } ORDER BY DESC(?d)" },
+  { NULL, NULL }
+};
+
+/* numbers of threads to compare with one; 0 is the sort without threads */
+static const int sort_test_threads[] = { 2, 8, 0 };
+
+#define SORT_TEST_THREADS_COUNT \
+  RASQAL_GOOD_CAST(int, sizeof(sort_test_threads) / sizeof(sort_test_threads[0]))
+
+
+static const struct {
+  const char* label;
+  rasqal_literal_type type1;
+  const char* value1;
+  rasqal_literal_type type2;
+  const char* value2;
+  int is_distinct;
+  /* threads used of 8 */
+  int threads;
+} sort_fallback_tests[] = {
+  { "exact integer keys",
+    RASQAL_LITERAL_INTEGER, "1", RASQAL_LITERAL_INTEGER, "2", 0, 8 },
+  { "inexact decimal key",
+    RASQAL_LITERAL_INTEGER, "1", RASQAL_LITERAL_DECIMAL, "1.5", 0, 1 },
+  { "inexact large integer key",
+    RASQAL_LITERAL_INTEGER, "1", RASQAL_LITERAL_INTEGER,
+    "9223372036854775807", 0, 1 },
+  { "inexact NaN key",
+    RASQAL_LITERAL_DOUBLE, "NaN", RASQAL_LITERAL_DOUBLE, "1.0e0", 0, 1 },
+  { "inexact decimal key with DISTINCT",
+    RASQAL_LITERAL_INTEGER, "1", RASQAL_LITERAL_DECIMAL, "1.5", 1, 8 },
+  { NULL, RASQAL_LITERAL_UNKNOWN, NULL, RASQAL_LITERAL_UNKNOWN, NULL, 0, 0 }
+};
+
+
+static int
+write_data(void)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(DATA_FILE_NAME, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < SUBJECTS_COUNT; i++) {
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> \"%d\"^^<" XSD "integer> .\n",
+            i, (i * 37) % 500);
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/m> \"m%d\" .\n",
+            i, i % 5);
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/d> \"%d.%d\"^^<" XSD "decimal> .\n",
+            i, (i * 13) % 100, i % 3);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and write every row to a new string
+ *
+ * Return value: new string or NULL on failure
+ */
+static char*
+run_query(rasqal_query* query)
+{
+  rasqal_world* world = query->world;
+  rasqal_query_results* results;
+  raptor_iostream* iostr;
+  void* string = NULL;
+  size_t string_len;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return NULL;
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &string_len, NULL);
+  if(!iostr) {
+    rasqal_free_query_results(results);
+    return NULL;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal_write(rasqal_query_results_get_binding_value(results, i),
+                           iostr);
+      raptor_iostream_write_byte(' ', iostr);
+    }
+    raptor_iostream_write_byte('\n', iostr);
+
+    rasqal_query_results_next(results);
+  }
+  rasqal_free_query_results(results);
+  raptor_free_iostream(iostr);
+
+  return (char*)string;
+}
+
+
+/*
+ * Check rows with inexact sort keys are sorted with one thread
+ *
+ * Return value: number of failures
+ */
+static int
+fallback_tests(const char* program, rasqal_world* world, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  raptor_sequence* order_seq;
+  int failures = 0;
+  int i;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query ||
+     rasqal_query_prepare(query,
+                          (const unsigned char*)"SELECT ?v WHERE { ?s ?p ?v } ORDER BY ?v",
+                          base_uri)) {
+    fprintf(stderr, "%s: fallback query prepare FAILED\n", program);
+    if(query)
+      rasqal_free_query(query);
+    return 1;
+  }
+  order_seq = rasqal_query_get_order_conditions_sequence(query);
+
+  for(i = 0; sort_fallback_tests[i].label; i++) {
+    const char* label = sort_fallback_tests[i].label;
+    rasqal_row* rows[2] = { NULL, NULL };
+    int r;
+    int threads;
+
+    for(r = 0; r < 2; r++) {
+      rasqal_literal_type type = r ? sort_fallback_tests[i].type2 :
+                                     sort_fallback_tests[i].type1;
+      const char* value = r ? sort_fallback_tests[i].value2 :
+                              sort_fallback_tests[i].value1;
+
+      rows[r] = rasqal_new_row_for_size(world, 1);
+      if(!rows[r] || rasqal_row_set_order_size(rows[r], 1))
+        break;
+      rows[r]->order_values[0] = rasqal_new_typed_literal(world, type,
+                                                          (const unsigned char*)value);
+      if(!rows[r]->order_values[0] ||
+         rasqal_engine_rowsort_calculate_order_key(query, order_seq, rows[r]))
+        break;
+    }
+
+    if(r < 2) {
+      fprintf(stderr, "%s: %s: making rows FAILED\n", program, label);
+      failures++;
+    } else {
+      threads = rasqal_engine_rowsort_get_threads(rows, 2,
+                                                  sort_fallback_tests[i].is_distinct,
+                                                  8);
+      if(threads != sort_fallback_tests[i].threads) {
+        fprintf(stderr, "%s: %s: FAILED sorting with %d threads, expected %d\n",
+                program, label, threads, sort_fallback_tests[i].threads);
+        failures++;
+      }
+    }
+
+    for(r = 0; r < 2; r++) {
+      if(rows[r])
+        rasqal_free_row(rows[r]);
+    }
+  }
+
+  rasqal_free_query(query);
+
+  return failures;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  if(write_data()) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(q = 0; sort_test_queries[q].label; q++) {
+    const char* label = sort_test_queries[q].label;
+    rasqal_query* query;
+    rasqal_data_graph* dg;
+    char* expected;
+    int t;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query,
+                            (const unsigned char*)sort_test_queries[q].query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: %s: query prepare FAILED\n", program, label);
+      return(1);
+    }
+
+    dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                        RASQAL_DATA_GRAPH_BACKGROUND,
+                                        NULL, "ntriples", NULL);
+    if(!dg || rasqal_query_add_data_graph(query, dg)) {
+      fprintf(stderr, "%s: %s: adding data graph FAILED\n", program, label);
+      return(1);
+    }
+
+    /* one thread */
+    rasqal_query_set_feature(query, RASQAL_FEATURE_SORT_THREADS, 1);
+    expected = run_query(query);
+    if(!expected || !*expected) {
+      fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+      failures++;
+      if(expected)
+        raptor_free_memory(expected);
+      rasqal_free_query(query);
+      continue;
+    }
+
+    for(t = 0; t < SORT_TEST_THREADS_COUNT; t++) {
+      char* result;
+
+      rasqal_query_set_feature(query, RASQAL_FEATURE_SORT_THREADS,
+                               sort_test_threads[t]);
+      result = run_query(query);
+      if(!result) {
+        fprintf(stderr, "%s: %s: query execution with %d threads FAILED\n",
+                program, label, sort_test_threads[t]);
+        failures++;
+        continue;
+      }
+
+      if(strcmp(result, expected)) {
+        fprintf(stderr, "%s: %s: FAILED %d threads returned a different order than one thread\n",
+                program, label, sort_test_threads[t]);
+        failures++;
+      }
+      raptor_free_memory(result);
+    }
+
+    raptor_free_memory(expected);
+    rasqal_free_query(query);
+  }
+
+  failures += fallback_tests(program, world, base_uri);
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
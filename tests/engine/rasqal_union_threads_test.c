@@ -0,0 +1,276 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_union_threads_test.c - Rasqal RDF Query parallel UNION Tests
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <stdarg.h>
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+#ifdef RASQAL_QUERY_SPARQL
+#define QUERY_LANGUAGE "sparql"
+#else
+#define NO_QUERY_LANGUAGE
+#endif
+
+
+#ifdef NO_QUERY_LANGUAGE
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  fprintf(stderr, "%s: SPARQL query language not available, skipping test\n", program);
+  return(0);
+}
+#else
+
+
+#define DATA_FILE_NAME "rasqal_union_threads_test.nt"
+
+/* more rows per branch than a worker thread queues ahead */
+#define SUBJECTS_COUNT 3000
+
+/* every 7th subject has the value "3" */
+#define OBJECT_MODULUS 7
+
+static const struct {
+  const char* label;
+  const char* query_string;
+} union_test_queries[] = {
+  { "union of triple patterns",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?n ?v WHERE { "
+    "{ ?s ex:v \"3\" } UNION "
+    "{ ?s ex:n ?n . ?s ex:v \"1\" } UNION "
+    "{ ?s ex:v ?v } }" },
+  { "ordered union",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v WHERE { "
+    "{ ?s ex:v \"3\" } UNION { ?s ex:v ?v } } "
+    "ORDER BY ?v ?s" },
+  /* the reader stops before the worker threads finish */
+  { "union with a limit",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?v WHERE { "
+    "{ ?s ex:v \"3\" } UNION { ?s ex:v ?v } } "
+    "LIMIT 10" },
+  /* the branch with a filter stays on the calling thread */
+  { "union with a filtered branch",
+    "PREFIX ex: <http://example.org/> "
+    "SELECT ?s ?n WHERE { "
+    "{ ?s ex:n ?n FILTER(?n = \"17\") } UNION { ?s ex:v \"5\" } }" },
+  { NULL, NULL }
+};
+
+/* numbers of threads to compare with none */
+static const int union_test_threads[] = { 1, 2, 8, 0 };
+
+
+/*
+ * Write an N-Triples graph of subjects each with a number and a value
+ *
+ * Return value: non-0 on failure
+ */
+static int
+write_graph(const char* filename)
+{
+  FILE* fh;
+  int i;
+
+  fh = fopen(filename, "w");
+  if(!fh)
+    return 1;
+
+  for(i = 0; i < SUBJECTS_COUNT; i++) {
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/n> \"%d\" .\n",
+            i, i);
+    fprintf(fh, "<http://example.org/s/%d> <http://example.org/v> \"%d\" .\n",
+            i, i % OBJECT_MODULUS);
+  }
+
+  return fclose(fh) ? 1 : 0;
+}
+
+
+/*
+ * Execute @query and describe its rows in order by a count and a
+ * hash of every binding string
+ *
+ * Return value: non-0 on failure
+ */
+static int
+run_query(rasqal_query* query, int* count_p, unsigned long* hash_p)
+{
+  rasqal_query_results* results;
+  unsigned long hash = 2166136261UL;
+  int count = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return 1;
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal* value;
+      const unsigned char* str = NULL;
+
+      value = rasqal_query_results_get_binding_value(results, i);
+      if(value)
+        str = rasqal_literal_as_string(value);
+
+      /* FNV-1a including the terminating NUL */
+      do {
+        hash ^= str ? *str : 0;
+        hash *= 16777619UL;
+      } while(str && *str++);
+    }
+
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  *count_p = count;
+  *hash_p = hash;
+
+  return 0;
+}
+
+
+int
+main(int argc, char **argv) {
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world *world;
+  raptor_uri *base_uri;
+  raptor_uri *data_uri;
+  unsigned char *uri_string;
+  int failures = 0;
+  int q;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string("");
+  base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  if(write_graph(DATA_FILE_NAME)) {
+    fprintf(stderr, "%s: cannot write %s\n", program, DATA_FILE_NAME);
+    return(1);
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string(DATA_FILE_NAME);
+  data_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
+  raptor_free_memory(uri_string);
+
+  for(q = 0; union_test_queries[q].label; q++) {
+    const char* label = union_test_queries[q].label;
+    rasqal_query* query;
+    rasqal_data_graph* dg;
+    int expected_count;
+    unsigned long expected_hash;
+    int t;
+
+    query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+    if(!query ||
+       rasqal_query_prepare(query,
+                            (const unsigned char*)union_test_queries[q].query_string,
+                            base_uri)) {
+      fprintf(stderr, "%s: %s: query prepare FAILED\n", program, label);
+      return(1);
+    }
+
+    dg = rasqal_new_data_graph_from_uri(world, data_uri, NULL,
+                                        RASQAL_DATA_GRAPH_BACKGROUND,
+                                        NULL, "ntriples", NULL);
+    if(!dg || rasqal_query_add_data_graph(query, dg)) {
+      fprintf(stderr, "%s: %s: adding data graph FAILED\n", program, label);
+      return(1);
+    }
+
+    /* branches read one after another */
+    if(run_query(query, &expected_count, &expected_hash)) {
+      fprintf(stderr, "%s: %s: query execution FAILED\n", program, label);
+      failures++;
+      rasqal_free_query(query);
+      continue;
+    }
+    if(!expected_count) {
+      fprintf(stderr, "%s: %s: FAILED returned no results\n", program, label);
+      failures++;
+    }
+
+    for(t = 0; union_test_threads[t]; t++) {
+      int count;
+      unsigned long hash;
+      int run;
+
+      rasqal_query_set_feature(query, RASQAL_FEATURE_UNION_THREADS,
+                               union_test_threads[t]);
+
+      /* twice to start the worker threads again */
+      for(run = 0; run < 2; run++) {
+        if(run_query(query, &count, &hash)) {
+          fprintf(stderr, "%s: %s: query execution with %d threads FAILED\n",
+                  program, label, union_test_threads[t]);
+          failures++;
+          break;
+        }
+
+        if(count != expected_count || hash != expected_hash) {
+          fprintf(stderr, "%s: %s: FAILED %d threads returned %d different results, no threads returned %d\n",
+                  program, label, union_test_threads[t], count,
+                  expected_count);
+          failures++;
+        }
+      }
+    }
+
+    rasqal_free_query(query);
+  }
+
+  remove(DATA_FILE_NAME);
+
+  raptor_free_uri(data_uri);
+  raptor_free_uri(base_uri);
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif
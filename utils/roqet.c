@@ -529,21 +529,16 @@ print_graph_result(rasqal_query* rq,
     raptor_serializer_set_namespace(serializer, prefix->uri, prefix->prefix);
   raptor_serializer_start_to_file_handle(serializer, base_uri, output);
   
-  while(1) {
-    raptor_statement *rs = rasqal_query_results_get_triple(results);
-    if(!rs)
-      break;
-
-    raptor_serializer_serialize_statement(serializer, rs);
-    triple_count++;
-    
-    if(rasqal_query_results_next_triple(results))
-      break;
-  }
+  triple_count = rasqal_query_results_write_graph(results, serializer, 0);
   
   raptor_serializer_serialize_end(serializer);
   raptor_free_serializer(serializer);
   
+  if(triple_count < 0) {
+    fprintf(stderr, "%s: Failed to write graph result\n", program);
+    return 1;
+  }
+
   if(!quiet)
     fprintf(stderr, "%s: Total %d triples\n", program, triple_count);
 
@@ -1473,6 +1468,17 @@ main(int argc, char *argv[])
     rc = 1;
   }
 
+  if(!quiet) {
+    size_t memory_current;
+    size_t memory_peak;
+
+    if(!rasqal_query_results_get_memory_usage(results, &memory_current,
+                                              &memory_peak))
+      fprintf(stderr, "%s: Query used %lu bytes of memory at peak, %lu bytes still allocated\n",
+              program, (unsigned long)memory_peak,
+              (unsigned long)memory_current);
+  }
+
   rasqal_free_query_results(results);
   
  tidy_query: